@@ -0,0 +1,301 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cobs.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define BENCH_MAX_LEN	 (4096)
+#define BENCH_MIN_TIME (0.2) /* Seconds per measurement */
+#define CHECK_ROUNDS	 (20000)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef enum {
+	PATTERN_RANDOM,
+	PATTERN_ZEROS,
+	PATTERN_NO_ZEROS,
+
+	PATTERN_NB,
+} pattern_e;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double		now_s(void);
+static uint32_t rnd(void);
+static void			fill(uint8_t* buf, unsigned len, pattern_e pattern);
+static int			check(void);
+static void			bench(unsigned len, pattern_e pattern);
+
+static cobs_ret_t ref_encode(uint8_t const* dec, unsigned dec_len,
+														 uint8_t* enc, unsigned enc_max, unsigned* out_len);
+static cobs_ret_t ref_decode(uint8_t const* enc, unsigned enc_len,
+														 uint8_t* dec, unsigned dec_max, unsigned* out_len);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static const char* const pattern_names[PATTERN_NB] = {
+		[PATTERN_RANDOM]	 = "random",
+		[PATTERN_ZEROS]		 = "all-zero",
+		[PATTERN_NO_ZEROS] = "zero-free",
+};
+
+static const unsigned lengths[] = {16, 64, 256, 1024, BENCH_MAX_LEN};
+
+static uint32_t rnd_state = 0x12345678;
+
+static uint8_t dec_buf[BENCH_MAX_LEN];
+static uint8_t enc_buf[COBS_ENCODE_MAX(BENCH_MAX_LEN)];
+static uint8_t out_buf[COBS_ENCODE_MAX(BENCH_MAX_LEN)];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	if (check() != 0) {
+		return 1;
+	}
+
+	printf("%-10s %6s %14s %14s %14s\n", "payload", "len", "encode B/s",
+				 "decode B/s", "inplace B/s");
+	for (unsigned p = 0; p < PATTERN_NB; p++) {
+		for (unsigned i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+			bench(lengths[i], (pattern_e)p);
+		}
+	}
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+}
+
+/* xorshift32 - deterministic so runs are comparable */
+static uint32_t rnd(void) {
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static void fill(uint8_t* buf, unsigned len, pattern_e pattern) {
+	for (unsigned i = 0; i < len; i++) {
+		switch (pattern) {
+			case PATTERN_RANDOM: buf[i] = (uint8_t)rnd(); break;
+			case PATTERN_ZEROS: buf[i] = 0; break;
+			default: buf[i] = (uint8_t)(1 + (rnd() % 255)); break;
+		}
+	}
+}
+
+/* Compare the fast kernels against the byte-at-a-time reference versions
+ * over a spread of lengths, zero densities and incremental chunkings. */
+static int check(void) {
+	static uint8_t ref_enc[COBS_ENCODE_MAX(BENCH_MAX_LEN)];
+	static uint8_t ref_dec[BENCH_MAX_LEN];
+
+	for (unsigned round = 0; round < CHECK_ROUNDS; round++) {
+		unsigned const len	 = rnd() % 1100;
+		unsigned const zeros = rnd() % 4; /* 1 in 2^zeros bytes is zero */
+		for (unsigned i = 0; i < len; i++) {
+			uint8_t b = (uint8_t)(1 + (rnd() % 255));
+			if (zeros && ((rnd() & ((1u << (zeros * 3)) - 1)) == 0)) {
+				b = 0;
+			}
+			dec_buf[i] = b;
+		}
+
+		unsigned	 ref_len = 0, len_fast = 0, enc_max = COBS_ENCODE_MAX(len);
+		cobs_ret_t r1			 = ref_encode(dec_buf, len, ref_enc, enc_max, &ref_len);
+		cobs_ret_t r2 = cobs_encode(dec_buf, len, enc_buf, enc_max, &len_fast);
+		if ((r1 != r2) || (ref_len != len_fast) ||
+				memcmp(ref_enc, enc_buf, ref_len)) {
+			fprintf(stderr, "encode mismatch (len %u)\n", len);
+			return -1;
+		}
+
+		/* Too-small output buffers must fail identically. */
+		unsigned const short_max = 2 + (rnd() % (enc_max + 1));
+		r1 = ref_encode(dec_buf, len, ref_enc, short_max, &ref_len);
+		r2 = cobs_encode(dec_buf, len, enc_buf, short_max, &len_fast);
+		if ((r1 != r2) || ((r1 == COBS_RET_SUCCESS) &&
+											 ((ref_len != len_fast) ||
+												memcmp(ref_enc, enc_buf, ref_len)))) {
+			fprintf(stderr, "bounded encode mismatch (len %u)\n", len);
+			return -1;
+		}
+
+		/* Incremental encoding in random chunks. */
+		cobs_enc_ctx_t ctx;
+		unsigned			 pos = 0;
+		cobs_encode_inc_begin(out_buf, enc_max, &ctx);
+		while (pos < len) {
+			unsigned chunk = 1 + (rnd() % 300);
+			chunk					 = (chunk > (len - pos)) ? (len - pos) : chunk;
+			cobs_encode_inc(&ctx, dec_buf + pos, chunk);
+			pos += chunk;
+		}
+		cobs_encode_inc_end(&ctx, &len_fast);
+		r1 = ref_encode(dec_buf, len, ref_enc, enc_max, &ref_len);
+		if ((ref_len != len_fast) || memcmp(ref_enc, out_buf, ref_len)) {
+			fprintf(stderr, "incremental encode mismatch (len %u)\n", len);
+			return -1;
+		}
+
+		/* Decode, including a randomly corrupted copy. */
+		for (unsigned corrupt = 0; corrupt < 2; corrupt++) {
+			memcpy(out_buf, ref_enc, ref_len);
+			if (corrupt) {
+				out_buf[rnd() % ref_len] = (uint8_t)rnd();
+			}
+			unsigned rl = 0, fl = 0;
+			r1 = ref_decode(out_buf, ref_len, ref_dec, BENCH_MAX_LEN, &rl);
+			r2 = cobs_decode(out_buf, ref_len, dec_buf, BENCH_MAX_LEN, &fl);
+			if ((r1 != r2) ||
+					((r1 == COBS_RET_SUCCESS) && ((rl != fl) || memcmp(ref_dec, dec_buf, rl)))) {
+				fprintf(stderr, "decode mismatch (len %u)\n", len);
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void bench(unsigned len, pattern_e pattern) {
+	unsigned enc_len = 0, dec_len = 0, iters = 0;
+	double	 rate[3];
+
+	fill(dec_buf, len, pattern);
+
+	/* encode */
+	double t0 = now_s(), t1;
+	do {
+		for (unsigned i = 0; i < 256; i++) {
+			cobs_encode(dec_buf, len, enc_buf, sizeof(enc_buf), &enc_len);
+		}
+		iters += 256;
+		t1 = now_s();
+	} while ((t1 - t0) < BENCH_MIN_TIME);
+	rate[0] = ((double)len * iters) / (t1 - t0);
+
+	/* decode */
+	iters = 0;
+	t0		= now_s();
+	do {
+		for (unsigned i = 0; i < 256; i++) {
+			cobs_decode(enc_buf, enc_len, out_buf, sizeof(out_buf), &dec_len);
+		}
+		iters += 256;
+		t1 = now_s();
+	} while ((t1 - t0) < BENCH_MIN_TIME);
+	rate[1] = ((double)len * iters) / (t1 - t0);
+
+	/* decode in-place - the copy back into the work buffer is included */
+	iters = 0;
+	t0		= now_s();
+	do {
+		for (unsigned i = 0; i < 256; i++) {
+			memcpy(out_buf, enc_buf, enc_len);
+			out_buf[enc_len - 1] = 0;
+			cobs_decode_inplace(out_buf, enc_len);
+		}
+		iters += 256;
+		t1 = now_s();
+	} while ((t1 - t0) < BENCH_MIN_TIME);
+	rate[2] = ((double)len * iters) / (t1 - t0);
+
+	printf("%-10s %6u %14.4g %14.4g %14.4g\n", pattern_names[pattern], len,
+				 rate[0], rate[1], rate[2]);
+}
+
+/* Byte-at-a-time reference implementations, used to check the fast kernels
+ * produce identical output. */
+static cobs_ret_t ref_encode(uint8_t const* dec, unsigned dec_len,
+														 uint8_t* enc, unsigned enc_max, unsigned* out_len) {
+	unsigned dst_idx = 1, code_idx = 0, code = 1;
+
+	if (enc_max < 2) {
+		return COBS_RET_ERR_BAD_ARG;
+	}
+	if ((enc_max - dst_idx) < dec_len) {
+		return COBS_RET_ERR_EXHAUSTED;
+	}
+
+	for (unsigned i = 0; i < dec_len; i++) {
+		uint8_t const byte = dec[i];
+		if (byte) {
+			enc[dst_idx] = byte;
+			if (++dst_idx >= enc_max) {
+				return COBS_RET_ERR_EXHAUSTED;
+			}
+			++code;
+		}
+		if ((byte == 0) || (code == 0xFF)) {
+			enc[code_idx] = (uint8_t)code;
+			code_idx			= dst_idx;
+			code					= 1;
+			if ((byte == 0) || (i + 1 < dec_len)) {
+				if (++dst_idx >= enc_max) {
+					return COBS_RET_ERR_EXHAUSTED;
+				}
+			}
+		}
+	}
+
+	enc[code_idx]	 = (uint8_t)code;
+	enc[dst_idx++] = 0;
+	*out_len			 = dst_idx;
+	return COBS_RET_SUCCESS;
+}
+
+static cobs_ret_t ref_decode(uint8_t const* enc, unsigned enc_len,
+														 uint8_t* dec, unsigned dec_max, unsigned* out_len) {
+	if (enc_len < 2) {
+		return COBS_RET_ERR_BAD_ARG;
+	}
+	if ((enc[0] == 0) || (enc[enc_len - 1] != 0)) {
+		return COBS_RET_ERR_BAD_PAYLOAD;
+	}
+
+	unsigned src_idx = 0, dst_idx = 0;
+	while (src_idx < (enc_len - 1)) {
+		unsigned const code = enc[src_idx++];
+		if (!code) {
+			return COBS_RET_ERR_BAD_PAYLOAD;
+		}
+		if ((src_idx + code) > enc_len) {
+			return COBS_RET_ERR_BAD_PAYLOAD;
+		}
+		if ((dst_idx + code - 1) > dec_max) {
+			return COBS_RET_ERR_EXHAUSTED;
+		}
+		for (unsigned i = 0; i < code - 1; ++i) {
+			if (enc[src_idx] == 0) {
+				return COBS_RET_ERR_BAD_PAYLOAD;
+			}
+			dec[dst_idx++] = enc[src_idx++];
+		}
+		if ((src_idx < (enc_len - 1)) && (code < 0xFF)) {
+			if (dst_idx >= dec_max) {
+				return COBS_RET_ERR_EXHAUSTED;
+			}
+			dec[dst_idx++] = 0;
+		}
+	}
+
+	*out_len = dst_idx;
+	return COBS_RET_SUCCESS;
+}
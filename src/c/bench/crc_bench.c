@@ -0,0 +1,119 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+#include "nsmp_crc.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define BENCH_BYTES (64u << 20) /* Bytes processed per measurement */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef uint32_t (*crc_fn)(const uint8_t* buf, size_t len);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint64_t ticks(void);
+static void			bench(const char* name, crc_fn fn, size_t len);
+
+static uint32_t run_crc8(const uint8_t* buf, size_t len);
+static uint32_t run_crc8_bitwise(const uint8_t* buf, size_t len);
+static uint32_t run_crc16(const uint8_t* buf, size_t len);
+static uint32_t run_crc32c(const uint8_t* buf, size_t len);
+static uint32_t run_crc32c_sw(const uint8_t* buf, size_t len);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t data[4096];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	static const size_t lens[] = {5, 64, 256, 4096};
+
+	for (size_t i = 0; i < sizeof(data); i++) {
+		data[i] = (uint8_t)rand();
+	}
+
+#if defined(HAVE_TSC)
+	printf("%-16s %6s %10s\n", "crc", "len", "cycles/B");
+#else
+	printf("%-16s %6s %10s\n", "crc", "len", "ns/B");
+#endif
+	for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		bench("crc8", run_crc8, lens[i]);
+		bench("crc8-bitwise", run_crc8_bitwise, lens[i]);
+		bench("crc16", run_crc16, lens[i]);
+		bench("crc32c", run_crc32c, lens[i]);
+		bench("crc32c-sw", run_crc32c_sw, lens[i]);
+	}
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint64_t ticks(void) {
+#if defined(HAVE_TSC)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000u) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void bench(const char* name, crc_fn fn, size_t len) {
+	size_t const				iters = BENCH_BYTES / len;
+	volatile uint32_t sink	= 0;
+
+	uint64_t const t0 = ticks();
+	for (size_t i = 0; i < iters; i++) {
+		sink ^= fn(data, len);
+	}
+	uint64_t const t1 = ticks();
+
+	printf("%-16s %6zu %10.3f\n", name, len,
+				 (double)(t1 - t0) / ((double)iters * (double)len));
+}
+
+static uint32_t run_crc8(const uint8_t* buf, size_t len) {
+	return nsmp_crc8(buf, len);
+}
+
+/* Bit-at-a-time, as the libcrc routines the header CRC used to rely on */
+static uint32_t run_crc8_bitwise(const uint8_t* buf, size_t len) {
+	uint8_t crc = 0;
+	while (len--) {
+		crc ^= *buf++;
+		for (int i = 0; i < 8; i++) {
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+static uint32_t run_crc16(const uint8_t* buf, size_t len) {
+	return nsmp_crc16(0, buf, len);
+}
+
+static uint32_t run_crc32c(const uint8_t* buf, size_t len) {
+	return nsmp_crc32c(0, buf, len);
+}
+
+static uint32_t run_crc32c_sw(const uint8_t* buf, size_t len) {
+	return nsmp_crc32c_sw(0, buf, len);
+}
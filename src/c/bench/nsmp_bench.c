@@ -0,0 +1,1956 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* End to end throughput and latency of the protocol stack on a Linux host.
+ *
+ * Messages go through nsmp_send -> encode -> tx_cb -> transport ->
+ * nsmp_parse_if -> rx_cb, with the transport being either an in-memory
+ * loopback buffer or a pseudo-terminal pair. Each message carries its send
+ * time, so the latency includes queueing behind up to `depth` messages in
+ * flight. Each run is repeated with message bundling off and on, with the
+ * encoded bytes per message showing the framing overhead saved. The
+ * saturation runs then keep the deepest pipeline against a receiver whose
+ * rx_q holds only SAT_RX_DEPTH frames, which flow control must keep from
+ * dropping any of them.
+ *
+ * The relay runs time a node forwarding frames between two in-memory links,
+ * from the frame being parsed on one to it being written to the other, once
+ * cut-through and once store-and-forward. The CPU time per relayed byte is
+ * the process CPU time over the bytes written.
+ *
+ * The wakeup runs have nsmp_update() in a thread of its own and the receiver
+ * blocked in nsmp_rcv_wait(), once for each nsmp_os_s binding and once with
+ * both threads polling instead. The latency is from a frame being parsed to
+ * the receiver returning with it, one frame at a time. The idle CPU is the
+ * process CPU time over the wall time while nothing arrives, the update
+ * thread still waking every WAKE_TICK_MS for its timers.
+ *
+ * The posix runs drive a link over a pseudo-terminal with the epoll backend,
+ * the other end echoing every frame back, once reading a byte at a time and
+ * once in NSMP_POSIX_READ_LEN chunks.
+ *
+ * The broker runs relay between BROKER_IFACES in-memory links, each peer
+ * streaming to the one three links on, with the links spread over 1, 2 and
+ * NSMP_MAX_WORKERS worker threads. Each worker feeds its own links, so the
+ * frames per second show how relaying scales with cores - it cannot where
+ * the host has fewer cores than workers.
+ *
+ * The arq runs send reliably over the loopback, one message at a time and
+ * a window at a time, once acknowledging every message at once and once
+ * with ARQ_ACK_MS of delay. The device talks to itself, so each message is
+ * also the one going back that can carry the acknowledgement of the last.
+ * The frames and transport writes per message show the acknowledgements
+ * saved - each write being a line turnaround on a half-duplex bus.
+ *
+ * The lz runs send LZ_PAYLOAD byte messages of three kinds of data over the
+ * loopback, without and with NSMP_MSG_COMPRESS: chunks of this executable
+ * standing in for a firmware image, generated log lines, and random bytes
+ * that do not compress. Compression and expansion speed are timed on their
+ * own over the same chunks, and the wire bytes give the payload throughput
+ * a LZ_BAUD 8N1 serial line would get.
+ *
+ * The pubsub runs get each message from the peer on link 0 of a node to 1,
+ * 2, 4 and BROKER_IFACES - 1 subscribers on links of their own, once sent
+ * to each subscriber in turn and once published to PUBSUB_TOPIC. The
+ * upstream bytes per message are those link 0 carries, the CPU time per
+ * message that of the node relaying or fanning it out.
+ *
+ * The discovery runs are a model rather than the library: a node and 8, 16
+ * and 32 peers powered up together on one DISC_BAUD half-duplex bus, in
+ * virtual time. Frames that start in the same DISC_TICK_US are lost to a
+ * collision, and a device answering a request does so after a random part
+ * of DISC_RSP_MS. Each run is done once flooding - every device discovering
+ * after 10 to 50 ms and every device answering every request - and once the
+ * way nsmp_dir.c does it, with adaptive backoff and the node answering for
+ * everyone with its directory. A run converges once every device has the
+ * discovery payload of every other, the time and bus bytes being the mean
+ * over DISC_RUNS seeds. Results are written to stdout as JSON, one object
+ * per run:
+ *
+ *   nsmp_bench [--quick] [--loopback | --pty] > results.json
+ */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nsmp.h"
+#include "nsmp_os.h"
+#include "nsmp_posix.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU				(1024)
+#define MAX_DEPTH (64)
+#define MAX_MSGS	(50000)
+#define QUICK_MSGS (1000)
+#define WIRE_LEN	(64 * 1024)
+#define STALL_NS	(1000000000ull)
+#define SAT_RX_DEPTH (4)
+#define RELAY_NODE	 NSMP_ADDR(0, 0, 0)
+#define RELAY_DST		 NSMP_ADDR(0, 1, 3)
+#define WAKE_MSGS		 (10000)
+#define WAKE_PAYLOAD (8)
+#define WAKE_TICK_MS (10)
+#define WAKE_IDLE_MS (500)
+#define QUICK_IDLE_MS (50)
+#define POSIX_PAYLOAD (64)
+#define POSIX_DEPTH		(8)
+#define BROKER_IFACES	 (8)
+#define BROKER_PAYLOAD (64)
+#define BROKER_DEPTH	 (8)
+#define ARQ_PAYLOAD		 (64)
+#define ARQ_WINDOW		 (8)
+#define ARQ_ACK_MS		 (5)
+#define LZ_PAYLOAD		 (MTU)
+#define LZ_DATA_LEN		 (64 * 1024)
+#define LZ_DEPTH			 (8)
+#define LZ_BAUD				 (115200)
+#define PUBSUB_TOPIC	 (3)
+#define PUBSUB_PAYLOAD (64)
+#define DISC_BAUD			 (115200)
+#define DISC_PAYLOAD	 (8)
+#define DISC_MTU			 (128)
+#define DISC_DEVS			 (33) /* A node and up to 32 peers */
+#define DISC_TICK_US	 (100)
+#define DISC_RSP_MS		 (10)
+#define DISC_LIMIT_MS	 (60000)
+#define DISC_RUNS			 (5)
+#define DISC_HDR			 (2) /* Discovery request version, as nsmp_dir.c */
+#define DISC_DIR_HDR	 (4) /* Directory [from][to] */
+#define DISC_ENT_HDR	 (4) /* Directory entry [addr][len][ver] */
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+/* Allocations made by the library and the benchmark are counted by wrapping
+ * the calls to the allocator at link time (ld --wrap, set up by the build),
+ * which is left as it is - so sanitizers keep their own */
+#ifndef COUNT_ALLOCS
+#define COUNT_ALLOCS (0)
+#endif
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef struct {
+	const char* name;
+	int (*open)(void);
+	void (*close)(void);
+	int (*write)(const nsmp_iovec_s* iov, size_t iovcnt);
+	size_t (*read)(uint8_t* buf, size_t len);
+} transport_s;
+
+typedef struct {
+	const char* name;
+	int (*init)(nsmp_os_s* os);
+	void (*fini)(void);
+} waiter_s;
+
+typedef struct {
+	const char* name;
+	void (*fill)(uint8_t* buf, size_t len);
+} lz_set_s;
+
+typedef struct {
+	size_t	 payload;
+	size_t	 depth;
+	size_t	 bundle;
+	size_t	 rx_depth;
+	size_t	 read_len;
+	size_t	 workers;
+	size_t	 ack_ms;
+	size_t	 compress;
+	size_t	 subs;
+	uint32_t msgs;
+	uint32_t lost;
+	uint64_t ns;
+	uint64_t wire;
+	uint64_t frames;
+	uint64_t batches;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t cpu_ns;
+	uint64_t idle_ns;
+	uint64_t lz_in;
+	uint64_t lz_out;
+	uint64_t lz_enc_ns;
+	uint64_t lz_dec;
+	uint64_t lz_dec_ns;
+	long		 allocs;
+	size_t	 peers;
+	uint64_t max_ns;
+	uint64_t collisions;
+} result_s;
+
+enum {
+	DISC_IDLE,
+	DISC_WAIT,
+	DISC_SENT,
+};
+
+enum {
+	DISC_REQ,
+	DISC_RSP,
+	DISC_DIR,
+};
+
+/* A frame on the discovery bus */
+typedef struct {
+	uint8_t	 kind;
+	uint8_t	 src;
+	uint16_t since; /* Request */
+	uint16_t from;	/* Directory */
+	uint16_t to;
+	uint8_t	 n;
+	uint8_t	 ent[DISC_DEVS];
+	uint16_t ent_ver[DISC_DEVS];
+	uint32_t bytes;
+} disc_frame_s;
+
+/* A device on the discovery bus */
+typedef struct {
+	uint64_t known; /* Devices whose payload it has */
+	uint32_t due_us;
+	uint32_t rsp_us;
+	uint32_t rnd;
+	uint16_t window;
+	uint16_t since;
+	uint8_t	 state;
+	uint8_t	 tries;
+	uint8_t	 node_seen;
+	uint8_t	 listed; /* Seen its own directory entry */
+	uint8_t	 req;		 /* Waiting for the bus */
+	uint8_t	 rsp;
+} disc_dev_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int			setup(const transport_s* t, uint16_t bundle, size_t rx_depth);
+static void			pump(const transport_s* t);
+static result_s run(const transport_s* t, size_t payload, size_t depth,
+										size_t bundle, size_t rx_depth, uint32_t msgs);
+static void			report(const transport_s* t, const result_s* r, int first);
+static size_t		relay_frame(nsmp_msg_type_e type, uint8_t dst, uint8_t src,
+														size_t payload, uint8_t* out);
+static int			relay_setup(uint8_t store_forward);
+static result_s relay_run(size_t payload, uint8_t store_forward, uint32_t msgs);
+static void			relay_report(const result_s* r, uint8_t store_forward, int first);
+static result_s wake_run(const waiter_s* w, uint32_t msgs, uint32_t idle_ms);
+static void			wake_report(const waiter_s* w, const result_s* r, int first);
+static void*		wake_updater(void* arg);
+static int			wake_busy(nsmp_os_s* os);
+static int			wake_pthread(nsmp_os_s* os);
+static int			wake_futex(nsmp_os_s* os);
+static int			wake_eventfd(nsmp_os_s* os);
+static void			wake_eventfd_fini(void);
+static int			wake_tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov,
+													 size_t iovcnt);
+static result_s posix_run(uint32_t read_len, uint32_t msgs);
+static void			posix_report(const result_s* r, int first);
+static void			posix_echo(int fd);
+static result_s broker_run(uint8_t workers, uint32_t msgs);
+static void			broker_report(const result_s* r, int first);
+static void*		broker_thread(void* arg);
+static uint8_t	broker_peer(size_t i);
+static int			broker_tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov,
+														 size_t iovcnt);
+static result_s arq_run(uint16_t ack_ms, size_t depth, uint32_t msgs);
+static void			arq_report(const result_s* r, int first);
+static int			arq_tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov,
+													size_t iovcnt);
+static result_s lz_run(const lz_set_s* set, uint8_t compress, uint32_t msgs);
+static void			lz_report(const lz_set_s* set, const result_s* r, int first);
+static void			lz_codec(result_s* r, uint32_t chunks);
+static void			lz_firmware(uint8_t* buf, size_t len);
+static void			lz_log(uint8_t* buf, size_t len);
+static void			lz_random(uint8_t* buf, size_t len);
+static result_s pubsub_run(size_t subs, uint8_t publish, uint32_t msgs);
+static void			pubsub_report(const result_s* r, uint8_t publish, int first);
+static result_s disc_run(size_t peers, uint8_t dir);
+static uint32_t disc_sim(size_t devs, uint8_t dir, uint32_t seed,
+												 result_s* r);
+static void			disc_hear(disc_dev_s* d, size_t i, const disc_frame_s* f,
+													uint32_t now, uint8_t dir);
+static void			disc_start(disc_dev_s* d, uint32_t now);
+static void			disc_wait(disc_dev_s* d, uint32_t now);
+static void			disc_build(disc_dev_s* d, size_t i, uint32_t now, uint8_t dir,
+													 disc_frame_s* f);
+static uint32_t disc_bytes(size_t len);
+static uint32_t disc_rnd(disc_dev_s* d);
+static void			disc_report(const result_s* r, uint8_t dir, int first);
+static uint64_t now_ns(void);
+static uint32_t now_ms(void);
+static uint64_t cpu_ns(void);
+static int			cmp_u64(const void* a, const void* b);
+static int			rx_cb(nsmp_msg_s* msg);
+static int			tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+static int		lb_open(void);
+static void		lb_close(void);
+static int		lb_write(const nsmp_iovec_s* iov, size_t iovcnt);
+static size_t lb_read(uint8_t* buf, size_t len);
+static int		pty_open(void);
+static void		pty_close(void);
+static int		pty_write(const nsmp_iovec_s* iov, size_t iovcnt);
+static size_t pty_read(uint8_t* buf, size_t len);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static const transport_s transports[] = {
+		{"loopback", lb_open, lb_close, lb_write, lb_read},
+		{"pty", pty_open, pty_close, pty_write, pty_read},
+};
+
+static const waiter_s waiters[] = {
+		{"busy_poll", wake_busy, NULL},
+		{"pthread", wake_pthread, NULL},
+		{"futex", wake_futex, NULL},
+		{"eventfd", wake_eventfd, wake_eventfd_fini},
+};
+
+static const uint32_t posix_reads[] = {1, NSMP_POSIX_READ_LEN};
+static const uint8_t	broker_workers[] = {1, 2, NSMP_MAX_WORKERS};
+static const uint16_t arq_acks[]			 = {0, ARQ_ACK_MS};
+static const size_t		arq_depths[]		 = {1, ARQ_WINDOW};
+static const size_t		pubsub_subs[]		 = {1, 2, 4, BROKER_IFACES - 1};
+static const size_t		disc_peers[]		 = {8, 16, 32};
+static const lz_set_s lz_sets[]				 = {
+		 {"firmware", lz_firmware},
+		 {"log", lz_log},
+		 {"random", lz_random},
+};
+
+static const size_t payloads[] = {8, 64, 256, 1024};
+static const size_t depths[]	 = {1, 8, 64};
+static const size_t bundles[]	 = {0, MTU};
+
+static uint8_t tx_q[NSMP_QUEUE_LEN(MAX_DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t rx_q[NSMP_QUEUE_LEN(MAX_DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t tx_buf[8 * NSMP_TX_BUF_LEN(MTU)];
+
+static nsmp_iface_s				iface;
+static nsmp_iface_s				relay_if[2];
+static const transport_s* cur;
+
+static uint8_t	 rx_buf[WIRE_LEN];
+static uint64_t	 lat[MAX_MSGS];
+static uint32_t	 rx_count;
+static uint64_t	 rx_bytes;
+static uint64_t	 tx_wire;
+
+/* In-memory loopback */
+static uint8_t wire[WIRE_LEN];
+static size_t	 wire_len;
+
+/* Relay input and its egress side */
+static uint8_t	relay_in[NSMP_FRAME_MAX(MTU)];
+static uint8_t	relay_rx_q[NSMP_QUEUE_LEN(1, MTU)] __attribute__((aligned(4)));
+static uint64_t relay_out;
+static uint64_t relay_out_ns;
+
+/* Frames for the wakeup runs are taken out of rcv_q by nsmp_rcv_wait() */
+static uint8_t wake_rcv_q[NSMP_QUEUE_LEN(4, MTU)] __attribute__((aligned(4)));
+static nsmp_os_pthread_s wake_p;
+static nsmp_os_futex_s	 wake_f;
+static nsmp_os_eventfd_s wake_e;
+static int							 wake_stop;
+
+/* A link of the epoll backend, and what its far end has yet to echo */
+static nsmp_posix_s			 posix;
+static nsmp_posix_link_s posix_link;
+static uint8_t					 posix_buf[WIRE_LEN];
+static size_t						 posix_len;
+
+/* Broker runs, each link's counters are only touched by its worker */
+static uint8_t broker_tx_q[BROKER_IFACES][NSMP_QUEUE_LEN(BROKER_DEPTH, MTU)]
+		__attribute__((aligned(4)));
+static uint8_t broker_rx_q[BROKER_IFACES][NSMP_QUEUE_LEN(BROKER_DEPTH, MTU)]
+		__attribute__((aligned(4)));
+static uint8_t broker_tx_buf[BROKER_IFACES][NSMP_TX_BUF_LEN(MTU)];
+static uint8_t broker_relay_q[NSMP_MAX_WORKERS]
+														 [NSMP_RELAY_Q_LEN(BROKER_DEPTH, MTU)]
+		__attribute__((aligned(4)));
+static uint8_t					 broker_in[BROKER_IFACES][NSMP_FRAME_MAX(MTU)];
+static size_t						 broker_in_len[BROKER_IFACES];
+static uint32_t					 broker_fed[BROKER_IFACES];
+static uint64_t					 broker_out[BROKER_IFACES];
+static uint64_t					 broker_want[BROKER_IFACES];
+static uint32_t					 broker_msgs;
+static uint8_t					 broker_nw;
+static nsmp_iface_s			 broker_if[BROKER_IFACES];
+static nsmp_worker_s		 broker_w[NSMP_MAX_WORKERS];
+static nsmp_os_pthread_s broker_os[NSMP_MAX_WORKERS];
+
+/* Arq runs, frames and transport writes of the loopback */
+static uint64_t arq_frames;
+static uint64_t arq_batches;
+
+/* Lz runs, the data messages are cut from and the codec's working memory */
+static uint8_t	lz_data[LZ_DATA_LEN];
+static uint8_t	lz_buf[NSMP_LZ_BUF_LEN(LZ_PAYLOAD)] __attribute__((aligned(4)));
+static uint16_t lz_table[NSMP_LZ_TABLE_LEN / sizeof(uint16_t)];
+
+/* Pubsub runs, on the broker links, what link 0 gets for each message */
+static uint8_t pubsub_in[BROKER_IFACES * NSMP_FRAME_MAX(MTU)];
+
+/* Discovery runs, device 0 being the node, and the node's directory - the
+ * version of each device's entry, 0 for none, and the device of each one */
+static disc_dev_s disc_dev[DISC_DEVS];
+static uint16_t		disc_ver[DISC_DEVS];
+static uint8_t		disc_at[DISC_DEVS + 1];
+static uint16_t		disc_dir_ver;
+static uint16_t		disc_dir_from;
+static uint8_t		disc_dir_pend;
+
+/* Pseudo-terminal pair, frames are written to the master and read from the
+ * slave in raw mode */
+static int pty_master = -1;
+static int pty_slave	= -1;
+
+/* Heap calls made while a run is being measured */
+static volatile int	 count_allocs;
+static volatile long allocs;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#if COUNT_ALLOCS
+extern void* __real_malloc(size_t size);
+extern void* __real_calloc(size_t n, size_t size);
+extern void* __real_realloc(void* p, size_t size);
+
+void* __wrap_malloc(size_t size) {
+	allocs += count_allocs;
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+	allocs += count_allocs;
+	return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* p, size_t size) {
+	allocs += count_allocs;
+	return __real_realloc(p, size);
+}
+#endif
+
+int main(int argc, char** argv) {
+	uint32_t msgs = MAX_MSGS;
+	int			 only = -1;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--quick")) {
+			msgs = QUICK_MSGS;
+		} else if (!strcmp(argv[i], "--loopback")) {
+			only = 0;
+		} else if (!strcmp(argv[i], "--pty")) {
+			only = 1;
+		} else {
+			fprintf(stderr, "usage: %s [--quick] [--loopback | --pty]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	printf("{\"bench\": \"nsmp\", \"mtu\": %d, \"payload_crc\": %d, "
+				 "\"results\": [\n",
+				 MTU, NSMP_PAYLOAD_CRC);
+
+	int first = 1;
+	int fail	= 0;
+	for (size_t t = 0; t < ARRAY_LEN(transports); t++) {
+		const transport_s* const tr = &transports[t];
+		if ((only >= 0) && ((size_t)only != t)) {
+			continue;
+		}
+		if (tr->open() != 0) {
+			fprintf(stderr, "nsmp_bench: %s unavailable, skipped\n", tr->name);
+			continue;
+		}
+		for (size_t b = 0; b < ARRAY_LEN(bundles); b++) {
+			for (size_t p = 0; p < ARRAY_LEN(payloads); p++) {
+				for (size_t d = 0; d < ARRAY_LEN(depths); d++) {
+					if (setup(tr, (uint16_t)bundles[b], MAX_DEPTH) != NSMP_OK) {
+						fprintf(stderr, "nsmp_bench: interface setup failed\n");
+						return 1;
+					}
+					result_s const r = run(tr, payloads[p], depths[d], bundles[b],
+																 MAX_DEPTH, msgs);
+					report(tr, &r, first);
+					first = 0;
+					fail |= (r.lost != 0);
+				}
+			}
+		}
+		for (size_t p = 0; p < ARRAY_LEN(payloads); p++) {
+			if (setup(tr, 0, SAT_RX_DEPTH) != NSMP_OK) {
+				fprintf(stderr, "nsmp_bench: interface setup failed\n");
+				return 1;
+			}
+			result_s const r =
+					run(tr, payloads[p], MAX_DEPTH, 0, SAT_RX_DEPTH, msgs);
+			report(tr, &r, first);
+			first = 0;
+			fail |= (r.lost != 0);
+		}
+		tr->close();
+	}
+
+	printf("\n], \"relay\": [\n");
+	first = 1;
+	for (size_t p = 0; p < ARRAY_LEN(payloads); p++) {
+		for (uint8_t sf = 0; sf < 2; sf++) {
+			result_s const r = relay_run(payloads[p], sf, msgs);
+			relay_report(&r, sf, first);
+			first = 0;
+			fail |= (r.lost != 0);
+		}
+	}
+	printf("\n], \"wakeup\": [\n");
+	first = 1;
+	for (size_t w = 0; w < ARRAY_LEN(waiters); w++) {
+		uint32_t const n = (msgs < WAKE_MSGS) ? msgs : WAKE_MSGS;
+		result_s const r =
+				wake_run(&waiters[w], n, (msgs == QUICK_MSGS) ? QUICK_IDLE_MS
+																											: WAKE_IDLE_MS);
+		wake_report(&waiters[w], &r, first);
+		first = 0;
+		fail |= (r.lost != 0);
+	}
+	printf("\n], \"posix\": [\n");
+	first = 1;
+	for (size_t i = 0; i < ARRAY_LEN(posix_reads); i++) {
+		result_s const r = posix_run(posix_reads[i], msgs);
+		posix_report(&r, first);
+		first = 0;
+		fail |= (r.lost != 0);
+	}
+	printf("\n], \"broker\": [\n");
+	first = 1;
+	for (size_t i = 0; i < ARRAY_LEN(broker_workers); i++) {
+		result_s const r = broker_run(broker_workers[i], msgs);
+		broker_report(&r, first);
+		first = 0;
+		fail |= (r.lost != 0);
+	}
+	printf("\n], \"arq\": [\n");
+	first = 1;
+	for (size_t d = 0; d < ARRAY_LEN(arq_depths); d++) {
+		for (size_t a = 0; a < ARRAY_LEN(arq_acks); a++) {
+			result_s const r = arq_run(arq_acks[a], arq_depths[d], msgs);
+			arq_report(&r, first);
+			first = 0;
+			fail |= (r.lost != 0);
+		}
+	}
+	printf("\n], \"lz\": [\n");
+	first = 1;
+	for (size_t d = 0; d < ARRAY_LEN(lz_sets); d++) {
+		for (uint8_t c = 0; c < 2; c++) {
+			result_s const r = lz_run(&lz_sets[d], c, msgs);
+			lz_report(&lz_sets[d], &r, first);
+			first = 0;
+			fail |= (r.lost != 0);
+		}
+	}
+	printf("\n], \"pubsub\": [\n");
+	first = 1;
+	for (size_t n = 0; n < ARRAY_LEN(pubsub_subs); n++) {
+		for (uint8_t p = 0; p < 2; p++) {
+			result_s const r = pubsub_run(pubsub_subs[n], p, msgs);
+			pubsub_report(&r, p, first);
+			first = 0;
+			fail |= (r.lost != 0);
+		}
+	}
+	printf("\n], \"discovery\": [\n");
+	first = 1;
+	for (size_t n = 0; n < ARRAY_LEN(disc_peers); n++) {
+		for (uint8_t d = 0; d < 2; d++) {
+			result_s const r = disc_run(disc_peers[n], d);
+			disc_report(&r, d, first);
+			first = 0;
+			/* Flooding is expected not to settle on the larger buses */
+			fail |= d && (r.lost != 0);
+		}
+	}
+	printf("\n]}\n");
+	return fail;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int setup(const transport_s* t, uint16_t bundle, size_t rx_depth) {
+	memset(&iface, 0, sizeof(iface));
+	iface.tx_q			 = tx_q;
+	iface.tx_len		 = sizeof(tx_q);
+	iface.rx_q			 = rx_q;
+	iface.rx_len		 = NSMP_QUEUE_LEN(rx_depth, MTU);
+	iface.tx_buf		 = tx_buf;
+	iface.tx_buf_len = sizeof(tx_buf);
+	iface.mtu				 = MTU;
+	iface.rx_cb			 = rx_cb;
+	iface.tx_cb			 = tx_cb;
+	iface.bundle_len = bundle;
+	cur							 = t;
+
+	int status = nsmp_peer_init();
+	if (status == NSMP_OK) {
+		status = nsmp_peer_newif(&iface);
+	}
+
+	/* Let the capability exchange finish before measuring */
+	pump(t);
+	pump(t);
+	return status;
+}
+
+/* Transmit what is queued, then parse and deliver what arrived */
+static void pump(const transport_s* t) {
+	nsmp_update();
+	for (size_t n; (n = t->read(rx_buf, sizeof(rx_buf))) != 0;) {
+		nsmp_parse_if(&iface, rx_buf, n);
+		nsmp_update();
+	}
+}
+
+static result_s run(const transport_s* t, size_t payload, size_t depth,
+										size_t bundle, size_t rx_depth, uint32_t msgs) {
+	uint8_t	 data[MTU];
+	uint32_t sent = 0;
+	result_s r		= {.payload = payload, .depth = depth, .bundle = bundle};
+
+	memset(data, 0xA5, sizeof(data));
+	r.rx_depth = rx_depth;
+	rx_count	 = 0;
+	rx_bytes	 = 0;
+	tx_wire		 = 0;
+	allocs		 = 0;
+
+	count_allocs			= 1;
+	uint64_t const t0 = now_ns();
+	uint64_t			 tp = t0;
+	while (rx_count < msgs) {
+		while ((sent - rx_count < depth) && (sent < msgs)) {
+			nsmp_msg_s		 msg		 = {.hdr.dst = 0};
+			uint64_t const stamp = now_ns();
+			memcpy(data, &stamp, sizeof(stamp));
+			nsmp_add_data(&msg, data, payload);
+			if (nsmp_send(&msg) != NSMP_OK) {
+				break;
+			}
+			sent++;
+		}
+
+		uint32_t const before = rx_count;
+		pump(t);
+
+		/* A dropped frame never arrives, give up once nothing moves */
+		uint64_t const tn = now_ns();
+		if (rx_count != before) {
+			tp = tn;
+		} else if (tn - tp > STALL_NS) {
+			break;
+		}
+	}
+	r.ns				 = now_ns() - t0;
+	count_allocs = 0;
+
+	r.wire	 = tx_wire;
+	r.msgs	 = rx_count;
+	r.lost	 = msgs - rx_count;
+	r.allocs = allocs;
+	if (rx_count) {
+		qsort(lat, rx_count, sizeof(lat[0]), cmp_u64);
+		r.p50	 = lat[(rx_count - 1) * 50 / 100];
+		r.p99	 = lat[(rx_count - 1) * 99 / 100];
+		r.p999 = lat[(rx_count - 1) * 999 / 1000];
+	}
+	return r;
+}
+
+static void report(const transport_s* t, const result_s* r, int first) {
+	double const s = (double)r->ns / 1e9;
+
+	printf("%s  {\"transport\": \"%s\", \"payload\": %zu, \"depth\": %zu, "
+				 "\"bundle\": %zu, \"rx_depth\": %zu, \"messages\": %u, "
+				 "\"lost\": %u, \"seconds\": %.6f, \"msgs_per_s\": %.0f, "
+				 "\"bytes_per_s\": %.0f, "
+				 "\"wire_bytes_per_msg\": %.2f, "
+				 "\"latency_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu}, "
+				 "\"allocs\": ",
+				 first ? "" : ",\n", t->name, r->payload, r->depth, r->bundle,
+				 r->rx_depth, r->msgs, r->lost, s, r->msgs / s,
+				 (double)r->msgs * (double)r->payload / s,
+				 r->msgs ? (double)r->wire / r->msgs : 0.0,
+				 (unsigned long long)r->p50, (unsigned long long)r->p99,
+				 (unsigned long long)r->p999);
+#if COUNT_ALLOCS
+	printf("%ld}", r->allocs);
+#else
+	printf("null}");
+#endif
+}
+
+/* Encode a frame as a peer would send it, returns its length */
+static size_t relay_frame(nsmp_msg_type_e type, uint8_t dst, uint8_t src,
+													size_t payload, uint8_t* out) {
+	uint8_t		 data[MTU];
+	nsmp_msg_s msg = {.hdr = {.ctl.type = type, .dst = dst, .src = src}};
+
+	/* The first byte is also the topic published or subscribed to, turning
+	 * the subscription on */
+	memset(data, 0xA5, sizeof(data));
+	data[0] = PUBSUB_TOPIC;
+	lb_open();
+	setup(&transports[0], 0, MAX_DEPTH);
+	nsmp_add_data(&msg, data, payload);
+	nsmp_send(&msg);
+	nsmp_update();
+	return lb_read(out, NSMP_FRAME_MAX(MTU));
+}
+
+/* A node relaying from link 0 to link 1, behind which RELAY_DST is */
+static int relay_setup(uint8_t store_forward) {
+	nsmp_cfg_s const cfg = {.store_forward = store_forward};
+	uint8_t					 disc[NSMP_FRAME_MAX(MTU)];
+	size_t const		 n = relay_frame(NSMP_MSG_TYPE_CTL_DISCOVERY, RELAY_NODE,
+																	 RELAY_DST, 0, disc);
+
+	memset(relay_if, 0, sizeof(relay_if));
+	relay_if[0].rx_q			 = rx_q;
+	relay_if[0].rx_len		 = sizeof(rx_q);
+	relay_if[0].mtu				 = MTU;
+	relay_if[1].tx_q			 = tx_q;
+	relay_if[1].tx_len		 = sizeof(tx_q);
+	relay_if[1].rx_q			 = relay_rx_q;
+	relay_if[1].rx_len		 = sizeof(relay_rx_q);
+	relay_if[1].tx_buf		 = tx_buf;
+	relay_if[1].tx_buf_len = sizeof(tx_buf);
+	relay_if[1].mtu				 = MTU;
+	relay_if[1].tx_cb			 = tx_cb;
+
+	int status = nsmp_node_init();
+	if (status == NSMP_OK) {
+		status = nsmp_config(&cfg);
+	}
+	for (size_t i = 0; (status == NSMP_OK) && (i < ARRAY_LEN(relay_if)); i++) {
+		status = nsmp_node_newif(&relay_if[i]);
+	}
+	if (status == NSMP_OK) {
+		nsmp_parse_if(&relay_if[1], disc, n);
+		status = nsmp_update();
+	}
+	return status;
+}
+
+static result_s relay_run(size_t payload, uint8_t store_forward,
+													uint32_t msgs) {
+	result_s		 r = {.payload = payload, .depth = 1};
+	size_t const n = relay_frame(NSMP_MSG_TYPE_USER_MESSAGE, RELAY_DST,
+															 NSMP_ADDR(0, 0, 1), payload, relay_in);
+
+	if (relay_setup(store_forward) != NSMP_OK) {
+		r.lost = msgs;
+		return r;
+	}
+	relay_out = 0;
+
+	uint64_t const c0 = cpu_ns();
+	uint64_t const t0 = now_ns();
+	for (uint32_t m = 0; m < msgs; m++) {
+		uint64_t const start = now_ns();
+		uint64_t const want	 = relay_out + n;
+
+		nsmp_parse_if(&relay_if[0], relay_in, n);
+		for (int u = 0; (u < 4) && (relay_out < want); u++) {
+			nsmp_update();
+		}
+		if (relay_out < want) {
+			break;
+		}
+		lat[r.msgs++] = relay_out_ns - start;
+	}
+	r.ns		 = now_ns() - t0;
+	r.cpu_ns = cpu_ns() - c0;
+	r.wire	 = relay_out;
+	r.lost	 = msgs - r.msgs;
+	if (r.msgs) {
+		qsort(lat, r.msgs, sizeof(lat[0]), cmp_u64);
+		r.p50	 = lat[(r.msgs - 1) * 50 / 100];
+		r.p99	 = lat[(r.msgs - 1) * 99 / 100];
+		r.p999 = lat[(r.msgs - 1) * 999 / 1000];
+	}
+	return r;
+}
+
+static void relay_report(const result_s* r, uint8_t store_forward, int first) {
+	printf("%s  {\"relay\": \"%s\", \"payload\": %zu, \"frames\": %u, "
+				 "\"lost\": %u, \"seconds\": %.6f, "
+				 "\"cpu_ns_per_byte\": %.3f, "
+				 "\"latency_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu}}",
+				 first ? "" : ",\n", store_forward ? "store_forward" : "cut_through",
+				 r->payload, r->msgs, r->lost, (double)r->ns / 1e9,
+				 r->wire ? (double)r->cpu_ns / (double)r->wire : 0.0,
+				 (unsigned long long)r->p50, (unsigned long long)r->p99,
+				 (unsigned long long)r->p999);
+}
+
+/* Ping frames one at a time from here to a receiver waiting in
+ * nsmp_rcv_wait(), through an update thread, then sit idle */
+static result_s wake_run(const waiter_s* w, uint32_t msgs, uint32_t idle_ms) {
+	result_s	 r = {.payload = WAKE_PAYLOAD, .depth = 1};
+	nsmp_cfg_s cfg = {.rcv_q = wake_rcv_q, .rcv_len = sizeof(wake_rcv_q)};
+	uint8_t		 frame[NSMP_FRAME_MAX(MTU)];
+	uint8_t		 data[MTU];
+	pthread_t	 u;
+	size_t const n = relay_frame(NSMP_MSG_TYPE_USER_MESSAGE, 0,
+															 NSMP_ADDR(0, 0, 1), WAKE_PAYLOAD, frame);
+
+	if (w->init(&cfg.os) != NSMP_OK) {
+		r.lost = msgs;
+		return r;
+	}
+	memset(&iface, 0, sizeof(iface));
+	iface.tx_q			 = tx_q;
+	iface.tx_len		 = sizeof(tx_q);
+	iface.rx_q			 = rx_q;
+	iface.rx_len		 = sizeof(rx_q);
+	iface.tx_buf		 = tx_buf;
+	iface.tx_buf_len = sizeof(tx_buf);
+	iface.mtu				 = MTU;
+	iface.tx_cb			 = wake_tx_cb;
+	if ((nsmp_peer_init() != NSMP_OK) || (nsmp_config(&cfg) != NSMP_OK) ||
+			(nsmp_peer_newif(&iface) != NSMP_OK)) {
+		r.lost = msgs;
+		return r;
+	}
+
+	__atomic_store_n(&wake_stop, 0, __ATOMIC_RELEASE);
+	if (pthread_create(&u, NULL, wake_updater, &cfg.os) != 0) {
+		r.lost = msgs;
+		return r;
+	}
+
+	uint64_t const t0 = now_ns();
+	for (uint32_t m = 0; m < msgs; m++) {
+		nsmp_msg_s msg = {0};
+		int				 status;
+
+		nsmp_add_data(&msg, data, sizeof(data));
+		uint64_t const start = now_ns();
+		nsmp_parse_if(&iface, frame, n);
+		while (((status = nsmp_rcv_wait(&msg, 1000)) == NSMP_ERR_AGAIN) &&
+					 !cfg.os.wait && (now_ns() - start < STALL_NS)) {
+			sched_yield();
+		}
+		if (status != NSMP_OK) {
+			break;
+		}
+		lat[r.msgs++] = now_ns() - start;
+	}
+	r.ns = now_ns() - t0;
+
+	/* Nothing arrives, the receiver waits as it would for the next frame */
+	uint64_t const c0 = cpu_ns();
+	uint64_t const i0 = now_ns();
+	while (now_ns() - i0 < (uint64_t)idle_ms * 1000000ull) {
+		nsmp_msg_s msg = {0};
+		nsmp_add_data(&msg, data, sizeof(data));
+		if (nsmp_rcv_wait(&msg, idle_ms) == NSMP_OK) {
+			break;
+		}
+		if (!cfg.os.wait) {
+			sched_yield();
+		}
+	}
+	r.idle_ns = now_ns() - i0;
+	r.cpu_ns	= cpu_ns() - c0;
+
+	__atomic_store_n(&wake_stop, 1, __ATOMIC_RELEASE);
+	if (cfg.os.signal) {
+		cfg.os.signal(cfg.os.ctx, NSMP_EV_READY);
+	}
+	pthread_join(u, NULL);
+	if (w->fini) {
+		w->fini();
+	}
+
+	r.lost = msgs - r.msgs;
+	if (r.msgs) {
+		qsort(lat, r.msgs, sizeof(lat[0]), cmp_u64);
+		r.p50	 = lat[(r.msgs - 1) * 50 / 100];
+		r.p99	 = lat[(r.msgs - 1) * 99 / 100];
+		r.p999 = lat[(r.msgs - 1) * 999 / 1000];
+	}
+	return r;
+}
+
+static void wake_report(const waiter_s* w, const result_s* r, int first) {
+	printf("%s  {\"wait\": \"%s\", \"payload\": %zu, \"messages\": %u, "
+				 "\"lost\": %u, \"seconds\": %.6f, "
+				 "\"latency_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu}, "
+				 "\"idle_cpu\": %.4f}",
+				 first ? "" : ",\n", w->name, r->payload, r->msgs, r->lost,
+				 (double)r->ns / 1e9, (unsigned long long)r->p50,
+				 (unsigned long long)r->p99, (unsigned long long)r->p999,
+				 r->idle_ns ? (double)r->cpu_ns / (double)r->idle_ns : 0.0);
+}
+
+/* Updates whenever there is work, and every WAKE_TICK_MS for the timers.
+ * Without a wait hook it never stops polling. */
+static void* wake_updater(void* arg) {
+	const nsmp_os_s* const os = arg;
+
+	while (!__atomic_load_n(&wake_stop, __ATOMIC_ACQUIRE)) {
+		if (nsmp_update() != NSMP_OK) {
+			continue;
+		}
+		if (os->wait) {
+			os->wait(os->ctx, NSMP_EV_READY, WAKE_TICK_MS);
+		} else {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+static int wake_busy(nsmp_os_s* os) {
+	memset(os, 0, sizeof(*os));
+	return NSMP_OK;
+}
+
+static int wake_pthread(nsmp_os_s* os) {
+	return nsmp_os_pthread(os, &wake_p);
+}
+
+static int wake_futex(nsmp_os_s* os) {
+	return nsmp_os_futex(os, &wake_f);
+}
+
+static int wake_eventfd(nsmp_os_s* os) {
+	return nsmp_os_eventfd(os, &wake_e);
+}
+
+static void wake_eventfd_fini(void) {
+	nsmp_os_eventfd_close(&wake_e);
+}
+
+/* The link of the wakeup runs only carries its credit grants, dropped here */
+static int wake_tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov,
+											size_t iovcnt) {
+	size_t total = 0;
+
+	(void)i;
+	for (size_t n = 0; n < iovcnt; n++) {
+		total += iov[n].len;
+	}
+	return (int)total;
+}
+
+/* Keep POSIX_DEPTH messages going round a pseudo-terminal */
+static result_s posix_run(uint32_t read_len, uint32_t msgs) {
+	result_s	 r	 = {.payload = POSIX_PAYLOAD, .depth = POSIX_DEPTH};
+	nsmp_cfg_s cfg = {0};
+	uint8_t		 data[MTU];
+	char			 name[64];
+	uint32_t	 sent = 0;
+
+	r.read_len = read_len;
+	memset(&posix_link, 0, sizeof(posix_link));
+	posix_link.iface.tx_q				= tx_q;
+	posix_link.iface.tx_len			= sizeof(tx_q);
+	posix_link.iface.rx_q				= rx_q;
+	posix_link.iface.rx_len			= sizeof(rx_q);
+	posix_link.iface.tx_buf			= tx_buf;
+	posix_link.iface.tx_buf_len = sizeof(tx_buf);
+	posix_link.iface.mtu				= MTU;
+	posix_link.iface.rx_cb			= rx_cb;
+	posix_link.read_len					= read_len;
+
+	int fd = -1;
+	if ((nsmp_peer_init() != NSMP_OK) ||
+			(nsmp_posix_init(&posix, &cfg) != NSMP_OK)) {
+		r.lost = msgs;
+		return r;
+	}
+	if ((nsmp_config(&cfg) != NSMP_OK) ||
+			(nsmp_posix_pty(&posix, &posix_link, name, sizeof(name)) != NSMP_OK) ||
+			(nsmp_peer_newif(&posix_link.iface) != NSMP_OK) ||
+			((fd = open(name, O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0)) {
+		nsmp_posix_close(&posix);
+		r.lost = msgs;
+		return r;
+	}
+
+	/* Let the capability exchange finish before measuring */
+	posix_len = 0;
+	for (int i = 0; i < 100; i++) {
+		nsmp_posix_poll(&posix, 0);
+		posix_echo(fd);
+	}
+
+	rx_count					= 0;
+	uint64_t const c0 = cpu_ns();
+	uint64_t const t0 = now_ns();
+	uint64_t			 tp = t0;
+	memset(data, 0xA5, sizeof(data));
+	while (rx_count < msgs) {
+		while ((sent - rx_count < POSIX_DEPTH) && (sent < msgs)) {
+			nsmp_msg_s		 msg	 = {.hdr.dst = 0};
+			uint64_t const stamp = now_ns();
+			memcpy(data, &stamp, sizeof(stamp));
+			nsmp_add_data(&msg, data, POSIX_PAYLOAD);
+			if (nsmp_send(&msg) != NSMP_OK) {
+				break;
+			}
+			sent++;
+		}
+
+		uint32_t const before = rx_count;
+		nsmp_posix_poll(&posix, 0);
+		posix_echo(fd);
+
+		uint64_t const tn = now_ns();
+		if (rx_count != before) {
+			tp = tn;
+		} else if (tn - tp > STALL_NS) {
+			break;
+		}
+	}
+	r.ns		 = now_ns() - t0;
+	r.cpu_ns = cpu_ns() - c0;
+	r.msgs	 = rx_count;
+	r.lost	 = msgs - rx_count;
+	close(fd);
+	nsmp_posix_close(&posix);
+
+	if (rx_count) {
+		qsort(lat, rx_count, sizeof(lat[0]), cmp_u64);
+		r.p50	 = lat[(rx_count - 1) * 50 / 100];
+		r.p99	 = lat[(rx_count - 1) * 99 / 100];
+		r.p999 = lat[(rx_count - 1) * 999 / 1000];
+	}
+	return r;
+}
+
+static void posix_report(const result_s* r, int first) {
+	double const s = (double)r->ns / 1e9;
+
+	printf("%s  {\"posix\": \"pty\", \"read_len\": %zu, \"payload\": %zu, "
+				 "\"depth\": %zu, \"messages\": %u, \"lost\": %u, "
+				 "\"seconds\": %.6f, \"msgs_per_s\": %.0f, "
+				 "\"cpu_ns_per_msg\": %.0f, "
+				 "\"latency_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu}}",
+				 first ? "" : ",\n", r->read_len, r->payload, r->depth, r->msgs,
+				 r->lost, s, r->msgs / s,
+				 r->msgs ? (double)r->cpu_ns / r->msgs : 0.0,
+				 (unsigned long long)r->p50, (unsigned long long)r->p99,
+				 (unsigned long long)r->p999);
+}
+
+/* The far end of the pseudo-terminal sends back whatever it receives */
+static void posix_echo(int fd) {
+	ssize_t const n =
+			read(fd, &posix_buf[posix_len], sizeof(posix_buf) - posix_len);
+	if (n > 0) {
+		posix_len += (size_t)n;
+	}
+	if (posix_len) {
+		ssize_t const w = write(fd, posix_buf, posix_len);
+		if (w > 0) {
+			memmove(posix_buf, &posix_buf[w], posix_len - (size_t)w);
+			posix_len -= (size_t)w;
+		}
+	}
+}
+
+/* Every peer streams msgs frames through the node to the peer three links
+ * on, the links split evenly between the workers */
+static result_s broker_run(uint8_t workers, uint32_t msgs) {
+	result_s	 r = {.payload = BROKER_PAYLOAD, .workers = workers};
+	uint8_t		 disc[BROKER_IFACES][NSMP_FRAME_MAX(MTU)];
+	size_t		 disc_len[BROKER_IFACES];
+	pthread_t	 t[NSMP_MAX_WORKERS];
+
+	for (size_t i = 0; i < BROKER_IFACES; i++) {
+		disc_len[i] = relay_frame(NSMP_MSG_TYPE_CTL_DISCOVERY, RELAY_NODE,
+															broker_peer(i), 0, disc[i]);
+		broker_in_len[i] = relay_frame(
+				NSMP_MSG_TYPE_USER_MESSAGE, broker_peer((i + 3) % BROKER_IFACES),
+				broker_peer(i), BROKER_PAYLOAD, broker_in[i]);
+	}
+
+	nsmp_cfg_s const cfg		= {0};
+	int							 status = nsmp_node_init();
+	if (status == NSMP_OK) {
+		status = nsmp_config(&cfg);
+	}
+	memset(broker_if, 0, sizeof(broker_if));
+	for (size_t i = 0; (status == NSMP_OK) && (i < BROKER_IFACES); i++) {
+		broker_if[i].tx_q				= broker_tx_q[i];
+		broker_if[i].tx_len			= sizeof(broker_tx_q[i]);
+		broker_if[i].rx_q				= broker_rx_q[i];
+		broker_if[i].rx_len			= sizeof(broker_rx_q[i]);
+		broker_if[i].tx_buf			= broker_tx_buf[i];
+		broker_if[i].tx_buf_len = sizeof(broker_tx_buf[i]);
+		broker_if[i].mtu				= MTU;
+		broker_if[i].tx_cb			= broker_tx_cb;
+		status									= nsmp_node_newif(&broker_if[i]);
+		if (status == NSMP_OK) {
+			nsmp_parse_if(&broker_if[i], disc[i], disc_len[i]);
+		}
+	}
+	for (int u = 0; (status == NSMP_OK) && (u < 4); u++) {
+		status = nsmp_update();
+	}
+	for (uint8_t k = 0; (status == NSMP_OK) && (k < workers); k++) {
+		memset(&broker_w[k], 0, sizeof(broker_w[k]));
+		broker_w[k].relay_q		= broker_relay_q[k];
+		broker_w[k].relay_len = sizeof(broker_relay_q[k]);
+		status = nsmp_os_pthread(&broker_w[k].os, &broker_os[k]);
+		if (status == NSMP_OK) {
+			status = nsmp_worker_add(&broker_w[k]);
+		}
+	}
+	for (size_t i = 0; (status == NSMP_OK) && (i < BROKER_IFACES); i++) {
+		status = nsmp_worker_iface(&broker_w[(i * workers) / BROKER_IFACES],
+															 &broker_if[i]);
+	}
+	if (status != NSMP_OK) {
+		r.lost = msgs;
+		return r;
+	}
+
+	/* Capabilities went out above, only relayed frames are counted */
+	for (size_t i = 0; i < BROKER_IFACES; i++) {
+		size_t const src = (i + BROKER_IFACES - 3) % BROKER_IFACES;
+		broker_fed[i]		 = 0;
+		broker_out[i]		 = 0;
+		broker_want[i]	 = (uint64_t)msgs * broker_in_len[src];
+	}
+	broker_msgs = msgs;
+	broker_nw		= workers;
+
+	uint64_t const c0 = cpu_ns();
+	uint64_t const t0 = now_ns();
+	uint8_t				 started;
+	for (started = 0; started < workers; started++) {
+		if (pthread_create(&t[started], NULL, broker_thread, &broker_w[started])) {
+			break;
+		}
+	}
+	for (uint8_t k = 0; k < started; k++) {
+		pthread_join(t[k], NULL);
+	}
+	r.ns		 = now_ns() - t0;
+	r.cpu_ns = cpu_ns() - c0;
+
+	for (size_t i = 0; i < BROKER_IFACES; i++) {
+		size_t const src = (i + BROKER_IFACES - 3) % BROKER_IFACES;
+		r.msgs += (uint32_t)(broker_out[i] / broker_in_len[src]);
+		r.wire += broker_out[i];
+	}
+	r.lost = (BROKER_IFACES * msgs) - r.msgs;
+	return r;
+}
+
+static void broker_report(const result_s* r, int first) {
+	double const s = (double)r->ns / 1e9;
+
+	printf("%s  {\"broker\": \"workers\", \"workers\": %zu, \"links\": %d, "
+				 "\"payload\": %zu, \"frames\": %u, \"lost\": %u, "
+				 "\"seconds\": %.6f, \"frames_per_s\": %.0f, "
+				 "\"cpu_ns_per_frame\": %.0f}",
+				 first ? "" : ",\n", r->workers, BROKER_IFACES, r->payload, r->msgs,
+				 r->lost, s, r->msgs / s,
+				 r->msgs ? (double)r->cpu_ns / r->msgs : 0.0);
+}
+
+static result_s arq_run(uint16_t ack_ms, size_t depth, uint32_t msgs) {
+	nsmp_cfg_s const cfg = {
+			.get_time_ms = now_ms,
+			.arq_window	 = ARQ_WINDOW,
+			.arq_ack_ms	 = ack_ms,
+	};
+	result_s r = {.payload = ARQ_PAYLOAD, .depth = depth, .lost = msgs};
+
+	lb_open();
+	if ((setup(&transports[0], 0, MAX_DEPTH) != NSMP_OK) ||
+			(nsmp_config(&cfg) != NSMP_OK)) {
+		fprintf(stderr, "nsmp_bench: arq setup failed\n");
+		return r;
+	}
+	iface.tx_cb = arq_tx_cb;
+	arq_frames	= 0;
+	arq_batches = 0;
+
+	r					= run(&transports[0], ARQ_PAYLOAD, depth, 0, MAX_DEPTH, msgs);
+	r.ack_ms	= ack_ms;
+	r.frames	= arq_frames;
+	r.batches = arq_batches;
+	return r;
+}
+
+static void arq_report(const result_s* r, int first) {
+	double const s = (double)r->ns / 1e9;
+	double const m = r->msgs ? (double)r->msgs : 1.0;
+
+	printf("%s  {\"arq\": \"loopback\", \"payload\": %zu, \"depth\": %zu, "
+				 "\"window\": %d, \"ack_ms\": %zu, \"messages\": %u, \"lost\": %u, "
+				 "\"seconds\": %.6f, \"msgs_per_s\": %.0f, "
+				 "\"wire_bytes_per_msg\": %.2f, \"frames_per_msg\": %.3f, "
+				 "\"writes_per_msg\": %.3f, "
+				 "\"latency_ns\": {\"p50\": %llu, \"p99\": %llu}}",
+				 first ? "" : ",\n", r->payload, r->depth, ARQ_WINDOW, r->ack_ms,
+				 r->msgs, r->lost, s, r->msgs / s, (double)r->wire / m,
+				 (double)r->frames / m, (double)r->batches / m,
+				 (unsigned long long)r->p50, (unsigned long long)r->p99);
+}
+
+/* Counts the frames and writes the loopback takes */
+static int arq_tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	int const n = tx_cb(i, iov, iovcnt);
+
+	if (n > 0) {
+		size_t left = (size_t)n;
+		for (size_t k = 0; (k < iovcnt) && left; k++) {
+			size_t const len = (iov[k].len < left) ? iov[k].len : left;
+			for (size_t j = 0; j < len; j++) {
+				arq_frames += (iov[k].base[j] == 0);
+			}
+			left -= len;
+		}
+		arq_batches++;
+	}
+	return n;
+}
+
+static result_s lz_run(const lz_set_s* set, uint8_t compress, uint32_t msgs) {
+	nsmp_cfg_s const cfg		= {.lz_buf = lz_buf, .lz_len = sizeof(lz_buf)};
+	uint32_t const	 chunks = LZ_DATA_LEN / LZ_PAYLOAD;
+	uint32_t				 sent		= 0;
+	result_s r = {.payload = LZ_PAYLOAD, .compress = compress, .lost = msgs};
+
+	set->fill(lz_data, sizeof(lz_data));
+	lb_open();
+	if ((setup(&transports[0], 0, MAX_DEPTH) != NSMP_OK) ||
+			(nsmp_config(&cfg) != NSMP_OK)) {
+		fprintf(stderr, "nsmp_bench: lz setup failed\n");
+		return r;
+	}
+	pump(&transports[0]);
+	pump(&transports[0]);
+	rx_count = 0;
+	tx_wire	 = 0;
+
+	uint64_t const t0 = now_ns();
+	uint64_t			 tp = t0;
+	while (rx_count < msgs) {
+		while ((sent - rx_count < LZ_DEPTH) && (sent < msgs)) {
+			uint8_t* const data	 = &lz_data[(sent % chunks) * LZ_PAYLOAD];
+			nsmp_msg_s		 msg	 = {.hdr.dst = 0};
+			uint8_t				 keep[sizeof(uint64_t)];
+			uint64_t const stamp = now_ns();
+
+			/* The stamp replaces the start of the chunk while it is sent */
+			memcpy(keep, data, sizeof(keep));
+			memcpy(data, &stamp, sizeof(stamp));
+			nsmp_add_data(&msg, data, LZ_PAYLOAD);
+			msg.flags = compress ? NSMP_MSG_COMPRESS : 0;
+			int const rc = nsmp_send(&msg);
+			memcpy(data, keep, sizeof(keep));
+			if (rc != NSMP_OK) {
+				break;
+			}
+			sent++;
+		}
+
+		uint32_t const before = rx_count;
+		pump(&transports[0]);
+		uint64_t const tn = now_ns();
+		if (rx_count != before) {
+			tp = tn;
+		} else if (tn - tp > STALL_NS) {
+			break;
+		}
+	}
+	r.ns	 = now_ns() - t0;
+	r.wire = tx_wire;
+	r.msgs = rx_count;
+	r.lost = msgs - rx_count;
+	if (rx_count) {
+		qsort(lat, rx_count, sizeof(lat[0]), cmp_u64);
+		r.p50 = lat[(rx_count - 1) * 50 / 100];
+		r.p99 = lat[(rx_count - 1) * 99 / 100];
+	}
+	if (compress) {
+		lz_codec(&r, msgs);
+	}
+	return r;
+}
+
+static void lz_report(const lz_set_s* set, const result_s* r, int first) {
+	double const s	= (double)r->ns / 1e9;
+	double const m	= r->msgs ? (double)r->msgs : 1.0;
+	double const wb = (double)r->wire / m;
+
+	printf("%s  {\"lz\": \"%s\", \"compress\": %zu, \"payload\": %zu, "
+				 "\"messages\": %u, \"lost\": %u, \"seconds\": %.6f, "
+				 "\"msgs_per_s\": %.0f, \"wire_bytes_per_msg\": %.2f, "
+				 "\"serial_payload_bytes_per_s\": %.0f, "
+				 "\"latency_ns\": {\"p50\": %llu, \"p99\": %llu}",
+				 first ? "" : ",\n", set->name, r->compress, r->payload, r->msgs,
+				 r->lost, s, r->msgs / s, wb,
+				 wb ? (double)r->payload * LZ_BAUD / 10.0 / wb : 0.0,
+				 (unsigned long long)r->p50, (unsigned long long)r->p99);
+	if (r->lz_out) {
+		printf(", \"ratio\": %.3f, \"compress_mb_s\": %.1f, "
+					 "\"decompress_mb_s\": %.1f}",
+					 (double)r->lz_in / (double)r->lz_out,
+					 (double)r->lz_in * 1e3 / (double)r->lz_enc_ns,
+					 r->lz_dec ? (double)r->lz_dec * 1e3 / (double)r->lz_dec_ns : 0.0);
+	} else {
+		printf("}");
+	}
+}
+
+/* Times compressing and expanding the chunks the messages are cut from, each
+ * on its own like a message. The ratio counts chunks that do not compress as
+ * sent raw. */
+static void lz_codec(result_s* r, uint32_t chunks) {
+	static uint8_t out[LZ_DATA_LEN];
+	static size_t	 len[LZ_DATA_LEN / LZ_PAYLOAD];
+	static uint8_t back[LZ_PAYLOAD];
+	size_t const	 n = ARRAY_LEN(len);
+
+	uint64_t t0 = now_ns();
+	for (uint32_t c = 0; c < chunks; c++) {
+		size_t const i = c % n;
+		len[i] = nsmp_lz_compress(&lz_data[i * LZ_PAYLOAD], LZ_PAYLOAD,
+															&out[i * LZ_PAYLOAD], LZ_PAYLOAD, lz_table);
+		r->lz_out += len[i] ? len[i] : LZ_PAYLOAD;
+	}
+	r->lz_enc_ns = now_ns() - t0;
+	r->lz_in		 = (uint64_t)chunks * LZ_PAYLOAD;
+
+	/* Only those that compressed are expanded, and timed */
+	uint64_t want = 0;
+	t0						= now_ns();
+	for (uint32_t c = 0; c < chunks; c++) {
+		size_t const i = c % n;
+		if (len[i]) {
+			r->lz_dec += nsmp_lz_decompress(&out[i * LZ_PAYLOAD], len[i], back,
+																			sizeof(back));
+			want += LZ_PAYLOAD;
+		}
+	}
+	r->lz_dec_ns = now_ns() - t0;
+	if (r->lz_dec != want) {
+		r->lost = r->lost ? r->lost : 1;
+	}
+}
+
+/* Machine code and tables, as a firmware image would be */
+static void lz_firmware(uint8_t* buf, size_t len) {
+	FILE*	 f = fopen("/proc/self/exe", "rb");
+	size_t n = 0;
+
+	if (f) {
+		n = fread(buf, 1, len, f);
+		fclose(f);
+	}
+	if (n < len) {
+		lz_log(&buf[n], len - n);
+	}
+}
+
+/* Status lines as a device would log them */
+static void lz_log(uint8_t* buf, size_t len) {
+	static const char* const state[] = {"ok", "ok", "ok", "busy", "retry"};
+	size_t									 pos		 = 0;
+
+	for (unsigned i = 0; pos < len; i++) {
+		char			line[96];
+		int const n = snprintf(
+				line, sizeof(line), "[%010u] node %u/%u: temp=%d.%uC vbat=%umV %s\n",
+				i * 37u, (i / 3) % 4, i % 7, 21 + (int)((i / 16) % 6), (i * 7) % 10,
+				3300 - (i % 40), state[(i / 5) % ARRAY_LEN(state)]);
+		size_t const take = ((size_t)n < len - pos) ? (size_t)n : len - pos;
+		memcpy(&buf[pos], line, take);
+		pos += take;
+	}
+}
+
+static void lz_random(uint8_t* buf, size_t len) {
+	uint32_t x = 0x9E3779B9u;
+
+	for (size_t i = 0; i < len; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		buf[i] = (uint8_t)x;
+	}
+}
+
+/* Feeds the links of one worker whenever their rx_q has room, and serves
+ * them until they have passed on all they received and sent everything
+ * relayed to them */
+static void* broker_thread(void* arg) {
+	nsmp_worker_s* const w	= arg;
+	size_t const				 lo = ((size_t)w->idx * BROKER_IFACES) / broker_nw;
+	size_t const				 hi = (((size_t)w->idx + 1) * BROKER_IFACES) / broker_nw;
+	uint64_t						 tp = now_ns();
+
+	for (;;) {
+		int fed	 = 0;
+		int done = 1;
+
+		for (size_t i = lo; i < hi; i++) {
+			nsmp_iface_s* const ifp = &broker_if[i];
+			while ((broker_fed[i] < broker_msgs) &&
+						 (nsmp_queue_used(&ifp->rxq) <= ifp->rx_len / 2)) {
+				nsmp_parse_if(ifp, broker_in[i], broker_in_len[i]);
+				broker_fed[i]++;
+				fed = 1;
+			}
+			done &= (broker_fed[i] == broker_msgs) && !nsmp_queue_used(&ifp->rxq) &&
+							(broker_out[i] >= broker_want[i]);
+		}
+		if (done) {
+			break;
+		}
+
+		/* The other workers may still relay to these links */
+		int const			 rc = nsmp_worker_update(w);
+		uint64_t const tn = now_ns();
+		if ((rc > 0) || fed) {
+			tp = tn;
+		} else if (tn - tp > STALL_NS) {
+			break;
+		} else {
+			w->os.wait(w->os.ctx, NSMP_EV_READY, 1);
+		}
+	}
+	return NULL;
+}
+
+static uint8_t broker_peer(size_t i) {
+	return NSMP_ADDR(0, 1, i + 1);
+}
+
+static int broker_tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov,
+												size_t iovcnt) {
+	size_t total = 0;
+
+	for (size_t n = 0; n < iovcnt; n++) {
+		total += iov[n].len;
+	}
+	broker_out[i - broker_if] += total;
+	return (int)total;
+}
+
+/* A node with the publisher on link 0 and subs subscribers on the links after
+ * it, each message going to all of them */
+static result_s pubsub_run(size_t subs, uint8_t publish, uint32_t msgs) {
+	result_s r = {.payload = PUBSUB_PAYLOAD, .subs = subs};
+	uint8_t	 ctl[BROKER_IFACES][NSMP_FRAME_MAX(MTU)];
+	size_t	 ctl_len[BROKER_IFACES];
+	size_t	 in_len = 0;
+
+	/* Subscribers announce themselves and subscribe, the publisher either
+	 * publishes once or sends to each of them */
+	for (size_t i = 1; i <= subs; i++) {
+		ctl_len[i] = relay_frame(publish ? NSMP_MSG_TYPE_CTL_SUBSCRIBE
+																		 : NSMP_MSG_TYPE_CTL_DISCOVERY,
+														 RELAY_NODE, broker_peer(i), publish ? 2 : 0,
+														 ctl[i]);
+		if (!publish) {
+			in_len += relay_frame(NSMP_MSG_TYPE_USER_MESSAGE, broker_peer(i),
+														broker_peer(0), PUBSUB_PAYLOAD, &pubsub_in[in_len]);
+		}
+	}
+	if (publish) {
+		in_len = relay_frame(NSMP_MSG_TYPE_USER_MESSAGE, NSMP_ADDR_TOPIC,
+												 broker_peer(0), PUBSUB_PAYLOAD, pubsub_in);
+	}
+
+	nsmp_cfg_s const cfg		= {0};
+	int							 status = nsmp_node_init();
+	if (status == NSMP_OK) {
+		status = nsmp_config(&cfg);
+	}
+	memset(broker_if, 0, sizeof(broker_if));
+	for (size_t i = 0; (status == NSMP_OK) && (i <= subs); i++) {
+		broker_if[i].tx_q				= broker_tx_q[i];
+		broker_if[i].tx_len			= sizeof(broker_tx_q[i]);
+		broker_if[i].rx_q				= broker_rx_q[i];
+		broker_if[i].rx_len			= sizeof(broker_rx_q[i]);
+		broker_if[i].tx_buf			= broker_tx_buf[i];
+		broker_if[i].tx_buf_len = sizeof(broker_tx_buf[i]);
+		broker_if[i].mtu				= MTU;
+		broker_if[i].tx_cb			= broker_tx_cb;
+		status									= nsmp_node_newif(&broker_if[i]);
+		if ((status == NSMP_OK) && i) {
+			nsmp_parse_if(&broker_if[i], ctl[i], ctl_len[i]);
+		}
+	}
+	for (int u = 0; (status == NSMP_OK) && (u < 4); u++) {
+		status = nsmp_update();
+	}
+	if (status != NSMP_OK) {
+		r.lost = msgs;
+		return r;
+	}
+
+	/* Capabilities went out above, only what reaches the subscribers counts */
+	uint64_t out = 0;
+	memset(broker_out, 0, sizeof(broker_out));
+
+	uint64_t const c0 = cpu_ns();
+	uint64_t const t0 = now_ns();
+	for (uint32_t m = 0; m < msgs; m++) {
+		nsmp_parse_if(&broker_if[0], pubsub_in, in_len);
+		for (int u = 0; u < 4; u++) {
+			nsmp_update();
+		}
+
+		uint64_t total = 0;
+		for (size_t i = 1; i <= subs; i++) {
+			total += broker_out[i];
+		}
+		if (total - out < subs * (publish ? in_len : in_len / subs)) {
+			break;
+		}
+		out = total;
+		r.msgs++;
+	}
+	r.ns		 = now_ns() - t0;
+	r.cpu_ns = cpu_ns() - c0;
+	r.wire	 = (uint64_t)r.msgs * in_len;
+	r.frames = out;
+	r.lost	 = msgs - r.msgs;
+	return r;
+}
+
+static void pubsub_report(const result_s* r, uint8_t publish, int first) {
+	printf("%s  {\"pubsub\": \"%s\", \"subscribers\": %zu, \"payload\": %zu, "
+				 "\"msgs\": %u, \"lost\": %u, \"seconds\": %.6f, "
+				 "\"upstream_bytes_per_msg\": %.1f, "
+				 "\"downstream_bytes_per_msg\": %.1f, \"cpu_ns_per_msg\": %.0f}",
+				 first ? "" : ",\n", publish ? "publish" : "unicast", r->subs,
+				 r->payload, r->msgs, r->lost, (double)r->ns / 1e9,
+				 r->msgs ? (double)r->wire / r->msgs : 0.0,
+				 r->msgs ? (double)r->frames / r->msgs : 0.0,
+				 r->msgs ? (double)r->cpu_ns / r->msgs : 0.0);
+}
+
+/* The mean of DISC_RUNS cold starts, those that do not converge counted as
+ * lost and at DISC_LIMIT_MS */
+static result_s disc_run(size_t peers, uint8_t dir) {
+	result_s r = {.payload = DISC_PAYLOAD, .peers = peers, .msgs = DISC_RUNS};
+
+	for (uint32_t seed = 1; seed <= DISC_RUNS; seed++) {
+		uint32_t const us = disc_sim(peers + 1, dir, seed, &r);
+		uint64_t const ns = (uint64_t)(us ? us : DISC_LIMIT_MS * 1000u) * 1000u;
+		r.lost += !us;
+		r.ns += ns;
+		r.max_ns = (ns > r.max_ns) ? ns : r.max_ns;
+	}
+	return r;
+}
+
+/* One cold start of devs devices, returns when every device had the payload
+ * of every other, or 0 if that was not within DISC_LIMIT_MS */
+static uint32_t disc_sim(size_t devs, uint8_t dir, uint32_t seed,
+												 result_s* r) {
+	uint64_t const all			= (1ull << devs) - 1;
+	disc_frame_s	 air			= {0};
+	disc_frame_s	 f;
+	uint32_t			 busy_us	= 0;
+	size_t				 on_air		= 0;
+
+	memset(disc_dev, 0, sizeof(disc_dev));
+	memset(disc_ver, 0, sizeof(disc_ver));
+	disc_ver[0]		= 1;
+	disc_at[1]		= 0;
+	disc_dir_ver	= 1;
+	disc_dir_from = 0;
+	disc_dir_pend = 0;
+	for (size_t i = 0; i < devs; i++) {
+		disc_dev_s* const d = &disc_dev[i];
+		d->known						= 1ull << i;
+		d->rnd							= (seed * 2654435761u) ^ ((uint32_t)(i + 1) * 40503u);
+		d->rnd							= d->rnd ? d->rnd : 1;
+		/* With a directory the node has nothing to ask for */
+		if (!dir || i) {
+			disc_start(d, 0);
+		}
+	}
+
+	for (uint32_t now = 0; now < DISC_LIMIT_MS * 1000u; now += DISC_TICK_US) {
+		if (on_air && (now >= busy_us)) {
+			/* Frames that started together are heard by nobody */
+			for (size_t i = 0; (on_air == 1) && (i < devs); i++) {
+				if (i != air.src) {
+					disc_hear(&disc_dev[i], i, &air, now, dir);
+				}
+			}
+			on_air = 0;
+
+			size_t i = 0;
+			while ((i < devs) && (disc_dev[i].known == all)) {
+				i++;
+			}
+			if (i == devs) {
+				return now;
+			}
+		}
+
+		for (size_t i = 0; i < devs; i++) {
+			disc_dev_s* const d = &disc_dev[i];
+			if ((d->state == DISC_IDLE) || (now < d->due_us)) {
+				continue;
+			}
+			if (d->state == DISC_WAIT) {
+				d->req		= 1;
+				d->state	= DISC_SENT;
+				d->due_us = now + (NSMP_DISC_TIMEOUT_MS * 1000u);
+				d->tries++;
+			} else if (d->tries >= NSMP_DISC_TRIES) {
+				d->state = DISC_IDLE;
+			} else {
+				if (dir) {
+					d->window = (d->window < NSMP_DISC_WINDOW_MAX_MS / 2)
+													? (uint16_t)(d->window * 2)
+													: NSMP_DISC_WINDOW_MAX_MS;
+				}
+				disc_wait(d, now);
+			}
+		}
+		if (on_air) {
+			continue;
+		}
+
+		/* Whoever has a frame for the idle bus starts now */
+		uint32_t longest = 0;
+		for (size_t i = 0; i < devs; i++) {
+			disc_dev_s* const d = &disc_dev[i];
+			if (!d->req && !(d->rsp && (now >= d->rsp_us)) &&
+					!(dir && !i && disc_dir_pend)) {
+				continue;
+			}
+			disc_build(d, i, now, dir, &f);
+			uint32_t const us =
+					(uint32_t)(((uint64_t)f.bytes * 10u * 1000000u) / DISC_BAUD);
+			longest = (us > longest) ? us : longest;
+			air			= on_air ? air : f;
+			r->wire += f.bytes;
+			r->frames++;
+			on_air++;
+		}
+		if (on_air) {
+			busy_us = now + longest;
+			r->collisions += (on_air > 1) ? on_air : 0;
+		}
+	}
+	return 0;
+}
+
+/* Device i hears a frame, as nsmp_dir.c would with dir set */
+static void disc_hear(disc_dev_s* d, size_t i, const disc_frame_s* f,
+											uint32_t now, uint8_t dir) {
+	if (f->kind == DISC_DIR) {
+		d->known |= 1ull;
+		d->node_seen = 1;
+		if (d->since > f->to) {
+			d->since	= 0;
+			d->listed = 0;
+		}
+		if (f->from > d->since) {
+			if (d->state == DISC_IDLE) {
+				disc_start(d, now);
+			}
+			return;
+		}
+		for (size_t k = 0; k < f->n; k++) {
+			if (f->ent[k] == i) {
+				d->listed = 1;
+			} else if (f->ent_ver[k] > d->since) {
+				d->known |= 1ull << f->ent[k];
+			}
+		}
+		d->since = f->to;
+		if (d->listed) {
+			d->state = DISC_IDLE;
+		} else if (d->state == DISC_IDLE) {
+			disc_start(d, now);
+		}
+		return;
+	}
+
+	d->known |= 1ull << f->src;
+	if (dir && !i) {
+		/* The node adds the device to its directory, and answers requests */
+		if (!disc_ver[f->src]) {
+			disc_ver[f->src]			 = ++disc_dir_ver;
+			disc_at[disc_dir_ver] = f->src;
+		}
+		if ((f->kind == DISC_REQ) &&
+				(!disc_dir_pend || (f->since < disc_dir_from))) {
+			disc_dir_from = f->since;
+		}
+		disc_dir_pend |= (f->kind == DISC_REQ);
+		return;
+	}
+	if (f->kind == DISC_RSP) {
+		if (!d->node_seen && (d->state == DISC_SENT)) {
+			d->state = DISC_IDLE;
+		}
+		return;
+	}
+
+	if (!d->node_seen && !d->rsp) {
+		d->rsp		= 1;
+		d->rsp_us = now + (disc_rnd(d) % (DISC_RSP_MS * 1000u));
+	}
+	if (dir && (d->state == DISC_WAIT)) {
+		d->window = (d->window < NSMP_DISC_WINDOW_MAX_MS / 2)
+										? (uint16_t)(d->window * 2)
+										: NSMP_DISC_WINDOW_MAX_MS;
+		disc_wait(d, now);
+	}
+}
+
+static void disc_start(disc_dev_s* d, uint32_t now) {
+	d->tries	= 0;
+	d->window = NSMP_DISC_WINDOW_MS;
+	disc_wait(d, now);
+}
+
+/* Request after NSMP_DISC_WAIT_MS and a random part of the window, in whole
+ * milliseconds as a device's timer would */
+static void disc_wait(disc_dev_s* d, uint32_t now) {
+	d->state	= DISC_WAIT;
+	d->due_us = now + (NSMP_DISC_WAIT_MS + (disc_rnd(d) % (d->window + 1u))) *
+												1000u;
+}
+
+/* Take the frame device i has for the bus: its request, its response, or
+ * the node's next directory frame as dir_send() builds it */
+static void disc_build(disc_dev_s* d, size_t i, uint32_t now, uint8_t dir,
+											 disc_frame_s* f) {
+	size_t len = DISC_PAYLOAD;
+
+	memset(f, 0, sizeof(*f));
+	f->src = (uint8_t)i;
+	if (d->req) {
+		d->req	 = 0;
+		f->kind	 = DISC_REQ;
+		f->since = d->since;
+		len += dir ? DISC_HDR : 0;
+	} else if (d->rsp && (now >= d->rsp_us)) {
+		d->rsp	= 0;
+		f->kind = DISC_RSP;
+	} else {
+		f->kind = DISC_DIR;
+		f->from = (disc_dir_from > disc_dir_ver) ? 0 : disc_dir_from;
+		f->to		= f->from;
+		len			= DISC_DIR_HDR;
+		for (uint16_t v = f->from + 1; (v <= disc_dir_ver) &&
+																	 (len + DISC_ENT_HDR + DISC_PAYLOAD <= DISC_MTU);
+				 v++) {
+			f->ent[f->n]			= disc_at[v];
+			f->ent_ver[f->n++] = v;
+			f->to							= v;
+			len += DISC_ENT_HDR + DISC_PAYLOAD;
+		}
+		disc_dir_pend = (f->to != disc_dir_ver);
+		disc_dir_from = f->to;
+	}
+	f->bytes = disc_bytes(len);
+}
+
+/* Encoded length of a frame with a payload of len bytes, delimiter included */
+static uint32_t disc_bytes(size_t len) {
+	return (uint32_t)COBS_ENCODE_MAX(NSMP_HDR_LEN + len + NSMP_PAYLOAD_CRC_LEN) +
+				 1;
+}
+
+/* xorshift32 */
+static uint32_t disc_rnd(disc_dev_s* d) {
+	d->rnd ^= d->rnd << 13;
+	d->rnd ^= d->rnd >> 17;
+	d->rnd ^= d->rnd << 5;
+	return d->rnd;
+}
+
+static void disc_report(const result_s* r, uint8_t dir, int first) {
+	printf("%s  {\"discovery\": \"%s\", \"peers\": %zu, \"payload\": %zu, "
+				 "\"runs\": %u, \"unconverged\": %u, \"converge_ms\": %.1f, "
+				 "\"converge_max_ms\": %.1f, \"bus_bytes\": %.0f, "
+				 "\"frames\": %.1f, \"collisions\": %.1f}",
+				 first ? "" : ",\n", dir ? "directory" : "flood", r->peers,
+				 r->payload, r->msgs, r->lost, (double)r->ns / 1e6 / r->msgs,
+				 (double)r->max_ns / 1e6, (double)r->wire / r->msgs,
+				 (double)r->frames / r->msgs, (double)r->collisions / r->msgs);
+}
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t now_ms(void) {
+	return (uint32_t)(now_ns() / 1000000);
+}
+
+static uint64_t cpu_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void* a, const void* b) {
+	uint64_t const x = *(const uint64_t*)a;
+	uint64_t const y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	uint64_t stamp;
+
+	if ((msg->len >= sizeof(stamp)) && (rx_count < MAX_MSGS)) {
+		memcpy(&stamp, msg->data, sizeof(stamp));
+		lat[rx_count] = now_ns() - stamp;
+		rx_bytes += msg->len;
+		rx_count++;
+	}
+	return NSMP_OK;
+}
+
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	/* The relay egress only counts what leaves */
+	if (i == &relay_if[1]) {
+		size_t total = 0;
+		for (size_t n = 0; n < iovcnt; n++) {
+			total += iov[n].len;
+		}
+		relay_out += total;
+		relay_out_ns = now_ns();
+		return (int)total;
+	}
+
+	int const n = cur->write(iov, iovcnt);
+	if (n > 0) {
+		tx_wire += (uint64_t)n;
+	}
+	return n;
+}
+
+static int lb_open(void) {
+	wire_len = 0;
+	return 0;
+}
+
+static void lb_close(void) {
+}
+
+/* Accepts as much as fits, like a transport with a bounded FIFO */
+static int lb_write(const nsmp_iovec_s* iov, size_t iovcnt) {
+	size_t total = 0;
+
+	for (size_t n = 0; n < iovcnt; n++) {
+		size_t len = iov[n].len;
+		if (len > sizeof(wire) - wire_len) {
+			len = sizeof(wire) - wire_len;
+		}
+		memcpy(&wire[wire_len], iov[n].base, len);
+		wire_len += len;
+		total += len;
+	}
+	return (int)total;
+}
+
+static size_t lb_read(uint8_t* buf, size_t len) {
+	size_t const n = (wire_len < len) ? wire_len : len;
+
+	memcpy(buf, wire, n);
+	memmove(wire, &wire[n], wire_len - n);
+	wire_len -= n;
+	return n;
+}
+
+static int pty_open(void) {
+	struct termios tio;
+
+	pty_master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if ((pty_master < 0) || grantpt(pty_master) || unlockpt(pty_master)) {
+		pty_close();
+		return -1;
+	}
+
+	const char* const name = ptsname(pty_master);
+	pty_slave = name ? open(name, O_RDWR | O_NOCTTY | O_NONBLOCK) : -1;
+	if ((pty_slave < 0) || tcgetattr(pty_slave, &tio)) {
+		pty_close();
+		return -1;
+	}
+
+	/* Raw bytes, no echo back to the master */
+	cfmakeraw(&tio);
+	if (tcsetattr(pty_slave, TCSANOW, &tio)) {
+		pty_close();
+		return -1;
+	}
+	return 0;
+}
+
+static void pty_close(void) {
+	if (pty_slave >= 0) {
+		close(pty_slave);
+	}
+	if (pty_master >= 0) {
+		close(pty_master);
+	}
+	pty_slave	 = -1;
+	pty_master = -1;
+}
+
+static int pty_write(const nsmp_iovec_s* iov, size_t iovcnt) {
+	struct iovec v[8];
+
+	if (iovcnt > ARRAY_LEN(v)) {
+		iovcnt = ARRAY_LEN(v);
+	}
+	for (size_t n = 0; n < iovcnt; n++) {
+		v[n].iov_base = (void*)iov[n].base;
+		v[n].iov_len	= iov[n].len;
+	}
+
+	ssize_t const n = writev(pty_master, v, (int)iovcnt);
+	if (n < 0) {
+		return ((errno == EAGAIN) || (errno == EINTR)) ? 0 : -1;
+	}
+	return (int)n;
+}
+
+static size_t pty_read(uint8_t* buf, size_t len) {
+	ssize_t const n = read(pty_slave, buf, len);
+	return (n > 0) ? (size_t)n : 0;
+}
@@ -1,9 +1,99 @@
 #include "cobs.h"
 
+#include <stdint.h>
+#include <string.h>
+
+/* Zero-byte scanning kernel selection. The widest vector unit the compiler */
+/* is targeting is used; everything else falls back to word-at-a-time SWAR. */
+/* Define COBS_SCAN_BYTEWISE to force the plain byte loop, or COBS_SCAN_SWAR */
+/* to force SWAR. */
+#if !defined(COBS_SCAN_BYTEWISE) && !defined(COBS_SCAN_SWAR) &&               \
+		defined(__GNUC__)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define COBS_SCAN_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define COBS_SCAN_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define COBS_SCAN_NEON
+#else
+#define COBS_SCAN_SWAR
+#endif
+#endif
+
 #define COBS_ISV COBS_INPLACE_SENTINEL_VALUE
 
 typedef unsigned char cobs_byte_t;
 
+#if defined(COBS_SCAN_SWAR)
+typedef uintptr_t cobs_word_t;
+
+#define COBS_WORD_ONES	((cobs_word_t)-1 / 0xFF)
+#define COBS_WORD_HIGHS (COBS_WORD_ONES * 0x80)
+#endif
+
+/* cobs_scan */
+/* */
+/* Returns the index of the first COBS_FRAME_DELIMITER in the |len| bytes at */
+/* |buf|, or |len| if there is none. */
+static unsigned cobs_scan(cobs_byte_t const* buf, unsigned len) {
+	unsigned i = 0;
+
+#if defined(COBS_SCAN_AVX2)
+	__m256i const zero32 = _mm256_setzero_si256();
+	for (; i + 32 <= len; i += 32) {
+		__m256i const v = _mm256_loadu_si256((__m256i const*)(buf + i));
+		unsigned const m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero32));
+		if (m) {
+			return i + (unsigned)__builtin_ctz(m);
+		}
+	}
+#endif
+
+#if defined(COBS_SCAN_AVX2) || defined(COBS_SCAN_SSE2)
+	__m128i const zero16 = _mm_setzero_si128();
+	for (; i + 16 <= len; i += 16) {
+		__m128i const	 v = _mm_loadu_si128((__m128i const*)(buf + i));
+		unsigned const m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero16));
+		if (m) {
+			return i + (unsigned)__builtin_ctz(m);
+		}
+	}
+#elif defined(COBS_SCAN_NEON)
+	for (; i + 16 <= len; i += 16) {
+		uint8x16_t const v = vceqq_u8(vld1q_u8(buf + i), vdupq_n_u8(0));
+		/* Narrow each byte lane to a nibble to get a 64-bit match mask. */
+		uint64_t const m = vget_lane_u64(
+				vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+		if (m) {
+			return i + (unsigned)(__builtin_ctzll(m) >> 2);
+		}
+	}
+#elif defined(COBS_SCAN_SWAR)
+	for (; i + sizeof(cobs_word_t) <= len; i += sizeof(cobs_word_t)) {
+		cobs_word_t w;
+		memcpy(&w, buf + i, sizeof(w));
+		w = (w - COBS_WORD_ONES) & ~w & COBS_WORD_HIGHS;
+		if (w) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+			/* Borrows only propagate towards higher addresses, so the lowest */
+			/* flagged byte is always a real zero. */
+			return i + (unsigned)(__builtin_ctzl((unsigned long)w) >> 3);
+#else
+			break;
+#endif
+		}
+	}
+#endif
+
+	while ((i < len) && (buf[i] != COBS_FRAME_DELIMITER)) {
+		++i;
+	}
+	return i;
+}
+
 cobs_ret_t cobs_encode_inplace(void* buf, unsigned len) {
 	if (!buf || (len < 2)) {
 		return COBS_RET_ERR_BAD_ARG;
@@ -16,14 +106,16 @@ cobs_ret_t cobs_encode_inplace(void* buf, unsigned len) {
 
 	unsigned patch = 0, cur = 1;
 	while (cur < len - 1) {
-		if (src[cur] == COBS_FRAME_DELIMITER) {
-			unsigned const ofs = cur - patch;
-			if (ofs > 255) {
-				return COBS_RET_ERR_BAD_PAYLOAD;
-			}
-			src[patch] = (cobs_byte_t)ofs;
-			patch			 = cur;
+		cur += cobs_scan(src + cur, (len - 1) - cur);
+		if (cur == len - 1) {
+			break;
+		}
+		unsigned const ofs = cur - patch;
+		if (ofs > 255) {
+			return COBS_RET_ERR_BAD_PAYLOAD;
 		}
+		src[patch] = (cobs_byte_t)ofs;
+		patch			 = cur;
 		++cur;
 	}
 	unsigned const ofs = cur - patch;
@@ -43,11 +135,12 @@ cobs_ret_t cobs_decode_inplace(void* buf, unsigned const len) {
 	cobs_byte_t* const src = (cobs_byte_t*)buf;
 	unsigned					 ofs, cur = 0;
 	while (cur < len && ((ofs = src[cur]) != COBS_FRAME_DELIMITER)) {
+		if (cur + ofs > len) {
+			return COBS_RET_ERR_BAD_PAYLOAD;
+		}
 		src[cur] = 0;
-		for (unsigned i = 1; i < ofs; ++i) {
-			if (src[cur + i] == 0) {
-				return COBS_RET_ERR_BAD_PAYLOAD;
-			}
+		if (cobs_scan(src + cur + 1, ofs - 1) != ofs - 1) {
+			return COBS_RET_ERR_BAD_PAYLOAD;
 		}
 		cur += ofs;
 	}
@@ -127,30 +220,43 @@ cobs_ret_t cobs_encode_inc(cobs_enc_ctx_t* ctx, void const* dec,
 		need_advance = 0;
 	}
 
-	while (dec_len--) {
-		cobs_byte_t const byte = src[src_idx];
-		if (byte) {
-			dst[dst_idx] = byte;
-			if (++dst_idx >= enc_max) {
+	while (src_idx < dec_len) {
+		/* Copy the longest zero-free run that fits in the current block. */
+		unsigned const lim = 0xFF - code;
+		unsigned const avail = dec_len - src_idx;
+		unsigned const run = cobs_scan(src + src_idx, (avail < lim) ? avail : lim);
+		if (run) {
+			if ((dst_idx + run) >= enc_max) {
 				return COBS_RET_ERR_EXHAUSTED;
 			}
-			++code;
+			memcpy(dst + dst_idx, src + src_idx, run);
+			dst_idx += run;
+			src_idx += run;
+			code += run;
 		}
 
-		if ((byte == 0) || (code == 0xFF)) {
+		if (code == 0xFF) {
+			/* Block is full; only start the next one if more data follows. */
 			dst[dst_code_idx] = (cobs_byte_t)code;
 			dst_code_idx			= dst_idx;
 			code							= 1;
-
-			if ((byte == 0) || dec_len) {
+			if (src_idx < dec_len) {
 				if (++dst_idx >= enc_max) {
 					return COBS_RET_ERR_EXHAUSTED;
 				}
 			} else {
-				need_advance = !dec_len;
+				need_advance = 1;
+			}
+		} else if (src_idx < dec_len) {
+			/* The run stopped on a zero byte. */
+			dst[dst_code_idx] = (cobs_byte_t)code;
+			dst_code_idx			= dst_idx;
+			code							= 1;
+			++src_idx;
+			if (++dst_idx >= enc_max) {
+				return COBS_RET_ERR_EXHAUSTED;
 			}
 		}
-		++src_idx;
 	}
 
 	ctx->cur					= dst_idx;
@@ -204,12 +310,12 @@ cobs_ret_t cobs_decode(void const* enc, unsigned enc_len, void* out_dec,
 		if ((dst_idx + code - 1) > dec_max) {
 			return COBS_RET_ERR_EXHAUSTED;
 		}
-		for (unsigned i = 0; i < code - 1; ++i) {
-			if (src[src_idx] == 0) {
-				return COBS_RET_ERR_BAD_PAYLOAD;
-			}
-			dst[dst_idx++] = src[src_idx++];
+		if (cobs_scan(src + src_idx, code - 1) != code - 1) {
+			return COBS_RET_ERR_BAD_PAYLOAD;
 		}
+		memcpy(dst + dst_idx, src + src_idx, code - 1);
+		dst_idx += code - 1;
+		src_idx += code - 1;
 
 		if ((src_idx < (enc_len - 1)) && (code < 0xFF)) {
 			if (dst_idx >= dec_max) {
@@ -15,6 +15,7 @@
 #define NUM_TX_MSGS	 (16)
 #define NUM_RX_MSGS	 (16)
 #define TX_QUEUE_LEN NSMP_QUEUE_LEN(NUM_TX_MSGS, PAYLOAD_LEN)
+#define TX_BUF_LEN	 NSMP_TX_BUF_LEN(PAYLOAD_LEN)
 #define RX_QUEUE_LEN NSMP_QUEUE_LEN(NUM_RX_MSGS, PAYLOAD_LEN)
 
 #define UART_FIFO_LEN (32)
@@ -33,6 +34,13 @@ enum {
 	MY_DEVICES_NB,
 };
 
+/* Ports of the user messages, their first payload byte */
+enum {
+	PORT_READING,
+
+	PORT_NB,
+};
+
 typedef struct __attribute__((packed, aligned(4))) {
 	uint8_t device_type;
 	uint8_t fw_version;
@@ -42,8 +50,10 @@ typedef struct __attribute__((packed, aligned(4))) {
 } device_info_s;
 
 typedef struct __attribute__((packed, aligned(4))) {
-	device_info_s device;
+	uint8_t				port;
 	uint8_t				id;
+	uint8_t				pad[2];
+	device_info_s device;
 	uint8_t				data[32];
 } msg_s;
 
@@ -51,17 +61,29 @@ typedef struct __attribute__((packed, aligned(4))) {
 
 static void uart_init(void);
 static void uart_rx(void);
-static void uart_tx(uint8_t data, size_t len);
+static void uart_tx(const uint8_t* data, size_t len);
 static int	discovery_handler(nsmp_msg_s* msg);
 static int	msg_handler(nsmp_msg_s* msg);
-static int	rx_cb(nsmp_msg_s* msg);
-static int	tx_cb_uart(nsmp_msg_s* msg);
+static int	send_reading(uint8_t dst, const device_info_s* dev);
+static int	tx_cb_uart(nsmp_iface_s* iface, const nsmp_iovec_s* iov,
+											 size_t iovcnt);
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 static uint8_t nsmp_tx_queue[TX_QUEUE_LEN] __attribute__((aligned(4)));
 static uint8_t nsmp_rx_queue[RX_QUEUE_LEN] __attribute__((aligned(4)));
+static uint8_t nsmp_tx_buf[TX_BUF_LEN] __attribute__((aligned(4)));
+
+/* Received messages go straight to their handler, by type or port. NSMP will
+ * reply to all discovery requests automatically. The user can add their own
+ * payload to the response message, thus enabling some form of service
+ * discovery - the response is transmitted after the handler has returned.
+ * Messages with no handler are dropped as they arrive. */
+static const nsmp_dispatch_s handlers = {
+		.type[NSMP_MSG_TYPE_CTL_DISCOVERY] = discovery_handler,
+		.port[PORT_READING]								 = msg_handler,
+};
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -76,13 +98,21 @@ void main(void) {
 	status = nsmp_node_init();
 	/* add error handling code */
 
+	static const nsmp_cfg_s cfg = {
+			.dispatch = &handlers,
+	};
+	status = nsmp_config(&cfg);
+	/* add error handling code */
+
 	/* Add a comms interface to the system - UART in this case */
 	static nsmp_iface_s uart_if = {
 			.tx_q		= nsmp_tx_queue,
 			.rx_q		= nsmp_rx_queue,
+			.tx_buf = nsmp_tx_buf,
 			.tx_len = TX_QUEUE_LEN,
 			.rx_len = RX_QUEUE_LEN,
-			.rx_cb	= rx_cb,
+			.tx_buf_len = TX_BUF_LEN,
+			.mtu		= PAYLOAD_LEN,
 			.tx_cb	= tx_cb_uart,
 	};
 
@@ -96,6 +126,12 @@ void main(void) {
 	while (1) {
 		status = nsmp_update();
 		/* add error handling code */
+
+		/* Nothing was left over by the nsmp_cfg_s::update_bytes budget, wait for
+		 * the next interrupt */
+		if (status == NSMP_OK) {
+			/* __WFI(); */
+		}
 	}
 }
 
@@ -111,47 +147,28 @@ static void uart_rx(void) {
 
 	/* NSMP uses a streaming parser - the number of input bytes is arbitrary. 
 	 * Once a complete message has been received it is added to the receive
-	 * queue and the rx_cb function is called. The parser automatically
+	 * queue and its handler is called. The parser automatically
 	 * resets between messages.
 	*/
 	nsmp_parse(buffer, UART_FIFO_LEN);
 }
 
 /* TODO */
-static void uart_tx(uint8_t data, size_t len) {
+static void uart_tx(const uint8_t* data, size_t len) {
 	for (size_t i = 0; i < len; i++) {}
 }
 
-int rx_cb(nsmp_msg_s* msg) {
-	int status = 0;
-
-	switch (msg->hdr.ctl.type) {
-		case NSMP_MSG_TYPE_USER_MESSAGE: {
-			status = msg_handler(msg);
-			/* error handling... */
-			break;
-		}
-
-		/* NSMP will reply to all discovery requests automatically.
-		 * The user can add their own payload to the response message, * thus enabling 
-		 * some form of service discovery. Note - the response will be transmitted after 
-		 * the message handler callback as returned. 
-		 */
-		case NSMP_MSG_TYPE_CTL_DISCOVERY: {
-			status = discovery_handler(msg);
-			/* error handling... */
-			break;
-		}
+/* NSMP hands over a batch of encoded frames as a list of chunks. A DMA
+ * driver would queue the chunks, set .tx_async and call nsmp_tx_done() from
+ * its transfer complete interrupt. */
+static int tx_cb_uart(nsmp_iface_s* iface, const nsmp_iovec_s* iov,
+											size_t iovcnt) {
+	size_t total = 0;
+	for (size_t i = 0; i < iovcnt; i++) {
+		uart_tx(iov[i].base, iov[i].len);
+		total += iov[i].len;
 	}
-
-	/* Return 0 to indicate that the message has been handled */
-
-	return 0;
-}
-
-static tx_cb_uart(nsmp_msg_s* msg) {
-	uart_tx((uint8_t*)msg, nsmp_message_len(msg));
-	return 0;
+	return (int)total;
 }
 
 static int discovery_handler(nsmp_msg_s* msg) {
@@ -172,6 +189,22 @@ static int discovery_handler(nsmp_msg_s* msg) {
 	}
 }
 
+static int send_reading(uint8_t dst, const device_info_s* dev) {
+	/* Serialise the message straight into the transmit queue - no copies */
+	msg_s* m = (msg_s*)nsmp_send_reserve(dst, NSMP_MSG_TYPE_USER_MESSAGE,
+																			 sizeof(msg_s));
+	if (!m) {
+		return NSMP_ERR_NO_MEM; /* Queue full, try again later */
+	}
+
+	m->port		= PORT_READING;
+	m->id			= 0;
+	m->device = *dev;
+	/* fill m->data... */
+
+	return nsmp_send_commit(sizeof(msg_s));
+}
+
 static int msg_handler(nsmp_msg_s* msg) {
 	int status = 0;
 
@@ -9,22 +9,195 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "cobs.h"
+#include "nsmp_crc.h"
+#include "nsmp_lz.h"
+#include "nsmp_queue.h"
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 #define NSMP_MAX_PEERS				(32)
+#define NSMP_MAX_NODES				(4)
 #define NSMP_PROTOCOL_VERSION (0x01)
 
+/* Routing addresses: <0> broker bit, <1,2> node, <3,7> peer */
+#define NSMP_ADDR(broker, node, peer)                                          \
+	((uint8_t)(((broker) & 0x01) | (((node) & 0x03) << 1) |                     \
+						 (((peer) & 0x1F) << 3)))
+#define NSMP_ADDR_BROKER(a) ((a) & 0x01)
+#define NSMP_ADDR_NODE(a)		(((a) >> 1) & 0x03)
+#define NSMP_ADDR_PEER(a)		(((a) >> 3) & 0x1F)
+#define NSMP_ADDR_NB				(256)
+
+/* Destination of messages published to a topic, see nsmp_subscribe(). Taken
+ * from the broker addresses, next to the one for the end of a link */
+#define NSMP_ADDR_TOPIC (NSMP_ADDR(1, 3, 30))
+
+/* Destination of link messages, consumed by the device at the other end of
+ * the link */
+#define NSMP_ADDR_LINK (0xFF)
+
+/* Interfaces a node may register, at most 32 */
+#ifndef NSMP_MAX_IFACES
+#define NSMP_MAX_IFACES (8)
+#endif
+#if (NSMP_MAX_IFACES > 32)
+#error "NSMP_MAX_IFACES must not exceed 32"
+#endif
+
+/* Threads a node may spread its interfaces over, see nsmp_worker_s */
+#ifndef NSMP_MAX_WORKERS
+#define NSMP_MAX_WORKERS (4)
+#endif
+
+/* Peers that reliable delivery keeps sequence numbers for */
+#ifndef NSMP_ARQ_PEERS
+#define NSMP_ARQ_PEERS (8)
+#endif
+
+/* Default retransmission timeout, see nsmp_cfg_s::arq_rto_ms */
+#ifndef NSMP_ARQ_RTO_MS
+#define NSMP_ARQ_RTO_MS (100)
+#endif
+
+/* A quiet peer's reliable delivery state may go to another after this long */
+#ifndef NSMP_ARQ_IDLE_MS
+#define NSMP_ARQ_IDLE_MS (1000)
+#endif
+
+/* Messages from other devices reassembled at once, see nsmp_cfg_s::frag_cb */
+#ifndef NSMP_FRAG_SLOTS
+#define NSMP_FRAG_SLOTS (2)
+#endif
+
+/* Default reassembly timeout, see nsmp_cfg_s::frag_ms */
+#ifndef NSMP_FRAG_MS
+#define NSMP_FRAG_MS (1000)
+#endif
+
+/* Ports of user messages that may have a handler, see nsmp_dispatch_s */
+#ifndef NSMP_PORTS
+#define NSMP_PORTS (16)
+#endif
+
+/* Topics a node keeps subscribers for, see nsmp_subscribe() */
+#ifndef NSMP_TOPICS
+#define NSMP_TOPICS (32)
+#endif
+#if (NSMP_TOPICS > 256)
+#error "NSMP_TOPICS must not exceed 256"
+#endif
+
+/* Longest discovery payload, see nsmp_set_discovery_payload() */
+#ifndef NSMP_DISCOVERY_LEN
+#define NSMP_DISCOVERY_LEN (16)
+#endif
+#if (NSMP_DISCOVERY_LEN > 254)
+#error "NSMP_DISCOVERY_LEN must not exceed 254"
+#endif
+
+/* Devices a node keeps the discovery payload of, see nsmp_discover() */
+#ifndef NSMP_DIR_ENTRIES
+#define NSMP_DIR_ENTRIES (NSMP_MAX_PEERS)
+#endif
+
+/* Discovery backoff, see nsmp_discover(). The first request waits
+ * NSMP_DISC_WAIT_MS plus a random part of NSMP_DISC_WINDOW_MS, the window
+ * doubling up to NSMP_DISC_WINDOW_MAX_MS each time the request goes
+ * unanswered for NSMP_DISC_TIMEOUT_MS or another device's is heard first,
+ * and discovery gives up after NSMP_DISC_TRIES requests. */
+#ifndef NSMP_DISC_WAIT_MS
+#define NSMP_DISC_WAIT_MS (10)
+#endif
+#ifndef NSMP_DISC_WINDOW_MS
+#define NSMP_DISC_WINDOW_MS (40)
+#endif
+#ifndef NSMP_DISC_WINDOW_MAX_MS
+#define NSMP_DISC_WINDOW_MAX_MS (1280)
+#endif
+#ifndef NSMP_DISC_TIMEOUT_MS
+#define NSMP_DISC_TIMEOUT_MS (100)
+#endif
+#ifndef NSMP_DISC_TRIES
+#define NSMP_DISC_TRIES (5)
+#endif
+
+/* Buckets of the latency histograms of nsmp_stats_s: the first counts
+ * latencies of 0 ms, bucket n those of 2^(n-1) up to 2^n ms, and the last
+ * everything longer. Devices reading each other's statistics must agree. */
+#ifndef NSMP_STATS_BUCKETS
+#define NSMP_STATS_BUCKETS (12)
+#endif
+#if (NSMP_STATS_BUCKETS < 2) || (NSMP_STATS_BUCKETS > 32)
+#error "NSMP_STATS_BUCKETS must be between 2 and 32"
+#endif
+
+/* Frame events kept by the trace ring, see nsmp_trace_read() - a power of
+ * two, at most 32768. 0 leaves tracing out altogether. */
+#ifndef NSMP_TRACE
+#define NSMP_TRACE (0)
+#endif
+#if (NSMP_TRACE & (NSMP_TRACE - 1)) || (NSMP_TRACE > 32768)
+#error "NSMP_TRACE must be 0 or a power of two up to 32768"
+#endif
+
+/* How long a sender waits for credit before asking for it, see
+ * NSMP_MSG_TYPE_CTL_SLOWDOWN */
+#ifndef NSMP_CREDIT_MS
+#define NSMP_CREDIT_MS (100)
+#endif
+
 /* Macro to calculate NSMP queue length based on:
- 	 x - number of messages in the queue
+ 	 m - number of messages in the queue
 	 p - the maximum payload length (user-defined)
 
-	 The queue length is calculated as follows:
-	 number of messages * (nsmp header + user payload) + (2 * number of messages)
-
-	 The last term is used to store the size of the payload in each message.
-	 
+	 The queue is a ring of variable-length records, each message takes
+	 its header, its own payload, the payload CRC (if enabled) and a 4-byte
+	 record prefix (rounded up to a multiple of 4). A queue of this length
+	 always fits m messages of p bytes, and correspondingly more messages when
+	 they are smaller.
 */
-#define NSMP_QUEUE_LEN(m, p) ((m) * (p + sizeof(nsmp_hdr_s)) + (2 * m))
+#define NSMP_QUEUE_LEN(m, p)                                                   \
+	NSMP_QUEUE_SIZE((m),                                                         \
+									NSMP_HDR_LEN + NSMP_SEQ_LEN + (p) + NSMP_PAYLOAD_CRC_LEN)
+
+/* No limit on how long nsmp_send_wait() and nsmp_rcv_wait() block */
+#define NSMP_WAIT_FOREVER (UINT32_MAX)
+
+/* Default part of tx_q kept for control and urgent messages, one message of
+ * up to p bytes, see nsmp_iface_s::tx_urgent_len */
+#define NSMP_URGENT_LEN(p) NSMP_QUEUE_LEN(1, (p))
+
+/* Length of the decoded frame header on the wire: nsmp_hdr_s + 16-bit length */
+#define NSMP_HDR_LEN (sizeof(nsmp_hdr_s) + sizeof(uint16_t))
+
+/* Sequence number and inner control byte added to reliable messages */
+#define NSMP_SEQ_LEN (2)
+
+/* Payload of NSMP_MSG_TYPE_CTL_SLOWDOWN, a 32-bit credit count */
+#define NSMP_CREDIT_LEN (4)
+
+/* Largest reliable delivery window, in messages per peer */
+#define NSMP_ARQ_WINDOW_MAX (32)
+
+/* Largest encoded frame for a payload of p bytes, including the delimiter */
+#define NSMP_FRAME_MAX(p)                                                      \
+	COBS_ENCODE_MAX(NSMP_HDR_LEN + NSMP_SEQ_LEN + (p) + NSMP_PAYLOAD_CRC_LEN)
+
+/* Length of an interface transmit buffer (tx_buf) that holds two batches of
+ * at least one frame each, so one can be encoded while the other is sent. */
+#define NSMP_TX_BUF_LEN(p) (2 * NSMP_FRAME_MAX(p))
+
+/* Length of nsmp_cfg_s::lz_buf for compressing and expanding messages of up
+ * to p bytes */
+#define NSMP_LZ_BUF_LEN(p) (NSMP_LZ_TABLE_LEN + (2 * (p)))
+
+/* Length of nsmp_worker_s::relay_q that holds m frames of up to p bytes of
+ * payload from each other worker. A relayed frame is kept as it arrived,
+ * behind its decoded header and the index of the interface it goes out on. */
+#define NSMP_RELAY_Q_LEN(m, p)                                                 \
+	(NSMP_MAX_WORKERS *                                                          \
+	 NSMP_QUEUE_SIZE((m), NSMP_HDR_LEN + NSMP_FRAME_MAX(p) + 2))
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -44,6 +217,27 @@ typedef enum {
 	NSMP_MSG_TYPE_CTL_PLS_RETRY,
 	NSMP_MSG_TYPE_CTL_SLOWDOWN,
 
+	/* Link */
+	NSMP_MSG_TYPE_CTL_CAPS,		/* Capabilities of the sending device */
+	NSMP_MSG_TYPE_CTL_BUNDLE, /* Several messages packed into one frame */
+
+	/* Reliable delivery */
+	NSMP_MSG_TYPE_CTL_SEQ,		 /* Message with a sequence number, see nsmp_cfg_s */
+	NSMP_MSG_TYPE_CTL_SEQ_ACK, /* The same, carrying an acknowledgement */
+
+	/* Compression and fragmentation */
+	NSMP_MSG_TYPE_CTL_LZ,		/* Compressed message, see NSMP_MSG_COMPRESS */
+	NSMP_MSG_TYPE_CTL_FRAG, /* Part of a message longer than the mtu */
+
+	/* Publish/subscribe */
+	NSMP_MSG_TYPE_CTL_SUBSCRIBE, /* Topic to publish to the sender, or not */
+
+	/* Discovery */
+	NSMP_MSG_TYPE_CTL_DIRECTORY, /* Discovery payloads a node keeps, or changes */
+
+	/* Monitoring */
+	NSMP_MSG_TYPE_CTL_STATS, /* Statistics of an interface, see nsmp_stats_query() */
+
 	NSMP_MSG_TYPE_NB,
 } nsmp_msg_type_e;
 
@@ -52,7 +246,13 @@ enum {
 	NSMP_MSG_REQUEST	= 1,
 };
 
-typedef struct {
+/* nsmp_msg_s::flags */
+enum {
+	NSMP_MSG_URGENT		= (1u << 0), /* Sent ahead of queued messages */
+	NSMP_MSG_COMPRESS = (1u << 1), /* Compressed if that makes it shorter */
+};
+
+typedef struct __attribute__((packed)) {
 	uint8_t					data	 : 1; /* 0 = no data, 1 = data */
 	uint8_t					reqres : 1; /* 0 = response, 1 = request */
 	uint8_t					retry	 : 1; /* 0 = first, 1 = retransmit */
@@ -70,25 +270,323 @@ typedef struct __attribute__((packed)) {
 	nsmp_hdr_s hdr;
 	uint16_t	 len; /* Length of the data payload */
 	uint8_t*	 data;
+	uint8_t		 flags; /* NSMP_MSG_*, cleared by nsmp_add_data() */
 } nsmp_msg_s;
 
+/* Handles a received message, like nsmp_iface_s::rx_cb */
+typedef int (*nsmp_handler_f)(nsmp_msg_s* msg);
+
+/**
+ * @brief Handlers for the messages received for this device, see
+ * nsmp_cfg_s::dispatch. Meant to be a const table filled in at compile time:
+ *
+ *   static const nsmp_dispatch_s handlers = {
+ *       .type[NSMP_MSG_TYPE_CTL_DISCOVERY] = on_discovery,
+ *       .port[PORT_SENSOR]                  = on_reading,
+ *   };
+ *
+ * The first byte of a user message's payload is its port. A user message
+ * goes to the handler of its port, or to type[NSMP_MSG_TYPE_USER_MESSAGE]
+ * if that port has none (or the message is empty), and is passed on whole.
+ */
+typedef struct {
+	nsmp_handler_f type[NSMP_MSG_TYPE_CTL_ACK]; /* Types that are delivered */
+	nsmp_handler_f port[NSMP_PORTS];
+} nsmp_dispatch_s;
+
+/* Optional protocol features, exchanged with the device at the other end of a
+ * link in NSMP_MSG_TYPE_CTL_CAPS messages */
+enum {
+	NSMP_CAP_BUNDLE = (1 << 0), /* Receives NSMP_MSG_TYPE_CTL_BUNDLE frames */
+	NSMP_CAP_ARQ		= (1 << 1), /* Receives and acknowledges NSMP_MSG_TYPE_CTL_SEQ */
+	NSMP_CAP_CREDIT = (1 << 2), /* Flow control with NSMP_MSG_TYPE_CTL_SLOWDOWN */
+	NSMP_CAP_ACK		= (1 << 3), /* Receives NSMP_MSG_TYPE_CTL_SEQ_ACK */
+	NSMP_CAP_LZ			= (1 << 4), /* Expands NSMP_MSG_TYPE_CTL_LZ */
+	NSMP_CAP_FRAG		= (1 << 5), /* Reassembles NSMP_MSG_TYPE_CTL_FRAG */
+};
+
 enum {
 	NSMP_ERR_BAD_ARG = -1,
 	NSMP_ERR_BAD_CRC = -2,
 	NSMP_ERR_BAD_LEN = -3,
 	NSMP_ERR_BAD_VER = -4,
+	NSMP_ERR_NO_MEM	 = -5,
+	NSMP_ERR_NO_IF	 = -6,
+	NSMP_ERR_AGAIN	 = -7, /* Nothing received yet, or the wait timed out */
+	NSMP_ERR_IO			 = -8, /* A system call failed, see errno */
+	NSMP_ERR_BAD_ENC = -9, /* Frame cut short or badly encoded */
 
 	NSMP_OK = 0,
 };
 
+/**
+ * @brief One chunk of data handed to an interface's transmit callback.
+ */
+typedef struct {
+	const uint8_t* base;
+	size_t				 len;
+} nsmp_iovec_s;
+
+/* Events of the nsmp_os_s hooks */
+typedef enum {
+	NSMP_EV_READY, /* nsmp_update() has work to do */
+	NSMP_EV_TX,		 /* Space was freed in a tx_q */
+	NSMP_EV_RX,		 /* A message was queued for nsmp_rcv() */
+	NSMP_EV_NB,
+} nsmp_ev_e;
+
+/**
+ * @brief Operating system hooks for blocking calls and event loops, see
+ * nsmp_os.h for ready-made bindings.
+ * A signal given while nobody waits is kept, so the next wait for the same
+ * event returns at once. Waits may also return early, callers check again.
+ */
+typedef struct {
+	void* ctx; /* Passed to both hooks */
+
+	/* Block until ev is signalled, for up to ms (or NSMP_WAIT_FOREVER).
+	 * Returns 0 if it was signalled, non-zero on timeout. */
+	int (*wait)(void* ctx, nsmp_ev_e ev, uint32_t ms);
+
+	/* Wake whoever waits for ev. NSMP_EV_READY is signalled when an interface
+	 * gets work while none had any, from nsmp_parse_if() and nsmp_tx_done()
+	 * as well - possibly an interrupt - so an event loop can run nsmp_update()
+	 * only when it is needed. Timers are not signalled, the loop still runs
+	 * it every few ms. The others are signalled by nsmp_update(). */
+	void (*signal)(void* ctx, nsmp_ev_e ev);
+} nsmp_os_s;
+
 typedef struct {
 	uint8_t uuid[8];
 
+	/* Address of this device, see NSMP_ADDR(). Addresses are not assigned by
+	 * registration, so each device on a network needs its own. */
+	uint8_t addr;
+
 	/* User function get system time */
 	uint32_t (*get_time_ms)(void);
 
+	/* Reliable delivery of user messages, to peers whose link advertised
+	 * NSMP_CAP_ARQ. Up to arq_window messages (at most NSMP_ARQ_WINDOW_MAX)
+	 * per peer may be waiting for an acknowledgement, they are kept in tx_q
+	 * and sent again if not acknowledged within arq_rto_ms (default
+	 * NSMP_ARQ_RTO_MS, counted in nsmp_update() calls when there is no
+	 * get_time_ms). An arq_window of 0 disables. When enabled
+	 * nsmp_update() must run in the same context as nsmp_send().
+	 *
+	 * State is kept for NSMP_ARQ_PEERS peers, either way. A peer with nothing
+	 * in flight for NSMP_ARQ_IDLE_MS gives up its slot to the next that needs
+	 * one, and one that unregisters gives it up at once. Sequenced messages
+	 * from a peer that finds none are dropped until there is one.
+	 *
+	 * Received messages are acknowledged up to arq_ack_ms later (counted like
+	 * arq_rto_ms, and well below it), so that the acknowledgement can ride on
+	 * a message going back to the same peer - if its link advertised
+	 * NSMP_CAP_ACK - or cover several messages. Half a window of messages, or
+	 * a gap, is acknowledged at once. 0 acknowledges every message straight
+	 * away, in a frame of its own. */
+	uint8_t	 arq_window;
+	uint16_t arq_rto_ms;
+	uint16_t arq_ack_ms;
+
+	/* A node relays frames for another interface without decoding them, they
+	 * are kept in rx_q as they arrived and copied to the other interface's
+	 * tx_buf, leaving the payload CRC to the destination. Set to decode them
+	 * into rx_q and queue them again instead. */
+	uint8_t store_forward;
+
+	/* Work done by one nsmp_update() call, 0 for no limit: bytes received and
+	 * transmitted over all interfaces, and ms (needs get_time_ms). Interfaces
+	 * get turns in proportion to nsmp_iface_s::weight, the next call carries
+	 * on with those left. */
+	uint32_t update_bytes;
+	uint16_t update_ms;
+
+	/* Lets nsmp_send_wait() and nsmp_rcv_wait() block, without a wait hook
+	 * they return at once. nsmp_update() must then run in a context of its
+	 * own, so reliable delivery and bundling are not available. */
+	nsmp_os_s os;
+
+	/* Messages for this device received on an interface without an rx_cb are
+	 * kept here for nsmp_rcv(), see NSMP_QUEUE_LEN(). While it is full they
+	 * wait in rx_q, so flow control holds the sender back. Without it they
+	 * are dropped. */
+	uint8_t* rcv_q;
+	size_t	 rcv_len;
+
+	/* Working memory for compression, see NSMP_LZ_BUF_LEN() - aligned to 4
+	 * bytes. A message sent with NSMP_MSG_COMPRESS to a link that advertised
+	 * NSMP_CAP_LZ, and not bundled, is compressed on its own if it is at least
+	 * NSMP_LZ_MIN bytes long and comes out shorter. NSMP_CAP_LZ is advertised
+	 * while this is set, and received messages are expanded here before they
+	 * are delivered. Routers pass compressed messages on as they are, so a
+	 * destination further away must have lz_buf set as well. */
+	uint8_t* lz_buf;
+	size_t	 lz_len;
+
+	/* Reassembly of messages longer than the mtu of a link, which nsmp_send()
+	 * splits into fragments. Fragments are passed to frag_cb as they arrive,
+	 * in order: msg carries the message's header and this part of its
+	 * payload, ofs where the part goes in a message of total bytes - the
+	 * message is not delivered otherwise. Without frag_cb they are put
+	 * together in frag_buf, which holds NSMP_FRAG_SLOTS messages of up to
+	 * frag_len / NSMP_FRAG_SLOTS bytes each, and the complete message is
+	 * delivered like any other. A message that loses a fragment is dropped,
+	 * and one whose next fragment does not come within frag_ms (default
+	 * NSMP_FRAG_MS, counted like arq_rto_ms) gives up its slot to the next
+	 * message that needs one. NSMP_CAP_FRAG is advertised while either is
+	 * set, and only sent to a link whose other end advertised it; as with
+	 * lz_buf, a destination further away must reassemble as well. */
+	void (*frag_cb)(const nsmp_msg_s* msg, uint16_t ofs, uint16_t total);
+	uint8_t* frag_buf;
+	size_t	 frag_len;
+	uint16_t frag_ms;
+
+	/* Handlers for the messages received for this device, in place of the
+	 * interfaces' rx_cb and rcv_q. Messages none of them takes are dropped,
+	 * user messages in a frame of their own by the parser - they use no space
+	 * in rx_q and no work in nsmp_update(). */
+	const nsmp_dispatch_s* dispatch;
+
 } nsmp_cfg_s;
 
+/**
+ * @brief Streaming frame parser state, one per interface.
+ * Private - initialised when the interface is registered.
+ */
+typedef struct {
+	uint8_t	 state;							/* Decoder state */
+	uint8_t	 code;							/* Code byte of the current COBS block */
+	uint8_t	 left;							/* Bytes left in the current COBS block */
+	uint8_t	 hlen;							/* Header bytes received */
+	uint8_t	 hdr[NSMP_HDR_LEN]; /* Header bytes, until a slot is reserved */
+	uint32_t need;							/* Decoded frame length from the header */
+	uint32_t pos;								/* Decoded bytes written to the slot */
+	uint8_t* slot;							/* Reserved rx_q slot, or ctl */
+	uint8_t	 ctl[NSMP_HDR_LEN + NSMP_CREDIT_LEN + NSMP_PAYLOAD_CRC_LEN]; /* Credit */
+	uint8_t	 relay;							/* Frame is kept encoded, to be relayed */
+	uint8_t	 rlen;							/* Encoded header bytes received */
+	uint8_t	 raw[2 * NSMP_HDR_LEN + 1]; /* Encoded header bytes */
+	uint32_t wpos;							/* Encoded bytes written to the slot */
+	uint32_t wmax;							/* Length of the slot of a relayed frame */
+} nsmp_parser_s;
+
+/**
+ * @brief Transmit buffer state, one per interface.
+ * Private - tx_buf is used as two halves, a batch of frames is encoded into
+ * one half while the other may still be owned by the transport.
+ */
+typedef struct {
+	uint8_t					 cur;			/* Half being filled or submitted */
+	uint8_t					 closed;	/* Current half is being submitted */
+	uint8_t					 oldest;	/* Half released by the next nsmp_tx_done() */
+	volatile uint8_t busy[2]; /* Half owned by an asynchronous transport */
+	size_t					 half;		/* Length of each half */
+	size_t					 fill;		/* Encoded bytes in the current half */
+	size_t					 sent;		/* Bytes of the current half accepted */
+	uint32_t				 rd;			/* tx_q position of the next message to encode */
+	uint16_t				 resend;	/* Messages in tx_q marked to be sent again */
+} nsmp_txbuf_s;
+
+/**
+ * @brief Bundle being filled, one per interface.
+ * Private - small messages for the same destination are packed into one
+ * reserved tx_q record until it is full or its deadline passes.
+ */
+typedef struct {
+	uint8_t* frame; /* Reserved tx_q record, NULL when no bundle is open */
+	uint16_t fill;	/* Bytes of packed messages */
+	uint16_t cnt;		/* Number of packed messages */
+	uint8_t	 dst;		/* Destination of every packed message */
+	uint8_t	 src;		/* Source of every packed message */
+	uint8_t	 ofs;		/* Space in front of the packed messages, for a sequence number */
+	uint32_t t0;		/* Time the bundle was opened, in ms */
+} nsmp_bundle_s;
+
+/**
+ * @brief Credit based flow control state, one per interface.
+ * Private - counts are bytes of rx_q space and wrap around. The fields marked
+ * (parser) are only written by nsmp_parse_if(), the others only by
+ * nsmp_update().
+ */
+typedef struct {
+	uint32_t					tx;					/* Credit used by the frames sent */
+	volatile uint32_t limit;			/* Credit granted by the other end (parser) */
+	volatile uint32_t rx;					/* Credit used by the frames received (parser) */
+	uint32_t					adv;				/* Last limit granted to the other end */
+	uint32_t					t_req;			/* Time credit was last asked for */
+	volatile uint8_t	granted;		/* Credit has been granted (parser) */
+	volatile uint8_t	req;				/* Credit requests received (parser) */
+	volatile uint8_t	drops;			/* Frames dropped (parser) */
+	volatile uint8_t	sync;				/* Grants asking for our count (parser) */
+	uint8_t						req_done;		/* Credit requests answered */
+	uint8_t						drops_done; /* Dropped frames reported */
+	uint8_t						sync_done;	/* Counts sent when asked for */
+	uint8_t						blocked;		/* The last frame offered had no credit */
+} nsmp_credit_s;
+
+/**
+ * @brief Statistics of an interface, see nsmp_stats_get().
+ * Counters wrap around, a monitor takes the difference between two
+ * snapshots. Each field is written by one context only - those marked
+ * (parser) by nsmp_parse_if(), tx_q_max by whoever queues a message and the
+ * others by nsmp_update() - with relaxed atomic stores, so reading them takes
+ * no lock and never holds up traffic.
+ *
+ * The histograms count latencies in ms (nsmp_update() calls without
+ * nsmp_cfg_s::get_time_ms) in the buckets described with NSMP_STATS_BUCKETS.
+ * They are sampled: a message is timed if none other in the same queue is.
+ */
+typedef struct {
+	uint32_t rx_frames;		/* Frames received whole (parser) */
+	uint32_t rx_bytes;		/* Bytes given to nsmp_parse_if() (parser) */
+	uint32_t err_crc;			/* Frames with a bad header or payload CRC (parser) */
+	uint32_t err_cobs;		/* Frames cut short or badly encoded (parser) */
+	uint32_t err_len;			/* Frames longer than the mtu or their header (parser) */
+	uint32_t rx_drops;		/* Frames rx_q had no room for (parser) */
+	uint32_t rx_q_max;		/* Most bytes of rx_q in use (parser) */
+	uint32_t tx_frames;		/* Frames encoded for tx_cb */
+	uint32_t tx_bytes;		/* Bytes tx_cb accepted */
+	uint32_t tx_drops;		/* Bytes of batches tx_cb discarded */
+	uint32_t retransmits; /* Messages sent again by reliable delivery */
+	uint32_t tx_q_max;		/* Most bytes of tx_q in use, both lanes together */
+	uint32_t rx_delay[NSMP_STATS_BUCKETS]; /* rx_q until delivered or relayed */
+	uint32_t tx_delay[NSMP_STATS_BUCKETS]; /* tx_q until encoded into tx_buf */
+} nsmp_stats_s;
+
+/**
+ * @brief A message being timed for the latency histograms of nsmp_stats_s.
+ * Private - set by the context that queues the message, before it does, and
+ * cleared by the one that takes it from the queue.
+ */
+typedef struct {
+	volatile uint8_t set; /* A message is being timed */
+	uint32_t				 pos; /* Queue position of its record */
+	uint32_t				 t0;	/* Time it was queued */
+} nsmp_stamp_s;
+
+/* nsmp_trace_rec_s::dir */
+enum {
+	NSMP_TRACE_RX = 1,
+	NSMP_TRACE_TX = 2,
+};
+
+/**
+ * @brief A frame event kept by the trace ring, see NSMP_TRACE. 16 bytes in
+ * the byte order of the device, copied out with nsmp_trace_read() or dumped
+ * from memory as they are, and turned into a capture by tools/nsmp_pcap.c.
+ */
+typedef struct {
+	uint32_t	 ms;		 /* nsmp_now() at the event */
+	uint16_t	 seq;		 /* Number of the event, counting from 0 and wrapping */
+	uint16_t	 len;		 /* Payload length from the header, or batch bytes */
+	nsmp_hdr_s hdr;		 /* As on the wire, zero if it was not received whole */
+	uint8_t		 iface;	 /* Index of the interface */
+	uint8_t		 dir;		 /* NSMP_TRACE_RX or NSMP_TRACE_TX, 0 if never written */
+	int8_t		 result; /* NSMP_OK, or the NSMP_ERR_* it was dropped with */
+	uint8_t		 rsvd;
+} nsmp_trace_rec_s;
+
 /**
  * @brief A structure to hold the configuration of an NSMP interface.
  * This structure must be statically allocated by the user, and
@@ -100,22 +598,123 @@ typedef struct {
 typedef struct nsmp_iface_s {
 	// private:
 	struct nsmp_iface_s* next;
+	uint8_t							 idx;
+	nsmp_parser_s				 parser;
+	nsmp_queue_s				 rxq;
+	nsmp_queue_s				 txq; /* Bulk lane of tx_q */
+	nsmp_queue_s				 txu; /* Urgent lane of tx_q, size 0 when there is none */
+	nsmp_txbuf_s				 txb;
+	nsmp_bundle_s				 bnd;
+	nsmp_credit_s				 cr;
+	uint16_t						 peer_caps; /* NSMP_CAP_* of the device at the other end */
+	uint16_t						 peer_mtu;	/* Largest payload the other end accepts */
+	uint8_t							 ctl_pend;	/* Control messages waiting for tx_q space */
+	uint32_t reach[NSMP_ADDR_NB / 32]; /* Addresses routed over this interface */
+	int32_t							 deficit;		/* Bytes of work owed by nsmp_update() */
+	struct nsmp_worker_s* worker;		/* Serving it, NULL for nsmp_update() */
+	uint32_t							 fan;				/* Interfaces a published frame has yet to go to */
+	uint16_t							 dir_from;	/* Directory version to answer from */
+	nsmp_stats_s					 stats;
+	nsmp_stamp_s					 stamp[3]; /* Timed message of rxq, txu and txq */
+	uint8_t								 stats_to;	 /* Device asking for statistics */
+	uint8_t								 stats_idx;	 /* Interface it asked about */
+	uint8_t								 stats_next; /* Word of nsmp_stats_s to send next */
 
 	// public:
 	uint8_t	 uuid[8];
 	uint8_t* tx_q;
 	uint8_t* rx_q;
+	uint8_t* tx_buf; /* Encoded frames, see NSMP_TX_BUF_LEN() - may be DMA memory */
 	size_t	 tx_len;
 	size_t	 rx_len;
+	size_t	 tx_buf_len;
+	uint16_t mtu;			 /* Largest payload accepted, as passed to NSMP_QUEUE_LEN() */
+	uint8_t	 tx_async; /* Transport reads tx_buf after tx_cb returns */
+	uint8_t	 weight;	 /* Share of nsmp_update() under load, 0 counts as 1 */
+
+	/* Bytes at the start of tx_q kept for control messages and messages sent
+	 * with NSMP_MSG_URGENT, which are always transmitted before the rest of
+	 * tx_q. 0 picks NSMP_URGENT_LEN(mtu) if tx_q has room for another message
+	 * of mtu bytes besides, and otherwise a single lane for everything. */
+	size_t tx_urgent_len;
+
+	/* Pack messages of up to 255 bytes for the same destination into frames
+	 * with up to bundle_len bytes of payload (at most mtu), 0 disables. Only
+	 * used once the other end has advertised NSMP_CAP_BUNDLE, and never above
+	 * the mtu it advertised. A bundle is sent
+	 * when it is full, or by nsmp_update() once it is bundle_ms old (needs
+	 * nsmp_cfg_s::get_time_ms, otherwise on every update). Bundles are
+	 * closed by nsmp_update(), so it must run in the same context as
+	 * nsmp_send() when bundling is enabled. */
+	uint16_t bundle_len;
+	uint16_t bundle_ms;
+
 	int (*rx_cb)(nsmp_msg_s* msg);
-	int (*tx_cb)(nsmp_msg_s* msg);
+
+	/* Transmit a batch of encoded frames, given as a list of chunks to be
+	 * written in order (e.g. with one writev() call). A batch is currently
+	 * one contiguous chunk of tx_buf, but a transport must write all iovcnt
+	 * chunks. Returns the number of bytes accepted, which may be fewer than
+	 * offered - the rest is offered again on the next update - or a negative
+	 * value to discard the batch.
+	 * If tx_async is set the chunks must stay untouched until the transport
+	 * calls nsmp_tx_done(), for example from a DMA complete interrupt. */
+	int (*tx_cb)(struct nsmp_iface_s* iface, const nsmp_iovec_s* iov,
+							 size_t iovcnt);
 } nsmp_iface_s;
 
+/**
+ * @brief Interfaces waiting to be served, by index.
+ * Private - one set for nsmp_update() and one per worker.
+ */
+typedef struct {
+	uint32_t ready; /* With work to do, set from any context */
+	uint32_t held;	/* Left with work by the last update, not signalled */
+	uint8_t	 turn;	/* Index of the interface served first next time */
+} nsmp_sched_s;
+
+/**
+ * @brief A thread serving some of a node's interfaces, see nsmp_worker_add().
+ * This structure must be statically allocated by the user.
+ *
+ * Each worker parses what its interfaces receive and transmits on them, so
+ * a broker with many links uses as many cores. A frame relayed to an
+ * interface of another worker is handed over in relay_q, which is split into
+ * one lock-free queue per sending worker, so the frames of each flow stay in
+ * order. Routes are shared by all workers and rarely change, lookups do not
+ * take a lock.
+ */
+typedef struct nsmp_worker_s {
+	// private:
+	uint8_t			 idx;
+	nsmp_sched_s sched;
+	nsmp_queue_s relq[NSMP_MAX_WORKERS]; /* Frames from each worker */
+	uint32_t		 stalled; /* Workers that found their queue full, by index */
+
+	// public:
+	uint8_t* relay_q; /* See NSMP_RELAY_Q_LEN() */
+	size_t	 relay_len;
+
+	/* Wakes the thread when its interfaces have work, NSMP_EV_READY only.
+	 * Signalled instead of nsmp_cfg_s::os for them. */
+	nsmp_os_s os;
+} nsmp_worker_s;
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/**
+ * @brief Set the device configuration, after nsmp_peer_init() or
+ * nsmp_node_init().
+ *
+ * @param cfg Pointer to configuration, copied.
+ * @return int NSMP_OK, or NSMP_ERR_BAD_ARG if cfg is NULL or its rcv_q is
+ * too small.
+ */
+int nsmp_config(const nsmp_cfg_s* cfg);
+
 /**
  * @brief Initialise the device as an NSMP peer.
  * 
@@ -140,27 +739,224 @@ int nsmp_node_init(void);
  */
 int nsmp_node_newif(nsmp_iface_s* ifcfg);
 
+/**
+ * @brief Register the interface used by an NSMP peer.
+ *
+ * @param ifcfg Pointer to interface configuration structure, must be
+ * statically allocated.
+ *
+ * @return int NSMP_OK, or NSMP_ERR_BAD_ARG if the queues cannot hold a
+ * single message of ifcfg->mtu bytes.
+ */
+int nsmp_peer_newif(nsmp_iface_s* ifcfg);
+
 /**
  * @brief Parse an incoming byte stream to extract NSMP messages.
+ * The stream is fed to the first registered interface, see nsmp_parse_if().
  * 
  * @param inbuf Pointer to byte stream.
  * @param inlen Number of bytes to parse.
- * @return int #TODO
+ * @return int Number of complete messages added to the receive queue, or a
+ * negative error code.
  */
 int nsmp_parse(uint8_t* inbuf, size_t inlen);
 
+/**
+ * @brief Parse an incoming byte stream received on a specific interface.
+ * The parser is resumable - frames may be split across any number of calls.
+ * Frames are decoded straight into the interface's receive queue, frames
+ * with a bad header CRC or a length above iface->mtu are dropped as soon as
+ * their header has been received.
+ *
+ * @param iface Interface the bytes were received on.
+ * @param inbuf Pointer to byte stream.
+ * @param inlen Number of bytes to parse.
+ * @return int Number of complete messages added to the receive queue, or a
+ * negative error code.
+ */
+int nsmp_parse_if(nsmp_iface_s* iface, const uint8_t* inbuf, size_t inlen);
+
+/**
+ * @brief Process queued messages on the interfaces that have work to do.
+ * Received messages are passed to the interface's rx_cb and then released
+ * from the receive queue. Interfaces take turns of up to weight frames worth
+ * of bytes, until none has work left or the nsmp_cfg_s::update_bytes or
+ * update_ms budget has been used.
+ *
+ * @return int NSMP_OK, the number of interfaces left with work when the
+ * budget ran out - call again rather than sleep - or a negative error code.
+ */
+int nsmp_update(void);
+
+/**
+ * @brief Add a worker to the node, to serve the interfaces given to it with
+ * nsmp_worker_iface() from a thread of its own. Call after nsmp_config()
+ * and before any worker runs.
+ *
+ * Workers only relay for each other: messages of the node's own are sent
+ * from one worker's thread, over that worker's interfaces, and reliable
+ * delivery from the node is not available (nsmp_cfg_s::arq_window must be
+ * 0, peers still deliver reliably through it). User messages for the node
+ * that are not sequenced are passed to rx_cb, or to a dispatch table
+ * handler, in the thread of the worker that received them - a callback
+ * shared by the interfaces of several workers may run in more than one at
+ * once. The rest, and messages put in rcv_q, are delivered by one worker at
+ * a time. Timers need
+ * nsmp_cfg_s::get_time_ms.
+ *
+ * @param w Worker, with relay_q and os filled in.
+ * @return int NSMP_OK, or NSMP_ERR_BAD_ARG if the device is not a node,
+ * there are NSMP_MAX_WORKERS already, relay_q cannot hold a frame from each
+ * worker, or reliable delivery is enabled.
+ */
+int nsmp_worker_add(nsmp_worker_s* w);
+
+/**
+ * @brief Have a registered interface served by a worker rather than by
+ * nsmp_update(). Once workers are used, every interface of the node should
+ * be given to one.
+ *
+ * @return int NSMP_OK, or NSMP_ERR_BAD_ARG if the interface is not
+ * registered or its mtu is too large for the relay_q of a worker.
+ */
+int nsmp_worker_iface(nsmp_worker_s* w, nsmp_iface_s* iface);
+
+/**
+ * @brief nsmp_update() for the interfaces of a worker, called from the
+ * worker's thread only. Frames other workers relayed to them are sent in
+ * the order they were queued.
+ *
+ * @return int As nsmp_update().
+ */
+int nsmp_worker_update(nsmp_worker_s* w);
+
 /**
  * @brief Performs NSMP network discovery.
  * The user can process each response individually.
- * @return int #TODO
+ *
+ * A discovery request carrying this device's discovery payload goes out on
+ * every interface from nsmp_update(), after the backoff described with
+ * NSMP_DISC_WAIT_MS, and is sent again with a wider window until it is
+ * answered. A peer answers with a discovery response carrying its payload. A
+ * node keeps the payloads of the devices that sent it one, up to
+ * NSMP_DIR_ENTRIES, and answers with its whole directory in as few
+ * NSMP_MSG_TYPE_CTL_DIRECTORY frames as the link's mtu allows - the same
+ * answer covering every request that arrived in the meantime. Each entry is
+ * delivered here as a discovery response from that device, and a device that
+ * unregistered as an unregister request from it.
+ *
+ * The directory has a version, counting the changes made to it. A peer asks
+ * for the changes since the version it last heard of, so calling this again
+ * later only brings what is new, and so do directory frames it overhears
+ * while it waits to send. Once up to date and listed in the directory it
+ * stops asking, and asks again by itself if a frame shows it missed one.
+ *
+ * @return int NSMP_OK, NSMP_ERR_BAD_ARG if the device is not initialised, or
+ * NSMP_ERR_NO_IF if it has no interface.
  */
 int nsmp_discover(void);
 
+/**
+ * @brief Subscribe to a topic, or stop. Messages published to it are then
+ * delivered here like any other user message, the topic being their port.
+ * A peer tells its node, which keeps the subscriptions of the peers a link
+ * away and sends each message published to a topic on to the interfaces they
+ * are on. A node only subscribes itself.
+ *
+ * @param topic Topic, below NSMP_TOPICS.
+ * @param on Non-zero to subscribe, 0 to stop.
+ * @return int NSMP_OK, NSMP_ERR_BAD_ARG if the topic is out of range or the
+ * device is not initialised, NSMP_ERR_NO_IF if a peer has no interface to
+ * send on, or NSMP_ERR_NO_MEM if its tx_q is full.
+ */
+int nsmp_subscribe(uint8_t topic, uint8_t on);
+
+/**
+ * @brief Take a snapshot of the statistics of an interface, from any context.
+ *
+ * @param iface Registered interface.
+ * @param out Copy of its counters, each read on its own.
+ * @return int NSMP_OK, or NSMP_ERR_BAD_ARG if either is NULL.
+ */
+int nsmp_stats_get(const nsmp_iface_s* iface, nsmp_stats_s* out);
+
+/**
+ * @brief Ask another device for the statistics of one of its interfaces.
+ * It answers with NSMP_MSG_TYPE_CTL_STATS responses, as many as its link's
+ * mtu needs, which are delivered to rx_cb or rcv_q - not to a dispatch table
+ * - and read with nsmp_stats_read(). Traffic carries on meanwhile, and each
+ * response is read from the counters as it is sent.
+ *
+ * @param dst Address of the device, NSMP_ADDR_LINK for the other end of the
+ * link.
+ * @param idx Index of its interface, in the order they were registered.
+ * @return int As nsmp_send().
+ */
+int nsmp_stats_query(uint8_t dst, uint8_t idx);
+
+/**
+ * @brief Copy the counters carried by a response to nsmp_stats_query() into
+ * out, where they go in nsmp_stats_s.
+ *
+ * @return int 1 once the last of them have been read, 0 if more responses
+ * follow, NSMP_ERR_NO_IF if the device has no such interface, or
+ * NSMP_ERR_BAD_ARG if msg is not a statistics response - or NSMP_ERR_BAD_LEN
+ * one that does not fit nsmp_stats_s, from a device built with another
+ * NSMP_STATS_BUCKETS.
+ */
+int nsmp_stats_read(const nsmp_msg_s* msg, nsmp_stats_s* out);
+
+/**
+ * @brief Copy the newest records of the trace ring, oldest first, from any
+ * context. The ring keeps the last NSMP_TRACE frame events of all interfaces:
+ * each frame received whole or dropped by nsmp_parse_if() (NSMP_ERR_BAD_CRC,
+ * NSMP_ERR_BAD_ENC, NSMP_ERR_BAD_LEN or NSMP_ERR_NO_MEM), each frame encoded
+ * into tx_buf, and each batch tx_cb failed (NSMP_ERR_IO, with no header).
+ * Recording one is a counter increment and a 16-byte store, so the ring can
+ * be left on. Records being overwritten while they are copied are left out.
+ *
+ * @param out Records, as many as max.
+ * @return size_t Records copied, 0 when built without NSMP_TRACE.
+ */
+size_t nsmp_trace_read(nsmp_trace_rec_s* out, size_t max);
+
+/**
+ * @brief Notify NSMP that an asynchronous transport has finished with the
+ * oldest batch it accepted from tx_cb. Safe to call from an interrupt.
+ *
+ * @param iface Interface the batch was sent on.
+ */
+void nsmp_tx_done(nsmp_iface_s* iface);
+
 /**
  * @brief Add a message to the outgoing queue.
  * Will be transmitted on the next NSMP update() call, and when the 
  * appropriate interface is ready.
  * 
+ * A message with NSMP_MSG_URGENT in msg->flags goes to the urgent lane of
+ * tx_q, if the interface has one, and is sent ahead of every message in the
+ * bulk lane. It is never bundled nor sent reliably, as that would hold it
+ * behind the bulk messages sent before it. nsmp_add_data() clears
+ * msg->flags, so they are set after it.
+ *
+ * A message longer than the mtu of the interface (or the mtu its other end
+ * advertised) is split into fragments, for the destination to reassemble -
+ * see nsmp_cfg_s::frag_cb - or refused with NSMP_ERR_BAD_LEN if the other
+ * end has not advertised NSMP_CAP_FRAG. Fragments are copied into the bulk
+ * lane as long as it stays no more than half full, leaving room for other
+ * messages. Until
+ * the last one is queued nsmp_send() returns NSMP_ERR_NO_MEM, and is called
+ * again with the same message to carry on - msg->data is read as it goes.
+ * Sending another long message abandons the rest of the first.
+ *
+ * A user message to NSMP_ADDR_TOPIC is published to the topic in the first
+ * byte of its payload, for the devices that subscribed to it - see
+ * nsmp_subscribe(). It goes out as a frame of its own, so it is never
+ * bundled, compressed, fragmented or sent reliably, and a message longer
+ * than the mtu is refused with NSMP_ERR_BAD_LEN. A node queues it on each
+ * interface with a subscriber, or returns NSMP_ERR_NO_MEM without queueing
+ * it anywhere if one of them has no room.
+ *
  * This function returns immediately if there is no space in the queue.
  * See nsmp_send_wait() for a blocking version.
  * 
@@ -169,17 +965,50 @@ int nsmp_discover(void);
  */
 int nsmp_send(nsmp_msg_s* msg);
 
+/**
+ * @brief Reserve space for an outgoing message in the transmit queue.
+ * The payload is serialised straight into the returned buffer, then the
+ * message is published with nsmp_send_commit() or dropped with
+ * nsmp_send_abort(). Only one message can be reserved at a time, and all
+ * nsmp_send*() calls must come from the same context.
+ *
+ * @param dst Destination address.
+ * @param type Message type.
+ * @param len Maximum payload length.
+ * @return uint8_t* Pointer to len bytes of payload space, or NULL if there is
+ * no space in the queue, len exceeds the interface mtu, or a message is
+ * already reserved. A node publishes to NSMP_ADDR_TOPIC with nsmp_send()
+ * only.
+ */
+uint8_t* nsmp_send_reserve(uint8_t dst, nsmp_msg_type_e type, size_t len);
+
+/**
+ * @brief Fill in the header of the reserved message and publish it.
+ *
+ * @param len Final payload length, no larger than the reserved length.
+ * @return int NSMP_OK, or NSMP_ERR_BAD_ARG if nothing is reserved or len is
+ * too large.
+ */
+int nsmp_send_commit(size_t len);
+
+/**
+ * @brief Release the reserved message without sending it.
+ */
+void nsmp_send_abort(void);
+
 /**
  * @brief Add a message to the outgoing queue.
  * Will be transmitted on the next NSMP update() call, and when the
  * appropriate interface is ready.
  * 
  * This function blocks for the specified number of milliseconds if there is no
- * space in the queue.
+ * space in the queue, waking up when nsmp_update() frees some - see
+ * nsmp_cfg_s::os. Without get_time_ms the time is counted from each wakeup.
  * 
  * @param msg Pointer to nsmp message.
- * @param waitms Number of milliseconds to wait for space in the queue.
- * @return int #TODO
+ * @param waitms Number of milliseconds to wait for space in the queue, or
+ * NSMP_WAIT_FOREVER.
+ * @return int As nsmp_send(), NSMP_ERR_NO_MEM if there was still no space.
  */
 int nsmp_send_wait(nsmp_msg_s* msg, uint32_t waitms);
 
@@ -187,6 +1016,9 @@ int nsmp_send_wait(nsmp_msg_s* msg, uint32_t waitms);
  * @brief Add a user-payload to an NSMP message.
  * This is the only way to add data to an NSMP message, do not attempt
  * to modify the nsmp msg data structure directly.
+ * The payload is referenced, not copied - it must remain valid until the
+ * message has been passed to nsmp_send(). msg->flags is cleared, set
+ * NSMP_MSG_URGENT or NSMP_MSG_COMPRESS after this call.
  * 
  * @param msg Pointer to nsmp message.
  * @param payload Pointer to user payload.
@@ -198,10 +1030,13 @@ int nsmp_add_data(nsmp_msg_s* msg, uint8_t* payload, size_t len);
 /**
  * @brief Adds a user-payload to a discovery response message, before
  * it is transmitted to other nodes/peers.
+ * The payload is copied, and also sent with this device's discovery requests.
+ * A node lists its own in its directory. It may be set from the handler of a
+ * discovery request, which is answered afterwards.
  * 
  * @param payload Pointer to user payload.
  * @param len Length of user payload.
- * @return int #TODO
+ * @return int NSMP_OK, or NSMP_ERR_BAD_LEN if len exceeds NSMP_DISCOVERY_LEN.
  */
 int nsmp_set_discovery_payload(uint8_t* payload, size_t len);
 
@@ -213,7 +1048,24 @@ int nsmp_set_discovery_payload(uint8_t* payload, size_t len);
  */
 size_t nsmp_message_len(nsmp_msg_s* msg);
 
+/**
+ * @brief Take the oldest message from nsmp_cfg_s::rcv_q.
+ * The payload is copied into the buffer given with nsmp_add_data().
+ *
+ * @param msg Pointer to nsmp message, whose header, length and payload are
+ * filled in.
+ * @return int NSMP_OK, NSMP_ERR_AGAIN if there is no message, or
+ * NSMP_ERR_BAD_LEN if the payload does not fit - msg->len is then set to its
+ * length and the message is kept.
+ */
 int nsmp_rcv(nsmp_msg_s* msg);
+
+/**
+ * @brief Take the oldest message from nsmp_cfg_s::rcv_q, waiting for up to
+ * waitms (or NSMP_WAIT_FOREVER) for one to arrive - see nsmp_send_wait().
+ *
+ * @return int As nsmp_rcv().
+ */
 int nsmp_rcv_wait(nsmp_msg_s* msg, uint32_t waitms);
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -0,0 +1,91 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Build options:
+ *
+ * NSMP_PAYLOAD_CRC   - Payload check appended to every frame: 0 (none, the
+ *                      default), 16 (CRC-16/X-25) or 32 (CRC-32C). All devices
+ *                      on a network must use the same setting.
+ * NSMP_CRC_SMALL     - Use a 16-entry nibble table for the header CRC8 and a
+ *                      single 256-entry table for the payload CRC, instead of
+ *                      slicing-by-8 (saves ~12 KiB of flash).
+ * NSMP_CRC16_HW(c,b,l) / NSMP_CRC32C_HW(c,b,l)
+ *                    - Hook to a CRC peripheral. Must return the same value as
+ *                      the software nsmp_crc16()/nsmp_crc32c() for the inputs.
+ *
+ * CRC-32C uses the SSE4.2 crc32 instruction, or the ARMv8 CRC32 extension,
+ * when the compiler targets them.
+ */
+#ifndef NSMP_PAYLOAD_CRC
+#define NSMP_PAYLOAD_CRC (0)
+#endif
+
+#if (NSMP_PAYLOAD_CRC != 0) && (NSMP_PAYLOAD_CRC != 16) &&                     \
+		(NSMP_PAYLOAD_CRC != 32)
+#error "NSMP_PAYLOAD_CRC must be 0, 16 or 32"
+#endif
+
+/* Bytes of payload CRC that follow the payload of every frame */
+#define NSMP_PAYLOAD_CRC_LEN (NSMP_PAYLOAD_CRC / 8)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief CRC-8/SMBUS (polynomial 0x07, initial value 0x00), used for the
+ * frame header.
+ */
+uint8_t nsmp_crc8(const uint8_t* buf, size_t len);
+
+/**
+ * @brief CRC-16/X-25 (the PPP/HDLC FCS-16).
+ * Pass crc = 0 for the first block, and the previous result to continue.
+ */
+uint16_t nsmp_crc16(uint16_t crc, const uint8_t* buf, size_t len);
+
+/**
+ * @brief CRC-32C (Castagnoli), using hardware support when available.
+ * Pass crc = 0 for the first block, and the previous result to continue.
+ */
+uint32_t nsmp_crc32c(uint32_t crc, const uint8_t* buf, size_t len);
+
+/**
+ * @brief Software-only CRC-32C, for testing and benchmarking.
+ */
+uint32_t nsmp_crc32c_sw(uint32_t crc, const uint8_t* buf, size_t len);
+
+/**
+ * @brief Continue the payload CRC selected by NSMP_PAYLOAD_CRC over another
+ * block, crc being the result for the blocks before it.
+ */
+static inline uint32_t nsmp_crc_payload_add(uint32_t crc, const uint8_t* buf,
+																						size_t len) {
+#if (NSMP_PAYLOAD_CRC == 16)
+	return nsmp_crc16((uint16_t)crc, buf, len);
+#elif (NSMP_PAYLOAD_CRC == 32)
+	return nsmp_crc32c(crc, buf, len);
+#else
+	(void)crc;
+	(void)buf;
+	(void)len;
+	return 0;
+#endif
+}
+
+/**
+ * @brief Calculate the payload CRC selected by NSMP_PAYLOAD_CRC.
+ */
+static inline uint32_t nsmp_crc_payload(const uint8_t* buf, size_t len) {
+	return nsmp_crc_payload_add(0, buf, len);
+}
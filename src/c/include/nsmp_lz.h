@@ -0,0 +1,57 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Build options:
+ *
+ * NSMP_LZ_HASH_BITS  - Size of the compressor's match table, 2^n 16-bit
+ *                      entries (default 10, 2 KiB). More find more matches
+ *                      in long messages, at the cost of RAM and of clearing
+ *                      the table for every message.
+ * NSMP_LZ_MIN        - Shortest message worth compressing, in bytes.
+ *
+ * The compressed format is the LZ4 block format, so any LZ4 decoder can read
+ * it. Blocks are at most 64 KiB, like messages.
+ */
+#ifndef NSMP_LZ_HASH_BITS
+#define NSMP_LZ_HASH_BITS (10)
+#endif
+
+#ifndef NSMP_LZ_MIN
+#define NSMP_LZ_MIN (32)
+#endif
+
+/* Bytes of the compressor's match table */
+#define NSMP_LZ_TABLE_LEN (sizeof(uint16_t) << NSMP_LZ_HASH_BITS)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Compress a block of up to 64 KiB.
+ *
+ * @param table Match table of NSMP_LZ_TABLE_LEN bytes, 2-byte aligned.
+ * @return size_t Compressed length, 0 if it would not fit in max bytes.
+ */
+size_t nsmp_lz_compress(const uint8_t* src, size_t len, uint8_t* dst,
+												size_t max, uint16_t* table);
+
+/**
+ * @brief Decompress a block, checking every length and offset against the
+ * input and the output space.
+ *
+ * @return size_t Decompressed length, 0 if the block is malformed or does
+ * not fit in max bytes.
+ */
+size_t nsmp_lz_decompress(const uint8_t* src, size_t len, uint8_t* dst,
+													size_t max);
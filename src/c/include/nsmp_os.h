@@ -0,0 +1,118 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+
+#include "nsmp.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+#if defined(NSMP_OS_FREERTOS)
+#include "FreeRTOS.h"
+#include "semphr.h"
+#endif
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Ready-made nsmp_os_s bindings, in port/. Each one keeps its state in a
+ * structure the application allocates and fills in nsmp_cfg_s::os:
+ *
+ *   static nsmp_os_futex_s os;
+ *   nsmp_cfg_s             cfg = {...};
+ *
+ *   nsmp_os_futex(&cfg.os, &os);
+ *   nsmp_config(&cfg);
+ *
+ * A thread that runs nsmp_update() can then wait for NSMP_EV_READY between
+ * calls with cfg.os.wait(), and an event loop can poll the NSMP_EV_READY and
+ * NSMP_EV_RX descriptors of the eventfd binding. */
+
+#if defined(__unix__) || defined(__APPLE__)
+/**
+ * @brief POSIX threads - a condition variable shared by all events. Signals
+ * must come from threads, not from signal handlers.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t	cond;
+	uint8_t					set[NSMP_EV_NB]; /* Signalled since the last wait */
+} nsmp_os_pthread_s;
+#endif
+
+#if defined(__linux__)
+/**
+ * @brief Linux futexes - one word per event, signalling takes no lock and is
+ * async-signal-safe.
+ */
+typedef struct {
+	uint32_t word[NSMP_EV_NB]; /* 1 when signalled since the last wait */
+} nsmp_os_futex_s;
+
+/**
+ * @brief Linux eventfds - one descriptor per event, which an event loop may
+ * add to its poll set. Signalling is async-signal-safe.
+ */
+typedef struct {
+	int fd[NSMP_EV_NB];
+} nsmp_os_eventfd_s;
+#endif
+
+#if defined(NSMP_OS_FREERTOS)
+/**
+ * @brief FreeRTOS - one binary semaphore per event, signalled from tasks or
+ * interrupts.
+ */
+typedef struct {
+	SemaphoreHandle_t sem[NSMP_EV_NB];
+	StaticSemaphore_t buf[NSMP_EV_NB];
+} nsmp_os_freertos_s;
+#endif
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#if defined(__unix__) || defined(__APPLE__)
+/**
+ * @brief Set up a pthread binding and fill in os.
+ *
+ * @return int NSMP_OK, or NSMP_ERR_NO_MEM if the mutex or condition variable
+ * cannot be created.
+ */
+int nsmp_os_pthread(nsmp_os_s* os, nsmp_os_pthread_s* p);
+#endif
+
+#if defined(__linux__)
+/**
+ * @brief Set up a futex binding and fill in os.
+ *
+ * @return int NSMP_OK.
+ */
+int nsmp_os_futex(nsmp_os_s* os, nsmp_os_futex_s* f);
+
+/**
+ * @brief Open the descriptors of an eventfd binding and fill in os.
+ *
+ * @return int NSMP_OK, or NSMP_ERR_NO_MEM if a descriptor cannot be opened.
+ */
+int nsmp_os_eventfd(nsmp_os_s* os, nsmp_os_eventfd_s* e);
+
+/**
+ * @brief Close the descriptors of an eventfd binding.
+ */
+void nsmp_os_eventfd_close(nsmp_os_eventfd_s* e);
+#endif
+
+#if defined(NSMP_OS_FREERTOS)
+/**
+ * @brief Create the semaphores of a FreeRTOS binding and fill in os.
+ *
+ * @return int NSMP_OK.
+ */
+int nsmp_os_freertos(nsmp_os_s* os, nsmp_os_freertos_s* r);
+#endif
@@ -0,0 +1,183 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nsmp.h"
+#include "nsmp_os.h"
+
+#if defined(__linux__)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Bytes taken from a descriptor by one read(), unless the link sets less */
+#define NSMP_POSIX_READ_LEN (16 * 1024)
+
+/* Descriptor events handled by one nsmp_posix_poll() call */
+#define NSMP_POSIX_EVENTS (16)
+
+/* Chunks handed to tx_cb that a link holds until they are written */
+#define NSMP_POSIX_IOV (8)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Links over serial ports, pseudo-terminals and UNIX-domain sockets, driven
+ * by one epoll loop in the thread that calls nsmp_update():
+ *
+ *   static nsmp_posix_s      px;
+ *   static nsmp_posix_link_s uart = {.iface = {.tx_q = ..., .rx_cb = ...}};
+ *   nsmp_cfg_s               cfg  = {...};
+ *
+ *   nsmp_node_init();
+ *   nsmp_posix_init(&px, &cfg);
+ *   nsmp_config(&cfg);
+ *   nsmp_posix_serial(&px, &uart, "/dev/ttyUSB0", 921600);
+ *   nsmp_node_newif(&uart.iface);
+ *   for (;;) {
+ *     nsmp_posix_poll(&px, 100);
+ *   }
+ *
+ * Other threads may call nsmp_send() and nsmp_rcv_wait() meanwhile, the
+ * loop is woken through the eventfd binding nsmp_posix_init() sets up.
+ *
+ * A broker with many links can run one loop per worker thread instead, each
+ * set up with nsmp_posix_worker() and driving the links of its worker:
+ *
+ *   nsmp_posix_worker(&px[i], &worker[i]);
+ *   nsmp_worker_add(&worker[i]);
+ *   nsmp_posix_serial(&px[i], &uart[j], ...);
+ *   nsmp_node_newif(&uart[j].iface);
+ *   nsmp_worker_iface(&worker[i], &uart[j].iface);
+ *   ...                      then in worker i's thread
+ *   for (;;) {
+ *     nsmp_posix_poll(&px[i], 100);
+ *   } */
+
+/**
+ * @brief A link driven by nsmp_posix_poll(). The application fills in iface
+ * as for any other interface, except for tx_cb and tx_async which are set
+ * when the link is opened.
+ */
+typedef struct nsmp_posix_link_s {
+	nsmp_iface_s iface; /* First, so the link is found from its interface */
+
+	// private:
+	struct nsmp_posix_link_s* next;
+	struct nsmp_posix_s*			px; /* Loop driving the link */
+	int												fd;
+	int												hold;		 /* Slave kept open by nsmp_posix_pty() */
+	nsmp_iovec_s							pend[NSMP_POSIX_IOV]; /* Accepted, not yet written */
+	uint8_t										ends[NSMP_POSIX_IOV]; /* The chunk ends a batch */
+	uint8_t										npend;
+	uint8_t										done; /* Batches written, for nsmp_tx_done() */
+	uint8_t										out;	/* Waiting for the descriptor to be writable */
+
+	// public:
+	uint8_t	 down;		 /* Closed at the other end, or failed */
+	uint32_t read_len; /* Bytes per read(), 0 for NSMP_POSIX_READ_LEN */
+} nsmp_posix_link_s;
+
+/**
+ * @brief The epoll loop and the links it drives.
+ */
+typedef struct nsmp_posix_s {
+	int								 epfd;
+	nsmp_os_eventfd_s	 ev; /* NSMP_EV_READY wakes the loop */
+	nsmp_posix_link_s* links;
+	nsmp_worker_s*		 worker; /* Serving the links, NULL for nsmp_update() */
+	int								 work;	 /* The last update had work left */
+	uint8_t						 rx[NSMP_POSIX_READ_LEN];
+} nsmp_posix_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Create the epoll loop, and fill in cfg->os with an eventfd binding
+ * whose NSMP_EV_READY descriptor the loop waits on. Call before
+ * nsmp_config(cfg).
+ *
+ * @return int NSMP_OK, NSMP_ERR_BAD_ARG, or NSMP_ERR_IO.
+ */
+int nsmp_posix_init(nsmp_posix_s* px, nsmp_cfg_s* cfg);
+
+/**
+ * @brief Create an epoll loop for the links of a worker, and fill in w->os
+ * with an eventfd binding the loop waits on. nsmp_posix_poll() then runs
+ * nsmp_worker_update() rather than nsmp_update(). Call before
+ * nsmp_worker_add(w).
+ *
+ * @return int NSMP_OK, NSMP_ERR_BAD_ARG, or NSMP_ERR_IO.
+ */
+int nsmp_posix_worker(nsmp_posix_s* px, nsmp_worker_s* w);
+
+/**
+ * @brief Close the loop and every link still open on it.
+ */
+void nsmp_posix_close(nsmp_posix_s* px);
+
+/**
+ * @brief Open a serial port in raw mode, with no flow control and the
+ * driver's low latency mode where it has one.
+ *
+ * @param path Device, such as /dev/ttyUSB0.
+ * @param baud Bit rate, or 0 to leave it as it is (for a pseudo-terminal).
+ * @return int NSMP_OK, NSMP_ERR_BAD_ARG if the bit rate is not supported, or
+ * NSMP_ERR_IO.
+ */
+int nsmp_posix_serial(nsmp_posix_s* px, nsmp_posix_link_s* link,
+											const char* path, uint32_t baud);
+
+/**
+ * @brief Open a pseudo-terminal and drive its master side, so another
+ * program (or nsmp_posix_serial()) can use the slave like a serial port.
+ *
+ * @param name Filled in with the path of the slave.
+ * @param len Size of name.
+ * @return int NSMP_OK, NSMP_ERR_BAD_ARG, or NSMP_ERR_IO.
+ */
+int nsmp_posix_pty(nsmp_posix_s* px, nsmp_posix_link_s* link, char* name,
+									 size_t len);
+
+/**
+ * @brief Connect to a UNIX-domain stream socket.
+ *
+ * @return int NSMP_OK, NSMP_ERR_BAD_ARG if path is too long, or NSMP_ERR_IO.
+ */
+int nsmp_posix_unix(nsmp_posix_s* px, nsmp_posix_link_s* link,
+										const char* path);
+
+/**
+ * @brief Drive a descriptor that is already open - a connection accepted on
+ * a listening socket, one end of a socketpair(), etc. The link owns it from
+ * then on.
+ *
+ * @return int NSMP_OK, or NSMP_ERR_IO.
+ */
+int nsmp_posix_fd(nsmp_posix_s* px, nsmp_posix_link_s* link, int fd);
+
+/**
+ * @brief Close a link. Its interface must not be used by nsmp_update() any
+ * more.
+ */
+void nsmp_posix_link_close(nsmp_posix_s* px, nsmp_posix_link_s* link);
+
+/**
+ * @brief Wait for up to timeout_ms (-1 for no limit) for a link to become
+ * readable or writable or for work to be queued, handle it and run
+ * nsmp_update() (nsmp_worker_update() for a worker's loop). Does not wait
+ * while the last update had work left,
+ * and timeout_ms bounds how late timers (credit, reliable delivery, bundles)
+ * run. A link closed at the other end is taken out of the loop and its down
+ * flag set.
+ *
+ * @return int NSMP_OK, or NSMP_ERR_IO if the wait failed.
+ */
+int nsmp_posix_poll(nsmp_posix_s* px, int timeout_ms);
+
+#endif
@@ -0,0 +1,778 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nsmp.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Offsets into a decoded frame */
+#define NSMP_OFS_CTL (0)
+#define NSMP_OFS_DST (1)
+#define NSMP_OFS_SRC (2)
+#define NSMP_OFS_CRC (3)
+#define NSMP_OFS_LEN (4)
+
+/* Features this implementation supports, see NSMP_MSG_TYPE_CTL_CAPS */
+#define NSMP_CAPS                                                              \
+	(NSMP_CAP_BUNDLE | NSMP_CAP_ARQ | NSMP_CAP_CREDIT | NSMP_CAP_ACK |            \
+	 NSMP_CAP_LZ | NSMP_CAP_FRAG)
+
+/* Each message in a bundle is [ctl][len][payload], with up to 255 bytes */
+#define NSMP_BUNDLE_SUB_HDR (2)
+#define NSMP_BUNDLE_SUB_MAX (0xFF)
+
+/* Control messages waiting to be queued, see nsmp_iface_s::ctl_pend */
+#define NSMP_PEND_CAPS_REQ (1u << 0)
+#define NSMP_PEND_CAPS_RSP (1u << 1)
+#define NSMP_PEND_DISC_REQ (1u << 2)
+#define NSMP_PEND_DISC_RSP (1u << 3)
+#define NSMP_PEND_DIR			 (1u << 4) /* From nsmp_iface_s::dir_from */
+#define NSMP_PEND_STATS		 (1u << 5) /* From nsmp_iface_s::stats_next */
+
+/* A sequenced message is [hdr][seq][ctl][payload], ctl being the control byte
+ * of the message itself */
+#define NSMP_OFS_SEQ		 (NSMP_HDR_LEN)
+#define NSMP_OFS_SEQ_CTL (NSMP_HDR_LEN + 1)
+
+/* CTL_ACK and CTL_PLS_RETRY are [next expected seq][32-bit held bitmap] */
+#define NSMP_ACK_LEN (5)
+
+/* CTL_SEQ_ACK is [hdr][seq][ctl][ack][payload], the acknowledgement being the
+ * payload of a CTL_ACK */
+#define NSMP_OFS_SEQ_ACK (NSMP_HDR_LEN + NSMP_SEQ_LEN)
+
+/* CTL_LZ is [ctl][16-bit length][LZ4 block], the control byte and length
+ * being those of the message before it was compressed */
+#define NSMP_LZ_HDR (3)
+
+/* CTL_FRAG is [ctl][id][16-bit total length][16-bit offset][data] */
+#define NSMP_FRAG_HDR (6)
+
+/* A discovery request is [16-bit directory version][discovery payload] */
+#define NSMP_DISC_HDR (2)
+
+/* CTL_DIRECTORY is [16-bit from][16-bit to][entries], the entries that
+ * changed after version from up to version to in the order they changed,
+ * each [addr][len][16-bit version][payload] - len being NSMP_DIR_GONE, and
+ * the payload empty, for a device that unregistered */
+#define NSMP_DIR_HDR		 (4)
+#define NSMP_DIR_ENT_HDR (4)
+#define NSMP_DIR_GONE		 (0xFF)
+
+/* A CTL_STATS request is [interface], a response [interface][first][total]
+ * followed by 32-bit words of nsmp_stats_s from word first on - total being
+ * the words of the whole structure, 0 if there is no such interface */
+#define NSMP_STATS_REQ_LEN (1)
+#define NSMP_STATS_HDR		 (3)
+#define NSMP_STATS_WORDS	 (sizeof(nsmp_stats_s) / sizeof(uint32_t))
+
+/* Space in tx_q that messages leave free for acknowledgements, so that a queue
+ * full of messages waiting for the window to open cannot stop them */
+#define NSMP_ACK_ROOM                                                          \
+	(NSMP_ARQ_PEERS * NSMP_QUEUE_REC_LEN(NSMP_HDR_LEN + NSMP_ACK_LEN))
+
+/* Largest encoded frame, delimiter included, for a decoded frame of n bytes.
+ * One byte more than our own encoder writes, for encoders that end a frame
+ * whose last block is full with an empty one. */
+#define NSMP_RELAY_LEN(n) (COBS_ENCODE_MAX(n) + 1)
+
+/* Queue record tags, see nsmp_queue_set_tag() */
+#define NSMP_TAG_NEW		(0) /* Not looked at yet */
+#define NSMP_TAG_DONE		(1) /* Finished with, released once it reaches the head */
+#define NSMP_TAG_PEND		(2) /* Sent, waiting for an acknowledgement */
+#define NSMP_TAG_RESEND (3) /* Sent, to be sent again */
+#define NSMP_TAG_HELD		(4) /* Received out of order */
+#define NSMP_TAG_FANNED (5) /* Published, sent on to the other subscribers */
+
+/* What to do with a received sequenced message */
+enum {
+	NSMP_ARQ_DROP,		/* Duplicate or outside the window */
+	NSMP_ARQ_HOLD,		/* Keep until the messages before it have arrived */
+	NSMP_ARQ_DELIVER, /* Next in sequence */
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef enum {
+	NSMP_ROLE_NONE,
+	NSMP_ROLE_PEER,
+	NSMP_ROLE_NODE,
+} nsmp_role_e;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Reset the NSMP context and set the role of this device.
+ */
+int nsmp_init(nsmp_role_e role);
+
+/**
+ * @brief Initialise an interface's queues and parser and add it to the
+ * interface list.
+ */
+int nsmp_iface_add(nsmp_iface_s* iface);
+
+/**
+ * @brief Mark an interface as having work for nsmp_update(), from any context.
+ */
+void nsmp_sched_ready(nsmp_iface_s* iface);
+
+/**
+ * @brief Move an interface's pending work from nsmp_update() to a worker.
+ */
+void nsmp_sched_assign(nsmp_iface_s* iface, nsmp_worker_s* w);
+
+/**
+ * @brief Serve the interfaces of a scheduling set, see nsmp_update().
+ *
+ * @param w Worker the set belongs to, NULL for nsmp_update().
+ */
+int nsmp_update_sched(nsmp_sched_s* s, nsmp_worker_s* w);
+
+/**
+ * @brief Get a registered interface by index, NULL if there is none.
+ */
+nsmp_iface_s* nsmp_iface_at(uint8_t idx);
+
+/**
+ * @brief Forget all workers.
+ */
+void nsmp_worker_reset(void);
+
+/**
+ * @brief Number of workers added.
+ */
+uint8_t nsmp_worker_count(void);
+
+/**
+ * @brief Send a frame received on one interface out of another, through the
+ * relay_q of the worker serving it if that is not the one serving the first.
+ *
+ * @return int 1 if the frame was taken, 0 to try again later.
+ */
+int nsmp_worker_relay(nsmp_iface_s* from, nsmp_iface_s* out,
+											const uint8_t* frame, size_t len);
+
+/**
+ * @brief Send the frames other workers relayed to a worker's interfaces, in
+ * order, up to the first one that cannot be sent yet.
+ */
+void nsmp_worker_drain(nsmp_worker_s* w);
+
+/**
+ * @brief Get the first registered interface.
+ */
+nsmp_iface_s* nsmp_iface_first(void);
+
+/**
+ * @brief Select the interface that leads to an address.
+ */
+nsmp_iface_s* nsmp_route(uint8_t dst);
+
+/**
+ * @brief Number of links to an address, 0 if it has no route and is sent to
+ * the first interface.
+ */
+uint8_t nsmp_route_hops(uint8_t dst);
+
+/**
+ * @brief Select the interface a node relays a received frame to.
+ *
+ * @param iface Interface the frame was received on.
+ * @param frame Decoded frame, or at least its header.
+ * @return nsmp_iface_s* NULL if the frame is for this device, or published
+ * to a topic - see nsmp_topic_fan().
+ */
+nsmp_iface_s* nsmp_relay(const nsmp_iface_s* iface, const uint8_t* frame);
+
+/**
+ * @brief Get the local address.
+ */
+uint8_t nsmp_addr(void);
+
+/**
+ * @brief Get the role given to nsmp_init().
+ */
+nsmp_role_e nsmp_role(void);
+
+/**
+ * @brief Get the device configuration.
+ */
+const nsmp_cfg_s* nsmp_cfg(void);
+
+/**
+ * @brief Current time in ms, or the number of nsmp_update() calls when the
+ * configuration has no get_time_ms.
+ */
+uint32_t nsmp_now(void);
+
+/**
+ * @brief Pass a received message to the NSMP handlers or the interface rx_cb.
+ */
+void nsmp_rx_msg(nsmp_iface_s* iface, nsmp_msg_s* msg);
+
+/**
+ * @brief Pass a received message to the application only, without the NSMP
+ * handlers looking at it.
+ */
+void nsmp_rx_deliver(nsmp_iface_s* iface, nsmp_msg_s* msg);
+
+/**
+ * @brief Queue a control message on an interface, bypassing routing, in its
+ * urgent lane if it has one. Without one it must not be called while the
+ * interface has a message reserved.
+ */
+int nsmp_ctl_send(nsmp_iface_s* iface, uint8_t dst, nsmp_msg_type_e type,
+									uint8_t reqres, const uint8_t* data, size_t len);
+
+/**
+ * @brief Reserve a control message of up to len bytes of payload, as
+ * nsmp_ctl_send() queues it, to be written in place.
+ *
+ * @return uint8_t* The payload, or NULL if the lane is full.
+ */
+uint8_t* nsmp_ctl_reserve(nsmp_iface_s* iface, size_t len);
+
+/**
+ * @brief Queue the control message reserved with nsmp_ctl_reserve().
+ *
+ * @param payload As returned by nsmp_ctl_reserve().
+ * @param len Payload written, up to what was reserved.
+ */
+void nsmp_ctl_commit(nsmp_iface_s* iface, uint8_t* payload, uint8_t dst,
+										 nsmp_msg_type_e type, uint8_t reqres, size_t len);
+
+/**
+ * @brief Check whether a message is reserved in an interface's tx_q.
+ */
+int nsmp_tx_reserved(const nsmp_iface_s* iface);
+
+/**
+ * @brief Send a frame received on another interface. A frame kept encoded
+ * is copied to tx_buf, a decoded one is queued in tx_q.
+ *
+ * @param frame rx_q record, see nsmp_frame_encoded().
+ * @param len Length of the record.
+ * @return int 1 if the frame was taken, 0 to try again later.
+ */
+int nsmp_tx_forward(nsmp_iface_s* iface, const uint8_t* frame, size_t len);
+
+/**
+ * @brief Pack a message into the interface's open bundle, opening a new one
+ * when needed. Returns 1 if the message was packed, 0 if it must be sent as
+ * a frame of its own.
+ */
+int nsmp_bundle_add(nsmp_iface_s* iface, const nsmp_hdr_s* hdr,
+										const uint8_t* data, size_t len);
+
+/**
+ * @brief Publish the interface's open bundle, if any.
+ */
+void nsmp_bundle_close(nsmp_iface_s* iface);
+
+/**
+ * @brief Publish the interface's open bundle once its deadline has passed.
+ */
+void nsmp_bundle_poll(nsmp_iface_s* iface);
+
+/**
+ * @brief Pass each message of a received bundle to nsmp_rx_msg().
+ *
+ * @param hdr Header of the frame that carried the bundle.
+ * @param data Bundle payload.
+ * @param len Length of the bundle payload.
+ */
+int nsmp_bundle_unpack(nsmp_iface_s* iface, const nsmp_hdr_s* hdr,
+											 const uint8_t* data, size_t len);
+
+/**
+ * @brief Reset the reliable delivery state of all peers.
+ */
+void nsmp_arq_reset(void);
+
+/**
+ * @brief Check that no peer has reliable delivery state, so there is nothing
+ * for nsmp_arq_poll() to do.
+ */
+int nsmp_arq_idle(void);
+
+/**
+ * @brief Space to leave in front of the payload of a message, NSMP_SEQ_LEN if
+ * it will be sent reliably, otherwise 0.
+ */
+size_t nsmp_arq_ofs(const nsmp_iface_s* iface, const nsmp_hdr_s* hdr);
+
+/**
+ * @brief Space a message must leave free in the bulk lane of tx_q,
+ * NSMP_ACK_ROOM while reliable delivery is in use on an interface without an
+ * urgent lane for the acknowledgements, otherwise 0.
+ */
+size_t nsmp_arq_room(const nsmp_iface_s* iface);
+
+/**
+ * @brief Fill in the header of a message in tx_q, adding the next sequence
+ * number of the destination if ofs is NSMP_SEQ_LEN.
+ *
+ * @return size_t Length of the tx_q record.
+ */
+size_t nsmp_arq_seal(uint8_t* frame, const nsmp_hdr_s* hdr, size_t ofs,
+										 size_t len);
+
+/**
+ * @brief Check whether a sequenced message fits in its peer's send window.
+ */
+int nsmp_arq_tx_ready(const uint8_t* frame);
+
+/**
+ * @brief Account for the first transmission of a sequenced message.
+ *
+ * @return int Non-zero if it stays in tx_q until it is acknowledged.
+ */
+int nsmp_arq_tx_sent(const uint8_t* frame);
+
+/**
+ * @brief Handle a received sequenced message, returns NSMP_ARQ_*.
+ *
+ * @param fresh Non-zero the first time the message is looked at.
+ */
+int nsmp_arq_rx(nsmp_iface_s* iface, const uint8_t* frame, int fresh);
+
+/**
+ * @brief Give up the reliable delivery state of a peer that unregistered,
+ * along with the messages sent to it that are waiting for an acknowledgement.
+ */
+void nsmp_arq_forget(uint8_t addr);
+
+/**
+ * @brief Handle a received acknowledgement or retry request.
+ */
+void nsmp_arq_ack(nsmp_msg_s* msg);
+
+/**
+ * @brief Fill in the acknowledgement that a sequenced message about to be
+ * sent can carry to its destination.
+ *
+ * @param frame tx_q record of the message.
+ * @param len Length of the record.
+ * @param ack Space for NSMP_ACK_LEN bytes.
+ * @return size_t NSMP_ACK_LEN, or 0 if none is waiting or it does not fit.
+ */
+size_t nsmp_arq_ack_fill(const nsmp_iface_s* iface, const uint8_t* frame,
+												 size_t len, uint8_t* ack);
+
+/**
+ * @brief Account for an acknowledgement filled in by nsmp_arq_ack_fill()
+ * having been sent.
+ */
+void nsmp_arq_ack_sent(const uint8_t* frame);
+
+/**
+ * @brief Check whether an acknowledgement is waiting to be sent on an
+ * interface, for nsmp_arq_poll() once it is due.
+ */
+int nsmp_arq_ack_wait(const nsmp_iface_s* iface);
+
+/**
+ * @brief Send acknowledgements and retransmissions due on an interface.
+ */
+void nsmp_arq_poll(nsmp_iface_s* iface);
+
+/**
+ * @brief Largest message nsmp_cfg_s::lz_buf can compress or expand, 0 if
+ * there is none.
+ */
+size_t nsmp_lz_max(void);
+
+/**
+ * @brief Forget messages being fragmented and reassembled.
+ */
+void nsmp_frag_reset(void);
+
+/**
+ * @brief Largest frame payload that can be sent on an interface, beyond
+ * which messages are fragmented.
+ */
+size_t nsmp_frag_mtu(const nsmp_iface_s* iface);
+
+/**
+ * @brief Queue the fragments of a message, see nsmp_send().
+ *
+ * @return int NSMP_OK once the last fragment is queued, NSMP_ERR_NO_MEM
+ * while some are left.
+ */
+int nsmp_frag_send(nsmp_iface_s* iface, const nsmp_msg_s* msg);
+
+/**
+ * @brief Handle a received fragment, passing the message to nsmp_rx_msg()
+ * once it is complete or the fragment to nsmp_cfg_s::frag_cb.
+ */
+void nsmp_frag_rx(nsmp_iface_s* iface, const nsmp_msg_s* msg);
+
+/**
+ * @brief Forget all topic subscriptions.
+ */
+void nsmp_topic_reset(void);
+
+/**
+ * @brief Handle a received NSMP_MSG_TYPE_CTL_SUBSCRIBE.
+ */
+void nsmp_topic_ctl(nsmp_iface_s* iface, const nsmp_msg_s* msg);
+
+/**
+ * @brief Drop the subscriptions of a peer that left.
+ */
+void nsmp_topic_forget(uint8_t addr);
+
+/**
+ * @brief Read the topic of a published frame.
+ *
+ * @param frame rx_q record, see nsmp_frame_encoded().
+ * @param len Length of the record.
+ * @return int The topic, -1 if the frame has no payload.
+ */
+int nsmp_topic_of(const uint8_t* frame, size_t len);
+
+/**
+ * @brief Interfaces with a subscriber to a topic, by index.
+ *
+ * @param iface Interface left out, the one a message came from, or NULL.
+ */
+uint32_t nsmp_topic_out(const nsmp_iface_s* iface, int topic);
+
+/**
+ * @brief Check whether this device subscribes to a topic.
+ */
+int nsmp_topic_local(int topic);
+
+/**
+ * @brief Send a published frame received on an interface on to the other
+ * interfaces with a subscriber, as nsmp_worker_relay() does.
+ *
+ * @return int 1 once it has gone to all of them, 0 to carry on later.
+ */
+int nsmp_topic_fan(nsmp_iface_s* iface, const uint8_t* frame, size_t len);
+
+/**
+ * @brief Forget the discovery payloads, the directory and any discovery in
+ * progress.
+ */
+void nsmp_dir_reset(void);
+
+/**
+ * @brief Handle a received discovery request or response, or
+ * NSMP_MSG_TYPE_CTL_DIRECTORY. The payload of a request is left pointing
+ * past its directory version.
+ */
+void nsmp_dir_rx(nsmp_iface_s* iface, nsmp_msg_s* msg);
+
+/**
+ * @brief Mark a device that unregistered as gone from the directory.
+ */
+void nsmp_dir_forget(uint8_t addr);
+
+/**
+ * @brief Send discovery requests whose backoff has passed, and give up on
+ * those left unanswered. Called by nsmp_update().
+ */
+void nsmp_dir_poll(void);
+
+/**
+ * @brief Queue the discovery messages waiting in nsmp_iface_s::ctl_pend.
+ * A directory longer than a frame goes out a frame at a time.
+ */
+void nsmp_dir_flush(nsmp_iface_s* iface);
+
+/**
+ * @brief Bytes of rcv_q the entries of a directory frame take once delivered.
+ *
+ * @param data Payload of the frame.
+ */
+size_t nsmp_dir_rcv_need(const uint8_t* data, size_t len);
+
+/**
+ * @brief Clear the statistics of an interface.
+ */
+void nsmp_stats_reset(nsmp_iface_s* iface);
+
+/**
+ * @brief Account for a message about to be committed to one of an
+ * interface's queues, timing it if no other in the queue is.
+ *
+ * @param q rxq, txu or txq, with the record reserved.
+ * @param len Length of the record.
+ */
+void nsmp_stats_queued(nsmp_iface_s* iface, nsmp_queue_s* q, size_t len);
+
+/**
+ * @brief Account for a message being taken from one of an interface's
+ * queues, by delivery or transmission.
+ *
+ * @param pos Queue position of its record.
+ */
+void nsmp_stats_taken(nsmp_iface_s* iface, nsmp_queue_s* q, uint32_t pos);
+
+/**
+ * @brief Handle a received NSMP_MSG_TYPE_CTL_STATS request.
+ */
+void nsmp_stats_rx(nsmp_iface_s* iface, const nsmp_msg_s* msg);
+
+/**
+ * @brief Queue the statistics responses waiting in nsmp_iface_s::ctl_pend, a
+ * frame at a time.
+ */
+void nsmp_stats_flush(nsmp_iface_s* iface);
+
+/**
+ * @brief Record a frame event in the trace ring, see nsmp_trace_read().
+ *
+ * @param dir NSMP_TRACE_RX or NSMP_TRACE_TX.
+ * @param hdr Decoded header, NULL if it was not received whole.
+ * @param len Bytes of the batch when there is no header, the payload length
+ * is taken from hdr otherwise.
+ * @param result NSMP_OK, or the NSMP_ERR_* the frame was dropped with.
+ */
+#if NSMP_TRACE
+void nsmp_trace(const nsmp_iface_s* iface, uint8_t dir, const uint8_t* hdr,
+								size_t len, int result);
+#else
+static inline void nsmp_trace(const nsmp_iface_s* iface, uint8_t dir,
+															const uint8_t* hdr, size_t len, int result) {
+	(void)iface;
+	(void)dir;
+	(void)hdr;
+	(void)len;
+	(void)result;
+}
+#endif
+
+/**
+ * @brief Add to a counter of nsmp_stats_s, from the one context that writes
+ * it.
+ */
+static inline void nsmp_stats_add(uint32_t* c, uint32_t n) {
+	__atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + n,
+									 __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Raise a high-water mark of nsmp_stats_s, from any context.
+ */
+static inline void nsmp_stats_max(uint32_t* c, uint32_t v) {
+	uint32_t cur = __atomic_load_n(c, __ATOMIC_RELAXED);
+
+	while ((v > cur) && !__atomic_compare_exchange_n(c, &cur, v, 1,
+																										__ATOMIC_RELAXED,
+																										__ATOMIC_RELAXED)) {
+	}
+}
+
+/**
+ * @brief Reset the flow control state of an interface.
+ */
+void nsmp_credit_reset(nsmp_iface_s* iface);
+
+/**
+ * @brief Use the credit needed to send a frame, returns 0 if the other end
+ * has not granted enough yet.
+ *
+ * @param frame Decoded frame, without the payload CRC.
+ * @param len Length of the frame.
+ */
+int nsmp_credit_take(nsmp_iface_s* iface, const uint8_t* frame, size_t len);
+
+/**
+ * @brief Build a credit grant or request that is due on an interface, the
+ * caller must send it.
+ *
+ * @param frame Space for NSMP_HDR_LEN + NSMP_CREDIT_LEN bytes.
+ * @return size_t Length of the frame, 0 if nothing is due.
+ */
+size_t nsmp_credit_frame(nsmp_iface_s* iface, uint8_t* frame);
+
+/**
+ * @brief Handle a received credit frame, called by the parser.
+ */
+void nsmp_credit_ctl(nsmp_iface_s* iface, const uint8_t* frame);
+
+/**
+ * @brief Check whether rx_q can take len bytes more than the frames the other
+ * end has been granted credit for, called by the parser.
+ */
+int nsmp_credit_spare(nsmp_iface_s* iface, size_t len);
+
+/**
+ * @brief Transmit queued messages on an interface, until at least quota bytes
+ * have been handed to the transport. Returns the bytes handed over.
+ */
+size_t nsmp_tx_process(nsmp_iface_s* iface, size_t quota);
+
+/**
+ * @brief Split tx_q into the urgent and bulk lanes, see
+ * nsmp_iface_s::tx_urgent_len.
+ *
+ * @return int NSMP_OK, or NSMP_ERR_BAD_ARG if the bulk lane cannot hold a
+ * message of mtu bytes.
+ */
+int nsmp_tx_lanes(nsmp_iface_s* iface);
+
+/**
+ * @brief Reset the transmit buffer state of an interface.
+ */
+void nsmp_tx_reset(nsmp_iface_s* iface);
+
+/**
+ * @brief Set up nsmp_cfg_s::rcv_q, returns NSMP_ERR_BAD_ARG if it is too small.
+ */
+int nsmp_rcv_init(void);
+
+/**
+ * @brief Check whether the messages of a received frame can be delivered -
+ * there is room for them in rcv_q, or they do not go there.
+ *
+ * @param frame Decoded frame.
+ * @param len Length of the frame.
+ */
+int nsmp_rcv_room(nsmp_iface_s* iface, const uint8_t* frame, size_t len);
+
+/**
+ * @brief Queue a message for nsmp_rcv(), dropped if rcv_q is full or missing.
+ */
+void nsmp_rcv_put(const nsmp_msg_s* msg);
+
+/**
+ * @brief Signal an event through nsmp_cfg_s::os, if it has a signal hook.
+ */
+void nsmp_os_signal(nsmp_ev_e ev);
+
+/**
+ * @brief Reset the streaming parser of an interface.
+ */
+void nsmp_parser_reset(nsmp_parser_s* p);
+
+/**
+ * @brief Calculate the header CRC of a decoded frame.
+ * Covers the control, routing and length bytes - everything in the header
+ * except the CRC itself.
+ */
+uint8_t nsmp_hdr_crc(const uint8_t* frame);
+
+/**
+ * @brief Write a header, payload length and header CRC to a decoded frame.
+ */
+static inline void nsmp_frame_hdr(uint8_t* frame, const nsmp_hdr_s* hdr,
+																	uint16_t len) {
+	memcpy(frame, hdr, sizeof(*hdr));
+	frame[NSMP_OFS_LEN]			= (uint8_t)len;
+	frame[NSMP_OFS_LEN + 1] = (uint8_t)(len >> 8);
+	frame[NSMP_OFS_CRC]			= nsmp_hdr_crc(frame);
+}
+
+/**
+ * @brief Read the message type of a decoded frame.
+ */
+static inline nsmp_msg_type_e nsmp_frame_type(const uint8_t* frame) {
+	nsmp_ctrl_s ctl;
+	memcpy(&ctl, &frame[NSMP_OFS_CTL], sizeof(ctl));
+	return ctl.type;
+}
+
+/**
+ * @brief Check for a sequenced frame this device sent, which stays in tx_q
+ * until acknowledged - not one it relays for another device, which is done
+ * with once encoded.
+ */
+static inline int nsmp_frame_own_seq(const uint8_t* frame) {
+	return (nsmp_frame_type(frame) == NSMP_MSG_TYPE_CTL_SEQ) &&
+				 (frame[NSMP_OFS_SRC] == nsmp_addr());
+}
+
+/**
+ * @brief Credit used by a frame of len bytes (without the payload CRC): the
+ * rx_q space the parser reserves for it.
+ */
+static inline uint32_t nsmp_credit_cost(size_t len) {
+	return (uint32_t)NSMP_QUEUE_REC_LEN(len + NSMP_PAYLOAD_CRC_LEN);
+}
+
+/**
+ * @brief Check whether an address is routed over an interface.
+ */
+static inline int nsmp_reach(const nsmp_iface_s* iface, uint8_t addr) {
+	return (iface->reach[addr / 32] >> (addr % 32)) & 1;
+}
+
+static inline void nsmp_reach_set(nsmp_iface_s* iface, uint8_t addr) {
+	iface->reach[addr / 32] |= (uint32_t)1 << (addr % 32);
+}
+
+static inline void nsmp_reach_clr(nsmp_iface_s* iface, uint8_t addr) {
+	iface->reach[addr / 32] &= ~((uint32_t)1 << (addr % 32));
+}
+
+/**
+ * @brief Space in front of the payload of a decoded frame taken by a sequence
+ * number and an acknowledgement, 0 if it is not sequenced.
+ */
+static inline size_t nsmp_frame_seq_ofs(const uint8_t* frame) {
+	switch (nsmp_frame_type(frame)) {
+		case NSMP_MSG_TYPE_CTL_SEQ:
+			return NSMP_SEQ_LEN;
+
+		case NSMP_MSG_TYPE_CTL_SEQ_ACK:
+			return NSMP_SEQ_LEN + NSMP_ACK_LEN;
+
+		default:
+			return 0;
+	}
+}
+
+/**
+ * @brief Read the payload length field of a decoded frame.
+ */
+static inline uint16_t nsmp_frame_len(const uint8_t* frame) {
+	return (uint16_t)(frame[NSMP_OFS_LEN] | (frame[NSMP_OFS_LEN + 1] << 8));
+}
+
+/**
+ * @brief Check whether a decoded frame, or at least its header, is a user
+ * message published to a topic.
+ */
+static inline int nsmp_frame_topic(const uint8_t* frame) {
+	return (frame[NSMP_OFS_DST] == NSMP_ADDR_TOPIC) &&
+				 (nsmp_frame_type(frame) == NSMP_MSG_TYPE_USER_MESSAGE);
+}
+
+/**
+ * @brief Check whether an rx_q record holds a frame as it arrived, after its
+ * decoded header, rather than the decoded frame. The encoded frame is always
+ * longer than the payload it carries, so the lengths tell them apart.
+ */
+static inline int nsmp_frame_encoded(const uint8_t* frame, size_t len) {
+	return len != (NSMP_HDR_LEN + nsmp_frame_len(frame));
+}
+
+/**
+ * @brief Handler of nsmp_cfg_s::dispatch that takes a received message of a
+ * type, NULL if there is none.
+ */
+static inline nsmp_handler_f nsmp_dispatch_find(const nsmp_dispatch_s* d,
+																								uint8_t type, const uint8_t* data,
+																								size_t len) {
+	if (type >= NSMP_MSG_TYPE_CTL_ACK) {
+		return NULL;
+	}
+	if ((type == NSMP_MSG_TYPE_USER_MESSAGE) && len && (data[0] < NSMP_PORTS) &&
+			d->port[data[0]]) {
+		return d->port[data[0]];
+	}
+	return d->type[type];
+}
@@ -0,0 +1,156 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Memory ordering between the producer and the consumer.
+ *
+ * By default C11 atomics are used. Toolchains without <stdatomic.h> (or
+ * targets where a plain compiler barrier is enough, e.g. single-core MCUs
+ * with the producer in an ISR) can define NSMP_QUEUE_BARRIER() to a barrier
+ * of their choice, the indices are then accessed as volatile words.
+ */
+#if !defined(NSMP_QUEUE_BARRIER) && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define NSMP_QUEUE_ATOMIC
+typedef _Atomic uint32_t nsmp_qidx_t;
+#else
+#ifndef NSMP_QUEUE_BARRIER
+#define NSMP_QUEUE_BARRIER() __sync_synchronize()
+#endif
+typedef volatile uint32_t nsmp_qidx_t;
+#endif
+
+/* Records are aligned to, and prefixed with, one 32-bit word */
+#define NSMP_QUEUE_ALIGN (4)
+
+/* Space taken by a record of n bytes, including its prefix and padding */
+#define NSMP_QUEUE_REC_LEN(n)                                                  \
+	((NSMP_QUEUE_ALIGN + (n) + (NSMP_QUEUE_ALIGN - 1)) &                         \
+	 ~(size_t)(NSMP_QUEUE_ALIGN - 1))
+
+/* Buffer length that always fits m records of up to n bytes each. One extra
+ * record covers the space lost when a record wraps to the start of the buffer. */
+#define NSMP_QUEUE_SIZE(m, n)                                                  \
+	((((m) + 1) * NSMP_QUEUE_REC_LEN(n)) + NSMP_QUEUE_ALIGN)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Lock-free single-producer/single-consumer ring of variable-length
+ * records, laid over a user-supplied buffer (tx_q/rx_q).
+ *
+ * Each record takes only its own length plus a one word prefix, so a queue
+ * sized for a few large messages holds many more small ones. A record that
+ * does not fit before the end of the buffer is placed at the start.
+ *
+ * One context (e.g. an ISR) may call reserve/commit while another (e.g. the
+ * main loop) calls peek/release, without masking interrupts. The consumer may
+ * also walk and tag records it has not released yet.
+ */
+typedef struct {
+	uint8_t* buf;
+	uint32_t size; /* Usable length of buf, a multiple of NSMP_QUEUE_ALIGN */
+
+	nsmp_qidx_t head; /* Offset of the oldest record, written by the consumer */
+	nsmp_qidx_t tail; /* Offset of the next record, written by the producer */
+
+	/* Producer only */
+	uint32_t rsv;	 /* Offset of the reserved record */
+	uint32_t wrap; /* Non-zero if the reserved record wraps to the start */
+} nsmp_queue_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Initialise a queue over a buffer.
+ *
+ * @param q Queue to initialise.
+ * @param buf Queue storage, ideally aligned to NSMP_QUEUE_ALIGN.
+ * @param len Length of buf in bytes.
+ * @return int 0 on success, -1 if buf is too small to hold a record.
+ */
+int nsmp_queue_init(nsmp_queue_s* q, uint8_t* buf, size_t len);
+
+/**
+ * @brief Reserve contiguous space for a record of up to len bytes at the tail
+ * of the queue. The record is not visible to the consumer until
+ * nsmp_queue_commit(). Reserving again without committing abandons the
+ * previous reservation. Producer only.
+ *
+ * @return uint8_t* Pointer to the reserved space, or NULL if there is not
+ * enough free space.
+ */
+uint8_t* nsmp_queue_reserve(nsmp_queue_s* q, size_t len);
+
+/**
+ * @brief Publish the reserved record. Producer only.
+ *
+ * @param len Final length of the record, no larger than the reservation.
+ */
+void nsmp_queue_commit(nsmp_queue_s* q, size_t len);
+
+/**
+ * @brief Get the record at the head of the queue without removing it.
+ * Consumer only.
+ *
+ * @param len Set to the length of the record.
+ * @return uint8_t* Pointer to the record, or NULL if the queue is empty.
+ */
+uint8_t* nsmp_queue_peek(nsmp_queue_s* q, size_t* len);
+
+/**
+ * @brief Remove the record at the head of the queue. Consumer only.
+ */
+void nsmp_queue_release(nsmp_queue_s* q);
+
+/**
+ * @brief Get a committed record without removing it, for consumers that keep
+ * records after reading them. Walk the queue by starting from
+ * nsmp_queue_head() and moving on with nsmp_queue_next(). Consumer only.
+ *
+ * @param pos Position of the record, updated if the record has wrapped to
+ * the start of the buffer.
+ * @param len Set to the length of the record.
+ * @return uint8_t* Pointer to the record, or NULL if pos is the tail.
+ */
+uint8_t* nsmp_queue_at(nsmp_queue_s* q, uint32_t* pos, size_t* len);
+
+/**
+ * @brief Position of the record at the head of the queue. Consumer only.
+ */
+uint32_t nsmp_queue_head(nsmp_queue_s* q);
+
+/**
+ * @brief Position following a record returned by nsmp_queue_at().
+ * Consumer only.
+ */
+uint32_t nsmp_queue_next(nsmp_queue_s* q, uint32_t pos);
+
+/**
+ * @brief Set the tag of a committed record, 0 when it is committed. Tags are
+ * free for the consumer to use, except for 0xFF. Consumer only.
+ *
+ * @param rec Record returned by nsmp_queue_at() or nsmp_queue_peek().
+ */
+void nsmp_queue_set_tag(uint8_t* rec, uint8_t tag);
+
+/**
+ * @brief Get the tag of a committed record. Consumer only.
+ */
+uint8_t nsmp_queue_tag(const uint8_t* rec);
+
+/**
+ * @brief Number of bytes currently used by committed records.
+ * Safe to call from either side; the result may be stale.
+ */
+size_t nsmp_queue_used(nsmp_queue_s* q);
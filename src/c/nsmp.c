@@ -8,8 +8,10 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "nsmp.h"
+#include "nsmp_private.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -18,33 +20,757 @@
 
 typedef struct {
 	uint8_t				addr;	 /* Local address */
+	nsmp_role_e		role;	 /* Peer or node */
+	uint8_t				nif;	 /* Number of registered interfaces */
 	nsmp_iface_s* iface; /* Linked list of interfaces */
+	nsmp_iface_s* ifaces[NSMP_MAX_IFACES]; /* Interfaces by index */
+	nsmp_cfg_s		cfg;	 /* Device configuration */
+	uint32_t			ticks; /* nsmp_update() calls, the clock without get_time_ms */
+	nsmp_sched_s	sched; /* Interfaces served by nsmp_update() */
+	uint32_t			rt_seq; /* Route changes made, odd while one is being made */
+	uint8_t				lock;	 /* Held by a worker changing what the workers share */
 } nsmp_ctx_s;
 
 /**
- * @brief Routing table.
+ * @brief Routing table entry, indexed by destination address.
  */
 typedef struct {
 	uint8_t iface_idx; /* Interface index */
-	uint8_t tof;			 /* Time of flight */
+	uint8_t hops;			 /* Links to the destination, 0 when there is no route */
 } nsmp_rtab_s;
 
-static nsmp_rtab_s rtab[NSMP_MAX_PEERS];
+static nsmp_rtab_s rtab[NSMP_ADDR_NB];
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int			nsmp_discovery_handler(nsmp_msg_s* msg, nsmp_iface_s* iface);
+static int			nsmp_caps_handler(nsmp_msg_s* msg, nsmp_iface_s* iface);
+static void			nsmp_lz_handler(nsmp_msg_s* msg, nsmp_iface_s* iface);
+static void			nsmp_route_learn(nsmp_iface_s* iface, uint8_t addr, uint8_t hops);
+static void			nsmp_route_forget(nsmp_iface_s* iface, uint8_t addr);
+static uint8_t	nsmp_route_find(uint8_t dst, uint8_t* idx);
+static size_t		nsmp_serve(nsmp_iface_s* iface, size_t quota, int* more);
+static int			nsmp_busy(nsmp_iface_s* iface);
+static int			nsmp_late(uint32_t t0);
+static size_t		nsmp_rx_process(nsmp_iface_s* iface, size_t quota);
+static int			nsmp_rx_local(nsmp_iface_s* iface, uint8_t* frame, size_t len,
+															int* held, int* again);
+static void			nsmp_rx_frame(nsmp_iface_s* iface, uint8_t* frame, size_t len,
+															size_t ofs);
+static void			nsmp_ctl_flush(nsmp_iface_s* iface);
+static int			nsmp_shared(const nsmp_iface_s* iface, const uint8_t* frame);
+static void			nsmp_lock(const nsmp_iface_s* iface);
+static int			nsmp_trylock(const nsmp_iface_s* iface);
+static void			nsmp_unlock(const nsmp_iface_s* iface);
+static void			nsmp_route_write(nsmp_rtab_s* r, uint8_t idx, uint8_t hops);
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static nsmp_ctx_s ctx;
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int nsmp_init(nsmp_role_e role) {
+	memset(&ctx, 0, sizeof(ctx));
+	memset(rtab, 0, sizeof(rtab));
+	nsmp_arq_reset();
+	nsmp_frag_reset();
+	nsmp_topic_reset();
+	nsmp_dir_reset();
+	nsmp_worker_reset();
+	ctx.role = role;
+	return nsmp_rcv_init();
+}
+
+int nsmp_config(const nsmp_cfg_s* cfg) {
+	if (!cfg) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	if (cfg->arq_window && nsmp_worker_count()) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	if (cfg->lz_buf && (((uintptr_t)cfg->lz_buf & 3) ||
+											(cfg->lz_len < NSMP_LZ_BUF_LEN(NSMP_LZ_MIN)))) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	ctx.cfg	 = *cfg;
+	ctx.addr = cfg->addr;
+	if (nsmp_rcv_init() != NSMP_OK) {
+		return NSMP_ERR_BAD_ARG;
+	}
+
+	/* Reliable delivery, compression and fragmentation depend on what the
+	 * other end of each link supports, and it needs to know whether we expand
+	 * or reassemble messages - which a new configuration may have changed */
+	for (nsmp_iface_s* iface = ctx.iface; iface; iface = iface->next) {
+		if (iface->tx_q) {
+			iface->ctl_pend |= NSMP_PEND_CAPS_REQ;
+			nsmp_sched_ready(iface);
+		}
+	}
+	return NSMP_OK;
+}
+
+int nsmp_iface_add(nsmp_iface_s* iface) {
+	if (!iface || !iface->rx_q || (ctx.role == NSMP_ROLE_NONE) ||
+			(ctx.nif >= NSMP_MAX_IFACES)) {
+		return NSMP_ERR_BAD_ARG;
+	}
+
+	/* Appended, so the first interface registered stays at the head. One
+	 * already registered is refused before any of its state is touched. */
+	nsmp_iface_s** tail = &ctx.iface;
+	while (*tail) {
+		if (*tail == iface) {
+			return NSMP_ERR_BAD_ARG;
+		}
+		tail = &(*tail)->next;
+	}
+
+	if ((iface->rx_len < NSMP_QUEUE_LEN(1, iface->mtu)) ||
+			(nsmp_queue_init(&iface->rxq, iface->rx_q, iface->rx_len) != 0)) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	if (iface->tx_q &&
+			(!iface->tx_buf || (iface->tx_buf_len < NSMP_FRAME_MAX(iface->mtu)) ||
+			 (iface->tx_len < NSMP_QUEUE_LEN(1, iface->mtu)) ||
+			 (nsmp_tx_lanes(iface) != NSMP_OK))) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	if (iface->bundle_len > iface->mtu) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	nsmp_tx_reset(iface);
+	nsmp_parser_reset(&iface->parser);
+	memset(&iface->bnd, 0, sizeof(iface->bnd));
+	nsmp_credit_reset(iface);
+	nsmp_stats_reset(iface);
+	memset(iface->reach, 0, sizeof(iface->reach));
+	iface->peer_caps = 0;
+	iface->peer_mtu	 = 0;
+	iface->ctl_pend	 = 0;
+	iface->deficit	 = 0;
+	iface->worker		 = NULL;
+	iface->fan			 = 0;
+	iface->dir_from	 = 0;
+
+	/* Find out what the other end supports before using optional features,
+	 * flow control being always used when it is supported */
+	if (iface->tx_q) {
+		iface->ctl_pend |= NSMP_PEND_CAPS_REQ;
+	}
+
+	iface->next						= NULL;
+	iface->idx						= ctx.nif++;
+	ctx.ifaces[iface->idx] = iface;
+	*tail									= iface;
+	nsmp_sched_ready(iface);
+	return NSMP_OK;
+}
+
+void nsmp_sched_ready(nsmp_iface_s* iface) {
+	nsmp_worker_s* const w	 = iface->worker;
+	nsmp_sched_s* const	 s	 = w ? &w->sched : &ctx.sched;
+	uint32_t const			 was = __atomic_fetch_or(
+			 &s->ready, (uint32_t)1 << iface->idx, __ATOMIC_RELEASE);
+
+	if (was) {
+		return;
+	}
+	if (!w) {
+		nsmp_os_signal(NSMP_EV_READY);
+	} else if (w->os.signal) {
+		w->os.signal(w->os.ctx, NSMP_EV_READY);
+	}
+}
+
+void nsmp_sched_assign(nsmp_iface_s* iface, nsmp_worker_s* w) {
+	uint32_t const bit = (uint32_t)1 << iface->idx;
+
+	__atomic_fetch_and(&ctx.sched.ready, ~bit, __ATOMIC_ACQ_REL);
+	ctx.sched.held &= ~bit;
+	iface->worker = w;
+	nsmp_sched_ready(iface);
+}
+
+nsmp_iface_s* nsmp_iface_at(uint8_t idx) {
+	return (idx < ctx.nif) ? ctx.ifaces[idx] : NULL;
+}
+
+nsmp_iface_s* nsmp_iface_first(void) {
+	return ctx.iface;
+}
+
+/* Destinations without a route of their own go towards the broker of their
+ * node, and otherwise to the first interface - the only one of a peer */
+nsmp_iface_s* nsmp_route(uint8_t dst) {
+	uint8_t idx;
+
+	return nsmp_route_find(dst, &idx) ? ctx.ifaces[idx] : ctx.iface;
+}
+
+uint8_t nsmp_route_hops(uint8_t dst) {
+	uint8_t idx;
+
+	return nsmp_route_find(dst, &idx);
+}
+
+nsmp_iface_s* nsmp_relay(const nsmp_iface_s* iface, const uint8_t* frame) {
+	uint8_t const dst = frame[NSMP_OFS_DST];
+
+	if ((ctx.role != NSMP_ROLE_NODE) || (dst == NSMP_ADDR_LINK) ||
+			(dst == NSMP_ADDR_TOPIC) || (dst == ctx.addr)) {
+		return NULL;
+	}
+
+	nsmp_iface_s* const out = nsmp_route(dst);
+	return (out != iface) ? out : NULL;
+}
+
+uint8_t nsmp_addr(void) {
+	return ctx.addr;
+}
+
+nsmp_role_e nsmp_role(void) {
+	return ctx.role;
+}
+
+const nsmp_cfg_s* nsmp_cfg(void) {
+	return &ctx.cfg;
+}
+
+size_t nsmp_lz_max(void) {
+	/* The match table, then a message's worth each way */
+	size_t const max =
+			ctx.cfg.lz_buf ? (ctx.cfg.lz_len - NSMP_LZ_TABLE_LEN) / 2 : 0;
+	return (max < UINT16_MAX) ? max : UINT16_MAX;
+}
+
+uint32_t nsmp_now(void) {
+	/* Also read by nsmp_parse_if(), which may run in another context */
+	return ctx.cfg.get_time_ms ? ctx.cfg.get_time_ms()
+														 : __atomic_load_n(&ctx.ticks, __ATOMIC_RELAXED);
+}
+
+/* Interfaces marked ready are served in turn, starting after the last one
+ * served. Without a budget each is served until it runs out of work. With
+ * one, deficit round-robin shares it out: each turn adds weight frames worth
+ * of bytes to what an interface is owed and it is served up to that, one that
+ * ran out of work is owed nothing more, and rounds go on until none is left
+ * or the budget has been used. */
+int nsmp_update(void) {
+	__atomic_store_n(&ctx.ticks, ctx.ticks + 1, __ATOMIC_RELAXED);
+	nsmp_dir_poll();
+	return nsmp_update_sched(&ctx.sched, NULL);
+}
+
+int nsmp_update_sched(nsmp_sched_s* s, nsmp_worker_s* w) {
+	uint32_t const t0			= nsmp_now();
+	int const			 budget = ctx.cfg.update_bytes || ctx.cfg.update_ms;
+	size_t				 bytes	= SIZE_MAX;
+	uint32_t			 left		= 0;
+	int						 stop		= 0;
+
+	if (ctx.cfg.update_bytes) {
+		bytes = ctx.cfg.update_bytes;
+	}
+
+	for (int more = 1; more && !stop;) {
+		uint32_t const ready =
+				__atomic_load_n(&s->ready, __ATOMIC_ACQUIRE) | s->held;
+		uint8_t const	 first = s->turn;
+
+		more = 0;
+		left = 0;
+		for (uint8_t n = 0; n < ctx.nif; n++) {
+			uint8_t const				idx		= (uint8_t)((first + n) % ctx.nif);
+			uint32_t const			bit		= (uint32_t)1 << idx;
+			nsmp_iface_s* const iface = ctx.ifaces[idx];
+
+			if (!(ready & bit)) {
+				continue;
+			}
+			if (!stop && (!bytes || nsmp_late(t0))) {
+				/* Out of budget, the first one left goes first next time */
+				s->turn = idx;
+				stop		= 1;
+			}
+			if (stop) {
+				left |= nsmp_busy(iface) ? bit : 0;
+				continue;
+			}
+
+			/* Cleared first, so work queued while it is served is not missed */
+			__atomic_fetch_and(&s->ready, ~bit, __ATOMIC_ACQ_REL);
+			s->held &= ~bit;
+			s->turn = (uint8_t)((idx + 1) % ctx.nif);
+
+			/* Frames other workers relayed go out first, including those for
+			 * this interface queued before its bit was cleared */
+			if (w) {
+				nsmp_worker_drain(w);
+			}
+
+			int		 cut	= 0;
+			size_t used = 0;
+			if (!budget) {
+				used = nsmp_serve(iface, SIZE_MAX, &cut);
+			} else {
+				iface->deficit += (int32_t)((iface->weight ? iface->weight : 1) *
+																		NSMP_FRAME_MAX(iface->mtu));
+				cut = 1;
+				if (iface->deficit > 0) {
+					size_t const owed = (size_t)iface->deficit;
+					used = nsmp_serve(iface, (owed < bytes) ? owed : bytes, &cut);
+				}
+				bytes -= (used < bytes) ? used : bytes;
+				iface->deficit = cut ? (iface->deficit - (int32_t)used) : 0;
+			}
+
+			if (cut) {
+				left |= bit;
+				more = 1;
+			}
+			/* Kept apart from ready, so an interface waiting for a timer, credit
+			 * or the transport does not wake an event loop for nothing, and the
+			 * event it waits for is still signalled */
+			if (cut || nsmp_busy(iface)) {
+				s->held |= bit;
+			}
+			/* Relayed frames that were waiting for the room it made */
+			if (w) {
+				nsmp_worker_drain(w);
+			}
+		}
+	}
+	return __builtin_popcount(left);
+}
+
+uint8_t nsmp_hdr_crc(const uint8_t* frame) {
+	const uint8_t b[] = {frame[NSMP_OFS_CTL], frame[NSMP_OFS_DST],
+											 frame[NSMP_OFS_SRC], frame[NSMP_OFS_LEN],
+											 frame[NSMP_OFS_LEN + 1]};
+	return nsmp_crc8(b, sizeof(b));
+}
+
+void nsmp_rx_msg(nsmp_iface_s* iface, nsmp_msg_s* msg) {
+	switch (msg->hdr.ctl.type) {
+		case NSMP_MSG_TYPE_CTL_CAPS:
+			nsmp_caps_handler(msg, iface);
+			return;
+
+		case NSMP_MSG_TYPE_CTL_ACK:
+		case NSMP_MSG_TYPE_CTL_PLS_RETRY:
+			nsmp_arq_ack(msg);
+			return;
+
+		case NSMP_MSG_TYPE_CTL_LZ:
+			nsmp_lz_handler(msg, iface);
+			return;
+
+		case NSMP_MSG_TYPE_CTL_FRAG:
+			nsmp_frag_rx(iface, msg);
+			return;
+
+		case NSMP_MSG_TYPE_CTL_SUBSCRIBE:
+			/* Subscriptions are kept by the device at the other end of the link */
+			nsmp_route_learn(iface, msg->hdr.src, 1);
+			nsmp_topic_ctl(iface, msg);
+			return;
+
+		case NSMP_MSG_TYPE_CTL_DIRECTORY:
+			nsmp_dir_rx(iface, msg);
+			return;
+
+		case NSMP_MSG_TYPE_CTL_STATS:
+			if (msg->hdr.ctl.reqres == NSMP_MSG_REQUEST) {
+				nsmp_stats_rx(iface, msg);
+				return;
+			}
+			/* Responses are for the application, see nsmp_stats_read() */
+			break;
+
+		case NSMP_MSG_TYPE_CTL_BUNDLE:
+		case NSMP_MSG_TYPE_CTL_SEQ:
+		case NSMP_MSG_TYPE_CTL_SEQ_ACK:
+		case NSMP_MSG_TYPE_CTL_SLOWDOWN:
+			/* Not valid inside a bundle or a sequenced message */
+			return;
+
+		case NSMP_MSG_TYPE_CTL_DISCOVERY:
+			nsmp_discovery_handler(msg, iface);
+			break;
+
+		case NSMP_MSG_TYPE_CTL_REGISTER:
+			/* Both ends of a registration are a link away */
+			nsmp_route_learn(iface, msg->hdr.src, 1);
+			break;
+
+		case NSMP_MSG_TYPE_CTL_UNREGISTER:
+			nsmp_arq_forget(msg->hdr.src);
+			nsmp_route_forget(iface, msg->hdr.src);
+			nsmp_topic_forget(msg->hdr.src);
+			nsmp_dir_forget(msg->hdr.src);
+			break;
+
+		default:
+			break;
+	}
+	nsmp_rx_deliver(iface, msg);
+}
+
+void nsmp_rx_deliver(nsmp_iface_s* iface, nsmp_msg_s* msg) {
+	if (ctx.cfg.dispatch) {
+		nsmp_handler_f const h = nsmp_dispatch_find(
+				ctx.cfg.dispatch, msg->hdr.ctl.type, msg->data, msg->len);
+		if (h) {
+			h(msg);
+		}
+	} else if (iface->rx_cb) {
+		iface->rx_cb(msg);
+	} else {
+		nsmp_rcv_put(msg);
+	}
+}
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static int nsmp_discovery_handler(nsmp_msg_s* msg, nsmp_iface_s* iface) {
-	if (msg->hdr.ctl.reqres == NSMP_MSG_REQUEST) {
+/* Serve an interface with up to quota bytes each way, more being set if it
+ * was cut short with work left. Returns the bytes received and transmitted. */
+static size_t nsmp_serve(nsmp_iface_s* iface, size_t quota, int* more) {
+	nsmp_bundle_poll(iface);
+	size_t const rx = nsmp_rx_process(iface, quota);
+	/* Not waiting for a worker that holds the lock, the acknowledgements and
+	 * repeats that are due go out on the next update */
+	if (!nsmp_arq_idle() && nsmp_trylock(iface)) {
+		nsmp_arq_poll(iface);
+		nsmp_unlock(iface);
+	}
+	nsmp_ctl_flush(iface);
+	size_t const tx = nsmp_tx_process(iface, quota);
+
+	*more = ((rx >= quota) || (tx >= quota)) && nsmp_busy(iface);
+	return rx + tx;
+}
+
+/* Work that is not announced with nsmp_sched_ready() - frames kept for a
+ * timer, the transport or credit, messages waiting for queue space, and
+ * acknowledgements waiting for a message to carry them */
+static int nsmp_busy(nsmp_iface_s* iface) {
+	return nsmp_queue_used(&iface->rxq) || iface->ctl_pend || iface->bnd.frame ||
+				 (iface->tx_q &&
+					(nsmp_queue_used(&iface->txq) || nsmp_queue_used(&iface->txu) ||
+					 iface->txb.closed || nsmp_arq_ack_wait(iface)));
+}
+
+/* The update_ms budget of a call started at t0 has been used */
+static int nsmp_late(uint32_t t0) {
+	return ctx.cfg.update_ms && ctx.cfg.get_time_ms &&
+				 ((uint32_t)(nsmp_now() - t0) >= ctx.cfg.update_ms);
+}
+
+/* Pass each received message to the interface callback, in order. Sequenced
+ * messages that arrive early stay in rx_q until the ones before them have
+ * been delivered, so the queue is walked again whenever a delivery may have
+ * released a held message. A node relays frames for other interfaces, those
+ * that cannot be sent yet hold up the rest of rx_q, as do messages for an
+ * application that has not taken the ones before them from rcv_q. Frames
+ * published to a topic go to the other interfaces with a subscriber first,
+ * and hold up the rest the same way until they have gone to all of them.
+ * Returns the bytes of the frames looked at, stopping at the first one past
+ * quota. */
+static size_t nsmp_rx_process(nsmp_iface_s* iface, size_t quota) {
+	nsmp_queue_s* const q		 = &iface->rxq;
+	size_t							used = 0;
+	uint8_t*						frame;
+	size_t							len;
+	int									again;
+
+	do {
+		uint32_t pos	= nsmp_queue_head(q);
+		int			 held = 0;
+
+		again = 0;
+		while ((frame = nsmp_queue_at(q, &pos, &len)) != NULL) {
+			uint8_t const tag = nsmp_queue_tag(frame);
+			if (tag == NSMP_TAG_DONE) {
+				/* Delivered, waiting for the head to catch up */
+				pos = nsmp_queue_next(q, pos);
+				continue;
+			}
+			if (used >= quota) {
+				again = 0;
+				break;
+			}
 
+			if ((tag == NSMP_TAG_NEW) && nsmp_frame_topic(frame)) {
+				if (!nsmp_topic_fan(iface, frame, len)) {
+					again = 0;
+					break;
+				}
+				nsmp_queue_set_tag(frame, NSMP_TAG_FANNED);
+			}
+
+			nsmp_iface_s* const out = nsmp_relay(iface, frame);
+			if (out) {
+				if (!nsmp_worker_relay(iface, out, frame, len)) {
+					again = 0;
+					break;
+				}
+				nsmp_queue_set_tag(frame, NSMP_TAG_DONE);
+			} else if (nsmp_frame_encoded(frame, len)) {
+				/* Kept for relaying, but its route has changed since, or published
+				 * to a topic only other devices subscribe to */
+				nsmp_queue_set_tag(frame, NSMP_TAG_DONE);
+			} else if (nsmp_frame_topic(frame) &&
+								 !nsmp_topic_local(nsmp_topic_of(frame, len))) {
+				nsmp_queue_set_tag(frame, NSMP_TAG_DONE);
+			} else if (!nsmp_rx_local(iface, frame, len, &held, &again)) {
+				/* The application has yet to take the messages before it */
+				again = 0;
+				break;
+			}
+			if (nsmp_queue_tag(frame) == NSMP_TAG_DONE) {
+				nsmp_stats_taken(iface, q, pos);
+			}
+			used += len;
+			pos = nsmp_queue_next(q, pos);
+		}
+	} while (again);
+
+	while (((frame = nsmp_queue_peek(q, &len)) != NULL) &&
+				 (nsmp_queue_tag(frame) == NSMP_TAG_DONE)) {
+		nsmp_queue_release(q);
+	}
+	return used;
+}
+
+/* Deliver a frame for this device, in order: held is set when a sequenced
+ * message is kept for later, again when one may have been released. Returns
+ * 0, leaving the frame queued, if rcv_q has no room for it yet. */
+static int nsmp_rx_local(nsmp_iface_s* iface, uint8_t* frame, size_t len,
+												 int* held, int* again) {
+	uint8_t const tag		 = nsmp_queue_tag(frame);
+	int const			shared = nsmp_shared(iface, frame);
+	int						ok		 = 1;
+
+	if (shared) {
+		nsmp_lock(iface);
+	}
+	if (!nsmp_rcv_room(iface, frame, len)) {
+		ok = 0;
+	} else if (!nsmp_frame_seq_ofs(frame)) {
+		nsmp_rx_frame(iface, frame, len, 0);
+		nsmp_queue_set_tag(frame, NSMP_TAG_DONE);
 	} else {
+		switch (nsmp_arq_rx(iface, frame, tag == NSMP_TAG_NEW)) {
+			case NSMP_ARQ_DELIVER:
+				nsmp_rx_frame(iface, frame, len, nsmp_frame_seq_ofs(frame));
+				nsmp_queue_set_tag(frame, NSMP_TAG_DONE);
+				*again |= *held;
+				break;
+
+			case NSMP_ARQ_HOLD:
+				nsmp_queue_set_tag(frame, NSMP_TAG_HELD);
+				*held = 1;
+				break;
+
+			default:
+				nsmp_queue_set_tag(frame, NSMP_TAG_DONE);
+				break;
+		}
+	}
+	if (shared) {
+		nsmp_unlock(iface);
+	}
+	return ok;
+}
+
+/* Deliver a received frame, ofs being the space taken by a sequence number
+ * and an acknowledgement */
+static void nsmp_rx_frame(nsmp_iface_s* iface, uint8_t* frame, size_t len,
+													size_t ofs) {
+	nsmp_msg_s msg;
+
+	memcpy(&msg.hdr, frame, sizeof(msg.hdr));
+	if (ofs) {
+		memcpy(&msg.hdr.ctl, &frame[NSMP_OFS_SEQ_CTL], sizeof(msg.hdr.ctl));
+	}
+	msg.len		= (uint16_t)(len - NSMP_HDR_LEN - ofs);
+	msg.data	= frame + NSMP_HDR_LEN + ofs;
+	msg.flags = 0;
+
+	if (msg.hdr.ctl.type == NSMP_MSG_TYPE_CTL_BUNDLE) {
+		nsmp_bundle_unpack(iface, &msg.hdr, msg.data, msg.len);
+	} else {
+		nsmp_rx_msg(iface, &msg);
+	}
+}
+
+/* Queue control messages that were waiting for the interface's tx_q */
+static void nsmp_ctl_flush(nsmp_iface_s* iface) {
+	uint16_t const ours =
+			NSMP_CAPS & ~(ctx.cfg.lz_buf ? 0 : NSMP_CAP_LZ) &
+			~((ctx.cfg.frag_buf || ctx.cfg.frag_cb) ? 0 : NSMP_CAP_FRAG);
+	uint8_t const caps[] = {(uint8_t)ours, (uint8_t)(ours >> 8),
+													(uint8_t)iface->mtu, (uint8_t)(iface->mtu >> 8)};
+
+	if (!iface->ctl_pend || !iface->tx_q || nsmp_tx_reserved(iface)) {
+		return;
+	}
+
+	if ((iface->ctl_pend & NSMP_PEND_CAPS_REQ) &&
+			(nsmp_ctl_send(iface, NSMP_ADDR_LINK, NSMP_MSG_TYPE_CTL_CAPS,
+										 NSMP_MSG_REQUEST, caps, sizeof(caps)) == NSMP_OK)) {
+		iface->ctl_pend &= (uint8_t)~NSMP_PEND_CAPS_REQ;
+	}
+	if ((iface->ctl_pend & NSMP_PEND_CAPS_RSP) &&
+			(nsmp_ctl_send(iface, NSMP_ADDR_LINK, NSMP_MSG_TYPE_CTL_CAPS,
+										 NSMP_MSG_RESPONSE, caps, sizeof(caps)) == NSMP_OK)) {
+		iface->ctl_pend &= (uint8_t)~NSMP_PEND_CAPS_RSP;
+	}
+	nsmp_dir_flush(iface);
+	nsmp_stats_flush(iface);
+}
+
+/* Capabilities and mtu of the device at the other end of the link, a request
+ * is answered with our own */
+static int nsmp_caps_handler(nsmp_msg_s* msg, nsmp_iface_s* iface) {
+	if (msg->len < 2 * sizeof(uint16_t)) {
+		return NSMP_ERR_BAD_LEN;
+	}
+
+	iface->peer_caps = (uint16_t)(msg->data[0] | (msg->data[1] << 8)) & NSMP_CAPS;
+	iface->peer_mtu	 = (uint16_t)(msg->data[2] | (msg->data[3] << 8));
+	if (msg->hdr.ctl.reqres == NSMP_MSG_REQUEST) {
+		iface->ctl_pend |= NSMP_PEND_CAPS_RSP;
+	}
+	return NSMP_OK;
+}
+
+/* Expand a compressed message and handle it as it was sent */
+static void nsmp_lz_handler(nsmp_msg_s* msg, nsmp_iface_s* iface) {
+	size_t const max = nsmp_lz_max();
+	nsmp_msg_s	 m	 = *msg;
+
+	if (!max || (msg->len < NSMP_LZ_HDR)) {
+		return;
+	}
+	memcpy(&m.hdr.ctl, msg->data, sizeof(m.hdr.ctl));
+	m.len	 = (uint16_t)(msg->data[1] | (msg->data[2] << 8));
+	m.data = ctx.cfg.lz_buf + NSMP_LZ_TABLE_LEN + max;
+
+	/* Only messages that are delivered are ever compressed */
+	if ((m.hdr.ctl.type >= NSMP_MSG_TYPE_CTL_ACK) || (m.len > max) ||
+			(nsmp_lz_decompress(&msg->data[NSMP_LZ_HDR], msg->len - NSMP_LZ_HDR,
+													m.data, m.len) != m.len)) {
+		return;
+	}
+	nsmp_rx_msg(iface, &m);
+}
+
+static int nsmp_discovery_handler(nsmp_msg_s* msg, nsmp_iface_s* iface) {
+	/* Discovery is answered by the device at the other end of the link, so
+	 * requests and responses both come from a direct connection */
+	nsmp_route_learn(iface, msg->hdr.src, 1);
+	nsmp_dir_rx(iface, msg);
+	return NSMP_OK;
+}
+
+/* Add or update the route to an address. A route over another interface is
+ * only replaced by a shorter one, so equal paths do not take turns. */
+static void nsmp_route_learn(nsmp_iface_s* iface, uint8_t addr, uint8_t hops) {
+	nsmp_rtab_s* const r = &rtab[addr];
 
-		size_t rtab_len = sizeof(rtab);
+	if ((addr == NSMP_ADDR_LINK) || (addr == NSMP_ADDR_TOPIC) ||
+			(addr == ctx.addr) || !hops) {
+		return;
+	}
+	if (r->hops && (r->iface_idx != iface->idx)) {
+		if (r->hops <= hops) {
+			return;
+		}
+		nsmp_reach_clr(ctx.ifaces[r->iface_idx], addr);
+	}
+	if ((r->iface_idx != iface->idx) || (r->hops != hops)) {
+		nsmp_route_write(r, iface->idx, hops);
+	}
+	nsmp_reach_set(iface, addr);
+}
+
+/* Remove the route to an address, if it goes over the interface the address
+ * left from */
+static void nsmp_route_forget(nsmp_iface_s* iface, uint8_t addr) {
+	nsmp_rtab_s* const r = &rtab[addr];
+
+	if (r->hops && (r->iface_idx == iface->idx)) {
+		nsmp_route_write(r, r->iface_idx, 0);
+		nsmp_reach_clr(iface, addr);
+	}
+}
+
+/* Change a route. Routes are changed by one context at a time - with workers,
+ * the one holding the lock while it delivers a control message - and
+ * looked up from any without a lock, a lookup that overlaps a change being
+ * made again. */
+static void nsmp_route_write(nsmp_rtab_s* r, uint8_t idx, uint8_t hops) {
+	__atomic_store_n(&ctx.rt_seq, ctx.rt_seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&r->iface_idx, idx, __ATOMIC_RELAXED);
+	__atomic_store_n(&r->hops, hops, __ATOMIC_RELAXED);
+	__atomic_store_n(&ctx.rt_seq, ctx.rt_seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Route to an address, or to the broker of its node one hop further. Returns
+ * the number of hops, 0 if there is no route. */
+static uint8_t nsmp_route_find(uint8_t dst, uint8_t* idx) {
+	uint8_t const broker = NSMP_ADDR(1, NSMP_ADDR_NODE(dst), 0);
+	uint32_t			seq;
+	uint8_t				hops;
+
+	do {
+		seq	 = __atomic_load_n(&ctx.rt_seq, __ATOMIC_ACQUIRE);
+		hops = __atomic_load_n(&rtab[dst].hops, __ATOMIC_RELAXED);
+		*idx = __atomic_load_n(&rtab[dst].iface_idx, __ATOMIC_RELAXED);
+		if (!hops) {
+			hops = __atomic_load_n(&rtab[broker].hops, __ATOMIC_RELAXED);
+			*idx = __atomic_load_n(&rtab[broker].iface_idx, __ATOMIC_RELAXED);
+			hops = (hops && (hops < UINT8_MAX)) ? (uint8_t)(hops + 1) : 0;
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) ||
+					 (seq != __atomic_load_n(&ctx.rt_seq, __ATOMIC_RELAXED)));
+	return hops;
+}
+
+/* Whether delivering a frame to this device touches what the workers share -
+ * routes and the other tables kept by control messages, the reliable
+ * delivery state and rcv_q. A plain message for rx_cb or a dispatch table
+ * does not, and is delivered without the lock. */
+static int nsmp_shared(const nsmp_iface_s* iface, const uint8_t* frame) {
+	return (nsmp_frame_type(frame) != NSMP_MSG_TYPE_USER_MESSAGE) ||
+				 (!ctx.cfg.dispatch && !iface->rx_cb);
+}
+
+/* Taken on an interface of a worker around what nsmp_shared() lists */
+static void nsmp_lock(const nsmp_iface_s* iface) {
+	if (!iface->worker) {
+		return;
+	}
+	while (__atomic_test_and_set(&ctx.lock, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(&ctx.lock, __ATOMIC_RELAXED)) {
+		}
+	}
+}
+
+/* Returns 0 if another worker holds the lock */
+static int nsmp_trylock(const nsmp_iface_s* iface) {
+	return !iface->worker || !__atomic_test_and_set(&ctx.lock, __ATOMIC_ACQUIRE);
+}
 
-		// Update direct connections
-		iface->rtab[msg->hdr.src] = 1;
+static void nsmp_unlock(const nsmp_iface_s* iface) {
+	if (iface->worker) {
+		__atomic_clear(&ctx.lock, __ATOMIC_RELEASE);
 	}
 }
@@ -0,0 +1,481 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Reliable delivery - selective repeat with a sliding window per peer.
+ *
+ * User messages to a peer get an 8-bit sequence number and are sent as
+ * NSMP_MSG_TYPE_CTL_SEQ frames. A sent message stays in tx_q, tagged
+ * NSMP_TAG_PEND, until the peer acknowledges it - so the memory used is
+ * bounded by tx_q, and a full window simply stops the transmit queue.
+ *
+ * The receiver keeps messages that arrive out of order in rx_q (tagged
+ * NSMP_TAG_HELD) and delivers them once the gap is filled. It answers with
+ * CTL_ACK [next expected seq][32-bit bitmap of held messages], or with
+ * CTL_PLS_RETRY carrying the same when it first notices a gap, which makes
+ * the sender repeat the missing messages straight away instead of waiting
+ * for the retransmission timeout. Repeated messages have the retry bit set,
+ * so a receiver can tell a duplicate from a sender that has restarted.
+ *
+ * An acknowledgement may wait up to arq_ack_ms, covering whatever arrives in
+ * the meantime. A message sent to the same peer before then carries it, as
+ * CTL_SEQ_ACK [seq][ctl][CTL_ACK payload][payload] - added by tx_frame() as
+ * the frame is encoded, so it is as fresh as it can be and the message in
+ * tx_q is untouched.
+ *
+ * State is kept for NSMP_ARQ_PEERS peers at once. A peer with nothing in
+ * flight either way, unused for NSMP_ARQ_IDLE_MS, gives up its slot to the
+ * next one that needs it - the least recently used first - and a peer that
+ * unregisters gives it up at once. Sequenced messages from a peer that finds
+ * no slot are dropped unacknowledged, to be repeated once one is free. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nsmp.h"
+#include "nsmp_private.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Acknowledgements waiting to be sent to a peer */
+#define ACK_PEND	(1u << 0)
+#define NACK_PEND (1u << 1)
+
+/* Sequence numbers this far behind the window base are old */
+#define SEQ_BEHIND (0x80)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef struct {
+	uint8_t	 used;
+	uint8_t	 addr;
+	uint32_t last; /* Last looked up, for handing the slot to another peer */
+
+	/* Sending */
+	uint8_t	 seq;			/* Next sequence number to assign */
+	uint8_t	 tx_base; /* Oldest unacknowledged sequence number */
+	uint8_t	 tx_next; /* Next sequence number to be sent for the first time */
+	uint32_t tx_sack; /* Acknowledged beyond tx_base, bit n is tx_base + 1 + n */
+	uint32_t tx_time; /* Last transmission or acknowledgement progress */
+
+	/* Receiving */
+	uint8_t	 rx_base;		/* Next sequence number to deliver */
+	uint8_t	 rx_new;		/* Nothing received since the slot was taken */
+	uint8_t	 rx_ack;		/* ACK_PEND, NACK_PEND */
+	uint8_t	 rx_nacked; /* A retry was requested for the current gap */
+	uint8_t	 rx_unack;	/* Messages received since the last acknowledgement */
+	uint32_t rx_have;		/* Held beyond rx_base, bit n is rx_base + 1 + n */
+	uint32_t rx_time;		/* Time the oldest of them was received */
+} arq_peer_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static arq_peer_s* peer_get(uint8_t addr, int create);
+static int				 quiet(const arq_peer_s* p, uint32_t now);
+static uint8_t		 window(void);
+static int				 ack_due(const arq_peer_s* p, uint32_t now);
+static void				 ack_fill(const arq_peer_s* p, uint8_t* ack);
+static void ack_rx(uint8_t src, const uint8_t* data, nsmp_msg_type_e type);
+static void tx_walk(nsmp_iface_s* iface, const arq_peer_s* p, uint8_t resend);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static arq_peer_s peers[NSMP_ARQ_PEERS];
+static uint8_t		active; /* A peer slot has been used since the reset */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void nsmp_arq_reset(void) {
+	memset(peers, 0, sizeof(peers));
+	active = 0;
+}
+
+int nsmp_arq_idle(void) {
+	return !__atomic_load_n(&active, __ATOMIC_ACQUIRE);
+}
+
+size_t nsmp_arq_ofs(const nsmp_iface_s* iface, const nsmp_hdr_s* hdr) {
+	/* Messages published to a topic have no one peer to acknowledge them */
+	if (!nsmp_cfg()->arq_window || !(iface->peer_caps & NSMP_CAP_ARQ) ||
+			(hdr->dst == NSMP_ADDR_TOPIC) ||
+			((hdr->ctl.type != NSMP_MSG_TYPE_USER_MESSAGE) &&
+			 (hdr->ctl.type != NSMP_MSG_TYPE_CTL_FRAG))) {
+		return 0;
+	}
+	/* Without a free peer slot the message goes out unsequenced */
+	return peer_get(hdr->dst, 1) ? NSMP_SEQ_LEN : 0;
+}
+
+size_t nsmp_arq_room(const nsmp_iface_s* iface) {
+	return (nsmp_cfg()->arq_window && (iface->peer_caps & NSMP_CAP_ARQ) &&
+					!iface->txu.size)
+						 ? NSMP_ACK_ROOM
+						 : 0;
+}
+
+size_t nsmp_arq_seal(uint8_t* frame, const nsmp_hdr_s* hdr, size_t ofs,
+										 size_t len) {
+	if (!ofs) {
+		nsmp_frame_hdr(frame, hdr, (uint16_t)len);
+		return NSMP_HDR_LEN + len;
+	}
+
+	arq_peer_s* const p			= peer_get(hdr->dst, 0);
+	nsmp_hdr_s				outer = *hdr;
+	outer.ctl.data					= 1;
+	outer.ctl.retry					= 0;
+	outer.ctl.type					= NSMP_MSG_TYPE_CTL_SEQ;
+
+	frame[NSMP_OFS_SEQ] = p->seq++;
+	memcpy(&frame[NSMP_OFS_SEQ_CTL], &hdr->ctl, sizeof(hdr->ctl));
+	nsmp_frame_hdr(frame, &outer, (uint16_t)(NSMP_SEQ_LEN + len));
+	return NSMP_HDR_LEN + NSMP_SEQ_LEN + len;
+}
+
+int nsmp_arq_tx_ready(const uint8_t* frame) {
+	if (!nsmp_cfg()->arq_window || !nsmp_frame_own_seq(frame)) {
+		/* Not ours, relayed for another device */
+		return 1;
+	}
+
+	const arq_peer_s* const p = peer_get(frame[NSMP_OFS_DST], 0);
+
+	return !p || ((uint8_t)(frame[NSMP_OFS_SEQ] - p->tx_base) < window());
+}
+
+int nsmp_arq_tx_sent(const uint8_t* frame) {
+	if (!nsmp_cfg()->arq_window || !nsmp_frame_own_seq(frame)) {
+		return 0;
+	}
+
+	arq_peer_s* const p = peer_get(frame[NSMP_OFS_DST], 0);
+	if (!p) {
+		/* The peer unregistered, nothing will acknowledge it */
+		return 0;
+	}
+	if (p->tx_next == p->tx_base) {
+		p->tx_time = nsmp_now();
+	}
+	p->tx_next = (uint8_t)(frame[NSMP_OFS_SEQ] + 1);
+	return 1;
+}
+
+int nsmp_arq_rx(nsmp_iface_s* iface, const uint8_t* frame, int fresh) {
+	arq_peer_s* const p = peer_get(frame[NSMP_OFS_SRC], 1);
+	nsmp_ctrl_s				ctl;
+
+	if (!p) {
+		/* No state to put it in order with, the sender repeats it until a slot
+		 * is free */
+		return NSMP_ARQ_DROP;
+	}
+
+	uint8_t const seq = frame[NSMP_OFS_SEQ];
+	if (p->rx_new && fresh) {
+		/* The peer may be part way through its sequence numbers - its slot went
+		 * to another peer in the meantime - so follow on from this message,
+		 * unless it can be one of the first window of a peer that has just
+		 * started */
+		p->rx_new = 0;
+		if ((uint8_t)(seq - 1) >= NSMP_ARQ_WINDOW_MAX) {
+			p->rx_base = seq;
+		}
+	}
+
+	memcpy(&ctl, &frame[NSMP_OFS_CTL], sizeof(ctl));
+	uint8_t const d = (uint8_t)(seq - p->rx_base);
+	if (fresh) {
+		if (ctl.type == NSMP_MSG_TYPE_CTL_SEQ_ACK) {
+			ack_rx(p->addr, &frame[NSMP_OFS_SEQ_ACK], NSMP_MSG_TYPE_CTL_ACK);
+		}
+		if (!p->rx_ack) {
+			p->rx_time = nsmp_now();
+		}
+		p->rx_ack |= ACK_PEND;
+		p->rx_unack++;
+	}
+
+	if (d == 0) {
+		p->rx_base++;
+		p->rx_have >>= 1;
+		p->rx_nacked = 0;
+		return NSMP_ARQ_DELIVER;
+	}
+
+	if (d <= NSMP_ARQ_WINDOW_MAX) {
+		uint32_t const bit = 1ul << (d - 1);
+		if (!fresh) {
+			return (p->rx_have & bit) ? NSMP_ARQ_HOLD : NSMP_ARQ_DROP;
+		}
+		/* Keep room in rx_q for the messages that are missing */
+		if ((p->rx_have & bit) ||
+				((iface->rxq.size - nsmp_queue_used(&iface->rxq)) <
+				 NSMP_QUEUE_LEN(1, iface->mtu))) {
+			return NSMP_ARQ_DROP;
+		}
+		p->rx_have |= bit;
+		if (!p->rx_nacked) {
+			p->rx_ack |= NACK_PEND;
+			p->rx_nacked = 1;
+		}
+		return NSMP_ARQ_HOLD;
+	}
+
+	if ((d > NSMP_ARQ_WINDOW_MAX) && (d < 0x100 - NSMP_ARQ_WINDOW_MAX) &&
+			fresh && !ctl.retry) {
+		/* A sequence number outside the window sent for the first time, too old
+		 * to be a copy of a recent message - the peer restarted */
+		p->rx_base	 = (uint8_t)(seq + 1);
+		p->rx_have	 = 0;
+		p->rx_nacked = 0;
+		return NSMP_ARQ_DELIVER;
+	}
+
+	/* A repeat of a message already delivered, the acknowledgement was lost */
+	return NSMP_ARQ_DROP;
+}
+
+void nsmp_arq_forget(uint8_t addr) {
+	arq_peer_s* const		p			= peer_get(addr, 0);
+	nsmp_iface_s* const iface = nsmp_route(addr);
+
+	if (!p) {
+		return;
+	}
+	if (iface && iface->tx_q) {
+		/* What was sent to it is done with, acknowledged or not */
+		p->tx_base = (uint8_t)(p->tx_base + SEQ_BEHIND);
+		p->tx_sack = 0;
+		tx_walk(iface, p, 0);
+	}
+	memset(p, 0, sizeof(*p));
+}
+
+void nsmp_arq_ack(nsmp_msg_s* msg) {
+	if (msg->len >= NSMP_ACK_LEN) {
+		ack_rx(msg->hdr.src, msg->data, msg->hdr.ctl.type);
+	}
+}
+
+size_t nsmp_arq_ack_fill(const nsmp_iface_s* iface, const uint8_t* frame,
+												 size_t len, uint8_t* ack) {
+	uint16_t const mtu =
+			(iface->peer_mtu < iface->mtu) ? iface->peer_mtu : iface->mtu;
+
+	/* Not when it would make the frame too long for either end */
+	if (!(iface->peer_caps & NSMP_CAP_ACK) ||
+			(len + NSMP_ACK_LEN > NSMP_HDR_LEN + NSMP_SEQ_LEN + mtu)) {
+		return 0;
+	}
+
+	const arq_peer_s* const p = peer_get(frame[NSMP_OFS_DST], 0);
+	if (!p || (p->rx_ack != ACK_PEND)) {
+		/* Retry requests are sent on their own, at once */
+		return 0;
+	}
+	ack_fill(p, ack);
+	return NSMP_ACK_LEN;
+}
+
+void nsmp_arq_ack_sent(const uint8_t* frame) {
+	arq_peer_s* const p = peer_get(frame[NSMP_OFS_DST], 0);
+
+	if (p) {
+		p->rx_ack		= 0;
+		p->rx_unack = 0;
+	}
+}
+
+int nsmp_arq_ack_wait(const nsmp_iface_s* iface) {
+	if (nsmp_arq_idle()) {
+		return 0;
+	}
+	for (size_t i = 0; i < NSMP_ARQ_PEERS; i++) {
+		if (peers[i].used && peers[i].rx_ack &&
+				(nsmp_route(peers[i].addr) == iface)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void nsmp_arq_poll(nsmp_iface_s* iface) {
+	const nsmp_cfg_s* const cfg = nsmp_cfg();
+	uint32_t const					rto = cfg->arq_rto_ms ? cfg->arq_rto_ms : NSMP_ARQ_RTO_MS;
+	uint32_t const					now = nsmp_now();
+
+	if (!iface->tx_q || nsmp_tx_reserved(iface)) {
+		return;
+	}
+
+	for (size_t i = 0; i < NSMP_ARQ_PEERS; i++) {
+		arq_peer_s* const p = &peers[i];
+		if (!p->used || (nsmp_route(p->addr) != iface)) {
+			continue;
+		}
+
+		if (p->rx_ack && ack_due(p, now)) {
+			uint8_t ack[NSMP_ACK_LEN];
+			ack_fill(p, ack);
+			nsmp_msg_type_e const type = (p->rx_ack & NACK_PEND)
+																			 ? NSMP_MSG_TYPE_CTL_PLS_RETRY
+																			 : NSMP_MSG_TYPE_CTL_ACK;
+			if (nsmp_ctl_send(iface, p->addr, type, NSMP_MSG_RESPONSE, ack,
+												sizeof(ack)) == NSMP_OK) {
+				p->rx_ack		= 0;
+				p->rx_unack = 0;
+			}
+		}
+
+		if ((p->tx_next != p->tx_base) && ((uint32_t)(now - p->tx_time) >= rto)) {
+			p->tx_time = now;
+			tx_walk(iface, p, SEQ_BEHIND);
+		}
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Slot of a peer. One is taken for a peer without, if create is set: a free
+ * one, or else the least recently used of those that are quiet. */
+static arq_peer_s* peer_get(uint8_t addr, int create) {
+	uint32_t const now	= nsmp_now();
+	arq_peer_s*		 free = NULL;
+	arq_peer_s*		 lru	= NULL;
+
+	for (size_t i = 0; i < NSMP_ARQ_PEERS; i++) {
+		arq_peer_s* const p = &peers[i];
+
+		if (!p->used) {
+			free = free ? free : p;
+		} else if (p->addr == addr) {
+			p->last = now;
+			return p;
+		} else if (quiet(p, now) &&
+							 (!lru || ((uint32_t)(now - p->last) >
+												 (uint32_t)(now - lru->last)))) {
+			lru = p;
+		}
+	}
+	free = free ? free : lru;
+	if (!create || !free) {
+		return NULL;
+	}
+
+	memset(free, 0, sizeof(*free));
+	free->used	 = 1;
+	free->addr	 = addr;
+	free->last	 = now;
+	free->rx_new = 1;
+	__atomic_store_n(&active, 1, __ATOMIC_RELEASE);
+	return free;
+}
+
+/* Nothing in flight either way, and unused for NSMP_ARQ_IDLE_MS */
+static int quiet(const arq_peer_s* p, uint32_t now) {
+	return (p->seq == p->tx_base) && !p->rx_have && !p->rx_ack &&
+				 ((uint32_t)(now - p->last) >= NSMP_ARQ_IDLE_MS);
+}
+
+static uint8_t window(void) {
+	uint8_t const w = nsmp_cfg()->arq_window;
+
+	if (!w) {
+		return 1;
+	}
+	return (w > NSMP_ARQ_WINDOW_MAX) ? NSMP_ARQ_WINDOW_MAX : w;
+}
+
+/* An acknowledgement has waited long enough for a message to carry it */
+static int ack_due(const arq_peer_s* p, uint32_t now) {
+	uint16_t const ms = nsmp_cfg()->arq_ack_ms;
+
+	return !ms || (p->rx_ack & NACK_PEND) ||
+				 (p->rx_unack >= (window() + 1) / 2) ||
+				 ((uint32_t)(now - p->rx_time) >= ms);
+}
+
+/* Payload of an acknowledgement of what has been received from a peer */
+static void ack_fill(const arq_peer_s* p, uint8_t* ack) {
+	ack[0] = p->rx_base;
+	ack[1] = (uint8_t)p->rx_have;
+	ack[2] = (uint8_t)(p->rx_have >> 8);
+	ack[3] = (uint8_t)(p->rx_have >> 16);
+	ack[4] = (uint8_t)(p->rx_have >> 24);
+}
+
+/* Handle an acknowledgement from a peer, of the given type */
+static void ack_rx(uint8_t src, const uint8_t* data, nsmp_msg_type_e type) {
+	arq_peer_s* const p = peer_get(src, 0);
+
+	if (!p || !nsmp_cfg()->arq_window) {
+		/* Nothing of ours is waiting for it */
+		return;
+	}
+
+	uint8_t const	 base = data[0];
+	uint32_t const sack = (uint32_t)data[1] | ((uint32_t)data[2] << 8) |
+												((uint32_t)data[3] << 16) | ((uint32_t)data[4] << 24);
+	uint8_t const	 adv	= (uint8_t)(base - p->tx_base);
+	if (adv > (uint8_t)(p->tx_next - p->tx_base)) {
+		/* Acknowledges something never sent, stale */
+		return;
+	}
+	if (adv || (sack != p->tx_sack)) {
+		p->tx_time = nsmp_now();
+	}
+	p->tx_base = base;
+	p->tx_sack = sack;
+
+	nsmp_iface_s* const iface = nsmp_route(p->addr);
+	if (!iface || !iface->tx_q) {
+		return;
+	}
+
+	/* Repeat what is missing below the highest message the peer holds */
+	uint8_t resend = 0;
+	if (type == NSMP_MSG_TYPE_CTL_PLS_RETRY) {
+		resend = 1;
+		for (uint32_t s = sack; s; s >>= 1) {
+			resend++;
+		}
+		p->tx_time = nsmp_now();
+	}
+	tx_walk(iface, p, resend);
+}
+
+/* Update the sent messages of a peer after an acknowledgement: acknowledged
+ * ones are done, unacknowledged ones less than `resend` after the window base
+ * are marked to be sent again */
+static void tx_walk(nsmp_iface_s* iface, const arq_peer_s* p, uint8_t resend) {
+	nsmp_queue_s* const q		= &iface->txq;
+	uint32_t						pos = nsmp_queue_head(q);
+	uint8_t*						frame;
+	size_t							len;
+
+	while ((pos != iface->txb.rd) && (frame = nsmp_queue_at(q, &pos, &len))) {
+		uint8_t const tag = nsmp_queue_tag(frame);
+		if (((tag == NSMP_TAG_PEND) || (tag == NSMP_TAG_RESEND)) &&
+				(frame[NSMP_OFS_DST] == p->addr) &&
+				(nsmp_frame_type(frame) == NSMP_MSG_TYPE_CTL_SEQ)) {
+			uint8_t const d = (uint8_t)(frame[NSMP_OFS_SEQ] - p->tx_base);
+
+			if ((d >= SEQ_BEHIND) || (d && (d <= NSMP_ARQ_WINDOW_MAX) &&
+																((p->tx_sack >> (d - 1)) & 1))) {
+				if (tag == NSMP_TAG_RESEND) {
+					iface->txb.resend--;
+				}
+				nsmp_queue_set_tag(frame, NSMP_TAG_DONE);
+			} else if ((tag == NSMP_TAG_PEND) && (d < resend)) {
+				iface->txb.resend++;
+				nsmp_queue_set_tag(frame, NSMP_TAG_RESEND);
+			}
+		}
+		pos = nsmp_queue_next(q, pos);
+	}
+}
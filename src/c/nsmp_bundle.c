@@ -0,0 +1,147 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Message bundling - small messages for the same destination are packed into
+ * a single NSMP_MSG_TYPE_CTL_BUNDLE frame, saving the COBS overhead,
+ * delimiter, header and payload CRC of all but one of them.
+ *
+ * The bundle is built in place in a tx_q record that stays reserved while it
+ * fills, so messages keep their order with respect to everything else sent on
+ * the interface - any other message closes the open bundle first. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nsmp.h"
+#include "nsmp_private.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint16_t bundle_max(const nsmp_iface_s* iface);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int nsmp_bundle_add(nsmp_iface_s* iface, const nsmp_hdr_s* hdr,
+										const uint8_t* data, size_t len) {
+	nsmp_bundle_s* const b		= &iface->bnd;
+	uint16_t const			 max	= bundle_max(iface);
+	size_t const				 need = NSMP_BUNDLE_SUB_HDR + len;
+	size_t const				 ofs	= nsmp_arq_ofs(iface, hdr);
+
+	if (!max || !(iface->peer_caps & NSMP_CAP_BUNDLE) ||
+			(len > NSMP_BUNDLE_SUB_MAX) ||
+			(hdr->ctl.type == NSMP_MSG_TYPE_CTL_CAPS) ||
+			(hdr->ctl.type == NSMP_MSG_TYPE_CTL_BUNDLE)) {
+		return 0;
+	}
+
+	/* Reliable and unreliable messages are not mixed */
+	if (b->frame && ((b->dst != hdr->dst) || (b->src != hdr->src) ||
+									 (b->ofs != ofs) || (b->fill + need > max))) {
+		nsmp_bundle_close(iface);
+	}
+	if (need > max) {
+		return 0;
+	}
+
+	if (!b->frame) {
+		b->frame = nsmp_queue_reserve(&iface->txq, NSMP_HDR_LEN + ofs + max +
+																								nsmp_arq_room(iface));
+		if (!b->frame) {
+			/* Not enough room for a whole bundle, a single frame may still fit */
+			return 0;
+		}
+		b->fill = 0;
+		b->cnt	= 0;
+		b->dst	= hdr->dst;
+		b->src	= hdr->src;
+		b->ofs	= (uint8_t)ofs;
+
+		const nsmp_cfg_s* const cfg = nsmp_cfg();
+		b->t0 = cfg->get_time_ms ? cfg->get_time_ms() : 0;
+	}
+
+	uint8_t* const p = &b->frame[NSMP_HDR_LEN + b->ofs + b->fill];
+	memcpy(&p[0], &hdr->ctl, sizeof(hdr->ctl));
+	p[1] = (uint8_t)len;
+	if (len) {
+		memcpy(&p[NSMP_BUNDLE_SUB_HDR], data, len);
+	}
+	b->fill += (uint16_t)need;
+	b->cnt++;
+	return 1;
+}
+
+void nsmp_bundle_close(nsmp_iface_s* iface) {
+	nsmp_bundle_s* const b	 = &iface->bnd;
+	nsmp_hdr_s					 hdr = {.dst = b->dst, .src = b->src};
+	uint16_t						 len = b->fill;
+
+	if (!b->frame) {
+		return;
+	}
+
+	if (b->cnt == 1) {
+		/* A bundle of one is sent as the plain message */
+		uint8_t* const p = &b->frame[NSMP_HDR_LEN + b->ofs];
+		memcpy(&hdr.ctl, &p[0], sizeof(hdr.ctl));
+		len = p[1];
+		memmove(p, &p[NSMP_BUNDLE_SUB_HDR], len);
+	} else {
+		hdr.ctl.data	 = 1;
+		hdr.ctl.reqres = NSMP_MSG_REQUEST;
+		hdr.ctl.type	 = NSMP_MSG_TYPE_CTL_BUNDLE;
+	}
+
+	size_t const rec = nsmp_arq_seal(b->frame, &hdr, b->ofs, len);
+	nsmp_stats_queued(iface, &iface->txq, rec);
+	nsmp_queue_commit(&iface->txq, rec);
+	b->frame = NULL;
+}
+
+void nsmp_bundle_poll(nsmp_iface_s* iface) {
+	nsmp_bundle_s* const		b		= &iface->bnd;
+	const nsmp_cfg_s* const cfg = nsmp_cfg();
+
+	if (!b->frame) {
+		return;
+	}
+	if (!iface->bundle_ms || !cfg->get_time_ms ||
+			((uint32_t)(cfg->get_time_ms() - b->t0) >= iface->bundle_ms)) {
+		nsmp_bundle_close(iface);
+	}
+}
+
+int nsmp_bundle_unpack(nsmp_iface_s* iface, const nsmp_hdr_s* hdr,
+											 const uint8_t* data, size_t len) {
+	nsmp_msg_s msg = {.hdr = *hdr};
+	size_t		 pos = 0;
+
+	while (pos + NSMP_BUNDLE_SUB_HDR <= len) {
+		size_t const n = data[pos + 1];
+		if (pos + NSMP_BUNDLE_SUB_HDR + n > len) {
+			return NSMP_ERR_BAD_LEN;
+		}
+
+		memcpy(&msg.hdr.ctl, &data[pos], sizeof(msg.hdr.ctl));
+		msg.len	 = (uint16_t)n;
+		msg.data = (uint8_t*)&data[pos + NSMP_BUNDLE_SUB_HDR];
+		nsmp_rx_msg(iface, &msg);
+		pos += NSMP_BUNDLE_SUB_HDR + n;
+	}
+	return (pos == len) ? NSMP_OK : NSMP_ERR_BAD_LEN;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A bundle must also fit the mtu of the other end */
+static uint16_t bundle_max(const nsmp_iface_s* iface) {
+	return (iface->peer_mtu < iface->bundle_len) ? iface->peer_mtu
+																							 : iface->bundle_len;
+}
@@ -0,0 +1,163 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Credit based flow control, between the two ends of a link.
+ *
+ * Credit is counted in bytes of the receiver's rx_q: every frame uses the
+ * space the parser reserves for it. Both ends count the credit used by the
+ * frames on the link, the receiver grants a limit - what it has received plus
+ * the space it has free - and the sender keeps frames in tx_q rather than go
+ * past it. Grants are NSMP_MSG_TYPE_CTL_SLOWDOWN responses, sent whenever a
+ * quarter of rx_q has been freed since the last one. Until the first grant
+ * arrives, just after the capabilities were exchanged, the sender is not held
+ * back - as with a receiver that does not support flow control.
+ *
+ * A frame lost on the link is counted by the sender only, which would leave
+ * it short of credit for good. So the sender sends a request carrying its own
+ * count when the receiver asks for it - the retry bit of a grant, set after
+ * the parser dropped a frame - or when it has been waiting for credit for
+ * NSMP_CREDIT_MS. The receiver takes that count as its own - the link keeps
+ * frames in order, so everything sent before the request has arrived or is
+ * lost - and answers with a grant.
+ *
+ * Credit frames are handled by the parser without going through rx_q, so
+ * they get through when it is full, and use no credit themselves. A frame a
+ * node relays still encoded takes more of rx_q than it is charged for, so it
+ * is only kept that way when rx_q has the difference to spare beyond the
+ * credit the sender may still use. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nsmp.h"
+#include "nsmp_private.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t credit_limit(nsmp_iface_s* iface);
+static size_t		credit_slack(const nsmp_iface_s* iface);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void nsmp_credit_reset(nsmp_iface_s* iface) {
+	memset(&iface->cr, 0, sizeof(iface->cr));
+}
+
+int nsmp_credit_take(nsmp_iface_s* iface, const uint8_t* frame, size_t len) {
+	nsmp_credit_s* const cr		= &iface->cr;
+	uint32_t const			 cost = nsmp_credit_cost(len);
+
+	if (nsmp_frame_type(frame) == NSMP_MSG_TYPE_CTL_SLOWDOWN) {
+		return 1;
+	}
+	cr->blocked = (iface->peer_caps & NSMP_CAP_CREDIT) && cr->granted &&
+								((int32_t)(cr->tx + cost - cr->limit) > 0);
+	if (cr->blocked) {
+		return 0;
+	}
+	cr->tx += cost;
+	return 1;
+}
+
+size_t nsmp_credit_frame(nsmp_iface_s* iface, uint8_t* frame) {
+	nsmp_credit_s* const cr	 = &iface->cr;
+	nsmp_hdr_s					 hdr = {
+			.ctl = {.data = 1, .type = NSMP_MSG_TYPE_CTL_SLOWDOWN},
+			.dst = NSMP_ADDR_LINK,
+			.src = nsmp_addr(),
+	};
+	uint32_t						 count;
+
+	uint32_t const limit = credit_limit(iface);
+	uint8_t const	 req	 = cr->req;
+	uint8_t const	 drops = cr->drops;
+	uint8_t const	 sync	 = cr->sync;
+	int const			 on		 = (iface->peer_caps & NSMP_CAP_CREDIT) != 0;
+	if ((req != cr->req_done) ||
+			(on && ((drops != cr->drops_done) ||
+							((limit - cr->adv) >= (iface->rxq.size / 4))))) {
+		/* After a lost frame the grant asks for the sender's count, so the
+		 * credit the frame used is not lost with it */
+		hdr.ctl.reqres = NSMP_MSG_RESPONSE;
+		hdr.ctl.retry	 = on && (drops != cr->drops_done);
+		count					 = limit;
+		cr->adv				 = limit;
+		cr->req_done	 = req;
+		cr->drops_done = drops;
+	} else if ((sync != cr->sync_done) ||
+						 (cr->blocked &&
+							((uint32_t)(nsmp_now() - cr->t_req) >= NSMP_CREDIT_MS))) {
+		hdr.ctl.reqres = NSMP_MSG_REQUEST;
+		count					 = cr->tx;
+		cr->t_req			 = nsmp_now();
+		cr->sync_done	 = sync;
+		cr->blocked		 = 0;
+	} else {
+		return 0;
+	}
+
+	for (size_t i = 0; i < NSMP_CREDIT_LEN; i++) {
+		frame[NSMP_HDR_LEN + i] = (uint8_t)(count >> (8 * i));
+	}
+	nsmp_frame_hdr(frame, &hdr, NSMP_CREDIT_LEN);
+	return NSMP_HDR_LEN + NSMP_CREDIT_LEN;
+}
+
+void nsmp_credit_ctl(nsmp_iface_s* iface, const uint8_t* frame) {
+	nsmp_credit_s* const cr		 = &iface->cr;
+	uint32_t						 count = 0;
+	nsmp_ctrl_s					 ctl;
+
+	for (size_t i = 0; i < NSMP_CREDIT_LEN; i++) {
+		count |= (uint32_t)frame[NSMP_HDR_LEN + i] << (8 * i);
+	}
+	memcpy(&ctl, &frame[NSMP_OFS_CTL], sizeof(ctl));
+	if (ctl.reqres == NSMP_MSG_REQUEST) {
+		/* Frames the sender counted but that never arrived are forgotten */
+		cr->rx = count;
+		cr->req++;
+	} else {
+		cr->limit		= count;
+		cr->granted = 1;
+		cr->sync += ctl.retry;
+	}
+}
+
+/* Frames relayed without being decoded take more of rx_q than their credit,
+ * which is only done with the space the other end cannot be using */
+int nsmp_credit_spare(nsmp_iface_s* iface, size_t len) {
+	nsmp_credit_s* const cr		= &iface->cr;
+	int32_t const				 owed = (int32_t)(cr->adv - cr->rx);
+	size_t const				 used = nsmp_queue_used(&iface->rxq);
+	size_t							 need = len + credit_slack(iface);
+
+	if ((iface->peer_caps & NSMP_CAP_CREDIT) && (owed > 0)) {
+		need += (size_t)owed;
+	}
+	return (iface->rxq.size - used) >= need;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Credit the other end may use in total. The count is read before the queue,
+ * so a frame arriving in between makes the limit lower rather than higher. */
+static uint32_t credit_limit(nsmp_iface_s* iface) {
+	uint32_t const rx		 = __atomic_load_n(&iface->cr.rx, __ATOMIC_ACQUIRE);
+	size_t const	 used	 = nsmp_queue_used(&iface->rxq);
+	size_t const	 slack = credit_slack(iface);
+	size_t const	 free	 = iface->rxq.size - used;
+
+	return rx + (uint32_t)((free > slack) ? (free - slack) : 0);
+}
+
+/* Space kept back, covering what a frame may waste at the end of rx_q */
+static size_t credit_slack(const nsmp_iface_s* iface) {
+	return nsmp_credit_cost(NSMP_HDR_LEN + NSMP_SEQ_LEN + iface->mtu) +
+				 NSMP_QUEUE_ALIGN;
+}
@@ -0,0 +1,501 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Discovery, and the directory of discovery payloads a node keeps.
+ *
+ * nsmp_discover() sends a discovery request of [version][payload] to the
+ * other end of every link after a random backoff: NSMP_DISC_WAIT_MS plus up
+ * to a window that starts at NSMP_DISC_WINDOW_MS and doubles whenever the
+ * request goes unanswered, or another device's request is heard while
+ * waiting - the busier the link, the further apart the requests. Without a
+ * node, a peer answers each request with its own payload.
+ *
+ * A node answers with its directory instead: the payload of each device that
+ * sent it a discovery request or response, its own included. Each change to
+ * the directory takes the next version, and an entry keeps the version it
+ * last changed at, so the changes since any version are the entries with a
+ * later one - sent in version order, as many as a frame holds, each frame
+ * giving the versions it covers. An answer goes to the whole link, from the
+ * oldest version asked for since the last one, so the devices of a link
+ * starting up together share it. A device that unregistered is kept as gone
+ * until its entry is needed for another; asking from before then gets the
+ * whole directory again.
+ *
+ * A peer delivers the entries of a frame that follows on from the version
+ * it has, each as a discovery response from that device or an unregister
+ * request from one that is gone, and takes the frame's version as its own -
+ * overheard frames included, so its own request only asks for what is left.
+ * Its discovery is done once it is up to date and has seen its own entry,
+ * which an answer to someone else's request may well save it asking for. A
+ * frame that does not follow on, or one without its entry after it stopped
+ * asking, and it asks again.
+ *
+ * Versions are 16-bit and compared as serial numbers, 0 meaning none. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nsmp.h"
+#include "nsmp_private.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef enum {
+	DISC_IDLE,
+	DISC_WAIT, /* For the backoff to pass */
+	DISC_SENT, /* For an answer */
+} disc_state_e;
+
+typedef struct {
+	uint16_t ver; /* Version the entry last changed at */
+	uint8_t	 addr;
+	uint8_t	 len; /* NSMP_DIR_GONE once the device has unregistered */
+	uint8_t	 data[NSMP_DISCOVERY_LEN];
+} dir_ent_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void				disc_start(void);
+static void				disc_wait(void);
+static void				disc_widen(void);
+static void				disc_done(void);
+static int				disc_send(nsmp_iface_s* iface, uint8_t reqres);
+static void				dir_put(uint8_t addr, const uint8_t* data, size_t len);
+static dir_ent_s* dir_find(uint8_t addr);
+static dir_ent_s* dir_slot(void);
+static dir_ent_s* dir_next(uint16_t v);
+static int				dir_send(nsmp_iface_s* iface);
+static void				dir_apply(nsmp_iface_s* iface, const uint8_t* data, size_t len);
+static uint16_t		ver_next(void);
+static int				ver_after(uint16_t a, uint16_t b);
+static uint16_t		get16(const uint8_t* p);
+static void				put16(uint8_t* p, uint16_t v);
+static uint32_t		rnd(void);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* The directory of a node */
+static dir_ent_s ents[NSMP_DIR_ENTRIES];
+static size_t		 nents;
+static uint16_t	 ver;			 /* Changes made */
+static uint16_t	 ver_lost; /* Newest change of a gone entry given up */
+
+/* This device's discovery payload */
+static uint8_t own[NSMP_DISCOVERY_LEN];
+static uint8_t own_len;
+
+/* Discovery in progress, and the directory version a peer has */
+static struct {
+	uint8_t	 state;
+	uint8_t	 tries;
+	uint8_t	 node;	 /* A node answered, peers no longer do */
+	uint8_t	 listed; /* The node has our entry */
+	uint16_t window;
+	uint16_t since;
+	uint32_t due;
+	uint32_t rnd;
+} disc;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int nsmp_discover(void) {
+	if (nsmp_role() == NSMP_ROLE_NONE) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	if (!nsmp_iface_first()) {
+		return NSMP_ERR_NO_IF;
+	}
+
+	disc_start();
+	return NSMP_OK;
+}
+
+int nsmp_set_discovery_payload(uint8_t* payload, size_t len) {
+	if (len > NSMP_DISCOVERY_LEN) {
+		return NSMP_ERR_BAD_LEN;
+	}
+	if (len) {
+		memcpy(own, payload, len);
+	}
+	own_len			= (uint8_t)len;
+	disc.listed = 0;
+	if (nsmp_role() == NSMP_ROLE_NODE) {
+		dir_put(nsmp_addr(), own, own_len);
+	}
+	return NSMP_OK;
+}
+
+void nsmp_dir_reset(void) {
+	memset(ents, 0, sizeof(ents));
+	memset(&disc, 0, sizeof(disc));
+	nents		 = 0;
+	ver			 = 0;
+	ver_lost = 0;
+	own_len	 = 0;
+}
+
+void nsmp_dir_rx(nsmp_iface_s* iface, nsmp_msg_s* msg) {
+	uint8_t const node = (nsmp_role() == NSMP_ROLE_NODE);
+
+	if (msg->hdr.ctl.type == NSMP_MSG_TYPE_CTL_DIRECTORY) {
+		if (!node) {
+			dir_apply(iface, msg->data, msg->len);
+		}
+		return;
+	}
+	if (msg->hdr.ctl.reqres == NSMP_MSG_RESPONSE) {
+		/* Without a node, any answer will do */
+		if (node) {
+			dir_put(msg->hdr.src, msg->data, msg->len);
+		} else if (!disc.node) {
+			disc_done();
+		}
+		return;
+	}
+
+	/* A request, from a device that has the directory up to since */
+	uint16_t since = 0;
+	if (msg->len >= NSMP_DISC_HDR) {
+		since = get16(msg->data);
+		msg->data += NSMP_DISC_HDR;
+		msg->len	-= NSMP_DISC_HDR;
+	}
+	if (!node) {
+		if (!disc.node) {
+			iface->ctl_pend |= NSMP_PEND_DISC_RSP;
+		}
+		/* Someone else is discovering, make room for them */
+		if (disc.state == DISC_WAIT) {
+			disc_widen();
+			disc_wait();
+		}
+		return;
+	}
+
+	dir_put(msg->hdr.src, msg->data, msg->len);
+	if (!(iface->ctl_pend & NSMP_PEND_DIR) ||
+			ver_after(iface->dir_from, since)) {
+		iface->dir_from = since;
+	}
+	iface->ctl_pend |= NSMP_PEND_DIR;
+}
+
+void nsmp_dir_forget(uint8_t addr) {
+	dir_ent_s* const e = dir_find(addr);
+
+	if ((nsmp_role() == NSMP_ROLE_NODE) && e && (e->len != NSMP_DIR_GONE)) {
+		e->len = NSMP_DIR_GONE;
+		e->ver = ver_next();
+	}
+}
+
+void nsmp_dir_poll(void) {
+	uint32_t const now = nsmp_now();
+
+	if ((disc.state == DISC_IDLE) || ((int32_t)(now - disc.due) < 0)) {
+		return;
+	}
+
+	if (disc.state == DISC_WAIT) {
+		for (nsmp_iface_s* iface = nsmp_iface_first(); iface;
+				 iface = iface->next) {
+			if (iface->tx_q) {
+				iface->ctl_pend |= NSMP_PEND_DISC_REQ;
+				nsmp_sched_ready(iface);
+			}
+		}
+		disc.state = DISC_SENT;
+		disc.due	 = now + NSMP_DISC_TIMEOUT_MS;
+		disc.tries++;
+	} else if (disc.tries >= NSMP_DISC_TRIES) {
+		disc.state = DISC_IDLE;
+	} else {
+		disc_widen();
+		disc_wait();
+	}
+}
+
+void nsmp_dir_flush(nsmp_iface_s* iface) {
+	if ((iface->ctl_pend & NSMP_PEND_DISC_REQ) &&
+			(disc_send(iface, NSMP_MSG_REQUEST) == NSMP_OK)) {
+		iface->ctl_pend &= (uint8_t)~NSMP_PEND_DISC_REQ;
+	}
+	if ((iface->ctl_pend & NSMP_PEND_DISC_RSP) &&
+			(disc_send(iface, NSMP_MSG_RESPONSE) == NSMP_OK)) {
+		iface->ctl_pend &= (uint8_t)~NSMP_PEND_DISC_RSP;
+	}
+	while ((iface->ctl_pend & NSMP_PEND_DIR) && dir_send(iface)) {
+	}
+}
+
+size_t nsmp_dir_rcv_need(const uint8_t* data, size_t len) {
+	size_t need = 0;
+
+	if (nsmp_role() == NSMP_ROLE_NODE) {
+		return 0;
+	}
+	for (size_t pos = NSMP_DIR_HDR; pos + NSMP_DIR_ENT_HDR <= len;) {
+		size_t const n = (data[pos + 1] == NSMP_DIR_GONE) ? 0 : data[pos + 1];
+		need += NSMP_QUEUE_REC_LEN(sizeof(nsmp_hdr_s) + n);
+		pos += NSMP_DIR_ENT_HDR + n;
+	}
+	return need;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void disc_start(void) {
+	disc.tries	= 0;
+	disc.window = NSMP_DISC_WINDOW_MS;
+	disc_wait();
+}
+
+/* Send the request after a random part of the window */
+static void disc_wait(void) {
+	disc.state = DISC_WAIT;
+	disc.due	 = nsmp_now() + NSMP_DISC_WAIT_MS + (rnd() % (disc.window + 1u));
+}
+
+static void disc_widen(void) {
+	disc.window = (disc.window < NSMP_DISC_WINDOW_MAX_MS / 2)
+										? (uint16_t)(disc.window * 2)
+										: NSMP_DISC_WINDOW_MAX_MS;
+}
+
+static void disc_done(void) {
+	if ((disc.state == DISC_SENT) || (disc.node && (disc.state == DISC_WAIT))) {
+		disc.state = DISC_IDLE;
+	}
+}
+
+/* A request carries the directory version we have, both carry our payload */
+static int disc_send(nsmp_iface_s* iface, uint8_t reqres) {
+	uint8_t		 b[NSMP_DISC_HDR + NSMP_DISCOVERY_LEN];
+	size_t		 n = 0;
+
+	if (reqres == NSMP_MSG_REQUEST) {
+		put16(b, disc.since);
+		n = NSMP_DISC_HDR;
+	}
+	memcpy(&b[n], own, own_len);
+	return nsmp_ctl_send(iface, NSMP_ADDR_LINK, NSMP_MSG_TYPE_CTL_DISCOVERY,
+											 reqres, b, n + own_len);
+}
+
+/* Add or change a device's entry, if its payload is not the same */
+static void dir_put(uint8_t addr, const uint8_t* data, size_t len) {
+	if ((len > NSMP_DISCOVERY_LEN) || (addr == NSMP_ADDR_LINK) ||
+			(addr == NSMP_ADDR_TOPIC)) {
+		return;
+	}
+
+	dir_ent_s* e = dir_find(addr);
+	if (e && (e->len == len) && !memcmp(e->data, data, len)) {
+		return;
+	}
+	if (!e && !(e = dir_slot())) {
+		return;
+	}
+	e->addr = addr;
+	e->len	= (uint8_t)len;
+	if (len) {
+		memcpy(e->data, data, len);
+	}
+	e->ver = ver_next();
+}
+
+static dir_ent_s* dir_find(uint8_t addr) {
+	for (size_t i = 0; i < nents; i++) {
+		if (ents[i].addr == addr) {
+			return &ents[i];
+		}
+	}
+	return NULL;
+}
+
+/* A free entry, or the one gone the longest */
+static dir_ent_s* dir_slot(void) {
+	dir_ent_s* old = NULL;
+
+	if (nents < NSMP_DIR_ENTRIES) {
+		return &ents[nents++];
+	}
+	for (size_t i = 0; i < nents; i++) {
+		if ((ents[i].len == NSMP_DIR_GONE) &&
+				(!old || ver_after(old->ver, ents[i].ver))) {
+			old = &ents[i];
+		}
+	}
+	if (old && ver_after(old->ver, ver_lost)) {
+		ver_lost = old->ver;
+	}
+	return old;
+}
+
+/* The entry that changed first after version v */
+static dir_ent_s* dir_next(uint16_t v) {
+	dir_ent_s* next = NULL;
+
+	for (size_t i = 0; i < nents; i++) {
+		if (ver_after(ents[i].ver, v) &&
+				(!next || ver_after(next->ver, ents[i].ver))) {
+			next = &ents[i];
+		}
+	}
+	return next;
+}
+
+/* Queue a frame of the changes after nsmp_iface_s::dir_from, returns 0 if
+ * tx_q has no room */
+static int dir_send(nsmp_iface_s* iface) {
+	size_t const	 max = nsmp_frag_mtu(iface);
+	uint8_t* const p	 = nsmp_ctl_reserve(iface, max);
+	if (!p) {
+		return 0;
+	}
+
+	/* Gone entries are only needed by those who had them */
+	uint16_t from = iface->dir_from;
+	if (ver_after(ver_lost, from) || ver_after(from, ver)) {
+		from = 0;
+	}
+
+	size_t	 pos = NSMP_DIR_HDR;
+	uint16_t to	 = from;
+	for (dir_ent_s* e; (e = dir_next(to)) != NULL; to = e->ver) {
+		size_t const n = (e->len == NSMP_DIR_GONE) ? 0 : e->len;
+		if (!from && (e->len == NSMP_DIR_GONE)) {
+			continue;
+		}
+		if (pos + NSMP_DIR_ENT_HDR + n > max) {
+			if (pos == NSMP_DIR_HDR) {
+				continue; /* Never fits */
+			}
+			break;
+		}
+		p[pos]		 = e->addr;
+		p[pos + 1] = e->len;
+		put16(&p[pos + 2], e->ver);
+		memcpy(&p[pos + NSMP_DIR_ENT_HDR], e->data, n);
+		pos += NSMP_DIR_ENT_HDR + n;
+	}
+	if (!dir_next(to)) {
+		to = ver;
+		iface->ctl_pend &= (uint8_t)~NSMP_PEND_DIR;
+	}
+	iface->dir_from = to;
+
+	put16(&p[0], from);
+	put16(&p[2], to);
+	nsmp_ctl_commit(iface, p, NSMP_ADDR_LINK, NSMP_MSG_TYPE_CTL_DIRECTORY,
+									NSMP_MSG_RESPONSE, pos);
+	return 1;
+}
+
+/* Deliver the entries of a directory frame we have not seen yet */
+static void dir_apply(nsmp_iface_s* iface, const uint8_t* data, size_t len) {
+	if (len < NSMP_DIR_HDR) {
+		return;
+	}
+
+	uint16_t const from = get16(&data[0]);
+	uint16_t const to		= get16(&data[2]);
+	disc.node						= 1;
+	if (ver_after(disc.since, to)) {
+		/* The node started over */
+		disc.since	= 0;
+		disc.listed = 0;
+	}
+	if (ver_after(from, disc.since)) {
+		/* Changes before these are missing */
+		if (disc.state == DISC_IDLE) {
+			disc_start();
+		}
+		return;
+	}
+
+	for (size_t pos = NSMP_DIR_HDR; pos + NSMP_DIR_ENT_HDR <= len;) {
+		uint8_t const gone = (data[pos + 1] == NSMP_DIR_GONE);
+		size_t const	n		 = gone ? 0 : data[pos + 1];
+		if (pos + NSMP_DIR_ENT_HDR + n > len) {
+			break;
+		}
+
+		nsmp_msg_s m = {
+				.hdr =
+						{
+								.ctl =
+										{
+												.data		= (n != 0),
+												.reqres = gone ? NSMP_MSG_REQUEST : NSMP_MSG_RESPONSE,
+												.type		= gone ? NSMP_MSG_TYPE_CTL_UNREGISTER
+																	 : NSMP_MSG_TYPE_CTL_DISCOVERY,
+										},
+								.dst = nsmp_addr(),
+								.src = data[pos],
+						},
+				.len	= (uint16_t)n,
+				.data = (uint8_t*)&data[pos + NSMP_DIR_ENT_HDR],
+		};
+		if (m.hdr.src == nsmp_addr()) {
+			disc.listed = !gone;
+		} else if (ver_after(get16(&data[pos + 2]), disc.since)) {
+			nsmp_rx_deliver(iface, &m);
+		}
+		pos += NSMP_DIR_ENT_HDR + n;
+	}
+
+	disc.since = to;
+	if (disc.listed) {
+		disc_done();
+	} else if (disc.state == DISC_IDLE) {
+		/* The node has yet to hear from us */
+		disc_start();
+	}
+}
+
+/* The version of a change, 0 being none */
+static uint16_t ver_next(void) {
+	ver = (uint16_t)(ver + 1);
+	if (!ver) {
+		ver = 1;
+	}
+	return ver;
+}
+
+static int ver_after(uint16_t a, uint16_t b) {
+	return (int16_t)(uint16_t)(a - b) > 0;
+}
+
+static uint16_t get16(const uint8_t* p) {
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void put16(uint8_t* p, uint16_t v) {
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+/* xorshift32, seeded from the device's uuid and address so that devices
+ * starting together draw different backoffs */
+static uint32_t rnd(void) {
+	if (!disc.rnd) {
+		const nsmp_cfg_s* const cfg = nsmp_cfg();
+		uint32_t								x		= 2166136261u ^ nsmp_now();
+		for (size_t i = 0; i < sizeof(cfg->uuid); i++) {
+			x = (x ^ cfg->uuid[i]) * 16777619u;
+		}
+		x					 = (x ^ cfg->addr) * 16777619u;
+		disc.rnd = x ? x : 1;
+	}
+	disc.rnd ^= disc.rnd << 13;
+	disc.rnd ^= disc.rnd >> 17;
+	disc.rnd ^= disc.rnd << 5;
+	return disc.rnd;
+}
@@ -0,0 +1,224 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Fragmentation of messages longer than a link's mtu.
+ *
+ * nsmp_send() cuts such a message into NSMP_MSG_TYPE_CTL_FRAG frames of
+ * [ctl][id][16-bit total length][16-bit offset][data], ctl being the
+ * message's own control byte. Fragments are copied into tx_q as it drains,
+ * one at a time or up to half of the bulk lane, so other messages still find
+ * room between them and tx_q slots only need to fit the mtu. The first and
+ * last fragment are told by their offset and the total length.
+ *
+ * Fragments of a message follow the same path, so they arrive in order or
+ * not at all (reliable delivery sequences them like user messages). The
+ * receiver keeps one slot per message being reassembled, and gives up on
+ * the message at the first gap. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nsmp.h"
+#include "nsmp_private.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* The message nsmp_send() is fragmenting */
+typedef struct {
+	const uint8_t* data; /* NULL when there is none */
+	uint16_t			 len;
+	uint16_t			 pos; /* Bytes queued */
+	uint8_t				 dst;
+	uint8_t				 id;
+	nsmp_ctrl_s		 ctl;
+} frag_tx_s;
+
+/* A message being reassembled */
+typedef struct {
+	uint8_t		 used;
+	uint8_t		 src;
+	uint8_t		 id;
+	nsmp_ctrl_s ctl;
+	uint16_t	 total;
+	uint16_t	 got;	 /* Bytes received, the offset of the next fragment */
+	uint32_t	 time; /* Last fragment received */
+} frag_rx_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static frag_rx_s* rx_slot(uint8_t src, uint8_t id, uint16_t ofs);
+static size_t			rx_slot_len(void);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static frag_tx_s tx;
+static uint8_t	 tx_id;
+static frag_rx_s rx[NSMP_FRAG_SLOTS];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void nsmp_frag_reset(void) {
+	memset(&tx, 0, sizeof(tx));
+	memset(rx, 0, sizeof(rx));
+}
+
+size_t nsmp_frag_mtu(const nsmp_iface_s* iface) {
+	return (iface->peer_mtu && (iface->peer_mtu < iface->mtu)) ? iface->peer_mtu
+																														 : iface->mtu;
+}
+
+int nsmp_frag_send(nsmp_iface_s* iface, const nsmp_msg_s* msg) {
+	size_t const mtu = nsmp_frag_mtu(iface);
+
+	if (mtu <= NSMP_FRAG_HDR) {
+		return NSMP_ERR_BAD_LEN;
+	}
+
+	/* Anything else still being fragmented is abandoned */
+	if ((tx.data != msg->data) || (tx.len != msg->len) ||
+			(tx.dst != msg->hdr.dst)) {
+		tx.data = msg->data;
+		tx.len	= msg->len;
+		tx.pos	= 0;
+		tx.dst	= msg->hdr.dst;
+		tx.id		= tx_id++;
+		tx.ctl	= msg->hdr.ctl;
+	}
+
+	while (tx.pos < tx.len) {
+		/* At least one at a time, however small the lane */
+		size_t const used = nsmp_queue_used(&iface->txq);
+		if (used && (used + NSMP_QUEUE_REC_LEN(NSMP_HDR_LEN + NSMP_SEQ_LEN + mtu) >
+								 iface->txq.size / 2)) {
+			return NSMP_ERR_NO_MEM;
+		}
+
+		size_t const n = ((size_t)(tx.len - tx.pos) < mtu - NSMP_FRAG_HDR)
+												 ? (size_t)(tx.len - tx.pos)
+												 : mtu - NSMP_FRAG_HDR;
+		uint8_t* const p =
+				nsmp_send_reserve(tx.dst, NSMP_MSG_TYPE_CTL_FRAG, NSMP_FRAG_HDR + n);
+		if (!p) {
+			return NSMP_ERR_NO_MEM;
+		}
+		memcpy(&p[0], &tx.ctl, sizeof(tx.ctl));
+		p[1] = tx.id;
+		p[2] = (uint8_t)tx.len;
+		p[3] = (uint8_t)(tx.len >> 8);
+		p[4] = (uint8_t)tx.pos;
+		p[5] = (uint8_t)(tx.pos >> 8);
+		memcpy(&p[NSMP_FRAG_HDR], &tx.data[tx.pos], n);
+		nsmp_send_commit(NSMP_FRAG_HDR + n);
+		tx.pos += (uint16_t)n;
+	}
+	tx.data = NULL;
+	return NSMP_OK;
+}
+
+void nsmp_frag_rx(nsmp_iface_s* iface, const nsmp_msg_s* msg) {
+	const nsmp_cfg_s* const cfg = nsmp_cfg();
+	nsmp_msg_s							m		= *msg;
+
+	if ((msg->len < NSMP_FRAG_HDR) || (!cfg->frag_cb && !cfg->frag_buf)) {
+		return;
+	}
+	memcpy(&m.hdr.ctl, msg->data, sizeof(m.hdr.ctl));
+	uint16_t const total = (uint16_t)(msg->data[2] | (msg->data[3] << 8));
+	uint16_t const ofs	 = (uint16_t)(msg->data[4] | (msg->data[5] << 8));
+	m.data							 = &msg->data[NSMP_FRAG_HDR];
+	m.len								 = (uint16_t)(msg->len - NSMP_FRAG_HDR);
+
+	/* Only messages that are delivered are ever fragmented */
+	if ((m.hdr.ctl.type >= NSMP_MSG_TYPE_CTL_ACK) || (m.len > total - ofs) ||
+			(!cfg->frag_cb && (total > rx_slot_len()))) {
+		return;
+	}
+	frag_rx_s* const s = rx_slot(msg->hdr.src, msg->data[1], ofs);
+	if (!s) {
+		return;
+	}
+	if (!ofs) {
+		s->ctl	 = m.hdr.ctl;
+		s->total = total;
+	} else if ((s->total != total) ||
+						 (memcmp(&s->ctl, &m.hdr.ctl, sizeof(s->ctl)) != 0)) {
+		s->used = 0;
+		return;
+	}
+
+	if (cfg->frag_cb) {
+		cfg->frag_cb(&m, ofs, total);
+	} else {
+		memcpy(&cfg->frag_buf[(size_t)(s - rx) * rx_slot_len() + ofs], m.data,
+					 m.len);
+	}
+	s->got += m.len;
+	s->time = nsmp_now();
+	if (s->got < total) {
+		return;
+	}
+
+	s->used = 0;
+	if (!cfg->frag_cb) {
+		m.data = &cfg->frag_buf[(size_t)(s - rx) * rx_slot_len()];
+		m.len	 = total;
+		nsmp_rx_msg(iface, &m);
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Slot of the message a fragment belongs to. The first fragment takes a free
+ * slot, or one whose message has not moved for frag_ms, and the others must
+ * come next in theirs - NULL drops the fragment. */
+static frag_rx_s* rx_slot(uint8_t src, uint8_t id, uint16_t ofs) {
+	const nsmp_cfg_s* const cfg		 = nsmp_cfg();
+	uint32_t const					now		 = nsmp_now();
+	uint32_t const					expiry = cfg->frag_ms ? cfg->frag_ms : NSMP_FRAG_MS;
+	frag_rx_s*							free	 = NULL;
+
+	for (size_t i = 0; i < NSMP_FRAG_SLOTS; i++) {
+		frag_rx_s* const s = &rx[i];
+		if (s->used && (s->src == src) && (s->id == id)) {
+			if (!ofs) {
+				/* Sent again from the start */
+				s->got = 0;
+			}
+			if (s->got != ofs) {
+				/* A fragment went missing, so has the message */
+				s->used = 0;
+				return NULL;
+			}
+			return s;
+		}
+		if (s->used && (s->src == src) && !ofs) {
+			/* A device fragments one message at a time, it gave up on this one */
+			s->used = 0;
+		}
+		if (!free && (!s->used || (now - s->time > expiry))) {
+			free = s;
+		}
+	}
+	if (ofs || !free) {
+		return NULL;
+	}
+
+	free->used = 1;
+	free->src	 = src;
+	free->id	 = id;
+	free->got	 = 0;
+	free->time = now;
+	return free;
+}
+
+/* Bytes of frag_buf each slot reassembles into */
+static size_t rx_slot_len(void) {
+	return nsmp_cfg()->frag_len / NSMP_FRAG_SLOTS;
+}
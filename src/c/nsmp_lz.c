@@ -0,0 +1,221 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* LZ4 block compression, for message payloads.
+ *
+ * A block is a list of sequences, each [token][literals][offset][match]:
+ * the token holds the literal count in its high nibble and the match length
+ * less 4 in its low nibble, either continuing in extra bytes of 255 when the
+ * nibble is 15. The offset is 16-bit little-endian, counted back from the
+ * current output position. The last sequence has literals only, and the
+ * last 5 bytes of a block are always literals.
+ *
+ * The compressor finds matches through a table of the last position each
+ * hashed 4-byte sequence was seen at, skipping ahead faster the longer it
+ * finds none, so data that does not compress costs little. It uses no
+ * memory besides the table, which the caller provides. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nsmp_lz.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MIN_MATCH			(4)
+#define LAST_LITERALS (5)	 /* Bytes at the end that are always literals */
+#define MATCH_LIMIT		(12) /* A match starts at least this far from the end */
+#define MAX_OFFSET		(0xFFFF)
+#define NIBBLE_MAX		(15)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t lz_hash(const uint8_t* p);
+static uint32_t lz_load(const uint8_t* p);
+static size_t		lz_put_len(uint8_t* dst, size_t op, size_t max, size_t n);
+static size_t		lz_get_len(const uint8_t* src, size_t len, size_t* ip, size_t n);
+static size_t		lz_emit(uint8_t* dst, size_t op, size_t max, const uint8_t* lit,
+												size_t nlit, size_t offset, size_t mlen);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+size_t nsmp_lz_compress(const uint8_t* src, size_t len, uint8_t* dst,
+												size_t max, uint16_t* table) {
+	size_t anchor = 0;
+	size_t op			= 0;
+
+	if (len > MAX_OFFSET + 1) {
+		return 0;
+	}
+	if (len > MATCH_LIMIT) {
+		size_t const limit = len - MATCH_LIMIT;
+		size_t const end	 = len - LAST_LITERALS;
+		size_t			 ip		 = 1;
+
+		memset(table, 0, NSMP_LZ_TABLE_LEN);
+		while (ip < limit) {
+			uint32_t const h	 = lz_hash(&src[ip]);
+			size_t				 ref = table[h];
+
+			table[h] = (uint16_t)ip;
+			if ((ref >= ip) || (lz_load(&src[ref]) != lz_load(&src[ip]))) {
+				ip += 1 + ((ip - anchor) >> 6);
+				continue;
+			}
+
+			/* Take in the bytes before the match that also match */
+			while ((ip > anchor) && ref && (src[ip - 1] == src[ref - 1])) {
+				ip--;
+				ref--;
+			}
+			size_t mlen = MIN_MATCH;
+			while ((ip + mlen < end) && (src[ref + mlen] == src[ip + mlen])) {
+				mlen++;
+			}
+
+			op = lz_emit(dst, op, max, &src[anchor], ip - anchor, ip - ref, mlen);
+			if (!op) {
+				return 0;
+			}
+			ip += mlen;
+			anchor = ip;
+
+			/* Seen in passing, so the next match can reach back into this one */
+			if (ip < limit) {
+				table[lz_hash(&src[ip - 2])] = (uint16_t)(ip - 2);
+			}
+		}
+	}
+	return lz_emit(dst, op, max, &src[anchor], len - anchor, 0, 0);
+}
+
+size_t nsmp_lz_decompress(const uint8_t* src, size_t len, uint8_t* dst,
+													size_t max) {
+	size_t ip = 0;
+	size_t op = 0;
+
+	while (ip < len) {
+		uint8_t const token = src[ip++];
+		size_t const	nlit	= lz_get_len(src, len, &ip, token >> 4);
+		if ((nlit > len - ip) || (nlit > max - op)) {
+			return 0;
+		}
+		memcpy(&dst[op], &src[ip], nlit);
+		ip += nlit;
+		op += nlit;
+		if (ip == len) {
+			/* The last sequence */
+			return op;
+		}
+
+		if (len - ip < 2) {
+			return 0;
+		}
+		size_t const offset = src[ip] | ((size_t)src[ip + 1] << 8);
+		ip += 2;
+		size_t const mlen = lz_get_len(src, len, &ip, token & NIBBLE_MAX);
+		if (!offset || (offset > op) || (MIN_MATCH > max - op) ||
+				(mlen > max - op - MIN_MATCH)) {
+			return 0;
+		}
+
+		/* Copied a byte at a time when it overlaps what it copies */
+		uint8_t* const			 d = &dst[op];
+		const uint8_t* const s = &dst[op - offset];
+		if (offset >= mlen + MIN_MATCH) {
+			memcpy(d, s, mlen + MIN_MATCH);
+		} else {
+			for (size_t i = 0; i < mlen + MIN_MATCH; i++) {
+				d[i] = s[i];
+			}
+		}
+		op += mlen + MIN_MATCH;
+	}
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t lz_hash(const uint8_t* p) {
+	return (lz_load(p) * 2654435761u) >> (32 - NSMP_LZ_HASH_BITS);
+}
+
+static uint32_t lz_load(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/* Write the part of a length that did not fit in its nibble, returns the new
+ * output position or 0 if it does not fit */
+static size_t lz_put_len(uint8_t* dst, size_t op, size_t max, size_t n) {
+	for (n -= NIBBLE_MAX; n >= 0xFF; n -= 0xFF) {
+		if (op >= max) {
+			return 0;
+		}
+		dst[op++] = 0xFF;
+	}
+	if (op >= max) {
+		return 0;
+	}
+	dst[op++] = (uint8_t)n;
+	return op;
+}
+
+/* Read a length starting with the nibble n, returns SIZE_MAX if it runs past
+ * the input */
+static size_t lz_get_len(const uint8_t* src, size_t len, size_t* ip, size_t n) {
+	if (n < NIBBLE_MAX) {
+		return n;
+	}
+	for (;;) {
+		if (*ip >= len) {
+			return SIZE_MAX;
+		}
+		uint8_t const b = src[(*ip)++];
+		n += b;
+		if (b != 0xFF) {
+			return n;
+		}
+	}
+}
+
+/* Write a sequence, without a match when mlen is 0. Returns the new output
+ * position, 0 if it does not fit. */
+static size_t lz_emit(uint8_t* dst, size_t op, size_t max, const uint8_t* lit,
+											size_t nlit, size_t offset, size_t mlen) {
+	size_t const ml = mlen ? mlen - MIN_MATCH : 0;
+
+	if (op >= max) {
+		return 0;
+	}
+	dst[op++] = (uint8_t)(((nlit < NIBBLE_MAX) ? nlit : NIBBLE_MAX) << 4 |
+												((ml < NIBBLE_MAX) ? ml : NIBBLE_MAX));
+	if ((nlit >= NIBBLE_MAX) && !(op = lz_put_len(dst, op, max, nlit))) {
+		return 0;
+	}
+	if (nlit > max - op) {
+		return 0;
+	}
+	memcpy(&dst[op], lit, nlit);
+	op += nlit;
+	if (!mlen) {
+		return op;
+	}
+
+	if (max - op < 2) {
+		return 0;
+	}
+	dst[op++] = (uint8_t)offset;
+	dst[op++] = (uint8_t)(offset >> 8);
+	if ((ml >= NIBBLE_MAX) && !(op = lz_put_len(dst, op, max, ml))) {
+		return 0;
+	}
+	return op;
+}
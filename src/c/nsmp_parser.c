@@ -0,0 +1,394 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "nsmp_private.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef enum {
+	PARSE_CODE, /* Expecting a COBS code byte (or the frame delimiter) */
+	PARSE_DATA, /* Inside a COBS block */
+	PARSE_SYNC, /* Dropping bytes until the next frame delimiter */
+} parse_state_e;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int	parse_byte(nsmp_iface_s* iface, uint8_t byte);
+static int	emit(nsmp_iface_s* iface, uint8_t byte);
+static int	header_done(nsmp_iface_s* iface);
+static int	frame_end(nsmp_iface_s* iface);
+static void drop(nsmp_iface_s* iface, parse_state_e next, int err);
+static uint32_t* counter(nsmp_iface_s* iface, int err);
+static int	payload_ok(const nsmp_parser_s* p);
+static int	subscribed(const nsmp_parser_s* p);
+static size_t unwrap(nsmp_parser_s* p);
+static int	unclaimed(const nsmp_iface_s* iface, const uint8_t* frame,
+											size_t len);
+static void credit_rx(nsmp_iface_s* iface, size_t len);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int nsmp_parse(uint8_t* inbuf, size_t inlen) {
+	return nsmp_parse_if(nsmp_iface_first(), inbuf, inlen);
+}
+
+int nsmp_parse_if(nsmp_iface_s* iface, const uint8_t* inbuf, size_t inlen) {
+	if (!iface || (!inbuf && inlen)) {
+		return NSMP_ERR_BAD_ARG;
+	}
+
+	nsmp_parser_s* const p			= &iface->parser;
+	int									 frames = 0;
+	size_t							 i			= 0;
+
+	while (i < inlen) {
+		/* Fast path - copy the rest of a COBS block straight into the slot, as
+		 * it arrived if the frame is to be relayed */
+		if ((p->state == PARSE_DATA) && p->slot) {
+			size_t run = p->left;
+			if (run > (inlen - i)) {
+				run = inlen - i;
+			}
+			const uint8_t* z = memchr(&inbuf[i], COBS_FRAME_DELIMITER, run);
+			if (z) {
+				run = (size_t)(z - &inbuf[i]);
+			}
+			if ((run > (p->need - p->pos)) ||
+					(p->relay && (run > (p->wmax - p->wpos)))) {
+				drop(iface, PARSE_SYNC, NSMP_ERR_BAD_LEN);
+				continue;
+			}
+			if (p->relay) {
+				memcpy(&p->slot[p->wpos], &inbuf[i], run);
+				p->wpos += (uint32_t)run;
+			} else {
+				memcpy(&p->slot[p->pos], &inbuf[i], run);
+			}
+			p->pos += (uint32_t)run;
+			p->left -= (uint8_t)run;
+			i += run;
+			if (!p->left) {
+				p->state = PARSE_CODE;
+			}
+			if (!z) {
+				continue;
+			}
+		}
+
+		int status = parse_byte(iface, inbuf[i++]);
+		if (status > 0) {
+			frames++;
+		}
+	}
+
+	nsmp_stats_add(&iface->stats.rx_bytes, (uint32_t)inlen);
+	return frames;
+}
+
+void nsmp_parser_reset(nsmp_parser_s* p) {
+	memset(p, 0, sizeof(*p));
+	p->state = PARSE_CODE;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Returns 1 when a frame has been queued, 0 otherwise */
+static int parse_byte(nsmp_iface_s* iface, uint8_t byte) {
+	nsmp_parser_s* const p = &iface->parser;
+
+	/* Keep the encoded bytes of the header, and of all of a relayed frame */
+	if (p->state != PARSE_SYNC) {
+		if (p->relay) {
+			if (p->wpos >= p->wmax) {
+				drop(iface, PARSE_SYNC, NSMP_ERR_BAD_LEN);
+				return 0;
+			}
+			p->slot[p->wpos++] = byte;
+		} else if (!p->slot && (p->rlen < sizeof(p->raw))) {
+			p->raw[p->rlen++] = byte;
+		}
+	}
+
+	switch (p->state) {
+		case PARSE_SYNC: {
+			if (byte == COBS_FRAME_DELIMITER) {
+				nsmp_parser_reset(p);
+			}
+			return 0;
+		}
+
+		case PARSE_CODE: {
+			if (byte == COBS_FRAME_DELIMITER) {
+				return frame_end(iface);
+			}
+			/* Every block but the last is followed by an implied zero */
+			if (p->code && (p->code < 0xFF) && (emit(iface, 0) != NSMP_OK)) {
+				return 0;
+			}
+			p->code = byte;
+			p->left = (uint8_t)(byte - 1);
+			if (p->left) {
+				p->state = PARSE_DATA;
+			}
+			return 0;
+		}
+
+		case PARSE_DATA:
+		default: {
+			if (byte == COBS_FRAME_DELIMITER) {
+				/* Delimiter inside a block - the frame was cut short */
+				drop(iface, PARSE_CODE, NSMP_ERR_BAD_ENC);
+				return 0;
+			}
+			if (emit(iface, byte) != NSMP_OK) {
+				return 0;
+			}
+			if (--p->left == 0) {
+				p->state = PARSE_CODE;
+			}
+			return 0;
+		}
+	}
+}
+
+/* Store one decoded byte */
+static int emit(nsmp_iface_s* iface, uint8_t byte) {
+	nsmp_parser_s* const p = &iface->parser;
+
+	if (!p->slot) {
+		p->hdr[p->hlen++] = byte;
+		return (p->hlen == NSMP_HDR_LEN) ? header_done(iface) : NSMP_OK;
+	}
+
+	if (p->pos >= p->need) {
+		drop(iface, PARSE_SYNC, NSMP_ERR_BAD_LEN);
+		return NSMP_ERR_BAD_LEN;
+	}
+	if (!p->relay) {
+		p->slot[p->pos] = byte;
+	}
+	p->pos++;
+	return NSMP_OK;
+}
+
+/* Validate a complete header and move it into a receive queue slot. A frame
+ * a node relays to another interface, or sends on to the subscribers of a
+ * topic, is kept as it arrived, behind its decoded header, if rx_q has room
+ * to spare for the encoding overhead. */
+static int header_done(nsmp_iface_s* iface) {
+	nsmp_parser_s* const p = &iface->parser;
+
+	if (nsmp_hdr_crc(p->hdr) != p->hdr[NSMP_OFS_CRC]) {
+		drop(iface, PARSE_SYNC, NSMP_ERR_BAD_CRC);
+		return NSMP_ERR_BAD_CRC;
+	}
+
+	/* Reliable messages carry a sequence number on top of the mtu */
+	uint16_t const len = nsmp_frame_len(p->hdr);
+	if (len > iface->mtu + NSMP_SEQ_LEN) {
+		drop(iface, PARSE_SYNC, NSMP_ERR_BAD_LEN);
+		return NSMP_ERR_BAD_LEN;
+	}
+
+	p->need = NSMP_HDR_LEN + len + NSMP_PAYLOAD_CRC_LEN;
+	if (nsmp_frame_type(p->hdr) == NSMP_MSG_TYPE_CTL_SLOWDOWN) {
+		/* Credit must get through while rx_q is full, it is not queued */
+		if (len != NSMP_CREDIT_LEN) {
+			drop(iface, PARSE_SYNC, NSMP_ERR_BAD_LEN);
+			return NSMP_ERR_BAD_LEN;
+		}
+		p->slot = p->ctl;
+	} else {
+		if (!nsmp_cfg()->store_forward &&
+				(nsmp_relay(iface, p->hdr) ||
+				 ((nsmp_role() == NSMP_ROLE_NODE) && nsmp_frame_topic(p->hdr)))) {
+			p->wmax = NSMP_HDR_LEN + NSMP_RELAY_LEN(p->need);
+			if (nsmp_credit_spare(iface, NSMP_QUEUE_REC_LEN(p->wmax))) {
+				p->slot = nsmp_queue_reserve(&iface->rxq, p->wmax);
+			}
+		}
+		if (p->slot) {
+			p->relay = 1;
+			memcpy(&p->slot[NSMP_HDR_LEN], p->raw, p->rlen);
+			p->wpos = NSMP_HDR_LEN + p->rlen;
+		} else {
+			p->slot = nsmp_queue_reserve(&iface->rxq, p->need);
+		}
+	}
+	if (!p->slot) {
+		drop(iface, PARSE_SYNC, NSMP_ERR_NO_MEM);
+		return NSMP_ERR_NO_MEM;
+	}
+	memcpy(p->slot, p->hdr, NSMP_HDR_LEN);
+	p->pos = NSMP_HDR_LEN;
+	return NSMP_OK;
+}
+
+/* Frame delimiter received at a block boundary */
+static int frame_end(nsmp_iface_s* iface) {
+	nsmp_parser_s* const p			= &iface->parser;
+	int									 queued = 0;
+	int									 whole	= p->slot && (p->pos == p->need);
+
+	if (whole && p->relay && subscribed(p)) {
+		/* Published to a topic this node subscribes to as well, it is sent on
+		 * to the other subscribers decoded */
+		whole		 = (unwrap(p) == p->need);
+		p->relay = 0;
+	}
+	if (whole && (p->relay || payload_ok(p))) {
+		nsmp_stats_add(&iface->stats.rx_frames, 1);
+		nsmp_trace(iface, NSMP_TRACE_RX, p->hdr, 0, NSMP_OK);
+		if (p->slot == p->ctl) {
+			nsmp_credit_ctl(iface, p->ctl);
+		} else if (unclaimed(iface, p->slot,
+												 p->relay ? p->wpos
+																	: p->need - NSMP_PAYLOAD_CRC_LEN)) {
+			/* Received all the same, the sender counted its credit */
+			credit_rx(iface, p->need - NSMP_PAYLOAD_CRC_LEN);
+		} else {
+			/* A relayed frame ends with the delimiter, kept by parse_byte() */
+			size_t const len = p->relay ? p->wpos : p->need - NSMP_PAYLOAD_CRC_LEN;
+			nsmp_stats_queued(iface, &iface->rxq, len);
+			nsmp_queue_commit(&iface->rxq, len);
+			credit_rx(iface, p->need - NSMP_PAYLOAD_CRC_LEN);
+			queued = 1;
+		}
+	} else if (p->hlen) {
+		/* Complete but for its payload CRC, or cut short */
+		int const err = whole ? NSMP_ERR_BAD_CRC : NSMP_ERR_BAD_ENC;
+		nsmp_stats_add(counter(iface, err), 1);
+		nsmp_trace(iface, NSMP_TRACE_RX,
+							 (p->hlen == NSMP_HDR_LEN) ? p->hdr : NULL, 0, err);
+		iface->cr.drops++;
+	}
+	if (p->hlen) {
+		nsmp_sched_ready(iface);
+	}
+	/* Anything else is a truncated frame, or back-to-back delimiters */
+	nsmp_parser_reset(p);
+	return queued;
+}
+
+/* Abandon the current frame, whose credit the sender may have counted, for
+ * the reason err */
+static void drop(nsmp_iface_s* iface, parse_state_e next, int err) {
+	nsmp_parser_s* const p = &iface->parser;
+
+	nsmp_stats_add(counter(iface, err), 1);
+	nsmp_trace(iface, NSMP_TRACE_RX, (p->hlen == NSMP_HDR_LEN) ? p->hdr : NULL,
+						 0, err);
+	nsmp_parser_reset(p);
+	iface->parser.state = (uint8_t)next;
+	iface->cr.drops++;
+	nsmp_sched_ready(iface);
+}
+
+/* Counter of nsmp_stats_s a frame dropped for the reason err counts in */
+static uint32_t* counter(nsmp_iface_s* iface, int err) {
+	switch (err) {
+		case NSMP_ERR_BAD_CRC:
+			return &iface->stats.err_crc;
+		case NSMP_ERR_BAD_ENC:
+			return &iface->stats.err_cobs;
+		case NSMP_ERR_NO_MEM:
+			return &iface->stats.rx_drops;
+		case NSMP_ERR_BAD_LEN:
+		default:
+			return &iface->stats.err_len;
+	}
+}
+
+/* Check the payload CRC trailer, if enabled */
+static int payload_ok(const nsmp_parser_s* p) {
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+	size_t const	 len = p->need - NSMP_HDR_LEN - NSMP_PAYLOAD_CRC_LEN;
+	const uint8_t* fcs = &p->slot[NSMP_HDR_LEN + len];
+	uint32_t			 crc = 0;
+
+	for (size_t i = 0; i < NSMP_PAYLOAD_CRC_LEN; i++) {
+		crc |= (uint32_t)fcs[i] << (8 * i);
+	}
+	return crc == nsmp_crc_payload(&p->slot[NSMP_HDR_LEN], len);
+#else
+	(void)p;
+	return 1;
+#endif
+}
+
+/* Check whether a frame kept as it arrived was published to a topic this
+ * device subscribes to */
+static int subscribed(const nsmp_parser_s* p) {
+	return nsmp_frame_topic(p->slot) &&
+				 nsmp_topic_local(nsmp_topic_of(p->slot, p->wpos));
+}
+
+/* Decode a frame kept as it arrived in place, over its decoded header.
+ * Returns the length of the decoded frame. */
+static size_t unwrap(nsmp_parser_s* p) {
+	uint8_t* const f	 = p->slot;
+	size_t				 out = 0;
+
+	for (size_t i = NSMP_HDR_LEN; (i < p->wpos) && f[i];) {
+		size_t const code = f[i++];
+		if ((i + code - 1 > p->wpos) || (out + code - 1 > p->need)) {
+			return 0;
+		}
+		memmove(&f[out], &f[i], code - 1);
+		out += code - 1;
+		i += code - 1;
+		/* Every block but the last is followed by an implied zero */
+		if ((code < 0xFF) && (i < p->wpos) && f[i]) {
+			if (out >= p->need) {
+				return 0;
+			}
+			f[out++] = 0;
+		}
+	}
+	return out;
+}
+
+/* Check for a user message for this device that no handler takes, which is
+ * left out of rx_q, or one published to a topic that neither this device nor
+ * the other interfaces subscribe to. Those in a sequenced frame are left to
+ * reliable delivery, which must see them. */
+static int unclaimed(const nsmp_iface_s* iface, const uint8_t* frame,
+										 size_t len) {
+	const nsmp_dispatch_s* const d = nsmp_cfg()->dispatch;
+
+	if (nsmp_frame_topic(frame)) {
+		int const topic = nsmp_topic_of(frame, len);
+		if (nsmp_topic_out(iface, topic)) {
+			return 0;
+		}
+		if (!nsmp_topic_local(topic)) {
+			return 1;
+		}
+	}
+	return d && (nsmp_frame_type(frame) == NSMP_MSG_TYPE_USER_MESSAGE) &&
+				 !nsmp_relay(iface, frame) &&
+				 !nsmp_dispatch_find(d, NSMP_MSG_TYPE_USER_MESSAGE,
+														 &frame[NSMP_HDR_LEN], len - NSMP_HDR_LEN);
+}
+
+/* Count the credit a received frame of len bytes used, after it was
+ * committed to rx_q - nsmp_update() reads the count first, see
+ * credit_limit() */
+static void credit_rx(nsmp_iface_s* iface, size_t len) {
+	__atomic_store_n(&iface->cr.rx, iface->cr.rx + nsmp_credit_cost(len),
+									 __ATOMIC_RELEASE);
+}
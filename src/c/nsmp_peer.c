@@ -6,6 +6,7 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 #include "nsmp.h"
+#include "nsmp_private.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -15,6 +16,18 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int nsmp_peer_init(void) {
+	return nsmp_init(NSMP_ROLE_PEER);
+}
+
+int nsmp_peer_newif(nsmp_iface_s* ifcfg) {
+	/* A peer has a single link to the network */
+	if (nsmp_iface_first()) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	return nsmp_iface_add(ifcfg);
+}
+
 int nsmp_client_register();
 int nsmp_client_deregister();
 
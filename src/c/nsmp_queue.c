@@ -0,0 +1,189 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "nsmp_queue.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Record prefix: 24-bit length, 8-bit type */
+#define REC_WRAP	 (0xFF) /* Rest of the buffer is unused, continue at 0 */
+#define REC_MAX		 (0xFFFFFF)
+#define ALIGN_UP(n) (((n) + (NSMP_QUEUE_ALIGN - 1)) & ~(uint32_t)(NSMP_QUEUE_ALIGN - 1))
+
+#if defined(NSMP_QUEUE_ATOMIC)
+#define LOAD_OWN(p) atomic_load_explicit((p), memory_order_relaxed)
+#define LOAD_ACQ(p) atomic_load_explicit((p), memory_order_acquire)
+#define STORE_REL(p, v) atomic_store_explicit((p), (v), memory_order_release)
+#else
+#define LOAD_OWN(p) (*(p))
+#define STORE_REL(p, v)                                                        \
+	do {                                                                         \
+		NSMP_QUEUE_BARRIER();                                                      \
+		*(p) = (v);                                                                \
+	} while (0)
+static inline uint32_t load_acq(nsmp_qidx_t* p) {
+	uint32_t v = *p;
+	NSMP_QUEUE_BARRIER();
+	return v;
+}
+#define LOAD_ACQ(p) load_acq(p)
+#endif
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void		 put_prefix(uint8_t* p, uint32_t len, uint8_t type);
+static uint32_t get_len(const uint8_t* p);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int nsmp_queue_init(nsmp_queue_s* q, uint8_t* buf, size_t len) {
+	if (!q || !buf) {
+		return -1;
+	}
+
+	/* Start on an aligned boundary so record prefixes are word aligned */
+	size_t const skip = (size_t)(-(uintptr_t)buf) & (NSMP_QUEUE_ALIGN - 1);
+	if (len < (skip + (2 * NSMP_QUEUE_ALIGN))) {
+		return -1;
+	}
+	len -= skip;
+	if (len > UINT32_MAX) {
+		len = UINT32_MAX;
+	}
+
+	q->buf	= buf + skip;
+	q->size = (uint32_t)len & ~(uint32_t)(NSMP_QUEUE_ALIGN - 1);
+	q->rsv	= 0;
+	q->wrap = 0;
+	STORE_REL(&q->head, 0);
+	STORE_REL(&q->tail, 0);
+	return 0;
+}
+
+uint8_t* nsmp_queue_reserve(nsmp_queue_s* q, size_t len) {
+	if (len > REC_MAX) {
+		return NULL;
+	}
+
+	uint32_t const need = (uint32_t)NSMP_QUEUE_REC_LEN(len);
+	uint32_t const tail = LOAD_OWN(&q->tail);
+	uint32_t const head = LOAD_ACQ(&q->head);
+
+	/* tail == head means empty, so the tail must never catch up with the head */
+	if (tail >= head) {
+		uint32_t const end = q->size - tail;
+		if ((need < end) || ((need == end) && head)) {
+			q->rsv	= tail;
+			q->wrap = 0;
+			return &q->buf[tail + NSMP_QUEUE_ALIGN];
+		}
+		if (need < head) {
+			q->rsv	= 0;
+			q->wrap = 1;
+			return &q->buf[NSMP_QUEUE_ALIGN];
+		}
+	} else if (need < (head - tail)) {
+		q->rsv	= tail;
+		q->wrap = 0;
+		return &q->buf[tail + NSMP_QUEUE_ALIGN];
+	}
+
+	return NULL;
+}
+
+void nsmp_queue_commit(nsmp_queue_s* q, size_t len) {
+	uint32_t next = q->rsv + (uint32_t)NSMP_QUEUE_REC_LEN(len);
+
+	put_prefix(&q->buf[q->rsv], (uint32_t)len, 0);
+	if (q->wrap) {
+		put_prefix(&q->buf[LOAD_OWN(&q->tail)], 0, REC_WRAP);
+	}
+	if (next == q->size) {
+		next = 0;
+	}
+	STORE_REL(&q->tail, next);
+}
+
+uint8_t* nsmp_queue_peek(nsmp_queue_s* q, size_t* len) {
+	uint32_t			 head = LOAD_OWN(&q->head);
+	uint32_t const tail = LOAD_ACQ(&q->tail);
+
+	if (head == tail) {
+		return NULL;
+	}
+	if (q->buf[head + 3] == REC_WRAP) {
+		head = 0;
+		STORE_REL(&q->head, 0);
+	}
+	*len = get_len(&q->buf[head]);
+	return &q->buf[head + NSMP_QUEUE_ALIGN];
+}
+
+void nsmp_queue_release(nsmp_queue_s* q) {
+	uint32_t const head = LOAD_OWN(&q->head);
+	uint32_t			 next = head + (uint32_t)NSMP_QUEUE_REC_LEN(get_len(&q->buf[head]));
+
+	if (next == q->size) {
+		next = 0;
+	}
+	STORE_REL(&q->head, next);
+}
+
+uint8_t* nsmp_queue_at(nsmp_queue_s* q, uint32_t* pos, size_t* len) {
+	uint32_t const tail = LOAD_ACQ(&q->tail);
+
+	if (*pos == tail) {
+		return NULL;
+	}
+	if (q->buf[*pos + 3] == REC_WRAP) {
+		*pos = 0;
+	}
+	*len = get_len(&q->buf[*pos]);
+	return &q->buf[*pos + NSMP_QUEUE_ALIGN];
+}
+
+uint32_t nsmp_queue_head(nsmp_queue_s* q) {
+	return LOAD_OWN(&q->head);
+}
+
+uint32_t nsmp_queue_next(nsmp_queue_s* q, uint32_t pos) {
+	uint32_t const next = pos + (uint32_t)NSMP_QUEUE_REC_LEN(get_len(&q->buf[pos]));
+
+	return (next == q->size) ? 0 : next;
+}
+
+void nsmp_queue_set_tag(uint8_t* rec, uint8_t tag) {
+	rec[3 - NSMP_QUEUE_ALIGN] = tag;
+}
+
+uint8_t nsmp_queue_tag(const uint8_t* rec) {
+	return rec[3 - NSMP_QUEUE_ALIGN];
+}
+
+size_t nsmp_queue_used(nsmp_queue_s* q) {
+	uint32_t const head = LOAD_ACQ(&q->head);
+	uint32_t const tail = LOAD_ACQ(&q->tail);
+
+	return (tail >= head) ? (tail - head) : (q->size - head + tail);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void put_prefix(uint8_t* p, uint32_t len, uint8_t type) {
+	p[0] = (uint8_t)len;
+	p[1] = (uint8_t)(len >> 8);
+	p[2] = (uint8_t)(len >> 16);
+	p[3] = type;
+}
+
+static uint32_t get_len(const uint8_t* p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+}
@@ -0,0 +1,222 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Statistics of each interface, see nsmp_stats_s.
+ *
+ * Counters are plain 32-bit words with a single writer each, which adds to
+ * them with a relaxed load and store rather than a locked read-modify-write,
+ * so counting costs the hot paths next to nothing. High-water marks may be
+ * raised from more than one context, and use a compare-and-swap loop.
+ *
+ * Latencies are sampled rather than measured for every message, as a queue
+ * record has no room for a timestamp: each queue has one nsmp_stamp_s, set
+ * with the position and time of a message queued while it is free, and
+ * cleared - the latency counted - when that record is taken from the queue.
+ * The stamp is written before the record is committed, so whoever sees the
+ * record sees the stamp as well.
+ *
+ * A device asks another for the statistics of an interface with a
+ * NSMP_MSG_TYPE_CTL_STATS request, which is answered on the interface it came
+ * in on with as many responses as the mtu of that link needs, a frame at a
+ * time as there is room in tx_q. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nsmp.h"
+#include "nsmp_private.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static nsmp_stamp_s* stamp_of(nsmp_iface_s* iface, const nsmp_queue_s* q);
+static uint8_t			 bucket(uint32_t ms);
+static int					 stats_send(nsmp_iface_s* iface);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int nsmp_stats_get(const nsmp_iface_s* iface, nsmp_stats_s* out) {
+	if (!iface || !out) {
+		return NSMP_ERR_BAD_ARG;
+	}
+
+	const uint32_t* const in = (const uint32_t*)(const void*)&iface->stats;
+	uint32_t* const				w	 = (uint32_t*)(void*)out;
+	for (size_t i = 0; i < NSMP_STATS_WORDS; i++) {
+		w[i] = __atomic_load_n(&in[i], __ATOMIC_RELAXED);
+	}
+	return NSMP_OK;
+}
+
+int nsmp_stats_query(uint8_t dst, uint8_t idx) {
+	nsmp_msg_s msg = {
+			.hdr =
+					{
+							.ctl =
+									{
+											.data		= 1,
+											.reqres = NSMP_MSG_REQUEST,
+											.type		= NSMP_MSG_TYPE_CTL_STATS,
+									},
+							.dst = dst,
+							.src = nsmp_addr(),
+					},
+			.len	 = NSMP_STATS_REQ_LEN,
+			.data	 = &idx,
+			.flags = NSMP_MSG_URGENT,
+	};
+	return nsmp_send(&msg);
+}
+
+int nsmp_stats_read(const nsmp_msg_s* msg, nsmp_stats_s* out) {
+	if (!msg || !out || (msg->hdr.ctl.type != NSMP_MSG_TYPE_CTL_STATS) ||
+			(msg->hdr.ctl.reqres != NSMP_MSG_RESPONSE) ||
+			(msg->len < NSMP_STATS_HDR)) {
+		return NSMP_ERR_BAD_ARG;
+	}
+
+	size_t const first = msg->data[1];
+	size_t const total = msg->data[2];
+	size_t const n		 = (msg->len - NSMP_STATS_HDR) / sizeof(uint32_t);
+	if (!total) {
+		return NSMP_ERR_NO_IF;
+	}
+	if ((total != NSMP_STATS_WORDS) || (first + n > total)) {
+		return NSMP_ERR_BAD_LEN;
+	}
+
+	uint32_t* const				w = (uint32_t*)(void*)out;
+	const uint8_t* const	p = &msg->data[NSMP_STATS_HDR];
+	for (size_t i = 0; i < n; i++) {
+		w[first + i] = (uint32_t)p[4 * i] | ((uint32_t)p[(4 * i) + 1] << 8) |
+									 ((uint32_t)p[(4 * i) + 2] << 16) |
+									 ((uint32_t)p[(4 * i) + 3] << 24);
+	}
+	return (first + n == total) ? 1 : 0;
+}
+
+void nsmp_stats_reset(nsmp_iface_s* iface) {
+	memset(&iface->stats, 0, sizeof(iface->stats));
+	memset(iface->stamp, 0, sizeof(iface->stamp));
+	iface->stats_to		= 0;
+	iface->stats_idx	= 0;
+	iface->stats_next = 0;
+}
+
+void nsmp_stats_queued(nsmp_iface_s* iface, nsmp_queue_s* q, size_t len) {
+	nsmp_stamp_s* const s = stamp_of(iface, q);
+	size_t							used	= nsmp_queue_used(q) + NSMP_QUEUE_REC_LEN(len);
+
+	if (q == &iface->rxq) {
+		nsmp_stats_max(&iface->stats.rx_q_max, (uint32_t)used);
+	} else {
+		used += nsmp_queue_used((q == &iface->txq) ? &iface->txu : &iface->txq);
+		nsmp_stats_max(&iface->stats.tx_q_max, (uint32_t)used);
+	}
+
+	if (!__atomic_load_n(&s->set, __ATOMIC_ACQUIRE)) {
+		s->pos = q->rsv;
+		s->t0	 = nsmp_now();
+		__atomic_store_n(&s->set, 1, __ATOMIC_RELEASE);
+	}
+}
+
+void nsmp_stats_taken(nsmp_iface_s* iface, nsmp_queue_s* q, uint32_t pos) {
+	nsmp_stamp_s* const s = stamp_of(iface, q);
+
+	if (!__atomic_load_n(&s->set, __ATOMIC_ACQUIRE) || (s->pos != pos)) {
+		return;
+	}
+	uint32_t* const h =
+			(q == &iface->rxq) ? iface->stats.rx_delay : iface->stats.tx_delay;
+	nsmp_stats_add(&h[bucket(nsmp_now() - s->t0)], 1);
+	__atomic_store_n(&s->set, 0, __ATOMIC_RELEASE);
+}
+
+void nsmp_stats_rx(nsmp_iface_s* iface, const nsmp_msg_s* msg) {
+	if ((msg->hdr.ctl.reqres != NSMP_MSG_REQUEST) ||
+			(msg->len < NSMP_STATS_REQ_LEN)) {
+		return;
+	}
+
+	/* A request that comes while another is answered starts over */
+	iface->stats_to		= msg->hdr.src;
+	iface->stats_idx	= msg->data[0];
+	iface->stats_next = 0;
+	iface->ctl_pend |= NSMP_PEND_STATS;
+}
+
+void nsmp_stats_flush(nsmp_iface_s* iface) {
+	while ((iface->ctl_pend & NSMP_PEND_STATS) && stats_send(iface)) {
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static nsmp_stamp_s* stamp_of(nsmp_iface_s* iface, const nsmp_queue_s* q) {
+	if (q == &iface->rxq) {
+		return &iface->stamp[0];
+	}
+	return (q == &iface->txu) ? &iface->stamp[1] : &iface->stamp[2];
+}
+
+/* Histogram bucket of a latency, see NSMP_STATS_BUCKETS */
+static uint8_t bucket(uint32_t ms) {
+	uint8_t const b = ms ? (uint8_t)(32 - __builtin_clz(ms)) : 0;
+
+	return (b < NSMP_STATS_BUCKETS) ? b : (NSMP_STATS_BUCKETS - 1);
+}
+
+/* Queue the next response, returns 1 if there is another to send */
+static int stats_send(nsmp_iface_s* iface) {
+	size_t const				max		= nsmp_frag_mtu(iface);
+	nsmp_iface_s* const of		= nsmp_iface_at(iface->stats_idx);
+	size_t const				total = of ? NSMP_STATS_WORDS : 0;
+
+	if (max < NSMP_STATS_HDR + sizeof(uint32_t)) {
+		/* No room for a word, the question cannot be answered */
+		iface->ctl_pend &= (uint8_t)~NSMP_PEND_STATS;
+		return 0;
+	}
+
+	uint8_t* const p = nsmp_ctl_reserve(iface, max);
+	if (!p) {
+		return 0;
+	}
+
+	nsmp_stats_s s;
+	size_t const first = iface->stats_next;
+	size_t			 n		 = (max - NSMP_STATS_HDR) / sizeof(uint32_t);
+	if (n > total - first) {
+		n = total - first;
+	}
+	if (of) {
+		nsmp_stats_get(of, &s);
+	}
+	const uint32_t* const w = (const uint32_t*)(const void*)&s;
+	for (size_t i = 0; i < n; i++) {
+		uint8_t* const d = &p[NSMP_STATS_HDR + (4 * i)];
+		uint32_t const v = w[first + i];
+		d[0]						 = (uint8_t)v;
+		d[1]						 = (uint8_t)(v >> 8);
+		d[2]						 = (uint8_t)(v >> 16);
+		d[3]						 = (uint8_t)(v >> 24);
+	}
+	p[0] = iface->stats_idx;
+	p[1] = (uint8_t)first;
+	p[2] = (uint8_t)total;
+	nsmp_ctl_commit(iface, p, iface->stats_to, NSMP_MSG_TYPE_CTL_STATS,
+									NSMP_MSG_RESPONSE, NSMP_STATS_HDR + (4 * n));
+
+	iface->stats_next = (uint8_t)(first + n);
+	if (iface->stats_next >= total) {
+		iface->ctl_pend &= (uint8_t)~NSMP_PEND_STATS;
+		return 0;
+	}
+	return 1;
+}
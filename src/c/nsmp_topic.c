@@ -0,0 +1,192 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Topic publish/subscribe.
+ *
+ * A user message sent to NSMP_ADDR_TOPIC is published to the topic in the
+ * first byte of its payload - its port, so a subscriber dispatches it like
+ * any other user message. A peer sends it to its node, once, and the node
+ * sends it on to every interface a subscriber of the topic is on except the
+ * one it came from. The parser keeps the frame as it arrived, as it does a
+ * frame to be relayed, and the same encoded bytes are copied into the tx_buf
+ * of each of those interfaces - the node never decodes nor encodes it again,
+ * however many subscribers there are. Published frames are never bundled,
+ * compressed, fragmented or sent reliably, as they would then have to be
+ * unwrapped to be sent on.
+ *
+ * Devices subscribe with NSMP_MSG_TYPE_CTL_SUBSCRIBE frames of [topic][on]
+ * to the device at the other end of the link. A node keeps a bitmap of the
+ * peers subscribed to each topic, by NSMP_ADDR_PEER() of their address, and
+ * the interface each one is on. The interfaces of each topic are worked out
+ * whenever a subscription changes, so sending one on only takes a look up. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nsmp.h"
+#include "nsmp_private.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* NSMP_MSG_TYPE_CTL_SUBSCRIBE is [topic][on] */
+#define SUB_LEN (2)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef struct {
+	uint32_t peers;	 /* Subscribed peers, by NSMP_ADDR_PEER() */
+	uint32_t ifaces; /* Interfaces they are on, by index */
+	uint8_t	 local;	 /* This device is subscribed */
+} topic_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void topic_update(void);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static topic_s topics[NSMP_TOPICS];
+static uint8_t peer_if[NSMP_MAX_PEERS]; /* Interface each peer is on */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int nsmp_subscribe(uint8_t topic, uint8_t on) {
+	if ((topic >= NSMP_TOPICS) || (nsmp_role() == NSMP_ROLE_NONE)) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	if (nsmp_role() == NSMP_ROLE_NODE) {
+		__atomic_store_n(&topics[topic].local, on != 0, __ATOMIC_RELAXED);
+		return NSMP_OK;
+	}
+
+	nsmp_iface_s* const iface = nsmp_iface_first();
+	uint8_t const				d[SUB_LEN] = {topic, on != 0};
+	if (!iface || !iface->tx_q) {
+		return NSMP_ERR_NO_IF;
+	}
+	if (!iface->txu.size && nsmp_tx_reserved(iface)) {
+		return NSMP_ERR_NO_MEM;
+	}
+	int const status = nsmp_ctl_send(iface, NSMP_ADDR_LINK,
+																	 NSMP_MSG_TYPE_CTL_SUBSCRIBE,
+																	 NSMP_MSG_REQUEST, d, sizeof(d));
+	if (status == NSMP_OK) {
+		__atomic_store_n(&topics[topic].local, on != 0, __ATOMIC_RELAXED);
+	}
+	return status;
+}
+
+void nsmp_topic_reset(void) {
+	memset(topics, 0, sizeof(topics));
+	memset(peer_if, 0, sizeof(peer_if));
+}
+
+void nsmp_topic_ctl(nsmp_iface_s* iface, const nsmp_msg_s* msg) {
+	if ((nsmp_role() != NSMP_ROLE_NODE) || (msg->len < SUB_LEN) ||
+			(msg->data[0] >= NSMP_TOPICS)) {
+		return;
+	}
+
+	uint8_t const	 peer = NSMP_ADDR_PEER(msg->hdr.src);
+	uint32_t const bit	= (uint32_t)1 << peer;
+	topic_s* const t		= &topics[msg->data[0]];
+	if (msg->data[1]) {
+		/* A peer that moved takes its other subscriptions along */
+		peer_if[peer] = iface->idx;
+		t->peers |= bit;
+	} else {
+		t->peers &= ~bit;
+	}
+	topic_update();
+}
+
+void nsmp_topic_forget(uint8_t addr) {
+	uint32_t const bit = (uint32_t)1 << NSMP_ADDR_PEER(addr);
+
+	for (size_t i = 0; i < NSMP_TOPICS; i++) {
+		topics[i].peers &= ~bit;
+	}
+	topic_update();
+}
+
+int nsmp_topic_of(const uint8_t* frame, size_t len) {
+	if (!nsmp_frame_len(frame)) {
+		return -1;
+	}
+	if (!nsmp_frame_encoded(frame, len)) {
+		return frame[NSMP_HDR_LEN];
+	}
+
+	/* Walk the COBS blocks of the frame as it arrived, up to the first byte
+	 * after the header - a zero if it is the one a block stands for */
+	size_t at = 0;
+	for (size_t i = NSMP_HDR_LEN; (i < len) && frame[i];) {
+		size_t const code = frame[i++];
+		if (NSMP_HDR_LEN - at < code - 1) {
+			size_t const pos = i + (NSMP_HDR_LEN - at);
+			return (pos < len) ? frame[pos] : -1;
+		}
+		at += code - 1;
+		i += code - 1;
+		if (code < 0xFF) {
+			if (at == NSMP_HDR_LEN) {
+				return 0;
+			}
+			at++;
+		}
+	}
+	return -1;
+}
+
+uint32_t nsmp_topic_out(const nsmp_iface_s* iface, int topic) {
+	if ((topic < 0) || (topic >= NSMP_TOPICS)) {
+		return 0;
+	}
+
+	uint32_t const out = __atomic_load_n(&topics[topic].ifaces, __ATOMIC_RELAXED);
+	return iface ? (out & ~((uint32_t)1 << iface->idx)) : out;
+}
+
+int nsmp_topic_local(int topic) {
+	return (topic >= 0) && (topic < NSMP_TOPICS) &&
+				 __atomic_load_n(&topics[topic].local, __ATOMIC_RELAXED);
+}
+
+int nsmp_topic_fan(nsmp_iface_s* iface, const uint8_t* frame, size_t len) {
+	/* Carries on with the interfaces left over when the frame was last looked
+	 * at, those that had no room yet */
+	if (!iface->fan) {
+		iface->fan = nsmp_topic_out(iface, nsmp_topic_of(frame, len));
+	}
+	for (uint8_t idx = 0; iface->fan && (idx < NSMP_MAX_IFACES); idx++) {
+		uint32_t const			bit = (uint32_t)1 << idx;
+		nsmp_iface_s* const out = nsmp_iface_at(idx);
+		if ((iface->fan & bit) &&
+				(!out || nsmp_worker_relay(iface, out, frame, len))) {
+			iface->fan &= ~bit;
+		}
+	}
+	return !iface->fan;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Work out the interfaces each topic goes to, read by the workers without a
+ * lock */
+static void topic_update(void) {
+	for (size_t i = 0; i < NSMP_TOPICS; i++) {
+		uint32_t peers = topics[i].peers;
+		uint32_t out	 = 0;
+		while (peers) {
+			out |= (uint32_t)1 << peer_if[__builtin_ctz(peers)];
+			peers &= peers - 1;
+		}
+		__atomic_store_n(&topics[i].ifaces, out, __ATOMIC_RELAXED);
+	}
+}
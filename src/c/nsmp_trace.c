@@ -0,0 +1,94 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Trace ring of frame events, see nsmp_trace_read().
+ *
+ * The parser and nsmp_update() - or the workers - record events from
+ * contexts of their own, so a writer claims a record by adding to the count
+ * of events, and only then fills it in. Its seq is set to something other
+ * than the event's number while it is written, and to the number once it is
+ * done, which lets a reader tell a record it copied whole from one that was
+ * being overwritten, much like a sequence lock. Nothing is formatted: the
+ * record is the raw header as it was decoded, turned into something readable
+ * on the host by tools/nsmp_pcap.c. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nsmp.h"
+#include "nsmp_private.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#if NSMP_TRACE
+_Static_assert(sizeof(nsmp_trace_rec_s) == 16, "trace records are 16 bytes");
+
+static nsmp_trace_rec_s ring[NSMP_TRACE];
+static uint32_t					events; /* Recorded since start, the next to claim */
+#endif
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+size_t nsmp_trace_read(nsmp_trace_rec_s* out, size_t max) {
+#if NSMP_TRACE
+	uint32_t const end	 = __atomic_load_n(&events, __ATOMIC_ACQUIRE);
+	uint32_t			 avail = (end < NSMP_TRACE) ? end : NSMP_TRACE;
+	size_t				 n		 = 0;
+
+	if (!out) {
+		return 0;
+	}
+	if (avail > max) {
+		avail = (uint32_t)max;
+	}
+	for (uint32_t i = end - avail; i != end; i++) {
+		nsmp_trace_rec_s* const r = &ring[i & (NSMP_TRACE - 1)];
+
+		if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != (uint16_t)i) {
+			continue;
+		}
+		memcpy(&out[n], r, sizeof(*r));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) == (uint16_t)i) {
+			n++;
+		}
+	}
+	return n;
+#else
+	(void)out;
+	(void)max;
+	return 0;
+#endif
+}
+
+#if NSMP_TRACE
+void nsmp_trace(const nsmp_iface_s* iface, uint8_t dir, const uint8_t* hdr,
+								size_t len, int result) {
+	uint32_t const n = __atomic_fetch_add(&events, 1, __ATOMIC_RELAXED);
+	nsmp_trace_rec_s* const r = &ring[n & (NSMP_TRACE - 1)];
+
+	__atomic_store_n(&r->seq, (uint16_t)~n, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	r->ms = nsmp_now();
+	if (hdr) {
+		memcpy(&r->hdr, hdr, sizeof(r->hdr));
+		r->len = nsmp_frame_len(hdr);
+	} else {
+		memset(&r->hdr, 0, sizeof(r->hdr));
+		r->len = (len < UINT16_MAX) ? (uint16_t)len : UINT16_MAX;
+	}
+	r->iface	= iface->idx;
+	r->dir		= dir;
+	r->result = (int8_t)result;
+	r->rsvd		= 0;
+
+	__atomic_store_n(&r->seq, (uint16_t)n, __ATOMIC_RELEASE);
+}
+#endif
@@ -0,0 +1,678 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "nsmp_private.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* The message currently reserved by nsmp_send_reserve() */
+typedef struct {
+	nsmp_iface_s* iface;
+	nsmp_queue_s* q; /* Lane the message is reserved in */
+	uint8_t*			frame;
+	nsmp_hdr_s		hdr;
+	uint16_t			len;
+	uint8_t				ofs; /* Space in front of the payload, see nsmp_arq_ofs() */
+} nsmp_rsv_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t* tx_reserve(const nsmp_hdr_s* hdr, size_t len, uint8_t urgent);
+static size_t		tx_compress(uint8_t* payload, size_t len);
+static int			tx_publish(const nsmp_msg_s* msg, uint8_t urgent);
+static nsmp_queue_s* tx_lane(nsmp_iface_s* iface, uint8_t urgent);
+static uint8_t	tx_urgent(const uint8_t* frame);
+static uint8_t	tx_halves(const nsmp_iface_s* iface);
+static void			tx_fill(nsmp_iface_s* iface);
+static int			tx_frame(nsmp_iface_s* iface, const uint8_t* frame, size_t len,
+												 int retry);
+static int			tx_room(const nsmp_iface_s* iface, size_t len);
+static int			tx_splice(nsmp_iface_s* iface, const uint8_t* frame, size_t len);
+static void			tx_acks(nsmp_iface_s* iface);
+static void			tx_release(nsmp_iface_s* iface);
+static int			tx_submit(nsmp_iface_s* iface);
+static size_t		tx_encode(uint8_t* out, size_t max, const nsmp_iovec_s* seg,
+													size_t nseg);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static nsmp_rsv_s rsv;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint8_t* nsmp_send_reserve(uint8_t dst, nsmp_msg_type_e type, size_t len) {
+	nsmp_hdr_s hdr = {
+			.ctl =
+					{
+							.data		= (len != 0),
+							.reqres = NSMP_MSG_REQUEST,
+							.type		= type,
+					},
+			.dst = dst,
+			.src = nsmp_addr(),
+	};
+	return tx_reserve(&hdr, len, 0);
+}
+
+int nsmp_send_commit(size_t len) {
+	if (!rsv.frame || (len > rsv.len)) {
+		return NSMP_ERR_BAD_ARG;
+	}
+
+	rsv.hdr.ctl.data = (len != 0);
+	size_t const rec = nsmp_arq_seal(rsv.frame, &rsv.hdr, rsv.ofs, len);
+	nsmp_stats_queued(rsv.iface, rsv.q, rec);
+	nsmp_queue_commit(rsv.q, rec);
+	nsmp_sched_ready(rsv.iface);
+	rsv.frame = NULL;
+	return NSMP_OK;
+}
+
+void nsmp_send_abort(void) {
+	/* Nothing was published - the space is simply reserved again next time */
+	rsv.frame = NULL;
+}
+
+int nsmp_send(nsmp_msg_s* msg) {
+	if (!msg || (msg->len && !msg->data)) {
+		return NSMP_ERR_BAD_ARG;
+	}
+
+	uint8_t const urgent = (msg->flags & NSMP_MSG_URGENT) != 0;
+	if (msg->hdr.dst == NSMP_ADDR_TOPIC) {
+		return tx_publish(msg, urgent);
+	}
+
+	nsmp_iface_s* const iface = nsmp_route(msg->hdr.dst);
+	if (iface && iface->tx_q && (msg->len > nsmp_frag_mtu(iface))) {
+		return (iface->peer_caps & NSMP_CAP_FRAG) ? nsmp_frag_send(iface, msg)
+																							: NSMP_ERR_BAD_LEN;
+	}
+	if (!urgent && !rsv.frame && iface && iface->tx_q &&
+			nsmp_bundle_add(iface, &msg->hdr, msg->data, msg->len)) {
+		nsmp_sched_ready(iface);
+		return NSMP_OK;
+	}
+
+	uint8_t* payload = tx_reserve(&msg->hdr, msg->len, urgent);
+	if (!payload) {
+		return NSMP_ERR_NO_MEM;
+	}
+	if (msg->len) {
+		memcpy(payload, msg->data, msg->len);
+	}
+	return nsmp_send_commit((msg->flags & NSMP_MSG_COMPRESS)
+															? tx_compress(payload, msg->len)
+															: msg->len);
+}
+
+int nsmp_add_data(nsmp_msg_s* msg, uint8_t* payload, size_t len) {
+	if (!msg || (len > UINT16_MAX) || (len && !payload)) {
+		return NSMP_ERR_BAD_ARG;
+	}
+
+	msg->data			= payload;
+	msg->len			= (uint16_t)len;
+	msg->hdr.ctl.data = (len != 0);
+	msg->flags		= 0;
+	return NSMP_OK;
+}
+
+int nsmp_ctl_send(nsmp_iface_s* iface, uint8_t dst, nsmp_msg_type_e type,
+									uint8_t reqres, const uint8_t* data, size_t len) {
+	uint8_t* const payload = nsmp_ctl_reserve(iface, len);
+	if (!payload) {
+		return NSMP_ERR_NO_MEM;
+	}
+	if (len) {
+		memcpy(payload, data, len);
+	}
+	nsmp_ctl_commit(iface, payload, dst, type, reqres, len);
+	return NSMP_OK;
+}
+
+uint8_t* nsmp_ctl_reserve(nsmp_iface_s* iface, size_t len) {
+	nsmp_queue_s* const q = tx_lane(iface, 1);
+	if (q == &iface->txq) {
+		nsmp_bundle_close(iface);
+	}
+	uint8_t* const frame = nsmp_queue_reserve(q, NSMP_HDR_LEN + len);
+	return frame ? frame + NSMP_HDR_LEN : NULL;
+}
+
+void nsmp_ctl_commit(nsmp_iface_s* iface, uint8_t* payload, uint8_t dst,
+										 nsmp_msg_type_e type, uint8_t reqres, size_t len) {
+	nsmp_hdr_s hdr = {
+			.ctl =
+					{
+							.data		= (len != 0),
+							.reqres = reqres,
+							.type		= type,
+					},
+			.dst = dst,
+			.src = nsmp_addr(),
+	};
+
+	nsmp_frame_hdr(payload - NSMP_HDR_LEN, &hdr, (uint16_t)len);
+	nsmp_stats_queued(iface, tx_lane(iface, 1), NSMP_HDR_LEN + len);
+	nsmp_queue_commit(tx_lane(iface, 1), NSMP_HDR_LEN + len);
+	nsmp_sched_ready(iface);
+}
+
+int nsmp_tx_reserved(const nsmp_iface_s* iface) {
+	return rsv.frame && (rsv.iface == iface);
+}
+
+int nsmp_tx_forward(nsmp_iface_s* iface, const uint8_t* frame, size_t len) {
+	if (!iface->tx_q || !iface->tx_cb) {
+		/* Nowhere to send it */
+		return 1;
+	}
+	if (nsmp_frame_encoded(frame, len)) {
+		return tx_splice(iface, frame, len);
+	}
+
+	/* Control messages for other devices get the same priority as ours */
+	nsmp_queue_s* const q		 = tx_lane(iface, tx_urgent(frame));
+	size_t							room = 0;
+	if (q == &iface->txq) {
+		if (nsmp_tx_reserved(iface)) {
+			return 0;
+		}
+		nsmp_bundle_close(iface);
+		room = nsmp_arq_room(iface);
+	}
+	uint8_t* const rec = nsmp_queue_reserve(q, len + room);
+	if (!rec) {
+		return 0;
+	}
+	memcpy(rec, frame, len);
+	nsmp_stats_queued(iface, q, len);
+	nsmp_queue_commit(q, len);
+	nsmp_sched_ready(iface);
+	return 1;
+}
+
+size_t nsmp_message_len(nsmp_msg_s* msg) {
+	return NSMP_HDR_LEN + msg->len;
+}
+
+size_t nsmp_tx_process(nsmp_iface_s* iface, size_t quota) {
+	nsmp_txbuf_s* const b		 = &iface->txb;
+	size_t							used = 0;
+
+	if (!iface->tx_q || !iface->tx_cb) {
+		return 0;
+	}
+
+	for (;;) {
+		if (!b->closed) {
+			/* The transport may still be reading this half */
+			if (b->busy[b->cur] || (used >= quota)) {
+				return used;
+			}
+			tx_fill(iface);
+			if (!b->fill) {
+				return used;
+			}
+			b->closed = 1;
+		}
+
+		size_t const sent = b->sent;
+		int const		 done = tx_submit(iface);
+		used += b->sent - sent;
+		if (!done) {
+			return used;
+		}
+
+		/* Batch accepted - move on to the other half */
+		if (iface->tx_async) {
+			b->busy[b->cur] = 1;
+		}
+		b->cur		= (uint8_t)((b->cur + 1) % tx_halves(iface));
+		b->closed = 0;
+		b->fill		= 0;
+		b->sent		= 0;
+	}
+}
+
+void nsmp_tx_done(nsmp_iface_s* iface) {
+	nsmp_txbuf_s* const b = &iface->txb;
+
+	b->busy[b->oldest] = 0;
+	b->oldest					 = (uint8_t)((b->oldest + 1) % tx_halves(iface));
+	nsmp_sched_ready(iface);
+}
+
+int nsmp_tx_lanes(nsmp_iface_s* iface) {
+	size_t const bulk		= NSMP_QUEUE_LEN(1, iface->mtu);
+	size_t			 urgent = iface->tx_urgent_len;
+
+	if (!urgent && (iface->tx_len >= bulk + NSMP_URGENT_LEN(iface->mtu))) {
+		urgent = NSMP_URGENT_LEN(iface->mtu);
+	}
+	/* Keep the bulk lane aligned like the buffer it is carved from */
+	urgent = (urgent + (NSMP_QUEUE_ALIGN - 1)) & ~(size_t)(NSMP_QUEUE_ALIGN - 1);
+
+	memset(&iface->txu, 0, sizeof(iface->txu));
+	if (urgent &&
+			((iface->tx_len < urgent + bulk) ||
+			 (nsmp_queue_init(&iface->txu, iface->tx_q, urgent) != 0))) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	if (nsmp_queue_init(&iface->txq, iface->tx_q + urgent,
+											iface->tx_len - urgent) != 0) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	return NSMP_OK;
+}
+
+void nsmp_tx_reset(nsmp_iface_s* iface) {
+	nsmp_txbuf_s* const b = &iface->txb;
+
+	memset(b, 0, sizeof(*b));
+	b->half = iface->tx_buf_len;
+	if (tx_halves(iface) == 2) {
+		b->half /= 2;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t* tx_reserve(const nsmp_hdr_s* hdr, size_t len, uint8_t urgent) {
+	if (rsv.frame) {
+		return NULL;
+	}
+
+	nsmp_iface_s* iface = nsmp_route(hdr->dst);
+	if (!iface || !iface->tx_q || (len > iface->mtu) ||
+			((hdr->dst == NSMP_ADDR_TOPIC) && (nsmp_role() == NSMP_ROLE_NODE))) {
+		return NULL;
+	}
+
+	/* Urgent messages overtake sequenced ones, so are not sequenced
+	 * themselves. Anything else that is not bundled goes out after the open
+	 * bundle. */
+	nsmp_queue_s* const q		= tx_lane(iface, urgent);
+	size_t							ofs = 0;
+	size_t							room = 0;
+	if (q == &iface->txq) {
+		nsmp_bundle_close(iface);
+		ofs	 = nsmp_arq_ofs(iface, hdr);
+		room = nsmp_arq_room(iface);
+	}
+
+	uint8_t* frame = nsmp_queue_reserve(q, NSMP_HDR_LEN + ofs + len + room);
+	if (!frame) {
+		return NULL;
+	}
+
+	rsv.iface = iface;
+	rsv.q			= q;
+	rsv.frame = frame;
+	rsv.hdr		= *hdr;
+	rsv.len		= (uint16_t)len;
+	rsv.ofs		= (uint8_t)ofs;
+	return frame + NSMP_HDR_LEN + ofs;
+}
+
+/* Replace the reserved message's payload by its compressed form if the other
+ * end of the link expands it and it comes out shorter, returns the length to
+ * commit */
+static size_t tx_compress(uint8_t* payload, size_t len) {
+	const nsmp_cfg_s* const cfg = nsmp_cfg();
+
+	if ((len < NSMP_LZ_MIN) || (len > nsmp_lz_max()) ||
+			!(rsv.iface->peer_caps & NSMP_CAP_LZ) ||
+			(rsv.hdr.ctl.type >= NSMP_MSG_TYPE_CTL_ACK)) {
+		return len;
+	}
+
+	uint8_t* const out = cfg->lz_buf + NSMP_LZ_TABLE_LEN;
+	size_t const	 n	 = nsmp_lz_compress(payload, len, out, len - NSMP_LZ_HDR - 1,
+																			(uint16_t*)(void*)cfg->lz_buf);
+	if (!n) {
+		return len;
+	}
+	nsmp_ctrl_s ctl = rsv.hdr.ctl;
+	ctl.data				= 1;
+	memcpy(&payload[0], &ctl, sizeof(ctl));
+	payload[1] = (uint8_t)len;
+	payload[2] = (uint8_t)(len >> 8);
+	memcpy(&payload[NSMP_LZ_HDR], out, n);
+	rsv.hdr.ctl.type = NSMP_MSG_TYPE_CTL_LZ;
+	return NSMP_LZ_HDR + n;
+}
+
+/* Publish a message to the topic in its first payload byte, as a frame of
+ * its own that a node can send on as it arrived. A peer sends it to its node,
+ * a node to each interface with a subscriber - to all of them, or to none
+ * while one has no room, so that calling again does not send it twice. */
+static int tx_publish(const nsmp_msg_s* msg, uint8_t urgent) {
+	uint8_t* rec[NSMP_MAX_IFACES] = {NULL};
+
+	if (!msg->len || (msg->hdr.ctl.type != NSMP_MSG_TYPE_USER_MESSAGE)) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	if (nsmp_role() != NSMP_ROLE_NODE) {
+		nsmp_iface_s* const iface = nsmp_route(msg->hdr.dst);
+		if (iface && iface->tx_q && (msg->len > nsmp_frag_mtu(iface))) {
+			return NSMP_ERR_BAD_LEN;
+		}
+		uint8_t* const payload = tx_reserve(&msg->hdr, msg->len, urgent);
+		if (!payload) {
+			return NSMP_ERR_NO_MEM;
+		}
+		memcpy(payload, msg->data, msg->len);
+		return nsmp_send_commit(msg->len);
+	}
+
+	uint32_t const mask = nsmp_topic_out(NULL, msg->data[0]);
+	size_t const	 len	= NSMP_HDR_LEN + msg->len;
+	for (uint8_t idx = 0; idx < NSMP_MAX_IFACES; idx++) {
+		nsmp_iface_s* const out = nsmp_iface_at(idx);
+		if (!(mask & ((uint32_t)1 << idx)) || !out || !out->tx_q) {
+			continue;
+		}
+		if (msg->len > nsmp_frag_mtu(out)) {
+			return NSMP_ERR_BAD_LEN;
+		}
+		nsmp_queue_s* const q		 = tx_lane(out, urgent);
+		size_t							room = 0;
+		if (q == &out->txq) {
+			if (nsmp_tx_reserved(out)) {
+				return NSMP_ERR_NO_MEM;
+			}
+			nsmp_bundle_close(out);
+			room = nsmp_arq_room(out);
+		}
+		rec[idx] = nsmp_queue_reserve(q, len + room);
+		if (!rec[idx]) {
+			return NSMP_ERR_NO_MEM;
+		}
+	}
+	for (uint8_t idx = 0; idx < NSMP_MAX_IFACES; idx++) {
+		nsmp_iface_s* const out = nsmp_iface_at(idx);
+		if (rec[idx]) {
+			nsmp_frame_hdr(rec[idx], &msg->hdr, msg->len);
+			memcpy(&rec[idx][NSMP_HDR_LEN], msg->data, msg->len);
+			nsmp_stats_queued(out, tx_lane(out, urgent), len);
+			nsmp_queue_commit(tx_lane(out, urgent), len);
+			nsmp_sched_ready(out);
+		}
+	}
+	return NSMP_OK;
+}
+
+/* Lane of tx_q a message goes to */
+static nsmp_queue_s* tx_lane(nsmp_iface_s* iface, uint8_t urgent) {
+	return (urgent && iface->txu.size) ? &iface->txu : &iface->txq;
+}
+
+/* Control messages, other than those carrying user messages */
+static uint8_t tx_urgent(const uint8_t* frame) {
+	uint8_t const type = nsmp_frame_type(frame);
+
+	return (type != NSMP_MSG_TYPE_USER_MESSAGE) &&
+				 (type != NSMP_MSG_TYPE_CTL_BUNDLE) && (type != NSMP_MSG_TYPE_CTL_LZ) &&
+				 (type != NSMP_MSG_TYPE_CTL_FRAG) && !nsmp_frame_seq_ofs(frame);
+}
+
+/* tx_buf is double buffered when it can hold two frames of the largest size */
+static uint8_t tx_halves(const nsmp_iface_s* iface) {
+	return (iface->tx_buf_len >= NSMP_TX_BUF_LEN(iface->mtu)) ? 2 : 1;
+}
+
+/* Encode queued messages into the current half of tx_buf. The urgent lane
+ * goes first, then messages marked to be sent again, then new messages in
+ * order. */
+static void tx_fill(nsmp_iface_s* iface) {
+	nsmp_txbuf_s* const b = &iface->txb;
+	nsmp_queue_s* const q = &iface->txq;
+	uint8_t							ctl[NSMP_HDR_LEN + NSMP_CREDIT_LEN];
+	uint8_t*						frame;
+	size_t							len;
+
+	/* Flow control goes first, and never waits for credit itself */
+	while (tx_room(iface, NSMP_HDR_LEN + NSMP_CREDIT_LEN) &&
+				 ((len = nsmp_credit_frame(iface, ctl)) != 0)) {
+		tx_frame(iface, ctl, len, 0);
+	}
+
+	/* Nothing from the bulk lane while an urgent message waits for room */
+	while ((frame = nsmp_queue_peek(&iface->txu, &len)) != NULL) {
+		if (!tx_frame(iface, frame, len, 0)) {
+			return;
+		}
+		nsmp_stats_taken(iface, &iface->txu, nsmp_queue_head(&iface->txu));
+		nsmp_queue_release(&iface->txu);
+		nsmp_os_signal(NSMP_EV_TX);
+	}
+
+	if (b->resend) {
+		uint32_t pos = nsmp_queue_head(q);
+		while ((pos != b->rd) && (frame = nsmp_queue_at(q, &pos, &len))) {
+			if (nsmp_queue_tag(frame) == NSMP_TAG_RESEND) {
+				if (!tx_frame(iface, frame, len, 1)) {
+					return;
+				}
+				nsmp_queue_set_tag(frame, NSMP_TAG_PEND);
+				nsmp_stats_add(&iface->stats.retransmits, 1);
+				b->resend--;
+			}
+			pos = nsmp_queue_next(q, pos);
+		}
+	}
+
+	while ((frame = nsmp_queue_at(q, &b->rd, &len)) != NULL) {
+		/* Sequenced messages stay queued until they are acknowledged */
+		uint8_t const seq = (uint8_t)nsmp_frame_own_seq(frame);
+		if (nsmp_queue_tag(frame) == NSMP_TAG_DONE) {
+			/* Already sent ahead of its turn */
+		} else if (seq && !nsmp_arq_tx_ready(frame)) {
+			tx_acks(iface);
+			break;
+		} else if (!tx_frame(iface, frame, len, 0)) {
+			break;
+		} else {
+			nsmp_queue_set_tag(frame, (seq && nsmp_arq_tx_sent(frame))
+																		? NSMP_TAG_PEND
+																		: NSMP_TAG_DONE);
+		}
+		nsmp_stats_taken(iface, q, b->rd);
+		b->rd = nsmp_queue_next(q, b->rd);
+	}
+	tx_release(iface);
+}
+
+/* The window is full - acknowledgements queued behind the message waiting
+ * for it to open are sent ahead, or the two ends could wait for each other */
+static void tx_acks(nsmp_iface_s* iface) {
+	nsmp_queue_s* const q		= &iface->txq;
+	uint32_t						pos = iface->txb.rd;
+	uint8_t*						frame;
+	size_t							len;
+
+	while ((frame = nsmp_queue_at(q, &pos, &len)) != NULL) {
+		uint8_t const type = nsmp_frame_type(frame);
+		if ((nsmp_queue_tag(frame) == NSMP_TAG_NEW) &&
+				((type == NSMP_MSG_TYPE_CTL_ACK) ||
+				 (type == NSMP_MSG_TYPE_CTL_PLS_RETRY))) {
+			if (!tx_frame(iface, frame, len, 0)) {
+				return;
+			}
+			nsmp_queue_set_tag(frame, NSMP_TAG_DONE);
+		}
+		pos = nsmp_queue_next(q, pos);
+	}
+}
+
+/* Encode one queued message into the current half of tx_buf, returns 0 if it
+ * does not fit */
+static int tx_frame(nsmp_iface_s* iface, const uint8_t* frame, size_t len,
+										int retry) {
+	nsmp_txbuf_s* const b		 = &iface->txb;
+	uint8_t* const			base = &iface->tx_buf[b->cur * b->half];
+	uint8_t							ack[NSMP_ACK_LEN];
+	size_t							ext	 = 0;
+
+	/* A sequenced message carries the acknowledgement due to its destination */
+	if (nsmp_frame_own_seq(frame)) {
+		ext = nsmp_arq_ack_fill(iface, frame, len, ack);
+	}
+	if (!tx_room(iface, len + ext) ||
+			!nsmp_credit_take(iface, frame, len + ext)) {
+		return 0;
+	}
+
+	/* The header is encoded from its own segment, so fields that are only
+	 * known at transmit time can be set without touching the queue. */
+	uint8_t hdr[NSMP_HDR_LEN];
+	memcpy(hdr, frame, NSMP_HDR_LEN);
+	if (retry || ext) {
+		nsmp_ctrl_s ctl;
+		memcpy(&ctl, &hdr[NSMP_OFS_CTL], sizeof(ctl));
+		ctl.retry |= (retry != 0);
+		if (ext) {
+			uint16_t const n = (uint16_t)(nsmp_frame_len(frame) + ext);
+			ctl.type							 = NSMP_MSG_TYPE_CTL_SEQ_ACK;
+			hdr[NSMP_OFS_LEN]			 = (uint8_t)n;
+			hdr[NSMP_OFS_LEN + 1]	 = (uint8_t)(n >> 8);
+			nsmp_arq_ack_sent(frame);
+		}
+		memcpy(&hdr[NSMP_OFS_CTL], &ctl, sizeof(ctl));
+		hdr[NSMP_OFS_CRC] = nsmp_hdr_crc(hdr);
+	}
+
+	/* The acknowledgement goes between the sequence number and the payload */
+	size_t const			 head = ext ? NSMP_SEQ_LEN : len - NSMP_HDR_LEN;
+	const uint8_t* const body = frame + NSMP_HDR_LEN;
+
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+	uint8_t	 fcs[NSMP_PAYLOAD_CRC_LEN];
+	uint32_t crc = nsmp_crc_payload(body, head);
+	crc					 = nsmp_crc_payload_add(crc, ack, ext);
+	crc = nsmp_crc_payload_add(crc, body + head, len - NSMP_HDR_LEN - head);
+	for (size_t i = 0; i < sizeof(fcs); i++) {
+		fcs[i] = (uint8_t)(crc >> (8 * i));
+	}
+#endif
+
+	const nsmp_iovec_s seg[] = {
+			{hdr, NSMP_HDR_LEN},
+			{body, head},
+			{ack, ext},
+			{body + head, len - NSMP_HDR_LEN - head},
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+			{fcs, sizeof(fcs)},
+#endif
+	};
+	b->fill += tx_encode(&base[b->fill], b->half - b->fill, seg,
+											 sizeof(seg) / sizeof(seg[0]));
+	nsmp_stats_add(&iface->stats.tx_frames, 1);
+	nsmp_trace(iface, NSMP_TRACE_TX, hdr, 0, NSMP_OK);
+	return 1;
+}
+
+/* Check that a frame of len bytes fits in the current half of tx_buf */
+static int tx_room(const nsmp_iface_s* iface, size_t len) {
+	return COBS_ENCODE_MAX(len + NSMP_PAYLOAD_CRC_LEN) <=
+				 (iface->txb.half - iface->txb.fill);
+}
+
+/* Copy a frame that was received on another interface and kept encoded into
+ * the current half of tx_buf. Messages in tx_q that have not been encoded yet
+ * go first, as they may have been relayed ahead of it or be urgent. */
+static int tx_splice(nsmp_iface_s* iface, const uint8_t* frame, size_t len) {
+	nsmp_txbuf_s* const b		 = &iface->txb;
+	uint8_t* const			base = &iface->tx_buf[b->cur * b->half];
+	size_t const				n		 = len - NSMP_HDR_LEN;
+	uint32_t						pos	 = b->rd;
+	size_t							l;
+
+	if (b->closed || b->busy[b->cur] || (n > (b->half - b->fill)) ||
+			nsmp_queue_at(&iface->txq, &pos, &l) || nsmp_queue_used(&iface->txu)) {
+		return 0;
+	}
+	if (!nsmp_credit_take(iface, frame, NSMP_HDR_LEN + nsmp_frame_len(frame))) {
+		return 0;
+	}
+	memcpy(&base[b->fill], &frame[NSMP_HDR_LEN], n);
+	b->fill += n;
+	nsmp_stats_add(&iface->stats.tx_frames, 1);
+	nsmp_trace(iface, NSMP_TRACE_TX, frame, 0, NSMP_OK);
+	nsmp_sched_ready(iface);
+	return 1;
+}
+
+/* Free the messages at the head of tx_q that are finished with */
+static void tx_release(nsmp_iface_s* iface) {
+	uint8_t* frame;
+	size_t	 len;
+	int			 freed = 0;
+
+	while (((frame = nsmp_queue_peek(&iface->txq, &len)) != NULL) &&
+				 (nsmp_queue_tag(frame) == NSMP_TAG_DONE)) {
+		nsmp_queue_release(&iface->txq);
+		freed = 1;
+	}
+	if (freed) {
+		nsmp_os_signal(NSMP_EV_TX);
+	}
+}
+
+/* Offer the unsent part of the current batch to the transport.
+ * Returns 1 once the whole batch has been accepted. */
+static int tx_submit(nsmp_iface_s* iface) {
+	nsmp_txbuf_s* const b		= &iface->txb;
+	size_t const				left = b->fill - b->sent;
+	const nsmp_iovec_s	iov	= {&iface->tx_buf[(b->cur * b->half) + b->sent], left};
+
+	int const n = iface->tx_cb(iface, &iov, 1);
+	if ((n < 0) || ((size_t)n >= left)) {
+		/* Accepted, or the link failed and the batch is dropped */
+		nsmp_stats_add((n < 0) ? &iface->stats.tx_drops : &iface->stats.tx_bytes,
+									 (uint32_t)left);
+		if (n < 0) {
+			nsmp_trace(iface, NSMP_TRACE_TX, NULL, left, NSMP_ERR_IO);
+		}
+		b->sent = b->fill;
+		return 1;
+	}
+	nsmp_stats_add(&iface->stats.tx_bytes, (uint32_t)n);
+	b->sent += (size_t)n;
+	return 0;
+}
+
+/* COBS-encode a frame gathered from several segments, returns encoded length */
+static size_t tx_encode(uint8_t* out, size_t max, const nsmp_iovec_s* seg,
+												size_t nseg) {
+	cobs_enc_ctx_t c;
+	unsigned			 n = 0;
+
+	if (cobs_encode_inc_begin(out, (unsigned)max, &c) != COBS_RET_SUCCESS) {
+		return 0;
+	}
+	for (size_t i = 0; i < nseg; i++) {
+		if (seg[i].len &&
+				(cobs_encode_inc(&c, seg[i].base, (unsigned)seg[i].len) !=
+				 COBS_RET_SUCCESS)) {
+			return 0;
+		}
+	}
+	cobs_encode_inc_end(&c, &n);
+	return n;
+}
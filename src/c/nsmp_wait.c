@@ -0,0 +1,231 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Blocking send and receive.
+ *
+ * Messages for the application on an interface without an rx_cb are copied
+ * from rx_q into rcv_q by nsmp_update(), as [nsmp_hdr_s][payload] records,
+ * and taken out by nsmp_rcv() - the two may run in different contexts. A
+ * frame whose messages do not fit stays in rx_q, the interface is marked
+ * blocked and nsmp_rcv() makes it ready again once it has freed some space.
+ *
+ * The waits use the nsmp_os_s hooks: nsmp_update() signals NSMP_EV_TX when it
+ * releases messages from a tx_q and NSMP_EV_RX when it queues one in rcv_q,
+ * the waiting call tries again every time it is woken. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nsmp.h"
+#include "nsmp_private.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef struct {
+	nsmp_queue_s q;				/* Over nsmp_cfg_s::rcv_q, size 0 when there is none */
+	uint32_t		 blocked; /* Interfaces waiting for space in q, by index */
+} nsmp_rcv_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static size_t rcv_need(const uint8_t* frame, size_t len);
+static int		rcv_fits(size_t need);
+static int		rcv_takes(nsmp_ctrl_s ctl);
+static int		wait_ev(nsmp_ev_e ev, uint32_t t0, uint32_t waitms);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static nsmp_rcv_s rcv;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int nsmp_rcv_init(void) {
+	const nsmp_cfg_s* const cfg = nsmp_cfg();
+
+	memset(&rcv, 0, sizeof(rcv));
+	if (cfg->rcv_q && (nsmp_queue_init(&rcv.q, cfg->rcv_q, cfg->rcv_len) != 0)) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	return NSMP_OK;
+}
+
+int nsmp_rcv_room(nsmp_iface_s* iface, const uint8_t* frame, size_t len) {
+	if (iface->rx_cb || !rcv.q.size || nsmp_cfg()->dispatch) {
+		return 1;
+	}
+
+	size_t const need = rcv_need(frame, len);
+	if (rcv_fits(need)) {
+		return 1;
+	}
+
+	/* Checked again once marked, nsmp_rcv() may have freed space in between */
+	__atomic_fetch_or(&rcv.blocked, (uint32_t)1 << iface->idx, __ATOMIC_SEQ_CST);
+	return rcv_fits(need);
+}
+
+void nsmp_rcv_put(const nsmp_msg_s* msg) {
+	uint8_t* const rec = nsmp_queue_reserve(&rcv.q, sizeof(msg->hdr) + msg->len);
+	if (!rec) {
+		return;
+	}
+	memcpy(rec, &msg->hdr, sizeof(msg->hdr));
+	if (msg->len) {
+		memcpy(rec + sizeof(msg->hdr), msg->data, msg->len);
+	}
+	nsmp_queue_commit(&rcv.q, sizeof(msg->hdr) + msg->len);
+	nsmp_os_signal(NSMP_EV_RX);
+}
+
+void nsmp_os_signal(nsmp_ev_e ev) {
+	const nsmp_os_s* const os = &nsmp_cfg()->os;
+
+	if (os->signal) {
+		os->signal(os->ctx, ev);
+	}
+}
+
+int nsmp_rcv(nsmp_msg_s* msg) {
+	size_t len;
+
+	if (!msg || (msg->len && !msg->data)) {
+		return NSMP_ERR_BAD_ARG;
+	}
+
+	const uint8_t* const rec = nsmp_queue_peek(&rcv.q, &len);
+	if (!rec) {
+		return NSMP_ERR_AGAIN;
+	}
+	size_t const n = len - sizeof(msg->hdr);
+	if (n > msg->len) {
+		msg->len = (uint16_t)n;
+		return NSMP_ERR_BAD_LEN;
+	}
+
+	memcpy(&msg->hdr, rec, sizeof(msg->hdr));
+	if (n) {
+		memcpy(msg->data, rec + sizeof(msg->hdr), n);
+	}
+	msg->len	 = (uint16_t)n;
+	msg->flags = 0;
+	nsmp_queue_release(&rcv.q);
+
+	/* Let the interfaces that were waiting for the space carry on */
+	uint32_t const blocked =
+			__atomic_exchange_n(&rcv.blocked, 0, __ATOMIC_SEQ_CST);
+	for (nsmp_iface_s* iface = nsmp_iface_first(); blocked && iface;
+			 iface = iface->next) {
+		if (blocked & ((uint32_t)1 << iface->idx)) {
+			nsmp_sched_ready(iface);
+		}
+	}
+	return NSMP_OK;
+}
+
+int nsmp_rcv_wait(nsmp_msg_s* msg, uint32_t waitms) {
+	const nsmp_cfg_s* const cfg = nsmp_cfg();
+	uint32_t const t0 = cfg->get_time_ms ? cfg->get_time_ms() : 0;
+
+	for (;;) {
+		int const status = nsmp_rcv(msg);
+		if ((status != NSMP_ERR_AGAIN) || wait_ev(NSMP_EV_RX, t0, waitms)) {
+			return status;
+		}
+	}
+}
+
+int nsmp_send_wait(nsmp_msg_s* msg, uint32_t waitms) {
+	const nsmp_cfg_s* const cfg = nsmp_cfg();
+	uint32_t const t0 = cfg->get_time_ms ? cfg->get_time_ms() : 0;
+
+	for (;;) {
+		int const status = nsmp_send(msg);
+		if ((status != NSMP_ERR_NO_MEM) || wait_ev(NSMP_EV_TX, t0, waitms)) {
+			return status;
+		}
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Bytes of rcv_q the messages of a frame take */
+static size_t rcv_need(const uint8_t* frame, size_t len) {
+	size_t const seq = nsmp_frame_seq_ofs(frame);
+	size_t const ofs = NSMP_HDR_LEN + seq;
+	nsmp_ctrl_s	 ctl;
+
+	memcpy(&ctl, &frame[seq ? NSMP_OFS_SEQ_CTL : NSMP_OFS_CTL], sizeof(ctl));
+	if ((ctl.type == NSMP_MSG_TYPE_CTL_LZ) && (len >= ofs + NSMP_LZ_HDR)) {
+		/* Queued expanded */
+		memcpy(&ctl, &frame[ofs], sizeof(ctl));
+		len = ofs + (frame[ofs + 1] | ((size_t)frame[ofs + 2] << 8));
+	}
+	if ((ctl.type == NSMP_MSG_TYPE_CTL_FRAG) && (len >= ofs + NSMP_FRAG_HDR)) {
+		/* Only the last fragment completes a message to queue */
+		size_t const total = frame[ofs + 2] | ((size_t)frame[ofs + 3] << 8);
+		size_t const at		 = frame[ofs + 4] | ((size_t)frame[ofs + 5] << 8);
+		if (nsmp_cfg()->frag_cb || (at + len - ofs - NSMP_FRAG_HDR != total)) {
+			return 0;
+		}
+		memcpy(&ctl, &frame[ofs], sizeof(ctl));
+		len = ofs + total;
+	}
+	if (ctl.type == NSMP_MSG_TYPE_CTL_DIRECTORY) {
+		return nsmp_dir_rcv_need(&frame[ofs], len - ofs);
+	}
+	if (ctl.type != NSMP_MSG_TYPE_CTL_BUNDLE) {
+		return rcv_takes(ctl)
+							 ? NSMP_QUEUE_REC_LEN(sizeof(nsmp_hdr_s) + len - ofs)
+							 : 0;
+	}
+
+	size_t need = 0;
+	for (size_t pos = ofs; pos + NSMP_BUNDLE_SUB_HDR <= len;
+			 pos += NSMP_BUNDLE_SUB_HDR + frame[pos + 1]) {
+		memcpy(&ctl, &frame[pos], sizeof(ctl));
+		if (rcv_takes(ctl)) {
+			need += NSMP_QUEUE_REC_LEN(sizeof(nsmp_hdr_s) + frame[pos + 1]);
+		}
+	}
+	return need;
+}
+
+/* Check that need bytes of records fit in rcv_q, with the space a record may
+ * leave unused at the end of the buffer. What would not even fit in an empty
+ * queue is let through, to be dropped. */
+static int rcv_fits(size_t need) {
+	size_t const used = nsmp_queue_used(&rcv.q);
+
+	return !need || !used || ((used + (2 * need)) < rcv.q.size);
+}
+
+/* Messages that are passed to the application, the rest are handled here */
+static int rcv_takes(nsmp_ctrl_s ctl) {
+	return (ctl.type < NSMP_MSG_TYPE_CTL_ACK) ||
+				 ((ctl.type == NSMP_MSG_TYPE_CTL_STATS) &&
+					(ctl.reqres == NSMP_MSG_RESPONSE));
+}
+
+/* Wait for an event until waitms after t0, returns 0 if it was signalled */
+static int wait_ev(nsmp_ev_e ev, uint32_t t0, uint32_t waitms) {
+	const nsmp_cfg_s* const cfg = nsmp_cfg();
+	uint32_t								ms	= waitms;
+
+	if (!cfg->os.wait || !waitms) {
+		return -1;
+	}
+	if ((waitms != NSMP_WAIT_FOREVER) && cfg->get_time_ms) {
+		uint32_t const spent = cfg->get_time_ms() - t0;
+		if (spent >= waitms) {
+			return -1;
+		}
+		ms = waitms - spent;
+	}
+	return cfg->os.wait(cfg->os.ctx, ev, ms);
+}
@@ -0,0 +1,179 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Workers - a node's interfaces spread over threads, each running
+ * nsmp_worker_update() for its own.
+ *
+ * Everything an interface does stays in its worker's thread: the transport
+ * feeds nsmp_parse_if() and takes batches from tx_cb there, and frames are
+ * relayed straight to the other interfaces of the same worker. A frame for
+ * an interface of another worker is copied, as it was kept in rx_q, into that
+ * worker's relay_q, which holds one single-producer single-consumer queue per
+ * sending worker. No lock is taken, and the frames of a flow - which all
+ * arrive on one interface - leave in the order they came in. The receiving
+ * worker sends them on while it serves its interfaces, and wakes a sender
+ * that found its queue full once there is room again.
+ *
+ * Each record is [outgoing interface index][rx_q record]. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nsmp.h"
+#include "nsmp_private.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Largest relay_q record for a frame of up to p bytes of payload */
+#define REC_MAX(p) (NSMP_HDR_LEN + NSMP_FRAME_MAX(p) + 2)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static size_t worker_slice(const nsmp_worker_s* w);
+static int		worker_known(const nsmp_worker_s* w);
+static void		worker_wake(uint32_t stalled);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static nsmp_worker_s* workers[NSMP_MAX_WORKERS];
+static uint8_t				nworkers;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int nsmp_worker_add(nsmp_worker_s* w) {
+	if (!w || !w->relay_q || worker_known(w) ||
+			(nsmp_role() != NSMP_ROLE_NODE) || (nworkers >= NSMP_MAX_WORKERS) ||
+			nsmp_cfg()->arq_window) {
+		return NSMP_ERR_BAD_ARG;
+	}
+
+	size_t const slice = worker_slice(w);
+	for (uint8_t i = 0; i < NSMP_MAX_WORKERS; i++) {
+		if (nsmp_queue_init(&w->relq[i], &w->relay_q[i * slice], slice) != 0) {
+			return NSMP_ERR_BAD_ARG;
+		}
+	}
+
+	/* Frames from the interfaces other workers already serve must fit */
+	nsmp_iface_s* iface;
+	for (uint8_t idx = 0; (iface = nsmp_iface_at(idx)) != NULL; idx++) {
+		if (iface->worker && (NSMP_QUEUE_SIZE(1, REC_MAX(iface->mtu)) > slice)) {
+			return NSMP_ERR_BAD_ARG;
+		}
+	}
+
+	memset(&w->sched, 0, sizeof(w->sched));
+	w->stalled					= 0;
+	w->idx							= nworkers;
+	workers[nworkers++] = w;
+	return NSMP_OK;
+}
+
+int nsmp_worker_iface(nsmp_worker_s* w, nsmp_iface_s* iface) {
+	if (!worker_known(w) || !iface || (nsmp_iface_at(iface->idx) != iface)) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	for (uint8_t i = 0; i < nworkers; i++) {
+		if (NSMP_QUEUE_SIZE(1, REC_MAX(iface->mtu)) > worker_slice(workers[i])) {
+			return NSMP_ERR_BAD_ARG;
+		}
+	}
+
+	nsmp_sched_assign(iface, w);
+	return NSMP_OK;
+}
+
+int nsmp_worker_update(nsmp_worker_s* w) {
+	if (!worker_known(w)) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	return nsmp_update_sched(&w->sched, w);
+}
+
+void nsmp_worker_reset(void) {
+	memset(workers, 0, sizeof(workers));
+	nworkers = 0;
+}
+
+uint8_t nsmp_worker_count(void) {
+	return nworkers;
+}
+
+int nsmp_worker_relay(nsmp_iface_s* from, nsmp_iface_s* out,
+											const uint8_t* frame, size_t len) {
+	nsmp_worker_s* const src = from->worker;
+	nsmp_worker_s* const dst = out->worker;
+
+	if (!src || !dst || (src == dst)) {
+		return nsmp_tx_forward(out, frame, len);
+	}
+
+	nsmp_queue_s* const q		= &dst->relq[src->idx];
+	uint8_t*						rec = nsmp_queue_reserve(q, len + 1);
+	if (!rec) {
+		/* Marked before looking again, so room made in between is not missed */
+		__atomic_fetch_or(&dst->stalled, (uint32_t)1 << src->idx,
+											__ATOMIC_SEQ_CST);
+		rec = nsmp_queue_reserve(q, len + 1);
+		if (!rec) {
+			return 0;
+		}
+	}
+	rec[0] = out->idx;
+	memcpy(&rec[1], frame, len);
+	nsmp_queue_commit(q, len + 1);
+	nsmp_sched_ready(out);
+	return 1;
+}
+
+void nsmp_worker_drain(nsmp_worker_s* w) {
+	int freed = 0;
+
+	for (uint8_t i = 0; i < nworkers; i++) {
+		nsmp_queue_s* const q = &w->relq[i];
+		uint8_t*						rec;
+		size_t							len;
+
+		while ((rec = nsmp_queue_peek(q, &len)) != NULL) {
+			nsmp_iface_s* const out = nsmp_iface_at(rec[0]);
+			if (out && !nsmp_tx_forward(out, &rec[1], len - 1)) {
+				/* Holds up the rest from the same worker, keeping their order */
+				break;
+			}
+			nsmp_queue_release(q);
+			freed = 1;
+		}
+	}
+	if (freed) {
+		worker_wake(__atomic_exchange_n(&w->stalled, 0, __ATOMIC_SEQ_CST));
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Length of the queue relay_q holds for each sending worker */
+static size_t worker_slice(const nsmp_worker_s* w) {
+	return (w->relay_len / NSMP_MAX_WORKERS) &
+				 ~(size_t)(NSMP_QUEUE_ALIGN - 1);
+}
+
+static int worker_known(const nsmp_worker_s* w) {
+	return w && (w->idx < nworkers) && (workers[w->idx] == w);
+}
+
+/* Wake the workers whose interfaces wait for room in a relay_q, they find
+ * the frames that did not fit still at the head of rx_q */
+static void worker_wake(uint32_t stalled) {
+	for (uint8_t i = 0; stalled && (i < nworkers); i++) {
+		nsmp_worker_s* const v = workers[i];
+		if ((stalled & ((uint32_t)1 << i)) && v->os.signal) {
+			v->os.signal(v->os.ctx, NSMP_EV_READY);
+		}
+	}
+}
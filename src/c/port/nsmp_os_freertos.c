@@ -0,0 +1,68 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* nsmp_os_s binding for FreeRTOS, built with NSMP_OS_FREERTOS defined.
+ *
+ * A binary semaphore holds a signal until it is taken, which is the sticky
+ * behaviour nsmp_os_s asks for. nsmp_parse_if() and the tx_done path may run
+ * in interrupts, so signalling checks which context it is called from. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+
+#include "nsmp.h"
+#include "nsmp_os.h"
+
+#if defined(NSMP_OS_FREERTOS)
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int	freertos_wait(void* ctx, nsmp_ev_e ev, uint32_t ms);
+static void freertos_signal(void* ctx, nsmp_ev_e ev);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int nsmp_os_freertos(nsmp_os_s* os, nsmp_os_freertos_s* r) {
+	if (!os || !r) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	for (int i = 0; i < NSMP_EV_NB; i++) {
+		r->sem[i] = xSemaphoreCreateBinaryStatic(&r->buf[i]);
+	}
+	os->ctx		 = r;
+	os->wait	 = freertos_wait;
+	os->signal = freertos_signal;
+	return NSMP_OK;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int freertos_wait(void* ctx, nsmp_ev_e ev, uint32_t ms) {
+	nsmp_os_freertos_s* const r = ctx;
+	TickType_t const ticks = (ms == NSMP_WAIT_FOREVER) ? portMAX_DELAY
+																										 : pdMS_TO_TICKS(ms);
+
+	return (xSemaphoreTake(r->sem[ev], ticks) == pdTRUE) ? 0 : 1;
+}
+
+static void freertos_signal(void* ctx, nsmp_ev_e ev) {
+	nsmp_os_freertos_s* const r = ctx;
+
+	if (xPortIsInsideInterrupt()) {
+		BaseType_t woken = pdFALSE;
+		xSemaphoreGiveFromISR(r->sem[ev], &woken);
+		portYIELD_FROM_ISR(woken);
+	} else {
+		xSemaphoreGive(r->sem[ev]);
+	}
+}
+
+#endif
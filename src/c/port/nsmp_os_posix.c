@@ -0,0 +1,259 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* nsmp_os_s bindings for POSIX threads, and for Linux futexes and eventfds.
+ *
+ * Every binding keeps a signal until it is waited for, so a signal that
+ * comes between the caller finding nothing to do and starting to wait is not
+ * lost. The futex binding only makes a system call to wake a thread that is
+ * actually waiting. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "nsmp.h"
+#include "nsmp_os.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#if defined(__APPLE__)
+#define COND_CLOCK (CLOCK_REALTIME) /* No pthread_condattr_setclock() */
+#else
+#define COND_CLOCK (CLOCK_MONOTONIC)
+#endif
+
+/* nsmp_os_futex_s::word */
+#define FUTEX_IDLE	 (0)
+#define FUTEX_SET		 (1)
+#define FUTEX_WAITER (2)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int	pthread_wait(void* ctx, nsmp_ev_e ev, uint32_t ms);
+static void pthread_signal(void* ctx, nsmp_ev_e ev);
+static void deadline(struct timespec* ts, clockid_t clk, uint32_t ms);
+#if defined(__linux__)
+static int	futex_wait(void* ctx, nsmp_ev_e ev, uint32_t ms);
+static void futex_signal(void* ctx, nsmp_ev_e ev);
+static int	left(const struct timespec* end, struct timespec* rel);
+static int	eventfd_wait(void* ctx, nsmp_ev_e ev, uint32_t ms);
+static void eventfd_signal(void* ctx, nsmp_ev_e ev);
+#endif
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int nsmp_os_pthread(nsmp_os_s* os, nsmp_os_pthread_s* p) {
+	pthread_condattr_t attr;
+
+	if (!os || !p) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	memset(p, 0, sizeof(*p));
+	if (pthread_mutex_init(&p->lock, NULL) != 0) {
+		return NSMP_ERR_NO_MEM;
+	}
+	pthread_condattr_init(&attr);
+#if !defined(__APPLE__)
+	pthread_condattr_setclock(&attr, COND_CLOCK);
+#endif
+	int const status = pthread_cond_init(&p->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	if (status != 0) {
+		pthread_mutex_destroy(&p->lock);
+		return NSMP_ERR_NO_MEM;
+	}
+
+	os->ctx		 = p;
+	os->wait	 = pthread_wait;
+	os->signal = pthread_signal;
+	return NSMP_OK;
+}
+
+#if defined(__linux__)
+int nsmp_os_futex(nsmp_os_s* os, nsmp_os_futex_s* f) {
+	if (!os || !f) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	memset(f, 0, sizeof(*f));
+	os->ctx		 = f;
+	os->wait	 = futex_wait;
+	os->signal = futex_signal;
+	return NSMP_OK;
+}
+
+int nsmp_os_eventfd(nsmp_os_s* os, nsmp_os_eventfd_s* e) {
+	if (!os || !e) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	for (int i = 0; i < NSMP_EV_NB; i++) {
+		e->fd[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (e->fd[i] < 0) {
+			while (i--) {
+				close(e->fd[i]);
+			}
+			return NSMP_ERR_NO_MEM;
+		}
+	}
+	os->ctx		 = e;
+	os->wait	 = eventfd_wait;
+	os->signal = eventfd_signal;
+	return NSMP_OK;
+}
+
+void nsmp_os_eventfd_close(nsmp_os_eventfd_s* e) {
+	for (int i = 0; i < NSMP_EV_NB; i++) {
+		if (e->fd[i] >= 0) {
+			close(e->fd[i]);
+			e->fd[i] = -1;
+		}
+	}
+}
+#endif
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int pthread_wait(void* ctx, nsmp_ev_e ev, uint32_t ms) {
+	nsmp_os_pthread_s* const p = ctx;
+	struct timespec					 end;
+	int											 status = 0;
+
+	deadline(&end, COND_CLOCK, ms);
+	pthread_mutex_lock(&p->lock);
+	while (!p->set[ev] && (status != ETIMEDOUT)) {
+		status = (ms == NSMP_WAIT_FOREVER)
+								 ? pthread_cond_wait(&p->cond, &p->lock)
+								 : pthread_cond_timedwait(&p->cond, &p->lock, &end);
+	}
+	int const set = p->set[ev];
+	p->set[ev]		= 0;
+	pthread_mutex_unlock(&p->lock);
+	return !set;
+}
+
+static void pthread_signal(void* ctx, nsmp_ev_e ev) {
+	nsmp_os_pthread_s* const p = ctx;
+
+	pthread_mutex_lock(&p->lock);
+	p->set[ev] = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/* Absolute time ms from now on clock clk */
+static void deadline(struct timespec* ts, clockid_t clk, uint32_t ms) {
+	clock_gettime(clk, ts);
+	if (ms == NSMP_WAIT_FOREVER) {
+		return;
+	}
+	ts->tv_sec += (time_t)(ms / 1000);
+	ts->tv_nsec += (long)(ms % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+#if defined(__linux__)
+static int futex_wait(void* ctx, nsmp_ev_e ev, uint32_t ms) {
+	nsmp_os_futex_s* const f = ctx;
+	uint32_t* const				 w = &f->word[ev];
+	struct timespec				 end;
+	struct timespec				 rel;
+
+	deadline(&end, CLOCK_MONOTONIC, ms);
+	for (;;) {
+		uint32_t v = __atomic_load_n(w, __ATOMIC_ACQUIRE);
+		if (v == FUTEX_SET) {
+			if (__atomic_compare_exchange_n(w, &v, FUTEX_IDLE, 0, __ATOMIC_ACQUIRE,
+																			__ATOMIC_RELAXED)) {
+				return 0;
+			}
+			continue;
+		}
+		if ((v == FUTEX_IDLE) &&
+				!__atomic_compare_exchange_n(w, &v, FUTEX_WAITER, 0, __ATOMIC_ACQ_REL,
+																		 __ATOMIC_RELAXED)) {
+			continue;
+		}
+		if ((ms != NSMP_WAIT_FOREVER) && !left(&end, &rel)) {
+			return 1;
+		}
+		syscall(SYS_futex, w, FUTEX_WAIT_PRIVATE, FUTEX_WAITER,
+						(ms == NSMP_WAIT_FOREVER) ? NULL : &rel, NULL, 0);
+	}
+}
+
+static void futex_signal(void* ctx, nsmp_ev_e ev) {
+	nsmp_os_futex_s* const f = ctx;
+	uint32_t* const				 w = &f->word[ev];
+
+	if (__atomic_exchange_n(w, FUTEX_SET, __ATOMIC_RELEASE) == FUTEX_WAITER) {
+		syscall(SYS_futex, w, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	}
+}
+
+/* Time from now until end, returns 0 once it has passed */
+static int left(const struct timespec* end, struct timespec* rel) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	rel->tv_sec	 = end->tv_sec - now.tv_sec;
+	rel->tv_nsec = end->tv_nsec - now.tv_nsec;
+	if (rel->tv_nsec < 0) {
+		rel->tv_sec--;
+		rel->tv_nsec += 1000000000L;
+	}
+	return (rel->tv_sec > 0) || ((rel->tv_sec == 0) && (rel->tv_nsec > 0));
+}
+
+static int eventfd_wait(void* ctx, nsmp_ev_e ev, uint32_t ms) {
+	nsmp_os_eventfd_s* const e		= ctx;
+	struct pollfd						 pfd	= {.fd = e->fd[ev], .events = POLLIN};
+	struct timespec					 end;
+	struct timespec					 rel;
+	uint64_t								 count;
+
+	deadline(&end, CLOCK_MONOTONIC, ms);
+	for (;;) {
+		if (read(e->fd[ev], &count, sizeof(count)) == (ssize_t)sizeof(count)) {
+			return 0;
+		}
+		int timeout = -1;
+		if (ms != NSMP_WAIT_FOREVER) {
+			if (!left(&end, &rel)) {
+				return 1;
+			}
+			timeout = (int)((rel.tv_sec * 1000) + ((rel.tv_nsec + 999999) / 1000000));
+		}
+		if ((poll(&pfd, 1, timeout) < 0) && (errno != EINTR)) {
+			return 1;
+		}
+	}
+}
+
+static void eventfd_signal(void* ctx, nsmp_ev_e ev) {
+	nsmp_os_eventfd_s* const e	 = ctx;
+	uint64_t const					 one = 1;
+
+	/* Only fails when the counter is saturated, which is signalled anyway */
+	(void)!write(e->fd[ev], &one, sizeof(one));
+}
+#endif
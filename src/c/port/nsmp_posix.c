@@ -0,0 +1,436 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Linux transport backend - serial ports, pseudo-terminals and UNIX-domain
+ * sockets driven by one epoll loop.
+ *
+ * Descriptors are non-blocking. A readable one is read in large chunks
+ * straight into nsmp_parse_if(). Links are asynchronous transports
+ * (nsmp_iface_s::tx_async): tx_cb takes the chunks of each batch of frames,
+ * as many as it has room for, and writes what the descriptor accepts - every
+ * chunk still pending going out with one writev(). The rest is written once
+ * epoll reports the descriptor writable, and a batch is handed back with
+ * nsmp_tx_done() after nsmp_update() returns, as nsmp_tx_done() must not be
+ * called from tx_cb. A link that cannot be written to for a while so does
+ * not keep the loop spinning. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define _GNU_SOURCE
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/serial.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "nsmp.h"
+#include "nsmp_posix.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef struct {
+	uint32_t baud;
+	speed_t	 speed;
+} posix_baud_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int	link_add(nsmp_posix_s* px, nsmp_posix_link_s* link, int fd);
+static void link_down(nsmp_posix_s* px, nsmp_posix_link_s* link);
+static void link_read(nsmp_posix_s* px, nsmp_posix_link_s* link);
+static void link_flush(nsmp_posix_s* px, nsmp_posix_link_s* link);
+static void link_watch(nsmp_posix_s* px, nsmp_posix_link_s* link, int out);
+static int	posix_open(nsmp_posix_s* px, nsmp_os_s* os);
+static int	posix_raw(int fd, uint32_t baud);
+static int	posix_tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov,
+												size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static const posix_baud_s bauds[] = {
+		{9600, B9600},			 {19200, B19200},			{38400, B38400},
+		{57600, B57600},		 {115200, B115200},		{230400, B230400},
+		{460800, B460800},	 {500000, B500000},		{576000, B576000},
+		{921600, B921600},	 {1000000, B1000000}, {1500000, B1500000},
+		{2000000, B2000000}, {3000000, B3000000}, {4000000, B4000000},
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int nsmp_posix_init(nsmp_posix_s* px, nsmp_cfg_s* cfg) {
+	if (!px || !cfg) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	return posix_open(px, &cfg->os);
+}
+
+int nsmp_posix_worker(nsmp_posix_s* px, nsmp_worker_s* w) {
+	if (!px || !w) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	int const rc = posix_open(px, &w->os);
+	if (rc == NSMP_OK) {
+		px->worker = w;
+	}
+	return rc;
+}
+
+void nsmp_posix_close(nsmp_posix_s* px) {
+	while (px->links) {
+		nsmp_posix_link_close(px, px->links);
+	}
+	nsmp_os_eventfd_close(&px->ev);
+	close(px->epfd);
+	px->epfd = -1;
+}
+
+int nsmp_posix_serial(nsmp_posix_s* px, nsmp_posix_link_s* link,
+											const char* path, uint32_t baud) {
+	if (!px || !link || !path) {
+		return NSMP_ERR_BAD_ARG;
+	}
+
+	int const fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		return NSMP_ERR_IO;
+	}
+	int const status = posix_raw(fd, baud);
+	if (status != NSMP_OK) {
+		close(fd);
+		return status;
+	}
+
+	/* Hand received bytes over at once rather than on the driver's timer */
+	struct serial_struct ser;
+	if (ioctl(fd, TIOCGSERIAL, &ser) == 0) {
+		ser.flags |= ASYNC_LOW_LATENCY;
+		ioctl(fd, TIOCSSERIAL, &ser);
+	}
+	return link_add(px, link, fd);
+}
+
+int nsmp_posix_pty(nsmp_posix_s* px, nsmp_posix_link_s* link, char* name,
+									 size_t len) {
+	if (!px || !link || !name || !len) {
+		return NSMP_ERR_BAD_ARG;
+	}
+
+	int const fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		return NSMP_ERR_IO;
+	}
+	if (grantpt(fd) || unlockpt(fd) || ptsname_r(fd, name, len)) {
+		close(fd);
+		return NSMP_ERR_IO;
+	}
+
+	/* The master reports a hangup whenever no one has the slave open, so it
+	 * is kept open here. Raw mode is set on the slave, for whoever opens it. */
+	int const hold = open(name, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if ((hold < 0) || (posix_raw(hold, 0) != NSMP_OK)) {
+		if (hold >= 0) {
+			close(hold);
+		}
+		close(fd);
+		return NSMP_ERR_IO;
+	}
+
+	int const status = link_add(px, link, fd);
+	link->hold			 = hold;
+	if (status != NSMP_OK) {
+		close(hold);
+		link->hold = -1;
+	}
+	return status;
+}
+
+int nsmp_posix_unix(nsmp_posix_s* px, nsmp_posix_link_s* link,
+										const char* path) {
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+	if (!px || !link || !path || (strlen(path) >= sizeof(addr.sun_path))) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	strcpy(addr.sun_path, path);
+
+	int const fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return NSMP_ERR_IO;
+	}
+	if (connect(fd, (const struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return NSMP_ERR_IO;
+	}
+	return link_add(px, link, fd);
+}
+
+int nsmp_posix_fd(nsmp_posix_s* px, nsmp_posix_link_s* link, int fd) {
+	if (!px || !link || (fd < 0)) {
+		return NSMP_ERR_BAD_ARG;
+	}
+	return link_add(px, link, fd);
+}
+
+void nsmp_posix_link_close(nsmp_posix_s* px, nsmp_posix_link_s* link) {
+	for (nsmp_posix_link_s** l = &px->links; *l; l = &(*l)->next) {
+		if (*l == link) {
+			*l = link->next;
+			break;
+		}
+	}
+	if (link->fd >= 0) {
+		epoll_ctl(px->epfd, EPOLL_CTL_DEL, link->fd, NULL);
+		close(link->fd);
+	}
+	if (link->hold >= 0) {
+		close(link->hold);
+	}
+	link->fd	 = -1;
+	link->hold = -1;
+	link->next = NULL;
+	link->down = 1;
+}
+
+int nsmp_posix_poll(nsmp_posix_s* px, int timeout_ms) {
+	struct epoll_event ev[NSMP_POSIX_EVENTS];
+
+	int const n = epoll_wait(px->epfd, ev, NSMP_POSIX_EVENTS,
+													 px->work ? 0 : timeout_ms);
+	if ((n < 0) && (errno != EINTR)) {
+		return NSMP_ERR_IO;
+	}
+
+	for (int i = 0; i < n; i++) {
+		nsmp_posix_link_s* const link = ev[i].data.ptr;
+		if (!link) {
+			uint64_t count;
+			(void)!read(px->ev.fd[NSMP_EV_READY], &count, sizeof(count));
+			continue;
+		}
+		if (ev[i].events & EPOLLIN) {
+			link_read(px, link);
+		}
+		if ((ev[i].events & EPOLLOUT) && !link->down) {
+			link_flush(px, link);
+		}
+		if ((ev[i].events & (EPOLLHUP | EPOLLERR)) && !(ev[i].events & EPOLLIN)) {
+			link_down(px, link);
+		}
+	}
+
+	int const rc = px->worker ? nsmp_worker_update(px->worker) : nsmp_update();
+	px->work		 = (rc > 0);
+
+	/* Written batches go back to their interfaces, which are readied again */
+	for (nsmp_posix_link_s* link = px->links; link; link = link->next) {
+		for (; link->done; link->done--) {
+			nsmp_tx_done(&link->iface);
+		}
+	}
+	return NSMP_OK;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int link_add(nsmp_posix_s* px, nsmp_posix_link_s* link, int fd) {
+	int const flags = fcntl(fd, F_GETFL);
+	if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)) {
+		close(fd);
+		return NSMP_ERR_IO;
+	}
+
+	link->px						= px;
+	link->fd						= fd;
+	link->hold					= -1;
+	link->npend					= 0;
+	link->done					= 0;
+	link->out						= 0;
+	link->down					= 0;
+	link->iface.tx_cb		= posix_tx_cb;
+	link->iface.tx_async = 1;
+
+	struct epoll_event ev = {.events = EPOLLIN, .data.ptr = link};
+	if (epoll_ctl(px->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+		close(fd);
+		link->fd = -1;
+		return NSMP_ERR_IO;
+	}
+	link->next = px->links;
+	px->links	 = link;
+	return NSMP_OK;
+}
+
+/* Stop driving a link that failed, the batches it held are dropped */
+static void link_down(nsmp_posix_s* px, nsmp_posix_link_s* link) {
+	if (link->down) {
+		return;
+	}
+	epoll_ctl(px->epfd, EPOLL_CTL_DEL, link->fd, NULL);
+	link->down = 1;
+	for (uint8_t k = 0; k < link->npend; k++) {
+		link->done += link->ends[k];
+	}
+	link->npend = 0;
+}
+
+static void link_read(nsmp_posix_s* px, nsmp_posix_link_s* link) {
+	size_t const max = (link->read_len && (link->read_len < sizeof(px->rx)))
+												 ? link->read_len
+												 : sizeof(px->rx);
+
+	/* A short read has emptied the descriptor, a full one may not have */
+	for (;;) {
+		ssize_t const n = read(link->fd, px->rx, max);
+		if (n > 0) {
+			nsmp_parse_if(&link->iface, px->rx, (size_t)n);
+			if ((size_t)n < max) {
+				return;
+			}
+		} else if ((n < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+			return;
+		} else {
+			/* End of file, or EIO from a pseudo-terminal whose slave closed */
+			link_down(px, link);
+			return;
+		}
+	}
+}
+
+/* Write as much of the pending batches as the descriptor takes */
+static void link_flush(nsmp_posix_s* px, nsmp_posix_link_s* link) {
+	while (link->npend) {
+		struct iovec v[NSMP_POSIX_IOV];
+		for (uint8_t i = 0; i < link->npend; i++) {
+			v[i].iov_base = (void*)link->pend[i].base;
+			v[i].iov_len	= link->pend[i].len;
+		}
+
+		ssize_t n = writev(link->fd, v, link->npend);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN) {
+				link_watch(px, link, 1);
+			} else {
+				link_down(px, link);
+			}
+			return;
+		}
+
+		uint8_t k = 0;
+		for (; (k < link->npend) && ((size_t)n >= link->pend[k].len); k++) {
+			n -= (ssize_t)link->pend[k].len;
+			link->done += link->ends[k];
+		}
+		link->npend = (uint8_t)(link->npend - k);
+		memmove(link->pend, &link->pend[k], link->npend * sizeof(link->pend[0]));
+		memmove(link->ends, &link->ends[k], link->npend);
+		if (link->npend) {
+			link->pend[0].base += n;
+			link->pend[0].len -= (size_t)n;
+		}
+	}
+	link_watch(px, link, 0);
+}
+
+/* Ask epoll to report when the descriptor becomes writable, or stop */
+static void link_watch(nsmp_posix_s* px, nsmp_posix_link_s* link, int out) {
+	if (link->out == out) {
+		return;
+	}
+
+	struct epoll_event ev = {.events = EPOLLIN | (out ? EPOLLOUT : 0),
+													 .data.ptr = link};
+	epoll_ctl(px->epfd, EPOLL_CTL_MOD, link->fd, &ev);
+	link->out = (uint8_t)out;
+}
+
+/* Raw 8N1, no flow control, reads that never wait */
+static int posix_open(nsmp_posix_s* px, nsmp_os_s* os) {
+	memset(px, 0, sizeof(*px));
+	px->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (px->epfd < 0) {
+		return NSMP_ERR_IO;
+	}
+	if (nsmp_os_eventfd(os, &px->ev) != NSMP_OK) {
+		close(px->epfd);
+		return NSMP_ERR_IO;
+	}
+
+	/* The wakeup is told apart from the links by its NULL pointer */
+	struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+	if (epoll_ctl(px->epfd, EPOLL_CTL_ADD, px->ev.fd[NSMP_EV_READY], &ev) != 0) {
+		nsmp_os_eventfd_close(&px->ev);
+		close(px->epfd);
+		return NSMP_ERR_IO;
+	}
+	return NSMP_OK;
+}
+
+static int posix_raw(int fd, uint32_t baud) {
+	struct termios tio;
+
+	if (tcgetattr(fd, &tio) != 0) {
+		return NSMP_ERR_IO;
+	}
+	cfmakeraw(&tio);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cflag &= ~(tcflag_t)CRTSCTS;
+	tio.c_cc[VMIN]	= 0;
+	tio.c_cc[VTIME] = 0;
+
+	if (baud) {
+		size_t i = 0;
+		while ((i < sizeof(bauds) / sizeof(bauds[0])) && (bauds[i].baud != baud)) {
+			i++;
+		}
+		if (i == sizeof(bauds) / sizeof(bauds[0])) {
+			return NSMP_ERR_BAD_ARG;
+		}
+		cfsetispeed(&tio, bauds[i].speed);
+		cfsetospeed(&tio, bauds[i].speed);
+	}
+	return (tcsetattr(fd, TCSANOW, &tio) == 0) ? NSMP_OK : NSMP_ERR_IO;
+}
+
+static int posix_tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov,
+											 size_t iovcnt) {
+	nsmp_posix_link_s* const link = (nsmp_posix_link_s*)iface;
+
+	if (link->down || !iovcnt) {
+		/* Dropped, but the half of tx_buf it was in must still be handed back */
+		link->done++;
+		return -1;
+	}
+
+	/* Chunks that do not fit are offered again, and the batch is handed back
+	 * once its last chunk has been written */
+	size_t taken = 0;
+	for (size_t k = 0; (k < iovcnt) && (link->npend < NSMP_POSIX_IOV); k++) {
+		link->pend[link->npend] = iov[k];
+		link->ends[link->npend] = (k == iovcnt - 1);
+		link->npend++;
+		taken += iov[k].len;
+	}
+	if (taken && !link->out) {
+		link_flush(link->px, link);
+	}
+	return (int)taken;
+}
+
+#endif
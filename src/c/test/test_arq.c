@@ -0,0 +1,423 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			 (256)
+#define DEPTH		 (48)
+#define WIRE_LEN (32 * 1024)
+#define RTO_MS	 (50)
+#define ACK_MS	 (10)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Decides what happens to a decoded frame on the wire, returns the number of
+ * copies to pass on */
+typedef int (*filter_f)(const uint8_t* frame, size_t len);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void setup(uint8_t window, uint16_t bundle_len, uint16_t ack_ms);
+static void test_inorder(void);
+static void test_loss(void);
+static void test_duplicate(void);
+static void test_window(void);
+static void test_bundle(void);
+static void test_ack_delay(void);
+static void settle(void);
+static void send_seq(uint8_t seq);
+static int	seq_of(const uint8_t* frame, size_t len, int* retry);
+static int	lose_some(const uint8_t* frame, size_t len);
+static int	lose_last(const uint8_t* frame, size_t len);
+static int	lose_acks(const uint8_t* frame, size_t len);
+static int	twice(const uint8_t* frame, size_t len);
+static int	rx_cb(nsmp_msg_s* msg);
+static int	tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t rx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t tx_buf[NSMP_TX_BUF_LEN(MTU)];
+
+static nsmp_iface_s iface;
+
+/* Encoded bytes that made it through the filter, waiting to be parsed */
+static uint8_t	wire[WIRE_LEN];
+static size_t		wire_len;
+static uint32_t wire_batches;
+
+static filter_f filter;
+
+/* Sequenced frames seen by tx_cb, before filtering */
+static uint32_t seq_frames;
+static uint32_t seq_retries;
+static uint32_t acks_lost;
+
+/* Acknowledgements seen by tx_cb, on their own and carried by messages */
+static uint32_t ack_frames;
+static uint32_t ack_carried;
+
+/* Messages seen by rx_cb */
+static uint32_t rx_count;
+static int			rx_bad;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_inorder();
+	test_loss();
+	test_duplicate();
+	test_window();
+	test_bundle();
+	test_ack_delay();
+	printf("test_arq: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void setup(uint8_t window, uint16_t bundle_len, uint16_t ack_ms) {
+	nsmp_cfg_s const cfg = {
+			.get_time_ms = clock_ms,
+			.arq_window	 = window,
+			.arq_rto_ms	 = RTO_MS,
+			.arq_ack_ms	 = ack_ms,
+	};
+
+	memset(&iface, 0, sizeof(iface));
+	iface.tx_q			 = tx_q;
+	iface.tx_len		 = sizeof(tx_q);
+	iface.rx_q			 = rx_q;
+	iface.rx_len		 = sizeof(rx_q);
+	iface.tx_buf		 = tx_buf;
+	iface.tx_buf_len = sizeof(tx_buf);
+	iface.mtu				 = MTU;
+	iface.rx_cb			 = rx_cb;
+	iface.tx_cb			 = tx_cb;
+	iface.bundle_len = bundle_len;
+
+	CHECK(nsmp_peer_init() == NSMP_OK);
+	CHECK(nsmp_peer_newif(&iface) == NSMP_OK);
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+
+	filter			= NULL;
+	wire_len		= 0;
+	seq_frames	= 0;
+	seq_retries = 0;
+	acks_lost		= 0;
+	ack_frames	= 0;
+	ack_carried = 0;
+	rx_count		= 0;
+	rx_bad			= 0;
+
+	/* Both ends of the loopback agree on reliable delivery */
+	loopback(&iface, wire, &wire_len, 2);
+	CHECK(iface.peer_caps & NSMP_CAP_ARQ);
+	CHECK(seq_frames == 0);
+}
+
+/* Without losses every message is sent once and acknowledged */
+static void test_inorder(void) {
+	setup(8, 0, 0);
+	for (unsigned i = 0; i < 600; i++) {
+		send_seq((uint8_t)i);
+		if ((i % 5) == 4) {
+			loopback(&iface, wire, &wire_len, 1);
+		}
+	}
+	settle();
+	CHECK(rx_count == 600);
+	CHECK(!rx_bad);
+	CHECK(seq_frames == 600);
+	CHECK(seq_retries == 0);
+	CHECK(nsmp_queue_used(&iface.txq) == 0);
+	CHECK(nsmp_queue_used(&iface.rxq) == 0);
+}
+
+/* Missing messages are asked for again, or resent after the timeout */
+static void test_loss(void) {
+	setup(16, 0, 0);
+	filter = lose_some;
+	for (unsigned i = 0; i < 590; i++) {
+		send_seq((uint8_t)i);
+		if ((i % 10) == 9) {
+			loopback(&iface, wire, &wire_len, 1);
+		}
+	}
+	settle();
+
+	/* A retry request recovers losses without waiting for the timeout, as long
+	 * as a later message shows the gap */
+	CHECK(rx_count == 590);
+	CHECK(!rx_bad);
+	CHECK(seq_retries > 0);
+	CHECK(nsmp_queue_used(&iface.txq) == 0);
+
+	/* Nothing follows the last message, only the timeout notices its loss */
+	filter = lose_last;
+	send_seq(590 & 0xFF);
+	settle();
+	CHECK(rx_count == 590);
+	now_ms += RTO_MS;
+	settle();
+	CHECK(rx_count == 591);
+
+	/* Lost acknowledgements make the sender repeat messages already delivered */
+	filter = lose_acks;
+	send_seq(591 & 0xFF);
+	send_seq(592 & 0xFF);
+	settle();
+	CHECK(rx_count == 593);
+	CHECK(acks_lost > 0);
+	filter = NULL;
+	now_ms += RTO_MS;
+	settle();
+	CHECK(rx_count == 593);
+	CHECK(!rx_bad);
+	CHECK(nsmp_queue_used(&iface.txq) == 0);
+}
+
+/* Every frame arrives twice, messages are delivered once */
+static void test_duplicate(void) {
+	setup(8, 0, 0);
+	filter = twice;
+	for (unsigned i = 0; i < 300; i++) {
+		send_seq((uint8_t)i);
+		if ((i % 3) == 2) {
+			loopback(&iface, wire, &wire_len, 1);
+		}
+	}
+	settle();
+	CHECK(rx_count == 300);
+	CHECK(!rx_bad);
+	CHECK(nsmp_queue_used(&iface.txq) == 0);
+}
+
+/* No more than a window of messages is sent before an acknowledgement */
+static void test_window(void) {
+	setup(4, 0, 0);
+	for (unsigned i = 0; i < 10; i++) {
+		send_seq((uint8_t)i);
+	}
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(seq_frames == 4);
+
+	settle();
+	CHECK(rx_count == 10);
+	CHECK(seq_frames == 10);
+	CHECK(!rx_bad);
+}
+
+/* A lost bundle is repeated as a whole */
+static void test_bundle(void) {
+	setup(8, MTU, 0);
+	CHECK(iface.peer_caps & NSMP_CAP_BUNDLE);
+	filter = lose_some;
+	for (unsigned i = 0; i < 400; i++) {
+		send_seq((uint8_t)i);
+		if ((i % 40) == 39) {
+			loopback(&iface, wire, &wire_len, 1);
+		}
+	}
+	settle();
+	CHECK(rx_count == 400);
+	CHECK(!rx_bad);
+	CHECK(seq_frames < 400);
+	CHECK(nsmp_queue_used(&iface.txq) == 0);
+}
+
+/* Acknowledgements wait for a message going back, or for arq_ack_ms */
+static void test_ack_delay(void) {
+	setup(8, 0, ACK_MS);
+	CHECK(iface.peer_caps & NSMP_CAP_ACK);
+
+	/* One message at a time, each carrying the acknowledgement of the last */
+	for (unsigned i = 0; i < 100; i++) {
+		send_seq((uint8_t)i);
+		loopback(&iface, wire, &wire_len, 1);
+	}
+	settle();
+	CHECK(rx_count == 100);
+	CHECK(!rx_bad);
+	CHECK(ack_frames == 0);
+	CHECK(ack_carried == 99);
+	CHECK(nsmp_queue_used(&iface.txq) != 0);
+
+	/* Nothing goes back after the last one, it is acknowledged once due */
+	now_ms += ACK_MS;
+	settle();
+	CHECK(ack_frames == 1);
+	CHECK(nsmp_queue_used(&iface.txq) == 0);
+
+	/* Half a window is acknowledged at once, less waits to be covered by one
+	 * acknowledgement */
+	for (unsigned i = 100; i < 104; i++) {
+		send_seq((uint8_t)i);
+	}
+	settle();
+	CHECK(ack_frames == 2);
+	CHECK(nsmp_queue_used(&iface.txq) == 0);
+	for (unsigned i = 104; i < 107; i++) {
+		send_seq((uint8_t)i);
+	}
+	settle();
+	CHECK(rx_count == 107);
+	CHECK(ack_frames == 2);
+	now_ms += ACK_MS;
+	settle();
+	CHECK(ack_frames == 3);
+	CHECK(nsmp_queue_used(&iface.txq) == 0);
+
+	/* A lost message loses the acknowledgement it carried, the timeout
+	 * recovers both */
+	filter = lose_some;
+	for (unsigned i = 107; i < 400; i++) {
+		send_seq((uint8_t)i);
+		loopback(&iface, wire, &wire_len, 1);
+		now_ms++;
+	}
+	settle();
+	now_ms += RTO_MS;
+	settle();
+	now_ms += ACK_MS;
+	settle();
+	CHECK(rx_count == 400);
+	CHECK(!rx_bad);
+	CHECK(seq_retries > 0);
+	CHECK(ack_carried > 99);
+	CHECK(nsmp_queue_used(&iface.txq) == 0);
+}
+
+/* Pump until nothing more is sent */
+static void settle(void) {
+	for (unsigned r = 0; r < 1000; r++) {
+		uint32_t const before = wire_batches;
+		loopback(&iface, wire, &wire_len, 1);
+		if ((wire_batches == before) && !wire_len) {
+			return;
+		}
+	}
+	CHECK(0);
+}
+
+/* Send a message of 1 to 12 bytes that rx_cb can check on its own */
+static void send_seq(uint8_t seq) {
+	uint8_t		 payload[16];
+	nsmp_msg_s msg = {.hdr.dst = 0};
+	size_t const len = 1 + (seq % 12);
+
+	for (size_t i = 0; i < len; i++) {
+		payload[i] = (uint8_t)(seq + i);
+	}
+	nsmp_add_data(&msg, payload, len);
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+}
+
+/* Sequence number of a decoded frame, -1 if it is not sequenced */
+static int seq_of(const uint8_t* frame, size_t len, int* retry) {
+	nsmp_ctrl_s ctl;
+
+	memcpy(&ctl, frame, sizeof(ctl));
+	if ((len <= NSMP_HDR_LEN) || ((ctl.type != NSMP_MSG_TYPE_CTL_SEQ) &&
+																(ctl.type != NSMP_MSG_TYPE_CTL_SEQ_ACK))) {
+		return -1;
+	}
+	*retry = ctl.retry;
+	return frame[NSMP_HDR_LEN];
+}
+
+/* Drop the first transmission of a few messages in every window */
+static int lose_some(const uint8_t* frame, size_t len) {
+	int			retry;
+	int const seq = seq_of(frame, len, &retry);
+
+	return ((seq < 0) || retry || ((seq % 7) != 3)) ? 1 : 0;
+}
+
+static int lose_last(const uint8_t* frame, size_t len) {
+	int retry;
+
+	return ((seq_of(frame, len, &retry) < 0) || retry) ? 1 : 0;
+}
+
+static int lose_acks(const uint8_t* frame, size_t len) {
+	nsmp_ctrl_s ctl;
+
+	(void)len;
+	memcpy(&ctl, frame, sizeof(ctl));
+	if (ctl.type == NSMP_MSG_TYPE_CTL_ACK) {
+		acks_lost++;
+		return 0;
+	}
+	return 1;
+}
+
+static int twice(const uint8_t* frame, size_t len) {
+	(void)frame;
+	(void)len;
+	return 2;
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	uint8_t const seq = (uint8_t)rx_count;
+
+	if (msg->len != 1 + (seq % 12)) {
+		rx_bad = 1;
+	}
+	for (size_t i = 0; (i < msg->len) && !rx_bad; i++) {
+		rx_bad = (msg->data[i] != (uint8_t)(seq + i));
+	}
+	rx_count++;
+	return NSMP_OK;
+}
+
+/* Split each batch into frames and pass them through the filter */
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	static uint8_t enc[WIRE_LEN];
+	size_t				 enc_len = 0;
+	uint8_t				 dec[NSMP_FRAME_MAX(MTU)];
+	size_t				 dec_len;
+	size_t				 end = 0;
+
+	(void)i;
+	wire_batches++;
+	wire_put(enc, &enc_len, sizeof(enc), iov, iovcnt);
+	for (size_t start = 0;
+			 (dec_len = wire_frame(enc, enc_len, &end, dec, sizeof(dec))) != 0;
+			 start = end) {
+		size_t const n = end - start;
+		int					 retry;
+
+		if (seq_of(dec, dec_len, &retry) >= 0) {
+			seq_frames++;
+			seq_retries += (unsigned)retry;
+		}
+		nsmp_ctrl_s ctl;
+		memcpy(&ctl, dec, sizeof(ctl));
+		ack_frames += (ctl.type == NSMP_MSG_TYPE_CTL_ACK);
+		ack_carried += (ctl.type == NSMP_MSG_TYPE_CTL_SEQ_ACK);
+
+		for (int copies = filter ? filter(dec, dec_len) : 1; copies; copies--) {
+			CHECK(wire_len + n <= sizeof(wire));
+			memcpy(&wire[wire_len], &enc[start], n);
+			wire_len += n;
+		}
+	}
+	CHECK(end == enc_len);
+	return (int)enc_len;
+}
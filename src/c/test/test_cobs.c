@@ -0,0 +1,298 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* The zero-scanning kernels of cobs.c against its byte-at-a-time loop: the
+ * library's own build (SIMD where the target has it) and cobs.c built again
+ * here with SWAR and with COBS_SCAN_BYTEWISE, the reference. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "cobs.h"
+#include "test_util.h"
+
+/* Byte-at-a-time reference, as ref_* */
+#define COBS_SCAN_BYTEWISE
+#define cobs_scan							ref_scan
+#define cobs_encode_inplace		ref_encode_inplace
+#define cobs_decode_inplace		ref_decode_inplace
+#define cobs_encode						ref_encode
+#define cobs_encode_inc_begin	ref_encode_inc_begin
+#define cobs_encode_inc				ref_encode_inc
+#define cobs_encode_inc_end		ref_encode_inc_end
+#define cobs_decode						ref_decode
+/* cobs.h declared the library's, which cobs.c calls before defining */
+cobs_ret_t ref_encode_inc_begin(void* out_enc, unsigned enc_max,
+																cobs_enc_ctx_t* out_ctx);
+cobs_ret_t ref_encode_inc(cobs_enc_ctx_t* ctx, void const* dec,
+													unsigned dec_len);
+cobs_ret_t ref_encode_inc_end(cobs_enc_ctx_t* ctx, unsigned* out_enc_len);
+#include "../cobs.c"
+#undef COBS_SCAN_BYTEWISE
+#undef cobs_scan
+#undef cobs_encode_inplace
+#undef cobs_decode_inplace
+#undef cobs_encode
+#undef cobs_encode_inc_begin
+#undef cobs_encode_inc
+#undef cobs_encode_inc_end
+#undef cobs_decode
+
+/* Word-at-a-time, as swar_* */
+#define COBS_SCAN_SWAR
+#define cobs_scan							swar_scan
+#define cobs_encode_inplace		swar_encode_inplace
+#define cobs_decode_inplace		swar_decode_inplace
+#define cobs_encode						swar_encode
+#define cobs_encode_inc_begin	swar_encode_inc_begin
+#define cobs_encode_inc				swar_encode_inc
+#define cobs_encode_inc_end		swar_encode_inc_end
+#define cobs_decode						swar_decode
+/* cobs.h declared the library's, which cobs.c calls before defining */
+cobs_ret_t swar_encode_inc_begin(void* out_enc, unsigned enc_max,
+																 cobs_enc_ctx_t* out_ctx);
+cobs_ret_t swar_encode_inc(cobs_enc_ctx_t* ctx, void const* dec,
+													 unsigned dec_len);
+cobs_ret_t swar_encode_inc_end(cobs_enc_ctx_t* ctx, unsigned* out_enc_len);
+#include "../cobs.c"
+#undef COBS_SCAN_SWAR
+#undef cobs_scan
+#undef cobs_encode_inplace
+#undef cobs_decode_inplace
+#undef cobs_encode
+#undef cobs_encode_inc_begin
+#undef cobs_encode_inc
+#undef cobs_encode_inc_end
+#undef cobs_decode
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MAX_LEN (1100)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef enum {
+	PATTERN_RANDOM,
+	PATTERN_ZEROS,
+	PATTERN_NO_ZEROS,
+	PATTERN_SPARSE, /* A zero every few hundred bytes */
+
+	PATTERN_NB,
+} pattern_e;
+
+/* A build of cobs.c under test */
+typedef struct {
+	const char* name;
+	cobs_ret_t (*encode)(void const* dec, unsigned dec_len, void* out_enc,
+											 unsigned enc_max, unsigned* out_enc_len);
+	cobs_ret_t (*decode)(void const* enc, unsigned enc_len, void* out_dec,
+											 unsigned dec_max, unsigned* out_dec_len);
+	cobs_ret_t (*encode_inplace)(void* buf, unsigned len);
+	cobs_ret_t (*decode_inplace)(void* buf, unsigned len);
+	cobs_ret_t (*inc_begin)(void* out_enc, unsigned enc_max,
+													cobs_enc_ctx_t* out_ctx);
+	cobs_ret_t (*inc)(cobs_enc_ctx_t* ctx, void const* dec, unsigned dec_len);
+	cobs_ret_t (*inc_end)(cobs_enc_ctx_t* ctx, unsigned* out_enc_len);
+} kernel_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void fill(uint8_t* buf, unsigned len, pattern_e pattern);
+static void test_encode(const kernel_s* k, const uint8_t* dec, unsigned len);
+static void test_decode(const kernel_s* k, const uint8_t* dec, unsigned len);
+static void test_inplace(const kernel_s* k, const uint8_t* dec, unsigned len);
+static void test_bounds(const kernel_s* k);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static const kernel_s kernels[] = {
+		{"library", cobs_encode, cobs_decode, cobs_encode_inplace,
+		 cobs_decode_inplace, cobs_encode_inc_begin, cobs_encode_inc,
+		 cobs_encode_inc_end},
+		{"swar", swar_encode, swar_decode, swar_encode_inplace,
+		 swar_decode_inplace, swar_encode_inc_begin, swar_encode_inc,
+		 swar_encode_inc_end},
+};
+
+/* Around the word and vector sizes, and the 254/255-byte blocks */
+static const unsigned lengths[] = {
+		0,	 1,		2,	 3,		4,	 5,		7,	 8,		9,	 15,	16,	 17,	23,	 24,	25,
+		31,	 32,	33,	 47,	48,	 49,	63,	 64,	65,	 127, 128, 129, 252, 253, 254,
+		255, 256, 257, 258, 382, 383, 384, 507, 508, 509, 510, 511, 512, 513, 762,
+		763, 764, 765, 766, 767, 768, 1016, 1017, 1018, 1020, 1024, MAX_LEN,
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	static uint8_t dec[MAX_LEN];
+
+	srand(1);
+	for (size_t n = 0; n < sizeof(kernels) / sizeof(kernels[0]); n++) {
+		const kernel_s* const k = &kernels[n];
+
+		for (int p = 0; p < PATTERN_NB; p++) {
+			for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+				/* From every alignment, so vector loads straddle differently */
+				for (unsigned ofs = 0; ofs < 4; ofs++) {
+					unsigned const len = lengths[i] - ((lengths[i] >= ofs) ? ofs : 0);
+					fill(dec, len, (pattern_e)p);
+					test_encode(k, dec, len);
+					test_decode(k, dec, len);
+					test_inplace(k, dec, len);
+				}
+			}
+		}
+		test_bounds(k);
+		printf("test_cobs: %s ok\n", k->name);
+	}
+
+	printf("test_cobs: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void fill(uint8_t* buf, unsigned len, pattern_e pattern) {
+	unsigned const gap = 200 + ((unsigned)rand() % 120);
+
+	for (unsigned i = 0; i < len; i++) {
+		switch (pattern) {
+			case PATTERN_RANDOM:
+				/* Zero about one byte in eight */
+				buf[i] = (rand() % 8) ? (uint8_t)(1 + (rand() % 255)) : 0;
+				break;
+
+			case PATTERN_ZEROS:
+				buf[i] = 0;
+				break;
+
+			case PATTERN_NO_ZEROS:
+				buf[i] = (uint8_t)(1 + (rand() % 255));
+				break;
+
+			default:
+				buf[i] = (i % gap) ? (uint8_t)(1 + (rand() % 255)) : 0;
+				break;
+		}
+	}
+}
+
+/* Whole, into a buffer one byte too short, and in pieces */
+static void test_encode(const kernel_s* k, const uint8_t* dec, unsigned len) {
+	static uint8_t ref[COBS_ENCODE_MAX(MAX_LEN)];
+	static uint8_t enc[COBS_ENCODE_MAX(MAX_LEN)];
+	unsigned			 ref_len = 0;
+	unsigned			 enc_len = 0;
+	unsigned const max		 = COBS_ENCODE_MAX(len);
+
+	CHECK(ref_encode(dec, len, ref, max, &ref_len) == COBS_RET_SUCCESS);
+	CHECK(k->encode(dec, len, enc, max, &enc_len) == COBS_RET_SUCCESS);
+	CHECK((enc_len == ref_len) && !memcmp(enc, ref, ref_len));
+
+	CHECK(k->encode(dec, len, enc, ref_len - 1, &enc_len) ==
+				ref_encode(dec, len, ref, ref_len - 1, &ref_len));
+
+	cobs_enc_ctx_t ctx;
+	unsigned			 pos = 0;
+	CHECK(ref_encode(dec, len, ref, max, &ref_len) == COBS_RET_SUCCESS);
+	CHECK(k->inc_begin(enc, max, &ctx) == COBS_RET_SUCCESS);
+	while (pos < len) {
+		unsigned n = 1 + ((unsigned)rand() % 300);
+		n					 = (n < len - pos) ? n : len - pos;
+		CHECK(k->inc(&ctx, &dec[pos], n) == COBS_RET_SUCCESS);
+		pos += n;
+	}
+	CHECK(k->inc_end(&ctx, &enc_len) == COBS_RET_SUCCESS);
+	CHECK((enc_len == ref_len) && !memcmp(enc, ref, ref_len));
+}
+
+/* Round trip, into a buffer too short, and with a byte of the encoding
+ * changed - the result and what was written so far match the reference */
+static void test_decode(const kernel_s* k, const uint8_t* dec, unsigned len) {
+	static uint8_t enc[COBS_ENCODE_MAX(MAX_LEN)];
+	static uint8_t ref[MAX_LEN];
+	static uint8_t out[MAX_LEN];
+	unsigned			 enc_len = 0;
+	unsigned			 ref_len = 0;
+	unsigned			 out_len = 0;
+
+	CHECK(ref_encode(dec, len, enc, sizeof(enc), &enc_len) == COBS_RET_SUCCESS);
+	CHECK(k->decode(enc, enc_len, out, sizeof(out), &out_len) ==
+				COBS_RET_SUCCESS);
+	CHECK((out_len == len) && !memcmp(out, dec, len));
+
+	if (len) {
+		CHECK(k->decode(enc, enc_len, out, len - 1, &out_len) ==
+					ref_decode(enc, enc_len, ref, len - 1, &ref_len));
+	}
+
+	for (int n = 0; n < 4; n++) {
+		enc[(unsigned)rand() % enc_len] = (uint8_t)(rand() % 4 ? rand() : 0);
+		memset(ref, 0, sizeof(ref));
+		memset(out, 0, sizeof(out));
+		cobs_ret_t const r = ref_decode(enc, enc_len, ref, sizeof(ref), &ref_len);
+		CHECK(k->decode(enc, enc_len, out, sizeof(out), &out_len) == r);
+		CHECK(!memcmp(out, ref, sizeof(out)));
+		if (r == COBS_RET_SUCCESS) {
+			CHECK(out_len == ref_len);
+		}
+	}
+}
+
+/* [sentinel][payload][sentinel] encoded and decoded in place */
+static void test_inplace(const kernel_s* k, const uint8_t* dec, unsigned len) {
+	static uint8_t ref[MAX_LEN + 2];
+	static uint8_t buf[MAX_LEN + 2];
+
+	memcpy(&ref[1], dec, len);
+	ref[0]			 = COBS_INPLACE_SENTINEL_VALUE;
+	ref[len + 1] = COBS_INPLACE_SENTINEL_VALUE;
+	memcpy(buf, ref, len + 2);
+
+	/* Longer runs than a block takes fail alike */
+	cobs_ret_t const r = ref_encode_inplace(ref, len + 2);
+	CHECK(k->encode_inplace(buf, len + 2) == r);
+	if (r != COBS_RET_SUCCESS) {
+		return;
+	}
+	CHECK(!memcmp(buf, ref, len + 2));
+
+	CHECK(k->decode_inplace(buf, len + 2) == COBS_RET_SUCCESS);
+	CHECK(ref_decode_inplace(ref, len + 2) == COBS_RET_SUCCESS);
+	CHECK(!memcmp(buf, ref, len + 2));
+	CHECK(!memcmp(&buf[1], dec, len));
+}
+
+/* Codes that point past the end of the buffer are refused before the bytes
+ * they cover are scanned - the buffer ends where a page that cannot be read
+ * starts */
+static void test_bounds(const kernel_s* k) {
+	long const		 page = sysconf(_SC_PAGESIZE);
+	uint8_t* const map	= mmap(NULL, 2 * (size_t)page, PROT_READ | PROT_WRITE,
+															MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	CHECK(map != MAP_FAILED);
+	CHECK(mprotect(&map[page], (size_t)page, PROT_NONE) == 0);
+
+	/* One byte past the end */
+	uint8_t* buf = &map[page - 2];
+	buf[0]			 = 3;
+	buf[1]			 = 1;
+	CHECK(k->decode_inplace(buf, 2) == COBS_RET_ERR_BAD_PAYLOAD);
+
+	/* Well past it, after some blocks that fit */
+	buf = &map[page - 64];
+	memset(buf, 1, 64);
+	buf[40] = 200;
+	CHECK(k->decode_inplace(buf, 64) == COBS_RET_ERR_BAD_PAYLOAD);
+
+	munmap(map, 2 * (size_t)page);
+}
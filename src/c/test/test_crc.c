@@ -0,0 +1,98 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nsmp_crc.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t	ref_crc8(const uint8_t* buf, size_t len);
+static uint16_t ref_crc16(const uint8_t* buf, size_t len);
+static uint32_t ref_crc32c(const uint8_t* buf, size_t len);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	static const uint8_t check[] = "123456789";
+	static uint8_t			 buf[1031];
+
+	/* Catalogue check values */
+	CHECK(nsmp_crc8(check, 9) == 0xF4);
+	CHECK(nsmp_crc16(0, check, 9) == 0x906E);
+	CHECK(nsmp_crc32c(0, check, 9) == 0xE3069283);
+	CHECK(nsmp_crc32c_sw(0, check, 9) == 0xE3069283);
+	CHECK(nsmp_crc8(check, 0) == 0x00);
+	CHECK(nsmp_crc32c(0, check, 0) == 0);
+
+	/* RFC 3720 B.4 - 32 bytes of zeros */
+	memset(buf, 0, 32);
+	CHECK(nsmp_crc32c(0, buf, 32) == 0x8A9136AA);
+
+	/* Every length and alignment against bit-by-bit references, plus
+	 * continuation across split buffers */
+	srand(1);
+	for (size_t i = 0; i < sizeof(buf); i++) {
+		buf[i] = (uint8_t)rand();
+	}
+	for (size_t ofs = 0; ofs < 8; ofs++) {
+		for (size_t len = 0; len + ofs <= sizeof(buf); len += 1 + (len / 16)) {
+			const uint8_t* p	 = &buf[ofs];
+			size_t const	 cut = len / 3;
+
+			CHECK(nsmp_crc8(p, len) == ref_crc8(p, len));
+			CHECK(nsmp_crc16(0, p, len) == ref_crc16(p, len));
+			CHECK(nsmp_crc32c(0, p, len) == ref_crc32c(p, len));
+			CHECK(nsmp_crc32c_sw(0, p, len) == ref_crc32c(p, len));
+			CHECK(nsmp_crc16(nsmp_crc16(0, p, cut), p + cut, len - cut) ==
+						nsmp_crc16(0, p, len));
+			CHECK(nsmp_crc32c(nsmp_crc32c(0, p, cut), p + cut, len - cut) ==
+						nsmp_crc32c(0, p, len));
+		}
+	}
+
+	printf("test_crc: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t ref_crc8(const uint8_t* buf, size_t len) {
+	uint8_t crc = 0;
+	while (len--) {
+		crc ^= *buf++;
+		for (int i = 0; i < 8; i++) {
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+static uint16_t ref_crc16(const uint8_t* buf, size_t len) {
+	uint16_t crc = 0xFFFF;
+	while (len--) {
+		crc ^= *buf++;
+		for (int i = 0; i < 8; i++) {
+			crc = (crc & 1) ? (uint16_t)((crc >> 1) ^ 0x8408) : (uint16_t)(crc >> 1);
+		}
+	}
+	return (uint16_t)~crc;
+}
+
+static uint32_t ref_crc32c(const uint8_t* buf, size_t len) {
+	uint32_t crc = 0xFFFFFFFF;
+	while (len--) {
+		crc ^= *buf++;
+		for (int i = 0; i < 8; i++) {
+			crc = (crc & 1) ? ((crc >> 1) ^ 0x82F63B78) : (crc >> 1);
+		}
+	}
+	return ~crc;
+}
@@ -0,0 +1,199 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nsmp.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			 (256)
+#define TX_DEPTH (32)
+#define RX_DEPTH (3)
+#define WIRE_LEN (32 * 1024)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void			setup(void);
+static void			test_saturate(void);
+static void			test_lost(void);
+static void			test_timeout(void);
+static uint32_t send_all(void);
+static void			transmit(void);
+static void			corrupt_last(void);
+static int			rx_cb(nsmp_msg_s* msg);
+static int tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A fast sender with a deep tx_q, a slow receiver with room for a few frames */
+static uint8_t tx_q[NSMP_QUEUE_LEN(TX_DEPTH, MTU) + NSMP_URGENT_LEN(MTU)]
+		__attribute__((aligned(4)));
+static uint8_t rx_q[NSMP_QUEUE_LEN(RX_DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t tx_buf[TX_DEPTH * NSMP_TX_BUF_LEN(MTU)];
+
+static nsmp_iface_s iface;
+
+/* Encoded bytes written by tx_cb, parsed in one go as a slow receiver would */
+static uint8_t wire[WIRE_LEN];
+static size_t	 wire_len;
+
+static uint32_t rx_count;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_saturate();
+	test_lost();
+	test_timeout();
+	printf("test_credit: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void setup(void) {
+	nsmp_cfg_s const cfg = {.get_time_ms = clock_ms};
+
+	memset(&iface, 0, sizeof(iface));
+	iface.tx_q			 = tx_q;
+	iface.tx_len		 = sizeof(tx_q);
+	iface.rx_q			 = rx_q;
+	iface.rx_len		 = sizeof(rx_q);
+	iface.tx_buf		 = tx_buf;
+	iface.tx_buf_len = sizeof(tx_buf);
+	iface.mtu				 = MTU;
+	iface.rx_cb			 = rx_cb;
+	iface.tx_cb			 = tx_cb;
+
+	CHECK(nsmp_peer_init() == NSMP_OK);
+	CHECK(nsmp_peer_newif(&iface) == NSMP_OK);
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+	wire_len = 0;
+	rx_count = 0;
+
+	/* Capabilities, then the first grant */
+	loopback(&iface, wire, &wire_len, 3);
+	CHECK(iface.peer_caps & NSMP_CAP_CREDIT);
+	CHECK(rx_count == 0);
+}
+
+/* Far more than rx_q holds is sent at once, and none of it is lost */
+static void test_saturate(void) {
+	setup();
+	for (int round = 0; round < 4; round++) {
+		uint32_t const n			= send_all();
+		uint32_t const before = rx_count;
+		CHECK(n > RX_DEPTH * 4);
+
+		/* The receiver never holds more than a few frames at a time */
+		for (unsigned r = 0; (r < 100) && (rx_count != before + n); r++) {
+			loopback(&iface, wire, &wire_len, 1);
+		}
+		CHECK(rx_count == before + n);
+	}
+	CHECK(iface.cr.drops == 0);
+	CHECK(nsmp_queue_used(&iface.txq) == 0);
+}
+
+/* A frame lost on the link does not take its credit with it */
+static void test_lost(void) {
+	setup();
+	for (int round = 0; round < 20; round++) {
+		uint32_t const n			= send_all();
+		uint32_t const before = rx_count;
+
+		transmit();
+		corrupt_last();
+		for (unsigned r = 0; (r < 100) && (rx_count != before + n - 1); r++) {
+			loopback(&iface, wire, &wire_len, 1);
+		}
+		CHECK(rx_count == before + n - 1);
+	}
+	CHECK(iface.cr.drops == 20);
+	CHECK(nsmp_queue_used(&iface.txq) == 0);
+}
+
+/* A sender that waits too long asks for credit, here after losing both the
+ * frame and the grant that reported its loss */
+static void test_timeout(void) {
+	setup();
+	uint32_t const n = send_all();
+
+	CHECK(nsmp_update() == NSMP_OK);
+	corrupt_last();
+	CHECK(nsmp_parse_if(&iface, wire, wire_len) >= 0);
+	wire_len = 0;
+	CHECK(nsmp_update() == NSMP_OK);
+	wire_len = 0;
+
+	loopback(&iface, wire, &wire_len, 20);
+	CHECK(nsmp_queue_used(&iface.txq) != 0);
+
+	now_ms += NSMP_CREDIT_MS;
+	for (unsigned r = 0; (r < 100) && (rx_count != n - 1); r++) {
+		loopback(&iface, wire, &wire_len, 1);
+	}
+	CHECK(rx_count == n - 1);
+	CHECK(nsmp_queue_used(&iface.txq) == 0);
+}
+
+/* Queue messages of the largest size until tx_q is full */
+static uint32_t send_all(void) {
+	uint8_t	 payload[MTU];
+	uint32_t n = 0;
+
+	memset(payload, 0x5A, sizeof(payload));
+	for (;;) {
+		nsmp_msg_s msg = {.hdr.dst = 0};
+		nsmp_add_data(&msg, payload, sizeof(payload));
+		if (nsmp_send(&msg) != NSMP_OK) {
+			return n;
+		}
+		n++;
+	}
+}
+
+/* Transmit until a message goes out after the grants it may be waiting for,
+ * which are delivered */
+static void transmit(void) {
+	for (unsigned r = 0; r < 10; r++) {
+		CHECK(nsmp_update() == NSMP_OK);
+		if (wire_len >= MTU) {
+			return;
+		}
+		CHECK(nsmp_parse_if(&iface, wire, wire_len) >= 0);
+		wire_len = 0;
+	}
+	CHECK(0);
+}
+
+/* Damage the header of the last frame on the wire */
+static void corrupt_last(void) {
+	size_t end = wire_len - 1;
+
+	CHECK(wire_len > 0);
+	do {
+		CHECK(end > 0);
+	} while (wire[--end] != 0);
+	wire[end + 2] ^= 0x10;
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	CHECK(msg->len == MTU);
+	rx_count++;
+	return NSMP_OK;
+}
+
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	(void)i;
+	return wire_put(wire, &wire_len, sizeof(wire), iov, iovcnt);
+}
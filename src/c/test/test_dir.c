@@ -0,0 +1,548 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "nsmp_private.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			 (64)
+#define DEPTH		 (8)
+#define IFACES	 (2)
+#define WIRE_LEN (16 * 1024)
+#define RX_MAX	 (64)
+
+#define NODE_ADDR NSMP_ADDR(0, 0, 1)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A directory frame sent by the node */
+typedef struct {
+	uint16_t from;
+	uint16_t to;
+	size_t	 n;
+	uint8_t	 addr[NSMP_DIR_ENTRIES];
+	uint8_t	 len[NSMP_DIR_ENTRIES];
+} dir_frame_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void		setup(nsmp_role_e role);
+static void		test_answer(void);
+static void		test_coalesce(void);
+static void		test_delta(void);
+static void		test_gone(void);
+static void		test_frames(void);
+static void		test_peer(void);
+static void		test_backoff(void);
+static void		request(int i, uint8_t src, uint16_t since, size_t len);
+static size_t build(uint8_t* out, nsmp_msg_type_e type, uint8_t reqres,
+										uint8_t dst, uint8_t src, const uint8_t* data, size_t len);
+static size_t next_frame(int i, size_t* pos, uint8_t* dec);
+static size_t dir_frames(int i, dir_frame_s* f, size_t max);
+static size_t count_type(int i, nsmp_msg_type_e type);
+static size_t count_requests(int i);
+static void		clear(void);
+static int		rx_cb(nsmp_msg_s* msg);
+static int		tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[IFACES][NSMP_QUEUE_LEN(DEPTH, MTU)]
+		__attribute__((aligned(4)));
+static uint8_t rx_q[IFACES][NSMP_QUEUE_LEN(DEPTH, MTU)]
+		__attribute__((aligned(4)));
+static uint8_t tx_buf[IFACES][NSMP_TX_BUF_LEN(MTU)];
+
+static nsmp_iface_s iface[IFACES];
+
+/* Bytes each interface transmitted */
+static uint8_t wire[IFACES][WIRE_LEN];
+static size_t	 wire_len[IFACES];
+
+/* Messages delivered to the device itself */
+static size_t					 rx_count;
+static uint8_t				 rx_src[RX_MAX];
+static nsmp_msg_type_e rx_type[RX_MAX];
+static uint8_t				 rx_len[RX_MAX];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_answer();
+	test_coalesce();
+	test_delta();
+	test_gone();
+	test_frames();
+	test_peer();
+	test_backoff();
+	printf("test_dir: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A device with IFACES interfaces, or one for a peer, on a clock of our own */
+static void setup(nsmp_role_e role) {
+	nsmp_cfg_s const cfg = {
+			.addr				 = (role == NSMP_ROLE_NODE) ? NODE_ADDR : NSMP_ADDR(0, 1, 1),
+			.get_time_ms = clock_ms,
+	};
+	int const				 n	 = (role == NSMP_ROLE_NODE) ? IFACES : 1;
+
+	CHECK(nsmp_init(role) == NSMP_OK);
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+	for (int i = 0; i < n; i++) {
+		memset(&iface[i], 0, sizeof(iface[i]));
+		iface[i].tx_q				= tx_q[i];
+		iface[i].tx_len			= sizeof(tx_q[i]);
+		iface[i].rx_q				= rx_q[i];
+		iface[i].rx_len			= sizeof(rx_q[i]);
+		iface[i].tx_buf			= tx_buf[i];
+		iface[i].tx_buf_len = sizeof(tx_buf[i]);
+		iface[i].mtu				= MTU;
+		iface[i].rx_cb			= rx_cb;
+		iface[i].tx_cb			= tx_cb;
+		CHECK(((role == NSMP_ROLE_NODE) ? nsmp_node_newif(&iface[i])
+																		: nsmp_peer_newif(&iface[i])) == NSMP_OK);
+	}
+	CHECK(nsmp_update() == NSMP_OK);
+	now_ms = 0;
+	clear();
+}
+
+/* A node answers a request with its directory, to the whole link */
+static void test_answer(void) {
+	uint8_t const own[] = {'n', 'o', 'd', 'e'};
+	dir_frame_s		f;
+
+	setup(NSMP_ROLE_NODE);
+	CHECK(nsmp_set_discovery_payload(NULL, NSMP_DISCOVERY_LEN + 1) ==
+				NSMP_ERR_BAD_LEN);
+	CHECK(nsmp_set_discovery_payload((uint8_t*)own, sizeof(own)) == NSMP_OK);
+
+	request(0, NSMP_ADDR(0, 1, 1), 0, 3);
+	CHECK(rx_count == 1);
+	CHECK((rx_type[0] == NSMP_MSG_TYPE_CTL_DISCOVERY) && (rx_len[0] == 3));
+	CHECK(dir_frames(0, &f, 1) == 1);
+	CHECK((f.from == 0) && (f.to == 2) && (f.n == 2));
+	CHECK((f.addr[0] == NODE_ADDR) && (f.len[0] == sizeof(own)));
+	CHECK((f.addr[1] == NSMP_ADDR(0, 1, 1)) && (f.len[1] == 3));
+	CHECK(wire_len[1] == 0);
+
+	/* The same payload again changes nothing */
+	clear();
+	request(1, NSMP_ADDR(0, 1, 1), 0, 3);
+	CHECK(dir_frames(1, &f, 1) == 1);
+	CHECK((f.to == 2) && (f.n == 2));
+}
+
+/* Requests that arrive together get one answer, from the oldest version */
+static void test_coalesce(void) {
+	uint8_t		 enc[4][NSMP_FRAME_MAX(MTU)];
+	size_t		 n[4];
+	uint8_t		 d[NSMP_DISC_HDR + 1] = {0};
+	dir_frame_s f;
+
+	setup(NSMP_ROLE_NODE);
+	request(0, NSMP_ADDR(0, 1, 1), 0, 1);
+	request(0, NSMP_ADDR(0, 1, 2), 0, 1);
+	clear();
+
+	for (uint8_t k = 0; k < 4; k++) {
+		uint8_t const src = NSMP_ADDR(0, 1, 1 + (k % 2));
+		d[0]							= (uint8_t)(2 - (k % 3));
+		d[NSMP_DISC_HDR]	= src;
+		n[k] = build(enc[k], NSMP_MSG_TYPE_CTL_DISCOVERY, NSMP_MSG_REQUEST,
+								 NSMP_ADDR_LINK, src, d, sizeof(d));
+		CHECK(nsmp_parse_if(&iface[0], enc[k], n[k]) >= 0);
+	}
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(count_type(0, NSMP_MSG_TYPE_CTL_DIRECTORY) == 1);
+	CHECK(dir_frames(0, &f, 1) == 1);
+	CHECK((f.from == 0) && (f.to == 2) && (f.n == 2));
+}
+
+/* Only the entries that changed after the version asked for are sent */
+static void test_delta(void) {
+	dir_frame_s f;
+
+	setup(NSMP_ROLE_NODE);
+	for (uint8_t a = 1; a <= 4; a++) {
+		request(0, NSMP_ADDR(0, 1, a), 0, a);
+	}
+	clear();
+
+	request(1, NSMP_ADDR(0, 2, 1), 4, 5);
+	CHECK(dir_frames(1, &f, 1) == 1);
+	CHECK((f.from == 4) && (f.to == 5) && (f.n == 1));
+	CHECK((f.addr[0] == NSMP_ADDR(0, 2, 1)) && (f.len[0] == 5));
+	clear();
+
+	/* A changed payload moves the entry to the end */
+	request(0, NSMP_ADDR(0, 1, 2), 5, 7);
+	CHECK(dir_frames(0, &f, 1) == 1);
+	CHECK((f.from == 5) && (f.to == 6) && (f.n == 1));
+	CHECK((f.addr[0] == NSMP_ADDR(0, 1, 2)) && (f.len[0] == 7));
+	clear();
+
+	/* Up to date */
+	request(0, NSMP_ADDR(0, 1, 2), 6, 7);
+	CHECK(dir_frames(0, &f, 1) == 1);
+	CHECK((f.from == 6) && (f.to == 6) && (f.n == 0));
+	clear();
+
+	/* From a version the node has not reached, it starts over */
+	request(0, NSMP_ADDR(0, 1, 2), 100, 7);
+	CHECK(dir_frames(0, &f, 1) == 1);
+	CHECK((f.from == 0) && (f.to == 6) && (f.n == 5));
+}
+
+/* A device that unregisters is sent as gone to those who knew of it */
+static void test_gone(void) {
+	uint8_t			enc[NSMP_FRAME_MAX(MTU)];
+	dir_frame_s f;
+
+	setup(NSMP_ROLE_NODE);
+	request(0, NSMP_ADDR(0, 1, 1), 0, 2);
+	request(1, NSMP_ADDR(0, 2, 1), 0, 2);
+	rx_feed(&iface[0], enc,
+					build(enc, NSMP_MSG_TYPE_CTL_UNREGISTER, NSMP_MSG_REQUEST, NODE_ADDR,
+								NSMP_ADDR(0, 1, 1), NULL, 0));
+	clear();
+
+	request(1, NSMP_ADDR(0, 2, 1), 2, 2);
+	CHECK(dir_frames(1, &f, 1) == 1);
+	CHECK((f.from == 2) && (f.to == 3) && (f.n == 1));
+	CHECK((f.addr[0] == NSMP_ADDR(0, 1, 1)) && (f.len[0] == NSMP_DIR_GONE));
+	clear();
+
+	/* Not to those who did not */
+	request(1, NSMP_ADDR(0, 2, 1), 0, 2);
+	CHECK(dir_frames(1, &f, 1) == 1);
+	CHECK((f.from == 0) && (f.to == 3) && (f.n == 1));
+	CHECK(f.addr[0] == NSMP_ADDR(0, 2, 1));
+}
+
+/* A directory larger than a frame is sent in frames that follow on */
+static void test_frames(void) {
+	dir_frame_s f[8];
+	size_t			total = 0;
+
+	setup(NSMP_ROLE_NODE);
+	for (uint8_t a = 1; a <= 12; a++) {
+		request(0, NSMP_ADDR(0, 1, a), 0, NSMP_DISCOVERY_LEN);
+	}
+	clear();
+
+	request(1, NSMP_ADDR(0, 1, 1), 0, NSMP_DISCOVERY_LEN);
+	for (int r = 0; r < 8; r++) {
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+	size_t const n = dir_frames(1, f, 8);
+	CHECK(n > 1);
+	CHECK(f[0].from == 0);
+	for (size_t k = 0; k < n; k++) {
+		CHECK(f[k].n > 0);
+		CHECK((k == 0) || (f[k].from == f[k - 1].to));
+		total += f[k].n;
+	}
+	CHECK((total == 12) && (f[n - 1].to == 12));
+	CHECK(!(iface[1].ctl_pend & NSMP_PEND_DIR));
+}
+
+/* A peer delivers the entries it has not seen, and answers requests itself
+ * until it hears from a node */
+static void test_peer(void) {
+	uint8_t	 enc[NSMP_FRAME_MAX(MTU)];
+	uint8_t	 d[MTU];
+	uint8_t* p = d;
+
+	setup(NSMP_ROLE_PEER);
+	uint8_t const own[] = {1, 2, 3};
+	CHECK(nsmp_set_discovery_payload((uint8_t*)own, sizeof(own)) == NSMP_OK);
+
+	uint8_t const since[NSMP_DISC_HDR] = {0};
+	rx_feed(&iface[0], enc,
+					build(enc, NSMP_MSG_TYPE_CTL_DISCOVERY, NSMP_MSG_REQUEST,
+								NSMP_ADDR_LINK, NSMP_ADDR(0, 1, 2), since, sizeof(since)));
+	CHECK(count_type(0, NSMP_MSG_TYPE_CTL_DISCOVERY) == 1);
+	clear();
+
+	/* [0 .. 3]: two devices, ourselves, and one that is gone */
+	*p++ = 0, *p++ = 0, *p++ = 3, *p++ = 0;
+	*p++ = NSMP_ADDR(0, 1, 2), *p++ = 2, *p++ = 1, *p++ = 0, *p++ = 9, *p++ = 9;
+	*p++ = nsmp_addr(), *p++ = 3, *p++ = 2, *p++ = 0, *p++ = 1, *p++ = 2,
+	*p++ = 3;
+	*p++ = NSMP_ADDR(0, 1, 3), *p++ = NSMP_DIR_GONE, *p++ = 3, *p++ = 0;
+	size_t const n = (size_t)(p - d);
+	rx_feed(&iface[0], enc,
+					build(enc, NSMP_MSG_TYPE_CTL_DIRECTORY, NSMP_MSG_RESPONSE,
+								NSMP_ADDR_LINK, NODE_ADDR, d, n));
+	CHECK(rx_count == 2);
+	CHECK((rx_type[0] == NSMP_MSG_TYPE_CTL_DISCOVERY) &&
+				(rx_src[0] == NSMP_ADDR(0, 1, 2)) && (rx_len[0] == 2));
+	CHECK((rx_type[1] == NSMP_MSG_TYPE_CTL_UNREGISTER) &&
+				(rx_src[1] == NSMP_ADDR(0, 1, 3)));
+	clear();
+
+	/* Seen already */
+	rx_feed(&iface[0], enc,
+					build(enc, NSMP_MSG_TYPE_CTL_DIRECTORY, NSMP_MSG_RESPONSE,
+								NSMP_ADDR_LINK, NODE_ADDR, d, n));
+	CHECK(rx_count == 0);
+
+	/* Following on from a version we do not have */
+	d[0] = 5, d[2] = 6;
+	rx_feed(&iface[0], enc,
+					build(enc, NSMP_MSG_TYPE_CTL_DIRECTORY, NSMP_MSG_RESPONSE,
+								NSMP_ADDR_LINK, NODE_ADDR, d, n));
+	CHECK(rx_count == 0);
+
+	/* With a node on the link, it answers for us */
+	rx_feed(&iface[0], enc,
+					build(enc, NSMP_MSG_TYPE_CTL_DISCOVERY, NSMP_MSG_REQUEST,
+								NSMP_ADDR_LINK, NSMP_ADDR(0, 1, 2), since, sizeof(since)));
+	CHECK(count_type(0, NSMP_MSG_TYPE_CTL_DISCOVERY) == 0);
+}
+
+/* Requests go out after a random wait, again with a wider window while
+ * unanswered, and stop once answered or after NSMP_DISC_TRIES */
+static void test_backoff(void) {
+	uint8_t				 enc[NSMP_FRAME_MAX(MTU)];
+	uint8_t				 dec[NSMP_FRAME_MAX(MTU)];
+	uint32_t const max = NSMP_DISC_TRIES * (NSMP_DISC_WAIT_MS +
+																					NSMP_DISC_WINDOW_MAX_MS +
+																					NSMP_DISC_TIMEOUT_MS);
+
+	setup(NSMP_ROLE_PEER);
+	CHECK(nsmp_discover() == NSMP_OK);
+	uint32_t sent[NSMP_DISC_TRIES + 1];
+	size_t	 tries = 0;
+	for (now_ms = 0; now_ms < max; now_ms++) {
+		CHECK(nsmp_update() == NSMP_OK);
+		if (count_type(0, NSMP_MSG_TYPE_CTL_DISCOVERY)) {
+			CHECK(tries <= NSMP_DISC_TRIES);
+			sent[tries++] = now_ms;
+			clear();
+		}
+	}
+	CHECK(tries == NSMP_DISC_TRIES);
+	CHECK((sent[0] >= NSMP_DISC_WAIT_MS) &&
+				(sent[0] <= NSMP_DISC_WAIT_MS + NSMP_DISC_WINDOW_MS));
+	for (size_t k = 1; k < tries; k++) {
+		CHECK(sent[k] - sent[k - 1] >= NSMP_DISC_TIMEOUT_MS + NSMP_DISC_WAIT_MS);
+	}
+
+	/* The request asks for the directory from the version we have */
+	setup(NSMP_ROLE_PEER);
+	CHECK(nsmp_discover() == NSMP_OK);
+	for (; !wire_len[0]; now_ms++) {
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+	size_t pos = 0;
+	CHECK(next_frame(0, &pos, dec) == NSMP_HDR_LEN + NSMP_DISC_HDR);
+	CHECK(nsmp_frame_type(dec) == NSMP_MSG_TYPE_CTL_DISCOVERY);
+	CHECK((dec[NSMP_OFS_DST] == NSMP_ADDR_LINK) && !dec[NSMP_HDR_LEN] &&
+				!dec[NSMP_HDR_LEN + 1]);
+	clear();
+
+	/* An answer without our entry is not the one to ours */
+	uint8_t d[NSMP_DIR_HDR + NSMP_DIR_ENT_HDR] = {0, 0, 1, 0,
+																							NSMP_ADDR(0, 1, 2), 0, 1, 0};
+	rx_feed(&iface[0], enc,
+					build(enc, NSMP_MSG_TYPE_CTL_DIRECTORY, NSMP_MSG_RESPONSE,
+								NSMP_ADDR_LINK, NODE_ADDR, d, sizeof(d)));
+	CHECK(rx_count == 1);
+	for (; !count_requests(0) && (now_ms < max); now_ms++) {
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+	pos = 0;
+	CHECK(next_frame(0, &pos, dec) == NSMP_HDR_LEN + NSMP_DISC_HDR);
+	CHECK((dec[NSMP_HDR_LEN] == 1) && !dec[NSMP_HDR_LEN + 1]);
+	clear();
+
+	/* Answered, no more requests */
+	d[0] = 1, d[2] = 2, d[4] = nsmp_addr(), d[6] = 2;
+	rx_feed(&iface[0], enc,
+					build(enc, NSMP_MSG_TYPE_CTL_DIRECTORY, NSMP_MSG_RESPONSE,
+								NSMP_ADDR_LINK, NODE_ADDR, d, sizeof(d)));
+	CHECK(rx_count == 0);
+	for (uint32_t t = now_ms + max; now_ms < t; now_ms++) {
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+	CHECK(count_type(0, NSMP_MSG_TYPE_CTL_DISCOVERY) == 0);
+
+	/* Until a frame shows changes were missed */
+	d[0] = 5, d[2] = 6;
+	rx_feed(&iface[0], enc,
+					build(enc, NSMP_MSG_TYPE_CTL_DIRECTORY, NSMP_MSG_RESPONSE,
+								NSMP_ADDR_LINK, NODE_ADDR, d, NSMP_DIR_HDR));
+	for (uint32_t t = now_ms + NSMP_DISC_WAIT_MS + NSMP_DISC_WINDOW_MS + 1;
+			 !count_requests(0) && (now_ms < t); now_ms++) {
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+	pos = 0;
+	CHECK(next_frame(0, &pos, dec) == NSMP_HDR_LEN + NSMP_DISC_HDR);
+	CHECK((dec[NSMP_HDR_LEN] == 2) && !dec[NSMP_HDR_LEN + 1]);
+
+	/* Another device's request while waiting puts ours off */
+	setup(NSMP_ROLE_PEER);
+	CHECK(nsmp_discover() == NSMP_OK);
+	uint8_t const since[NSMP_DISC_HDR] = {0};
+	size_t const	n = build(enc, NSMP_MSG_TYPE_CTL_DISCOVERY, NSMP_MSG_REQUEST,
+													NSMP_ADDR_LINK, NSMP_ADDR(0, 1, 2), since,
+													sizeof(since));
+	for (now_ms = 0; now_ms < NSMP_DISC_WAIT_MS + NSMP_DISC_WINDOW_MS;
+			 now_ms += 5) {
+		rx_feed(&iface[0], enc, n);
+		CHECK(count_requests(0) == 0);
+		clear();
+	}
+	CHECK(nsmp_discover() == NSMP_OK);
+
+	/* Not without an interface or a role */
+	CHECK(nsmp_init(NSMP_ROLE_NONE) == NSMP_OK);
+	CHECK(nsmp_discover() == NSMP_ERR_BAD_ARG);
+	CHECK(nsmp_init(NSMP_ROLE_PEER) == NSMP_OK);
+	CHECK(nsmp_discover() == NSMP_ERR_NO_IF);
+}
+
+/* Device src on interface i asks for the directory from version since, with
+ * a payload of len bytes */
+static void request(int i, uint8_t src, uint16_t since, size_t len) {
+	uint8_t d[NSMP_DISC_HDR + MTU];
+	uint8_t enc[NSMP_FRAME_MAX(MTU)];
+
+	d[0] = (uint8_t)since;
+	d[1] = (uint8_t)(since >> 8);
+	memset(&d[NSMP_DISC_HDR], src, len);
+	rx_feed(&iface[i], enc,
+					build(enc, NSMP_MSG_TYPE_CTL_DISCOVERY, NSMP_MSG_REQUEST,
+								NSMP_ADDR_LINK, src, d, NSMP_DISC_HDR + len));
+}
+
+/* Encode a frame, returns its length */
+static size_t build(uint8_t* out, nsmp_msg_type_e type, uint8_t reqres,
+										uint8_t dst, uint8_t src, const uint8_t* data, size_t len) {
+	uint8_t		 frame[NSMP_HDR_LEN + MTU + NSMP_PAYLOAD_CRC_LEN];
+	unsigned	 n	 = 0;
+	nsmp_hdr_s hdr = {
+			.ctl = {.data = (len != 0), .reqres = reqres, .type = type},
+			.dst = dst,
+			.src = src,
+	};
+
+	if (len) {
+		memcpy(&frame[NSMP_HDR_LEN], data, len);
+	}
+	nsmp_frame_hdr(frame, &hdr, (uint16_t)len);
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+	uint32_t const crc = nsmp_crc_payload(&frame[NSMP_HDR_LEN], len);
+	for (size_t i = 0; i < NSMP_PAYLOAD_CRC_LEN; i++) {
+		frame[NSMP_HDR_LEN + len + i] = (uint8_t)(crc >> (8 * i));
+	}
+#endif
+	CHECK(cobs_encode(frame, (unsigned)(NSMP_HDR_LEN + len + NSMP_PAYLOAD_CRC_LEN),
+										out, NSMP_FRAME_MAX(MTU), &n) == COBS_RET_SUCCESS);
+	if (out[n - 1] != 0) {
+		out[n++] = 0;
+	}
+	return n;
+}
+
+/* Decode the frame at pos on interface i's wire, returns its length without
+ * the payload CRC, or 0 at the end */
+static size_t next_frame(int i, size_t* pos, uint8_t* dec) {
+	size_t const n = wire_frame(wire[i], wire_len[i], pos, dec, NSMP_FRAME_MAX(MTU));
+
+	return n ? (n - NSMP_PAYLOAD_CRC_LEN) : 0;
+}
+
+/* The directory frames interface i sent, at most max */
+static size_t dir_frames(int i, dir_frame_s* f, size_t max) {
+	uint8_t dec[NSMP_FRAME_MAX(MTU)];
+	size_t	pos = 0;
+	size_t	k		= 0;
+
+	for (size_t n; (n = next_frame(i, &pos, dec)) != 0;) {
+		if (nsmp_frame_type(dec) != NSMP_MSG_TYPE_CTL_DIRECTORY) {
+			continue;
+		}
+		CHECK(k < max);
+		CHECK(dec[NSMP_OFS_DST] == NSMP_ADDR_LINK);
+		CHECK(nsmp_frame_len(dec) == n - NSMP_HDR_LEN);
+		uint8_t const* const d = &dec[NSMP_HDR_LEN];
+		f[k].from							 = (uint16_t)(d[0] | (d[1] << 8));
+		f[k].to								 = (uint16_t)(d[2] | (d[3] << 8));
+		f[k].n								 = 0;
+		for (size_t at = NSMP_DIR_HDR; at < n - NSMP_HDR_LEN;) {
+			f[k].addr[f[k].n] = d[at];
+			f[k].len[f[k].n]	= d[at + 1];
+			at += NSMP_DIR_ENT_HDR + ((d[at + 1] == NSMP_DIR_GONE) ? 0 : d[at + 1]);
+			CHECK(at <= n - NSMP_HDR_LEN);
+			f[k].n++;
+		}
+		k++;
+	}
+	return k;
+}
+
+/* Frames of a type interface i sent */
+static size_t count_type(int i, nsmp_msg_type_e type) {
+	uint8_t dec[NSMP_FRAME_MAX(MTU)];
+	size_t	pos = 0;
+	size_t	k		= 0;
+
+	while (next_frame(i, &pos, dec)) {
+		k += (nsmp_frame_type(dec) == type);
+	}
+	return k;
+}
+
+/* Discovery requests interface i sent */
+static size_t count_requests(int i) {
+	uint8_t dec[NSMP_FRAME_MAX(MTU)];
+	size_t	pos = 0;
+	size_t	k		= 0;
+
+	while (next_frame(i, &pos, dec)) {
+		nsmp_ctrl_s ctl;
+		memcpy(&ctl, &dec[NSMP_OFS_CTL], sizeof(ctl));
+		k += (ctl.type == NSMP_MSG_TYPE_CTL_DISCOVERY) &&
+				 (ctl.reqres == NSMP_MSG_REQUEST);
+	}
+	return k;
+}
+
+static void clear(void) {
+	memset(wire_len, 0, sizeof(wire_len));
+	rx_count = 0;
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	CHECK(rx_count < RX_MAX);
+	rx_src[rx_count]	= msg->hdr.src;
+	rx_type[rx_count] = msg->hdr.ctl.type;
+	rx_len[rx_count]	= (uint8_t)msg->len;
+	rx_count++;
+	return NSMP_OK;
+}
+
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	size_t const n = (size_t)(i - iface);
+
+	return wire_put(wire[n], &wire_len[n], WIRE_LEN, iov, iovcnt);
+}
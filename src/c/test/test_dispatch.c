@@ -0,0 +1,236 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nsmp.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			 (64)
+#define DEPTH		 (8)
+#define WIRE_LEN (4 * 1024)
+
+#define PORT_A (1)
+#define PORT_B (2)
+#define PORT_C (3) /* Without a handler */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_ports(void);
+static void test_fallback(void);
+static void test_parser_drop(void);
+static void test_bundle(void);
+static void setup(const nsmp_dispatch_s* d, uint16_t bundle_len);
+static void send_port(uint8_t port, size_t len);
+static int	on_a(nsmp_msg_s* msg);
+static int	on_b(nsmp_msg_s* msg);
+static int	on_user(nsmp_msg_s* msg);
+static int	rx_cb(nsmp_msg_s* msg);
+static int	tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t rx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t tx_buf[NSMP_TX_BUF_LEN(MTU)];
+
+static nsmp_iface_s iface;
+
+static uint8_t wire[WIRE_LEN];
+static size_t	 wire_len;
+
+/* Messages seen by each handler */
+static uint32_t n_a;
+static uint32_t n_b;
+static uint32_t n_user;
+static uint32_t n_rx;
+static int			bad;
+
+static const nsmp_dispatch_s ports = {
+		.port[PORT_A] = on_a,
+		.port[PORT_B] = on_b,
+};
+
+static const nsmp_dispatch_s ports_user = {
+		.type[NSMP_MSG_TYPE_USER_MESSAGE] = on_user,
+		.port[PORT_A]											 = on_a,
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_ports();
+	test_fallback();
+	test_parser_drop();
+	test_bundle();
+	printf("test_dispatch: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Each port goes to its own handler, rx_cb sees nothing */
+static void test_ports(void) {
+	setup(&ports, 0);
+	send_port(PORT_A, 4);
+	send_port(PORT_B, 10);
+	send_port(PORT_A, 1);
+	loopback(&iface, wire, &wire_len, 2);
+	CHECK((n_a == 2) && (n_b == 1));
+
+	/* Ports without a handler, empty messages and ports out of the table */
+	send_port(PORT_C, 4);
+	send_port(0, 0);
+	send_port(NSMP_PORTS, 4);
+	loopback(&iface, wire, &wire_len, 2);
+	CHECK((n_a == 2) && (n_b == 1));
+	CHECK(n_rx == 0);
+	CHECK(!bad);
+}
+
+/* The user message type takes what no port handler does */
+static void test_fallback(void) {
+	setup(&ports_user, 0);
+	send_port(PORT_A, 4);
+	send_port(PORT_B, 4);
+	send_port(0, 0);
+	send_port(NSMP_PORTS, 4);
+	loopback(&iface, wire, &wire_len, 2);
+	CHECK(n_a == 1);
+	CHECK(n_user == 3);
+	CHECK(n_rx == 0);
+	CHECK(!bad);
+
+	/* Without a table everything goes to rx_cb, as before */
+	setup(NULL, 0);
+	send_port(PORT_A, 4);
+	send_port(PORT_C, 4);
+	loopback(&iface, wire, &wire_len, 2);
+	CHECK((n_a == 0) && (n_rx == 2));
+}
+
+/* A message nobody takes never makes it into rx_q, and its credit is given
+ * back all the same */
+static void test_parser_drop(void) {
+	setup(&ports, 0);
+
+	send_port(PORT_C, 20);
+	CHECK(nsmp_update() == NSMP_OK);
+	uint32_t const rx = iface.cr.rx;
+	CHECK(nsmp_parse_if(&iface, wire, wire_len) == 0);
+	wire_len = 0;
+	CHECK(nsmp_queue_used(&iface.rxq) == 0);
+	CHECK(iface.cr.rx > rx);
+	CHECK(iface.cr.drops == 0);
+
+	send_port(PORT_A, 20);
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(nsmp_parse_if(&iface, wire, wire_len) == 1);
+	wire_len = 0;
+	CHECK(nsmp_queue_used(&iface.rxq) != 0);
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(n_a == 1);
+
+	/* More than rx_q could ever hold, were they kept */
+	for (int i = 0; i < 4 * DEPTH; i++) {
+		send_port(PORT_C, MTU);
+		loopback(&iface, wire, &wire_len, 2);
+	}
+	send_port(PORT_B, 4);
+	loopback(&iface, wire, &wire_len, 2);
+	CHECK(n_b == 1);
+	CHECK(iface.cr.drops == 0);
+	CHECK(!bad);
+}
+
+/* Messages in a bundle are handed out one by one */
+static void test_bundle(void) {
+	setup(&ports, MTU);
+	loopback(&iface, wire, &wire_len, 2);
+	CHECK(iface.peer_caps & NSMP_CAP_BUNDLE);
+
+	send_port(PORT_A, 4);
+	send_port(PORT_C, 4);
+	send_port(PORT_B, 4);
+	send_port(PORT_A, 4);
+	loopback(&iface, wire, &wire_len, 2);
+	CHECK((n_a == 2) && (n_b == 1));
+	CHECK(n_rx == 0);
+	CHECK(!bad);
+}
+
+/* A loopback interface */
+static void setup(const nsmp_dispatch_s* d, uint16_t bundle_len) {
+	nsmp_cfg_s const cfg = {.dispatch = d};
+
+	memset(&iface, 0, sizeof(iface));
+	iface.tx_q			 = tx_q;
+	iface.tx_len		 = sizeof(tx_q);
+	iface.rx_q			 = rx_q;
+	iface.rx_len		 = sizeof(rx_q);
+	iface.tx_buf		 = tx_buf;
+	iface.tx_buf_len = sizeof(tx_buf);
+	iface.mtu				 = MTU;
+	iface.rx_cb			 = rx_cb;
+	iface.tx_cb			 = tx_cb;
+	iface.bundle_len = bundle_len;
+
+	CHECK(nsmp_peer_init() == NSMP_OK);
+	CHECK(nsmp_peer_newif(&iface) == NSMP_OK);
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+	loopback(&iface, wire, &wire_len, 2);
+	n_a		 = 0;
+	n_b		 = 0;
+	n_user = 0;
+	n_rx	 = 0;
+	bad		 = 0;
+}
+
+/* Send a message of len bytes whose first byte is port, filled with it */
+static void send_port(uint8_t port, size_t len) {
+	uint8_t		 payload[MTU];
+	nsmp_msg_s msg = {.hdr.dst = 0};
+
+	memset(payload, port, len);
+	CHECK(nsmp_add_data(&msg, payload, len) == NSMP_OK);
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+}
+
+static int on_a(nsmp_msg_s* msg) {
+	bad |= !msg->len || (msg->data[0] != PORT_A);
+	n_a++;
+	return NSMP_OK;
+}
+
+static int on_b(nsmp_msg_s* msg) {
+	bad |= !msg->len || (msg->data[0] != PORT_B);
+	n_b++;
+	return NSMP_OK;
+}
+
+static int on_user(nsmp_msg_s* msg) {
+	bad |= (msg->hdr.ctl.type != NSMP_MSG_TYPE_USER_MESSAGE) ||
+				 (msg->len && (msg->data[0] == PORT_A));
+	n_user++;
+	return NSMP_OK;
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	(void)msg;
+	n_rx++;
+	return NSMP_OK;
+}
+
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	(void)i;
+	return wire_put(wire, &wire_len, sizeof(wire), iov, iovcnt);
+}
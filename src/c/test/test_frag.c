@@ -0,0 +1,423 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "nsmp_private.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			 (64)
+#define DEPTH		 (4)
+#define BLOB		 (4000)
+#define WIRE_LEN (64 * 1024)
+#define FRAG_MS	 (100)
+#define SRC(n)	 NSMP_ADDR(0, 1, (n))
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Decides whether a decoded frame on the wire gets through */
+typedef int (*filter_f)(const uint8_t* frame, size_t len);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_reassemble(void);
+static void test_interleave(void);
+static void test_stream(void);
+static void test_loss(void);
+static void test_arq(void);
+static void test_timeout(void);
+static void test_refused(void);
+static void setup(uint8_t stream, uint8_t window, uint8_t* tx, size_t tx_len);
+static void pump(void);
+static void send_blob(const uint8_t* data, size_t len);
+static void inject(uint8_t src, uint8_t id, uint16_t total, uint16_t ofs,
+									 uint16_t len);
+static void fill(uint8_t* buf, size_t len, uint8_t seed);
+static int	lose_one(const uint8_t* frame, size_t len);
+static int	rx_cb(nsmp_msg_s* msg);
+static void frag_cb(const nsmp_msg_s* msg, uint16_t ofs, uint16_t total);
+static int	tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t tx_big[NSMP_QUEUE_LEN(64, MTU)] __attribute__((aligned(4)));
+static uint8_t rx_q[NSMP_QUEUE_LEN(64, MTU)] __attribute__((aligned(4)));
+static uint8_t tx_buf[NSMP_TX_BUF_LEN(MTU)];
+static uint8_t frag_buf[NSMP_FRAG_SLOTS * BLOB];
+
+static nsmp_iface_s iface;
+
+static uint8_t	wire[WIRE_LEN];
+static size_t		wire_len;
+static filter_f filter;
+static uint32_t frag_frames;
+
+/* Messages seen by rx_cb, the last long one kept */
+static uint8_t	rx_data[BLOB];
+static size_t		rx_len;
+static uint32_t rx_count;
+static uint32_t rx_small; /* Short messages seen before the last long one */
+
+/* Fragments seen by frag_cb, put together */
+static uint8_t	st_data[BLOB];
+static uint32_t st_frags;
+static uint32_t st_next;
+static int			st_bad;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_reassemble();
+	test_interleave();
+	test_stream();
+	test_loss();
+	test_arq();
+	test_timeout();
+	test_refused();
+	printf("test_frag: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A message far longer than a tx_q slot goes through tx_q a few fragments at
+ * a time, and is delivered whole */
+static void test_reassemble(void) {
+	static uint8_t blob[BLOB];
+
+	setup(0, 0, tx_q, sizeof(tx_q));
+	fill(blob, sizeof(blob), 1);
+	send_blob(blob, sizeof(blob));
+	CHECK(frag_frames == (BLOB + (MTU - NSMP_FRAG_HDR) - 1) / (MTU - NSMP_FRAG_HDR));
+	CHECK(rx_count == 1);
+	CHECK((rx_len == BLOB) && (memcmp(rx_data, blob, BLOB) == 0));
+
+	/* Twice in a row, the buffer being free again */
+	send_blob(blob, 1000);
+	CHECK(rx_count == 2);
+	CHECK((rx_len == 1000) && (memcmp(rx_data, blob, 1000) == 0));
+
+	/* Up to the mtu a message still goes in one frame */
+	nsmp_msg_s msg = {.hdr.dst = 0};
+	nsmp_add_data(&msg, blob, MTU);
+	frag_frames = 0;
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	pump();
+	CHECK(frag_frames == 0);
+	CHECK(rx_count == 3);
+}
+
+/* Short messages sent while a long one is under way are not held behind it */
+static void test_interleave(void) {
+	static uint8_t blob[BLOB];
+	uint8_t				 small[8] = {0};
+	nsmp_msg_s		 msg			= {.hdr.dst = 0};
+
+	setup(0, 0, tx_q, sizeof(tx_q));
+	fill(blob, sizeof(blob), 2);
+	nsmp_add_data(&msg, blob, sizeof(blob));
+	CHECK(nsmp_send(&msg) == NSMP_ERR_NO_MEM);
+	for (unsigned i = 0; i < 10; i++) {
+		nsmp_msg_s s = {.hdr.dst = 0};
+		nsmp_add_data(&s, small, sizeof(small));
+		CHECK(nsmp_send(&s) == NSMP_OK);
+		pump();
+		CHECK(nsmp_send(&msg) == NSMP_ERR_NO_MEM);
+	}
+	send_blob(blob, sizeof(blob));
+	CHECK(rx_count == 11);
+	CHECK(rx_small == 10);
+	CHECK((rx_len == BLOB) && (memcmp(rx_data, blob, BLOB) == 0));
+}
+
+/* With frag_cb the fragments are passed on in order, and the message is not
+ * delivered otherwise */
+static void test_stream(void) {
+	static uint8_t blob[BLOB];
+
+	setup(1, 0, tx_q, sizeof(tx_q));
+	fill(blob, sizeof(blob), 3);
+	send_blob(blob, sizeof(blob));
+	CHECK(!st_bad);
+	CHECK(st_next == BLOB);
+	CHECK(st_frags == frag_frames);
+	CHECK(memcmp(st_data, blob, BLOB) == 0);
+	CHECK(rx_count == 0);
+}
+
+/* A lost fragment loses the message, the next one still gets through */
+static void test_loss(void) {
+	static uint8_t blob[BLOB];
+
+	setup(0, 0, tx_q, sizeof(tx_q));
+	fill(blob, sizeof(blob), 4);
+	filter = lose_one;
+	send_blob(blob, sizeof(blob));
+	CHECK(rx_count == 0);
+
+	filter = NULL;
+	send_blob(blob, sizeof(blob));
+	CHECK(rx_count == 1);
+	CHECK((rx_len == BLOB) && (memcmp(rx_data, blob, BLOB) == 0));
+}
+
+/* Reliable delivery repeats the lost fragment instead */
+static void test_arq(void) {
+	static uint8_t blob[BLOB];
+
+	setup(0, 4, tx_big, sizeof(tx_big));
+	CHECK(iface.peer_caps & NSMP_CAP_ARQ);
+	fill(blob, sizeof(blob), 5);
+	filter = lose_one;
+	send_blob(blob, sizeof(blob));
+	now_ms += NSMP_ARQ_RTO_MS;
+	pump();
+	CHECK(rx_count == 1);
+	CHECK((rx_len == BLOB) && (memcmp(rx_data, blob, BLOB) == 0));
+}
+
+/* Messages that stop half way keep their slot for frag_ms, a sender moving
+ * on frees its slot at once */
+static void test_timeout(void) {
+	setup(0, 0, tx_q, sizeof(tx_q));
+	inject(SRC(1), 0, 100, 0, 50);
+	inject(SRC(2), 0, 100, 0, 50);
+
+	/* No slot is free */
+	inject(SRC(3), 0, 100, 0, 50);
+	inject(SRC(3), 0, 100, 50, 50);
+	CHECK(rx_count == 0);
+
+	/* Until one has waited too long */
+	now_ms += FRAG_MS + 1;
+	inject(SRC(3), 0, 100, 0, 50);
+	inject(SRC(3), 0, 100, 50, 50);
+	CHECK(rx_count == 1);
+	CHECK(rx_len == 100);
+
+	/* A message out of its slot is gone, its fragments are dropped */
+	inject(SRC(1), 0, 100, 50, 50);
+	CHECK(rx_count == 1);
+
+	/* The first fragment of another message from the same source */
+	inject(SRC(4), 0, 100, 0, 50);
+	inject(SRC(4), 1, 50, 0, 50);
+	CHECK(rx_count == 2);
+	inject(SRC(4), 0, 100, 50, 50);
+	CHECK(rx_count == 2);
+}
+
+/* A device with nowhere to reassemble does not advertise NSMP_CAP_FRAG, and
+ * a long message for it is refused rather than lost */
+static void test_refused(void) {
+	static uint8_t	 blob[BLOB];
+	nsmp_cfg_s const cfg = {.get_time_ms = clock_ms};
+
+	setup(0, 0, tx_q, sizeof(tx_q));
+	CHECK(iface.peer_caps & NSMP_CAP_FRAG);
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+	pump();
+	CHECK(!(iface.peer_caps & NSMP_CAP_FRAG));
+
+	nsmp_msg_s msg = {.hdr.dst = 0};
+	nsmp_add_data(&msg, blob, MTU + 1);
+	CHECK(nsmp_send(&msg) == NSMP_ERR_BAD_LEN);
+	pump();
+	CHECK(frag_frames == 0);
+	CHECK(rx_count == 0);
+}
+
+/* A loopback interface reassembling into frag_buf, or through frag_cb */
+static void setup(uint8_t stream, uint8_t window, uint8_t* tx, size_t tx_len) {
+	nsmp_cfg_s const cfg = {
+			.get_time_ms = clock_ms,
+			.arq_window	 = window,
+			.frag_cb		 = stream ? frag_cb : NULL,
+			.frag_buf		 = stream ? NULL : frag_buf,
+			.frag_len		 = stream ? 0 : sizeof(frag_buf),
+			.frag_ms		 = FRAG_MS,
+	};
+
+	memset(&iface, 0, sizeof(iface));
+	iface.tx_q			 = tx;
+	iface.tx_len		 = tx_len;
+	iface.rx_q			 = rx_q;
+	iface.rx_len		 = sizeof(rx_q);
+	iface.tx_buf		 = tx_buf;
+	iface.tx_buf_len = sizeof(tx_buf);
+	iface.mtu				 = MTU;
+	iface.rx_cb			 = rx_cb;
+	iface.tx_cb			 = tx_cb;
+
+	CHECK(nsmp_peer_init() == NSMP_OK);
+	CHECK(nsmp_peer_newif(&iface) == NSMP_OK);
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+
+	filter			= NULL;
+	wire_len		= 0;
+	rx_count		= 0;
+	rx_len			= 0;
+	rx_small		= 0;
+	st_frags		= 0;
+	st_next			= 0;
+	st_bad			= 0;
+	pump();
+	frag_frames = 0;
+}
+
+/* Move what is queued for transmit through the parser until nothing is left */
+static void pump(void) {
+	for (unsigned r = 0; r < 1000; r++) {
+		CHECK(nsmp_update() == NSMP_OK);
+		if (!wire_len) {
+			return;
+		}
+		CHECK(nsmp_parse_if(&iface, wire, wire_len) >= 0);
+		wire_len = 0;
+	}
+	CHECK(0);
+}
+
+/* Send a long message, calling nsmp_send() again until all of it is queued */
+static void send_blob(const uint8_t* data, size_t len) {
+	nsmp_msg_s msg = {.hdr.dst = 0};
+	int				 rc;
+
+	nsmp_add_data(&msg, (uint8_t*)data, len);
+	while ((rc = nsmp_send(&msg)) == NSMP_ERR_NO_MEM) {
+		size_t const used = nsmp_queue_used(&iface.txq);
+		CHECK(used != 0);
+		pump();
+		if (nsmp_queue_used(&iface.txq) == used) {
+			/* Waiting on reliable delivery to repeat a lost fragment */
+			now_ms += NSMP_ARQ_RTO_MS;
+		}
+	}
+	CHECK(rc == NSMP_OK);
+	pump();
+}
+
+/* Have a fragment arrive from another device */
+static void inject(uint8_t src, uint8_t id, uint16_t total, uint16_t ofs,
+									 uint16_t len) {
+	uint8_t		 frame[NSMP_HDR_LEN + MTU + NSMP_PAYLOAD_CRC_LEN];
+	uint8_t		 enc[NSMP_FRAME_MAX(MTU)];
+	unsigned	 n	 = 0;
+	size_t const plen = NSMP_FRAG_HDR + len;
+	nsmp_hdr_s hdr = {
+			.ctl = {.data = 1, .type = NSMP_MSG_TYPE_CTL_FRAG},
+			.dst = 0,
+			.src = src,
+	};
+	nsmp_ctrl_s const ctl = {.data = 1, .type = NSMP_MSG_TYPE_USER_MESSAGE};
+
+	memcpy(&frame[NSMP_HDR_LEN], &ctl, sizeof(ctl));
+	frame[NSMP_HDR_LEN + 1] = id;
+	frame[NSMP_HDR_LEN + 2] = (uint8_t)total;
+	frame[NSMP_HDR_LEN + 3] = (uint8_t)(total >> 8);
+	frame[NSMP_HDR_LEN + 4] = (uint8_t)ofs;
+	frame[NSMP_HDR_LEN + 5] = (uint8_t)(ofs >> 8);
+	fill(&frame[NSMP_HDR_LEN + NSMP_FRAG_HDR], len, (uint8_t)ofs);
+	nsmp_frame_hdr(frame, &hdr, (uint16_t)plen);
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+	uint32_t const crc = nsmp_crc_payload(&frame[NSMP_HDR_LEN], plen);
+	for (size_t i = 0; i < NSMP_PAYLOAD_CRC_LEN; i++) {
+		frame[NSMP_HDR_LEN + plen + i] = (uint8_t)(crc >> (8 * i));
+	}
+#endif
+	CHECK(cobs_encode(frame, (unsigned)(NSMP_HDR_LEN + plen + NSMP_PAYLOAD_CRC_LEN),
+										enc, sizeof(enc), &n) == COBS_RET_SUCCESS);
+	if (enc[n - 1] != 0) {
+		enc[n++] = 0;
+	}
+	CHECK(nsmp_parse_if(&iface, enc, n) >= 0);
+	pump();
+}
+
+static void fill(uint8_t* buf, size_t len, uint8_t seed) {
+	for (size_t i = 0; i < len; i++) {
+		buf[i] = (uint8_t)(seed + (i * 7) + (i >> 8));
+	}
+}
+
+/* Drop the first transmission of the 10th fragment of each message */
+static int lose_one(const uint8_t* frame, size_t len) {
+	size_t const seq = nsmp_frame_seq_ofs(frame);
+	nsmp_ctrl_s	 outer;
+	nsmp_ctrl_s	 ctl;
+
+	/* Reliable delivery sets the retry bit of the outer control byte */
+	memcpy(&outer, &frame[NSMP_OFS_CTL], sizeof(outer));
+	memcpy(&ctl, &frame[seq ? NSMP_OFS_SEQ_CTL : NSMP_OFS_CTL], sizeof(ctl));
+	if ((ctl.type != NSMP_MSG_TYPE_CTL_FRAG) || outer.retry ||
+			(len < NSMP_HDR_LEN + seq + NSMP_FRAG_HDR)) {
+		return 1;
+	}
+	uint8_t const* const f = &frame[NSMP_HDR_LEN + seq];
+	return (f[4] | (f[5] << 8)) != 10 * (MTU - NSMP_FRAG_HDR);
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	CHECK(msg->hdr.ctl.type == NSMP_MSG_TYPE_USER_MESSAGE);
+	if (msg->len > MTU) {
+		memcpy(rx_data, msg->data, msg->len);
+		rx_len = msg->len;
+	} else if (!rx_len) {
+		rx_small++;
+	}
+	rx_count++;
+	return NSMP_OK;
+}
+
+static void frag_cb(const nsmp_msg_s* msg, uint16_t ofs, uint16_t total) {
+	st_bad |= (msg->hdr.ctl.type != NSMP_MSG_TYPE_USER_MESSAGE);
+	st_bad |= (ofs != st_next) || (total != BLOB) || (ofs + msg->len > total);
+	if (!st_bad) {
+		memcpy(&st_data[ofs], msg->data, msg->len);
+		st_next += msg->len;
+	}
+	st_frags++;
+}
+
+/* Keep the encoded batch for the parser, counting fragments and dropping
+ * those the filter does not let through */
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	static uint8_t enc[WIRE_LEN];
+	size_t				 enc_len = 0;
+	uint8_t				 dec[NSMP_FRAME_MAX(MTU)];
+	size_t				 dec_len;
+	size_t				 end = 0;
+
+	(void)i;
+	wire_put(enc, &enc_len, sizeof(enc), iov, iovcnt);
+	for (size_t start = 0;
+			 (dec_len = wire_frame(enc, enc_len, &end, dec, sizeof(dec))) != 0;
+			 start = end) {
+		size_t const n = end - start;
+		nsmp_ctrl_s	 ctl;
+
+		size_t const seq = nsmp_frame_seq_ofs(dec);
+		memcpy(&ctl, &dec[seq ? NSMP_OFS_SEQ_CTL : NSMP_OFS_CTL], sizeof(ctl));
+		frag_frames += (ctl.type == NSMP_MSG_TYPE_CTL_FRAG);
+
+		if (!filter || filter(dec, dec_len)) {
+			CHECK(wire_len + n <= sizeof(wire));
+			memcpy(&wire[wire_len], &enc[start], n);
+			wire_len += n;
+		}
+	}
+	CHECK(end == enc_len);
+	return (int)enc_len;
+}
@@ -0,0 +1,215 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "nsmp_private.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			 (32)
+#define DEPTH		 (8)
+#define WIRE_LEN (4096)
+#define FRAMES	 (64)
+#define URGENT	 (0xEE)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int	setup(size_t tx_len, size_t urgent_len);
+static void test_urgent(void);
+static void test_control(void);
+static void test_single(void);
+static void test_bad_len(void);
+static void test_stale_flags(void);
+static int	queue(uint8_t t, uint8_t flags);
+static void sent(void);
+static int	rx_cb(nsmp_msg_s* msg);
+static int	tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[NSMP_QUEUE_LEN(DEPTH, MTU) + NSMP_URGENT_LEN(MTU)]
+		__attribute__((aligned(4)));
+static uint8_t rx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t tx_buf[NSMP_TX_BUF_LEN(MTU)];
+
+static nsmp_iface_s iface;
+
+/* Bytes the interface transmitted */
+static uint8_t wire[WIRE_LEN];
+static size_t	 wire_len;
+
+/* Type and first payload byte of each frame transmitted, see sent() */
+static uint8_t type[FRAMES];
+static uint8_t tag[FRAMES];
+static size_t	 frames;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_urgent();
+	test_control();
+	test_single();
+	test_bad_len();
+	test_stale_flags();
+	printf("test_lanes: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A peer whose link does not answer, with its capabilities request sent */
+static int setup(size_t tx_len, size_t urgent_len) {
+	memset(&iface, 0, sizeof(iface));
+	iface.tx_q					= tx_q;
+	iface.tx_len				= tx_len;
+	iface.tx_urgent_len = urgent_len;
+	iface.rx_q					= rx_q;
+	iface.rx_len				= sizeof(rx_q);
+	iface.tx_buf				= tx_buf;
+	iface.tx_buf_len		= sizeof(tx_buf);
+	iface.mtu						= MTU;
+	iface.rx_cb					= rx_cb;
+	iface.tx_cb					= tx_cb;
+
+	CHECK(nsmp_peer_init() == NSMP_OK);
+	int const status = nsmp_peer_newif(&iface);
+	if (status == NSMP_OK) {
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+	wire_len = 0;
+	return status;
+}
+
+/* An urgent message overtakes those queued before it */
+static void test_urgent(void) {
+	CHECK(setup(sizeof(tx_q), 0) == NSMP_OK);
+	CHECK(iface.txu.size != 0);
+	for (uint8_t i = 0; i < 4; i++) {
+		CHECK(queue(i, 0) == NSMP_OK);
+	}
+	CHECK(queue(URGENT, NSMP_MSG_URGENT) == NSMP_OK);
+	sent();
+	CHECK(frames == 5);
+	CHECK(tag[0] == URGENT);
+	for (uint8_t i = 0; i < 4; i++) {
+		CHECK(tag[i + 1] == i);
+	}
+}
+
+/* A full bulk lane does not stop control or urgent messages, which go first */
+static void test_control(void) {
+	size_t bulk = 0;
+
+	CHECK(setup(sizeof(tx_q), 0) == NSMP_OK);
+	while (queue((uint8_t)bulk, 0) == NSMP_OK) {
+		bulk++;
+	}
+	CHECK(bulk >= DEPTH);
+	CHECK(nsmp_ctl_send(&iface, NSMP_ADDR_LINK, NSMP_MSG_TYPE_CTL_DISCOVERY,
+											NSMP_MSG_REQUEST, NULL, 0) == NSMP_OK);
+	CHECK(queue(URGENT, NSMP_MSG_URGENT) == NSMP_OK);
+	sent();
+	CHECK(frames == bulk + 2);
+	CHECK(type[0] == NSMP_MSG_TYPE_CTL_DISCOVERY);
+	CHECK(tag[1] == URGENT);
+	for (size_t i = 0; i < bulk; i++) {
+		CHECK(type[i + 2] == NSMP_MSG_TYPE_USER_MESSAGE);
+		CHECK(tag[i + 2] == (uint8_t)i);
+	}
+}
+
+/* Without room for two lanes messages keep their order */
+static void test_single(void) {
+	CHECK(setup(NSMP_QUEUE_LEN(1, MTU), 0) == NSMP_OK);
+	CHECK(iface.txu.size == 0);
+	CHECK(queue(1, 0) == NSMP_OK);
+	CHECK(queue(URGENT, NSMP_MSG_URGENT) == NSMP_OK);
+	sent();
+	CHECK(frames == 2);
+	CHECK(tag[0] == 1);
+	CHECK(tag[1] == URGENT);
+}
+
+/* The bulk lane must still hold a message of mtu bytes */
+static void test_bad_len(void) {
+	CHECK(setup(sizeof(tx_q), sizeof(tx_q)) == NSMP_ERR_BAD_ARG);
+	CHECK(setup(sizeof(tx_q), sizeof(tx_q) - NSMP_QUEUE_LEN(1, MTU)) ==
+				NSMP_OK);
+}
+
+/* A message filled in field by field is not sent urgently because of what
+ * its flags held before nsmp_add_data() */
+static void test_stale_flags(void) {
+	uint8_t		 payload[MTU / 2];
+	nsmp_msg_s msg;
+
+	CHECK(setup(sizeof(tx_q), 0) == NSMP_OK);
+	CHECK(queue(0, 0) == NSMP_OK);
+
+	memset(&msg, 0, sizeof(msg.hdr));
+	memset(payload, URGENT, sizeof(payload));
+	msg.flags = NSMP_MSG_URGENT;
+	CHECK(nsmp_add_data(&msg, payload, sizeof(payload)) == NSMP_OK);
+	CHECK(msg.flags == 0);
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	sent();
+	CHECK(frames == 2);
+	CHECK((tag[0] == 0) && (tag[1] == URGENT));
+}
+
+/* Queue a message of MTU / 2 bytes filled with t */
+static int queue(uint8_t t, uint8_t flags) {
+	uint8_t		 payload[MTU / 2];
+	nsmp_msg_s msg = {.hdr.dst = 0};
+
+	memset(payload, t, sizeof(payload));
+	CHECK(nsmp_add_data(&msg, payload, sizeof(payload)) == NSMP_OK);
+	msg.flags = flags;
+	return nsmp_send(&msg);
+}
+
+/* Transmit everything queued, and split what went out into frames */
+static void sent(void) {
+	for (int r = 0; r < 100; r++) {
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+
+	frames = 0;
+	for (size_t pos = 0; pos < wire_len;) {
+		const uint8_t* z = memchr(&wire[pos], 0, wire_len - pos);
+		uint8_t				 dec[NSMP_HDR_LEN + MTU + NSMP_PAYLOAD_CRC_LEN];
+		unsigned			 n = 0;
+
+		CHECK(z && (frames < FRAMES));
+		size_t const len = (size_t)(z - &wire[pos]) + 1;
+		CHECK(cobs_decode(&wire[pos], (unsigned)len, dec, sizeof(dec), &n) ==
+					COBS_RET_SUCCESS);
+		CHECK(n >= NSMP_HDR_LEN);
+		type[frames] = nsmp_frame_type(dec);
+		tag[frames]	 = (n > NSMP_HDR_LEN + NSMP_PAYLOAD_CRC_LEN) ? dec[NSMP_HDR_LEN]
+																														 : 0;
+		frames++;
+		pos += len;
+	}
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	(void)msg;
+	return NSMP_OK;
+}
+
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	(void)i;
+	return wire_put(wire, &wire_len, sizeof(wire), iov, iovcnt);
+}
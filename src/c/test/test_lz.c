@@ -0,0 +1,387 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			 (1024)
+#define DEPTH		 (8)
+#define WIRE_LEN (32 * 1024)
+#define BLOCK		 (64 * 1024)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void		test_codec(void);
+static void		test_format(void);
+static void		test_malformed(void);
+static void		test_link(void);
+static void		test_no_cap(void);
+static void		test_arq(void);
+static void		test_rcv(void);
+static void		setup(uint8_t lz, uint8_t window, size_t rcv_len);
+static void		settle(void);
+static void		send(const uint8_t* data, size_t len, uint8_t flags);
+static size_t roundtrip(const uint8_t* data, size_t len);
+static size_t fill_text(uint8_t* buf, size_t len, unsigned seed);
+static void		fill_random(uint8_t* buf, size_t len, uint32_t seed);
+static int		rx_cb(nsmp_msg_s* msg);
+static int		tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t rx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t rcv_q[NSMP_QUEUE_LEN(1, MTU)] __attribute__((aligned(4)));
+static uint8_t tx_buf[NSMP_TX_BUF_LEN(MTU)];
+static uint8_t lz_buf[NSMP_LZ_BUF_LEN(MTU)] __attribute__((aligned(4)));
+
+static nsmp_iface_s iface;
+
+static uint8_t wire[WIRE_LEN];
+static size_t	 wire_len;
+
+/* The last frame seen by tx_cb, decoded */
+static uint8_t last_type;
+static uint8_t last_inner;
+static size_t	 last_len;
+
+/* The last message seen by rx_cb */
+static uint8_t	rx_data[MTU];
+static size_t		rx_len;
+static uint32_t rx_count;
+
+static uint16_t table[NSMP_LZ_TABLE_LEN / sizeof(uint16_t)];
+static uint8_t	src[BLOCK];
+static uint8_t	enc[BLOCK + BLOCK / 128];
+static uint8_t	dec[BLOCK];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_codec();
+	test_format();
+	test_malformed();
+	test_link();
+	test_no_cap();
+	test_arq();
+	test_rcv();
+	printf("test_lz: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Whatever goes in comes out, repetitive data shrinks and random data does
+ * not grow past the space given */
+static void test_codec(void) {
+	static const size_t lens[] = {0, 1, 4, 12, 13, 17, 100, 1000, BLOCK};
+
+	for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		size_t const len = lens[i];
+
+		memset(src, 0, len);
+		CHECK(roundtrip(src, len) <= len + 1);
+		fill_text(src, len, (unsigned)i);
+		roundtrip(src, len);
+		fill_random(src, len, (uint32_t)i + 1);
+		roundtrip(src, len);
+	}
+
+	/* Runs, text and overlapping matches compress well */
+	memset(src, 'x', 4096);
+	CHECK(roundtrip(src, 4096) < 64);
+	CHECK(roundtrip(src, fill_text(src, 4096, 7)) < 4096 / 2);
+	for (size_t i = 0; i < 4096; i++) {
+		src[i] = (uint8_t)"abc"[i % 3];
+	}
+	CHECK(roundtrip(src, 4096) < 64);
+
+	/* Nothing is written past max */
+	fill_text(src, 4096, 3);
+	size_t const n = nsmp_lz_compress(src, 4096, enc, sizeof(enc), table);
+	CHECK(n);
+	memset(enc, 0xAA, sizeof(enc));
+	CHECK(nsmp_lz_compress(src, 4096, enc, n - 1, table) == 0);
+	CHECK(enc[n - 1] == 0xAA);
+	fill_random(src, 4096, 9);
+	CHECK(nsmp_lz_compress(src, 4096, enc, 4096, table) == 0);
+}
+
+/* Blocks follow the LZ4 block format */
+static void test_format(void) {
+	/* "abc", then 15 bytes from 3 back, then "abcab" */
+	static const uint8_t block[] = {0x3B, 'a', 'b', 'c', 3,	 0,
+																	0x50, 'a', 'b', 'c', 'a', 'b'};
+	static const char		 text[]	 = "abcabcabcabcabcabcabcab";
+
+	CHECK(nsmp_lz_decompress(block, sizeof(block), dec, sizeof(dec)) ==
+				sizeof(text) - 1);
+	CHECK(memcmp(dec, text, sizeof(text) - 1) == 0);
+	CHECK(nsmp_lz_decompress(block, sizeof(block), dec, sizeof(text) - 2) == 0);
+
+	/* A long literal run takes extra length bytes */
+	fill_random(src, 300, 5);
+	size_t const n = nsmp_lz_compress(src, 300, enc, sizeof(enc), table);
+	CHECK(n == 1 + 2 + 300);
+	CHECK(enc[0] == 0xF0);
+	CHECK(enc[1] == 0xFF);
+	CHECK(enc[2] == 300 - 15 - 255);
+}
+
+/* Broken blocks are rejected without reading or writing out of bounds */
+static void test_malformed(void) {
+	/* Offset 0, offset before the start, truncated offset and length */
+	static const uint8_t zero[]	 = {0x10, 'a', 0, 0, 0x00};
+	static const uint8_t back[]	 = {0x10, 'a', 2, 0, 0x00};
+	static const uint8_t trunc[] = {0x10, 'a', 1};
+	static const uint8_t more[]	 = {0xF0, 0xFF, 0xFF};
+
+	CHECK(nsmp_lz_decompress(zero, sizeof(zero), dec, sizeof(dec)) == 0);
+	CHECK(nsmp_lz_decompress(back, sizeof(back), dec, sizeof(dec)) == 0);
+	CHECK(nsmp_lz_decompress(trunc, sizeof(trunc), dec, sizeof(dec)) == 0);
+	CHECK(nsmp_lz_decompress(more, sizeof(more), dec, sizeof(dec)) == 0);
+
+	/* Every truncation of a valid block, and random damage */
+	size_t const len = fill_text(src, 2048, 11);
+	size_t const n	 = nsmp_lz_compress(src, len, enc, sizeof(enc), table);
+	CHECK(n >= 256);
+	for (size_t i = 0; i < n; i++) {
+		size_t const out = nsmp_lz_decompress(enc, i, dec, len);
+		CHECK((out == 0) || (out < len));
+	}
+	uint32_t r = 1;
+	for (unsigned i = 0; i < 2000; i++) {
+		uint8_t bad[256];
+
+		memcpy(bad, enc, sizeof(bad));
+		for (unsigned k = 0; k < 4; k++) {
+			r = r * 1103515245u + 12345u;
+			bad[(r >> 8) % sizeof(bad)] = (uint8_t)(r >> 20);
+		}
+		CHECK(nsmp_lz_decompress(bad, sizeof(bad), dec, 300) <= 300);
+	}
+}
+
+/* Large messages go out compressed when asked to, and arrive as they were
+ * sent */
+static void test_link(void) {
+	uint8_t msg[MTU];
+
+	setup(1, 0, 0);
+	CHECK(iface.peer_caps & NSMP_CAP_LZ);
+
+	size_t const len = fill_text(msg, 600, 1);
+	send(msg, len, NSMP_MSG_COMPRESS);
+	CHECK(last_type == NSMP_MSG_TYPE_CTL_LZ);
+	CHECK(last_len < NSMP_HDR_LEN + len / 2);
+	CHECK(rx_count == 1);
+	CHECK((rx_len == len) && (memcmp(rx_data, msg, len) == 0));
+
+	/* Not asked to, too short or not compressible */
+	send(msg, len, 0);
+	CHECK(last_type == NSMP_MSG_TYPE_USER_MESSAGE);
+	send(msg, NSMP_LZ_MIN - 1, NSMP_MSG_COMPRESS);
+	CHECK(last_type == NSMP_MSG_TYPE_USER_MESSAGE);
+	fill_random(msg, 600, 2);
+	send(msg, 600, NSMP_MSG_COMPRESS);
+	CHECK(last_type == NSMP_MSG_TYPE_USER_MESSAGE);
+	CHECK((rx_len == 600) && (memcmp(rx_data, msg, 600) == 0));
+	CHECK(rx_count == 4);
+}
+
+/* Without lz_buf the capability is not advertised, nothing is compressed */
+static void test_no_cap(void) {
+	nsmp_cfg_s cfg = {.lz_buf = lz_buf + 2, .lz_len = sizeof(lz_buf) - 2};
+	uint8_t		 msg[MTU];
+
+	CHECK(nsmp_config(&cfg) == NSMP_ERR_BAD_ARG);
+	cfg.lz_buf = lz_buf;
+	cfg.lz_len = NSMP_LZ_BUF_LEN(NSMP_LZ_MIN) - 1;
+	CHECK(nsmp_config(&cfg) == NSMP_ERR_BAD_ARG);
+
+	setup(0, 0, 0);
+	CHECK(!(iface.peer_caps & NSMP_CAP_LZ));
+	size_t const len = fill_text(msg, 600, 3);
+	send(msg, len, NSMP_MSG_COMPRESS);
+	CHECK(last_type == NSMP_MSG_TYPE_USER_MESSAGE);
+	CHECK((rx_len == len) && (memcmp(rx_data, msg, len) == 0));
+}
+
+/* A compressed message is sequenced like any other */
+static void test_arq(void) {
+	uint8_t msg[MTU];
+
+	setup(1, 8, 0);
+	CHECK(iface.peer_caps & NSMP_CAP_ARQ);
+	for (unsigned i = 0; i < 20; i++) {
+		size_t const len = fill_text(msg, 200 + 30 * i, i);
+		send(msg, len, NSMP_MSG_COMPRESS);
+		CHECK(last_type == NSMP_MSG_TYPE_CTL_SEQ);
+		CHECK(last_inner == NSMP_MSG_TYPE_CTL_LZ);
+		CHECK((rx_len == len) && (memcmp(rx_data, msg, len) == 0));
+	}
+	CHECK(rx_count == 20);
+	CHECK(nsmp_queue_used(&iface.txq) == 0);
+}
+
+/* Queued for nsmp_rcv() expanded, waiting for room for the expanded length */
+static void test_rcv(void) {
+	uint8_t		 msg[MTU];
+	uint8_t		 out[MTU];
+	nsmp_msg_s rcv = {0};
+
+	setup(1, 0, NSMP_QUEUE_SIZE(1, sizeof(nsmp_hdr_s) + 900));
+	size_t const len = fill_text(msg, 900, 4);
+	for (unsigned i = 0; i < 3; i++) {
+		send(msg, len, NSMP_MSG_COMPRESS);
+		CHECK(last_type == NSMP_MSG_TYPE_CTL_LZ);
+	}
+	for (unsigned i = 0; i < 3; i++) {
+		CHECK((i == 2) || (nsmp_queue_used(&iface.rxq) != 0));
+		nsmp_add_data(&rcv, out, sizeof(out));
+		CHECK(nsmp_rcv(&rcv) == NSMP_OK);
+		CHECK(rcv.hdr.ctl.type == NSMP_MSG_TYPE_USER_MESSAGE);
+		CHECK((rcv.len == len) && (memcmp(out, msg, len) == 0));
+		settle();
+	}
+	CHECK(nsmp_rcv(&rcv) == NSMP_ERR_AGAIN);
+	CHECK(iface.cr.drops == 0);
+}
+
+/* A loopback interface, with or without lz_buf, reliable delivery and rcv_q */
+static void setup(uint8_t lz, uint8_t window, size_t rcv_len) {
+	nsmp_cfg_s const cfg = {
+			.get_time_ms = clock_ms,
+			.arq_window	 = window,
+			.arq_rto_ms	 = 50,
+			.rcv_q			 = rcv_len ? rcv_q : NULL,
+			.rcv_len		 = rcv_len,
+			.lz_buf			 = lz ? lz_buf : NULL,
+			.lz_len			 = lz ? sizeof(lz_buf) : 0,
+	};
+
+	memset(&iface, 0, sizeof(iface));
+	iface.tx_q			 = tx_q;
+	iface.tx_len		 = sizeof(tx_q);
+	iface.rx_q			 = rx_q;
+	iface.rx_len		 = sizeof(rx_q);
+	iface.tx_buf		 = tx_buf;
+	iface.tx_buf_len = sizeof(tx_buf);
+	iface.mtu				 = MTU;
+	iface.rx_cb			 = rcv_len ? NULL : rx_cb;
+	iface.tx_cb			 = tx_cb;
+
+	CHECK(nsmp_peer_init() == NSMP_OK);
+	CHECK(nsmp_peer_newif(&iface) == NSMP_OK);
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+
+	wire_len = 0;
+	rx_count = 0;
+	rx_len	 = 0;
+	settle();
+}
+
+/* Move what is queued for transmit through the parser until nothing is left */
+static void settle(void) {
+	for (unsigned r = 0; r < 100; r++) {
+		CHECK(nsmp_update() == NSMP_OK);
+		if (!wire_len) {
+			return;
+		}
+		CHECK(nsmp_parse_if(&iface, wire, wire_len) >= 0);
+		wire_len = 0;
+	}
+	CHECK(0);
+}
+
+static void send(const uint8_t* data, size_t len, uint8_t flags) {
+	nsmp_msg_s msg = {.hdr.dst = 0};
+
+	nsmp_add_data(&msg, (uint8_t*)data, len);
+	msg.flags = flags;
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	settle();
+}
+
+/* Compress and expand a block, returns its compressed length */
+static size_t roundtrip(const uint8_t* data, size_t len) {
+	size_t const n = nsmp_lz_compress(data, len, enc, sizeof(enc), table);
+
+	CHECK(n);
+	CHECK(nsmp_lz_decompress(enc, n, dec, len) == len);
+	CHECK(memcmp(dec, data, len) == 0);
+	return n;
+}
+
+/* Log lines like a device would send, returns the length written */
+static size_t fill_text(uint8_t* buf, size_t len, unsigned seed) {
+	size_t pos = 0;
+
+	for (unsigned i = 0; pos < len; i++) {
+		char			line[64];
+		int const n = snprintf(line, sizeof(line),
+													 "t=%06u node=%02u temp=%d.%u state=%s\n",
+													 seed * 1000 + i * 17, (seed + i) % 8, 20 + (i % 5),
+													 (i * 7) % 10, (i % 9) ? "ok" : "warn");
+		size_t const take = ((size_t)n < len - pos) ? (size_t)n : len - pos;
+		memcpy(&buf[pos], line, take);
+		pos += take;
+	}
+	return pos;
+}
+
+static void fill_random(uint8_t* buf, size_t len, uint32_t seed) {
+	for (size_t i = 0; i < len; i++) {
+		seed		= seed * 1664525u + 1013904223u;
+		buf[i] = (uint8_t)(seed >> 24);
+	}
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	CHECK(msg->hdr.ctl.type == NSMP_MSG_TYPE_USER_MESSAGE);
+	CHECK(msg->len <= sizeof(rx_data));
+	memcpy(rx_data, msg->data, msg->len);
+	rx_len = msg->len;
+	rx_count++;
+	return NSMP_OK;
+}
+
+/* Keep the encoded batch for the parser, noting the type of its last message
+ * frame */
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	uint8_t frame[NSMP_FRAME_MAX(MTU)];
+	size_t	pos = wire_len;
+	size_t	len;
+
+	(void)i;
+	int const total = wire_put(wire, &wire_len, sizeof(wire), iov, iovcnt);
+	while ((len = wire_frame(wire, wire_len, &pos, frame, sizeof(frame))) != 0) {
+		nsmp_ctrl_s ctl;
+
+		memcpy(&ctl, frame, sizeof(ctl));
+		if ((ctl.type == NSMP_MSG_TYPE_CTL_CAPS) ||
+				(ctl.type == NSMP_MSG_TYPE_CTL_ACK) ||
+				(ctl.type == NSMP_MSG_TYPE_CTL_SLOWDOWN)) {
+			continue;
+		}
+		last_type = ctl.type;
+		last_len	= len;
+		if (ctl.type == NSMP_MSG_TYPE_CTL_SEQ) {
+			memcpy(&ctl, &frame[NSMP_HDR_LEN + 1], sizeof(ctl));
+		}
+		last_inner = ctl.type;
+	}
+	return total;
+}
@@ -0,0 +1,377 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nsmp.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU		 (256)
+#define DEPTH	 (8)
+#define WIRE_LEN (16 * 1024)
+
+/* rx_len for messages built by send_seq() */
+#define RX_SEQ (SIZE_MAX)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void setup(uint16_t bundle_len);
+static void test_roundtrip(void);
+static void test_split(void);
+static void test_reserve(void);
+static void test_corrupt(void);
+static void test_bundle(void);
+static void test_bundle_deadline(void);
+static void pump(size_t chunk);
+static void fill(uint8_t* p, size_t len, uint32_t seed);
+static void send_seq(uint8_t seq);
+static int	rx_cb(nsmp_msg_s* msg);
+static int	tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t rx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t tx_buf[NSMP_TX_BUF_LEN(MTU)];
+
+static nsmp_iface_s iface;
+
+/* Encoded bytes written by tx_cb, waiting to be parsed */
+static uint8_t wire[WIRE_LEN];
+static size_t	 wire_len;
+static uint32_t wire_frames;
+
+/* Messages seen by rx_cb */
+static uint32_t rx_count;
+static uint32_t rx_seed;
+static size_t		rx_len;
+static int			rx_bad;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_roundtrip();
+	test_split();
+	test_reserve();
+	test_corrupt();
+	test_bundle();
+	test_bundle_deadline();
+	printf("test_nsmp: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void setup(uint16_t bundle_len) {
+	memset(&iface, 0, sizeof(iface));
+	iface.tx_q			 = tx_q;
+	iface.tx_len		 = sizeof(tx_q);
+	iface.rx_q			 = rx_q;
+	iface.rx_len		 = sizeof(rx_q);
+	iface.tx_buf		 = tx_buf;
+	iface.tx_buf_len = sizeof(tx_buf);
+	iface.mtu				 = MTU;
+	iface.rx_cb			 = rx_cb;
+	iface.tx_cb			 = tx_cb;
+	iface.bundle_len = bundle_len;
+
+	CHECK(nsmp_peer_init() == NSMP_OK);
+	CHECK(nsmp_peer_newif(&iface) == NSMP_OK);
+	wire_len		= 0;
+	wire_frames = 0;
+	rx_count = 0;
+	rx_bad	 = 0;
+}
+
+/* Every payload length up to the mtu makes it through unchanged */
+static void test_roundtrip(void) {
+	uint8_t payload[MTU];
+
+	setup(0);
+	for (size_t len = 0; len <= MTU; len++) {
+		nsmp_msg_s msg = {.hdr.dst = 0};
+		fill(payload, len, (uint32_t)len);
+		CHECK(nsmp_add_data(&msg, payload, len) == NSMP_OK);
+		CHECK(nsmp_send(&msg) == NSMP_OK);
+
+		rx_seed = (uint32_t)len;
+		rx_len	= len;
+		pump(WIRE_LEN);
+		CHECK(rx_count == len + 1);
+	}
+	CHECK(!rx_bad);
+
+	/* Larger than the mtu is refused at the sender, as the other end has
+	 * nowhere to reassemble it (see test_frag) */
+	nsmp_msg_s msg = {.hdr.dst = 0};
+	uint8_t		 big[MTU + 1] = {0};
+	CHECK(nsmp_add_data(&msg, big, sizeof(big)) == NSMP_OK);
+	CHECK(nsmp_send(&msg) == NSMP_ERR_BAD_LEN);
+	pump(WIRE_LEN);
+	CHECK(rx_count == MTU + 1);
+}
+
+/* Frames survive being fed to the parser in arbitrary pieces */
+static void test_split(void) {
+	static const size_t chunks[] = {1, 2, 3, 7, 64, 255, 1000};
+	uint8_t							payload[MTU];
+
+	setup(0);
+	for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+		uint32_t const before = rx_count;
+		for (int i = 0; i < DEPTH; i++) {
+			nsmp_msg_s msg = {.hdr.dst = 0};
+			fill(payload, 100, 7);
+			nsmp_add_data(&msg, payload, 100);
+			CHECK(nsmp_send(&msg) == NSMP_OK);
+		}
+		rx_seed = 7;
+		rx_len	= 100;
+		pump(chunks[c]);
+		CHECK(rx_count == before + DEPTH);
+	}
+	CHECK(!rx_bad);
+}
+
+static void test_reserve(void) {
+	setup(0);
+
+	/* Only one reservation at a time, and it cannot grow on commit */
+	uint8_t* p = nsmp_send_reserve(0, NSMP_MSG_TYPE_USER_MESSAGE, 32);
+	CHECK(p != NULL);
+	CHECK(nsmp_send_reserve(0, NSMP_MSG_TYPE_USER_MESSAGE, 1) == NULL);
+	CHECK(nsmp_send_commit(33) == NSMP_ERR_BAD_ARG);
+
+	fill(p, 20, 3);
+	CHECK(nsmp_send_commit(20) == NSMP_OK);
+	CHECK(nsmp_send_commit(20) == NSMP_ERR_BAD_ARG);
+
+	/* An aborted message is never sent */
+	CHECK(nsmp_send_reserve(0, NSMP_MSG_TYPE_USER_MESSAGE, 8) != NULL);
+	nsmp_send_abort();
+
+	rx_seed = 3;
+	rx_len	= 20;
+	pump(WIRE_LEN);
+	CHECK(rx_count == 1);
+	CHECK(!rx_bad);
+}
+
+/* Damaged frames are dropped without losing the frames around them */
+static void test_corrupt(void) {
+	uint8_t payload[64];
+
+	setup(0);
+	fill(payload, sizeof(payload), 9);
+	rx_seed = 9;
+	rx_len	= sizeof(payload);
+
+	for (size_t bit = 0; bit < 8 * 16; bit++) {
+		for (int i = 0; i < 3; i++) {
+			nsmp_msg_s msg = {.hdr.dst = 0};
+			nsmp_add_data(&msg, payload, sizeof(payload));
+			CHECK(nsmp_send(&msg) == NSMP_OK);
+		}
+		CHECK(nsmp_update() == NSMP_OK);
+
+		/* Flip one bit in the header of the middle frame, the three messages
+		 * being the last frames on the wire - flow control may go first. */
+		size_t end = wire_len - 1;
+		for (int i = 0; i < 2; i++) {
+			do {
+				CHECK(end > 0);
+			} while (wire[--end] != 0);
+		}
+		uint8_t* mid = &wire[end];
+		mid[1 + (bit / 8)] ^= (uint8_t)(1u << (bit % 8));
+
+		uint32_t const before = rx_count;
+		nsmp_parse_if(&iface, wire, wire_len);
+		wire_len = 0;
+		CHECK(nsmp_update() == NSMP_OK);
+
+		/* Without a payload CRC a damaged payload may still be delivered */
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+		CHECK(rx_count == before + 2);
+		CHECK(!rx_bad);
+#else
+		CHECK((rx_count == before + 2) || (rx_count == before + 3));
+		rx_bad = 0;
+#endif
+	}
+
+	/* Line noise up to a delimiter, then a good frame */
+	static const uint8_t noise[] = {0x13, 0x37, 0xFF, 0x01, 0x02, 0x00, 0x05, 0x00};
+	CHECK(nsmp_parse_if(&iface, noise, sizeof(noise)) == 0);
+	nsmp_msg_s msg = {.hdr.dst = 0};
+	nsmp_add_data(&msg, payload, sizeof(payload));
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	uint32_t const before = rx_count;
+	pump(WIRE_LEN);
+	CHECK(rx_count == before + 1);
+	CHECK(!rx_bad);
+}
+
+/* Small messages are packed into one frame once the other end agrees */
+static void test_bundle(void) {
+	/* An older device never answers the capability request */
+	setup(MTU);
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(wire_frames == 1);
+	wire_len		= 0;
+	wire_frames = 0;
+	for (int i = 0; i < 5; i++) {
+		send_seq((uint8_t)i);
+	}
+	rx_len = RX_SEQ;
+	pump(WIRE_LEN);
+	CHECK(wire_frames == 5);
+	CHECK(rx_count == 5);
+	CHECK(!rx_bad);
+	CHECK(iface.peer_caps == 0);
+
+	/* Capabilities are exchanged over the loopback */
+	setup(MTU);
+	pump(WIRE_LEN);
+	CHECK(iface.peer_caps & NSMP_CAP_BUNDLE);
+	CHECK(iface.peer_mtu == MTU);
+	CHECK(rx_count == 0);
+
+	/* 40 messages of 1-12 bytes take 324 bytes bundled, two frames */
+	wire_frames = 0;
+	for (int i = 0; i < 40; i++) {
+		send_seq((uint8_t)i);
+	}
+	pump(WIRE_LEN);
+	CHECK(rx_count == 40);
+	CHECK(wire_frames == 2);
+
+	/* A bundle of one is a plain frame */
+	wire_frames = 0;
+	send_seq(40);
+	pump(WIRE_LEN);
+	CHECK(rx_count == 41);
+	CHECK(wire_frames == 1);
+
+	/* Order is kept when bundled and reserved messages are mixed */
+	send_seq(41);
+	send_seq(42);
+	uint8_t* p = nsmp_send_reserve(0, NSMP_MSG_TYPE_USER_MESSAGE, 16);
+	CHECK(p != NULL);
+	p[0] = 43;
+	fill(&p[1], 43 % 12, 43);
+	CHECK(nsmp_send_commit(1 + (43 % 12)) == NSMP_OK);
+	send_seq(44);
+	send_seq(45);
+	pump(WIRE_LEN);
+	CHECK(rx_count == 46);
+	CHECK(!rx_bad);
+}
+
+/* An open bundle waits for its deadline, or until it is full */
+static void test_bundle_deadline(void) {
+	nsmp_cfg_s const cfg = {.get_time_ms = clock_ms};
+
+	setup(MTU);
+	iface.bundle_ms = 10;
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+	pump(WIRE_LEN);
+	CHECK(iface.peer_caps & NSMP_CAP_BUNDLE);
+
+	rx_len = RX_SEQ;
+	send_seq(0);
+	send_seq(1);
+	pump(WIRE_LEN);
+	CHECK(rx_count == 0);
+
+	now_ms += 9;
+	pump(WIRE_LEN);
+	CHECK(rx_count == 0);
+
+	now_ms += 1;
+	pump(WIRE_LEN);
+	CHECK(rx_count == 2);
+
+	/* Full bundles go out straight away */
+	for (int i = 2; i < 40; i++) {
+		send_seq((uint8_t)i);
+	}
+	pump(WIRE_LEN);
+	CHECK(rx_count > 2);
+	CHECK(rx_count < 40);
+	now_ms += 10;
+	pump(WIRE_LEN);
+	CHECK(rx_count == 40);
+	CHECK(!rx_bad);
+}
+
+/* Move everything queued for transmit through the wire and the parser */
+static void pump(size_t chunk) {
+	CHECK(nsmp_update() == NSMP_OK);
+	for (size_t i = 0; i < wire_len; i += chunk) {
+		size_t const n = (wire_len - i < chunk) ? wire_len - i : chunk;
+		CHECK(nsmp_parse_if(&iface, &wire[i], n) >= 0);
+	}
+	wire_len = 0;
+	CHECK(nsmp_update() == NSMP_OK);
+}
+
+static void fill(uint8_t* p, size_t len, uint32_t seed) {
+	for (size_t i = 0; i < len; i++) {
+		p[i] = (uint8_t)((i * 31u) + seed);
+	}
+}
+
+/* Send a message of 1 to 12 bytes that rx_cb can check on its own */
+static void send_seq(uint8_t seq) {
+	uint8_t		 payload[16];
+	nsmp_msg_s msg = {.hdr.dst = 0};
+	size_t const len = 1 + (seq % 12);
+
+	payload[0] = seq;
+	fill(&payload[1], len - 1, seq);
+	nsmp_add_data(&msg, payload, len);
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	uint8_t expect[MTU];
+
+	if (rx_len == RX_SEQ) {
+		uint8_t const seq = (uint8_t)rx_count;
+		fill(expect, seq % 12, seq);
+		if ((msg->len != 1 + (seq % 12)) || (msg->data[0] != seq) ||
+				memcmp(&msg->data[1], expect, seq % 12)) {
+			rx_bad = 1;
+		}
+		rx_count++;
+		return NSMP_OK;
+	}
+
+	fill(expect, rx_len, rx_seed);
+	if ((msg->len != rx_len) || memcmp(msg->data, expect, rx_len) ||
+			(msg->hdr.ctl.data != (rx_len != 0))) {
+		rx_bad = 1;
+	}
+	rx_count++;
+	return NSMP_OK;
+}
+
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	(void)i;
+	for (size_t n = 0; n < iovcnt; n++) {
+		for (size_t k = 0; k < iov[n].len; k++) {
+			wire_frames += (iov[n].base[k] == 0);
+		}
+	}
+	return wire_put(wire, &wire_len, sizeof(wire), iov, iovcnt);
+}
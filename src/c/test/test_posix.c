@@ -0,0 +1,306 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nsmp.h"
+#include "nsmp_posix.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			 (128)
+#define DEPTH		 (64)
+#define MSGS		 (2000)
+#define ECHO_LEN (64 * 1024)
+#define ROUNDS	 (100000)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef enum {
+	LINK_SOCKETPAIR,
+	LINK_UNIX,
+	LINK_PTY,
+	LINK_SERIAL,
+} link_e;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void setup(link_e kind);
+static void test_echo(link_e kind, const char* name);
+static void test_down(void);
+static void test_chunks(void);
+static int	open_raw(const char* path);
+static void echo(void);
+static int	rx_cb(nsmp_msg_s* msg);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[NSMP_QUEUE_LEN(DEPTH, MTU) + NSMP_URGENT_LEN(MTU)]
+		__attribute__((aligned(4)));
+static uint8_t rx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t tx_buf[4 * NSMP_TX_BUF_LEN(MTU)];
+
+static nsmp_posix_s			 px;
+static nsmp_posix_link_s plink;
+
+/* The other end of the link, which sends everything straight back */
+static int		 far = -1;
+static uint8_t echo_buf[ECHO_LEN];
+static size_t	 echo_len;
+
+static uint32_t rx_count;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_echo(LINK_SOCKETPAIR, "socketpair");
+	test_echo(LINK_UNIX, "unix");
+	test_echo(LINK_PTY, "pty");
+	test_echo(LINK_SERIAL, "serial");
+	test_down();
+	test_chunks();
+	printf("test_posix: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A peer whose link loops back through the echo, capabilities exchanged */
+static void setup(link_e kind) {
+	nsmp_cfg_s cfg = {.get_time_ms = mono_ms};
+	char			 name[64];
+	int				 fd[2];
+
+	memset(&plink, 0, sizeof(plink));
+	plink.iface.tx_q			 = tx_q;
+	plink.iface.tx_len		 = sizeof(tx_q);
+	plink.iface.rx_q			 = rx_q;
+	plink.iface.rx_len		 = sizeof(rx_q);
+	plink.iface.tx_buf		 = tx_buf;
+	plink.iface.tx_buf_len = sizeof(tx_buf);
+	plink.iface.mtu				 = MTU;
+	plink.iface.rx_cb			 = rx_cb;
+
+	CHECK(nsmp_peer_init() == NSMP_OK);
+	CHECK(nsmp_posix_init(&px, &cfg) == NSMP_OK);
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+
+	switch (kind) {
+		case LINK_SOCKETPAIR: {
+			/* Small buffers, so writes are cut short and wait for epoll */
+			int const len = 4096;
+			CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == 0);
+			CHECK(setsockopt(fd[0], SOL_SOCKET, SO_SNDBUF, &len, sizeof(len)) == 0);
+			CHECK(setsockopt(fd[1], SOL_SOCKET, SO_RCVBUF, &len, sizeof(len)) == 0);
+			CHECK(nsmp_posix_fd(&px, &plink, fd[0]) == NSMP_OK);
+			far = fd[1];
+			break;
+		}
+
+		case LINK_UNIX: {
+			struct sockaddr_un addr = {.sun_family = AF_UNIX};
+			int const					 srv	= socket(AF_UNIX, SOCK_STREAM, 0);
+			snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/test_posix.%d",
+							 (int)getpid());
+			unlink(addr.sun_path);
+			CHECK(srv >= 0);
+			CHECK(bind(srv, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+			CHECK(listen(srv, 1) == 0);
+			CHECK(nsmp_posix_unix(&px, &plink, addr.sun_path) == NSMP_OK);
+			far = accept(srv, NULL, NULL);
+			CHECK(far >= 0);
+			close(srv);
+			unlink(addr.sun_path);
+			break;
+		}
+
+		case LINK_PTY:
+			CHECK(nsmp_posix_pty(&px, &plink, name, sizeof(name)) == NSMP_OK);
+			far = open_raw(name);
+			break;
+
+		case LINK_SERIAL: {
+			/* A pseudo-terminal stands in for the serial port */
+			int const m = posix_openpt(O_RDWR | O_NOCTTY);
+			CHECK((m >= 0) && !grantpt(m) && !unlockpt(m));
+			CHECK(ptsname_r(m, name, sizeof(name)) == 0);
+			CHECK(nsmp_posix_serial(&px, &plink, name, 1234) == NSMP_ERR_BAD_ARG);
+			CHECK(nsmp_posix_serial(&px, &plink, name, 115200) == NSMP_OK);
+			far = m;
+			break;
+		}
+	}
+	CHECK(fcntl(far, F_SETFL, fcntl(far, F_GETFL) | O_NONBLOCK) == 0);
+	CHECK(plink.iface.tx_async);
+	CHECK(nsmp_peer_newif(&plink.iface) == NSMP_OK);
+
+	echo_len = 0;
+	rx_count = 0;
+	for (int r = 0; (r < ROUNDS) && !(plink.iface.peer_caps & NSMP_CAP_CREDIT);
+			 r++) {
+		CHECK(nsmp_posix_poll(&px, 1) == NSMP_OK);
+		echo();
+	}
+	CHECK(plink.iface.peer_caps & NSMP_CAP_CREDIT);
+}
+
+/* Far more than the queues hold goes round the link in order, none lost */
+static void test_echo(link_e kind, const char* name) {
+	uint8_t	 payload[MTU];
+	uint32_t sent	 = 0;
+	int			 waits = 0;
+
+	setup(kind);
+	for (int r = 0; (r < ROUNDS) && (rx_count < MSGS); r++) {
+		while (sent < MSGS) {
+			nsmp_msg_s msg = {.hdr.dst = 0};
+			memset(payload, (uint8_t)sent, sizeof(payload));
+			memcpy(payload, &sent, sizeof(sent));
+			nsmp_add_data(&msg, payload, sizeof(payload));
+			if (nsmp_send(&msg) != NSMP_OK) {
+				break;
+			}
+			sent++;
+		}
+		CHECK(nsmp_posix_poll(&px, 1) == NSMP_OK);
+		waits += plink.out;
+
+		/* Over the socketpair the far end is slow to read, so the link fills */
+		if ((kind != LINK_SOCKETPAIR) || !(r % 16)) {
+			echo();
+		}
+	}
+	CHECK(rx_count == MSGS);
+	CHECK(!plink.down);
+	CHECK(plink.iface.cr.drops == 0);
+	if (kind == LINK_SOCKETPAIR) {
+		CHECK(waits > 0);
+	}
+
+	nsmp_posix_close(&px);
+	close(far);
+	printf("test_posix: %s ok\n", name);
+}
+
+/* A link closed at the other end is taken out of the loop */
+static void test_down(void) {
+	uint8_t payload[MTU] = {0};
+
+	setup(LINK_SOCKETPAIR);
+	close(far);
+	for (int r = 0; (r < 100) && !plink.down; r++) {
+		CHECK(nsmp_posix_poll(&px, 1) == NSMP_OK);
+	}
+	CHECK(plink.down);
+
+	for (int n = 0; n < 4 * DEPTH; n++) {
+		nsmp_msg_s msg = {.hdr.dst = 0};
+		nsmp_add_data(&msg, payload, sizeof(payload));
+		nsmp_send(&msg);
+		CHECK(nsmp_posix_poll(&px, 0) == NSMP_OK);
+	}
+	for (int r = 0; r < 10; r++) {
+		CHECK(nsmp_posix_poll(&px, 0) == NSMP_OK);
+	}
+
+	/* Nothing goes out without credit, which does not keep the loop busy */
+	uint32_t const t0 = mono_ms();
+	CHECK(nsmp_posix_poll(&px, 20) == NSMP_OK);
+	CHECK(mono_ms() - t0 >= 10);
+	nsmp_posix_close(&px);
+}
+
+/* Every chunk handed to tx_cb is written in order, those that do not fit
+ * are taken when offered again, and the batch is done after its last one */
+static void test_chunks(void) {
+	nsmp_iovec_s iov[NSMP_POSIX_IOV + 2];
+	uint8_t			 data[NSMP_POSIX_IOV + 2][3];
+	uint8_t			 got[256];
+	size_t			 len = 0;
+
+	setup(LINK_SOCKETPAIR);
+	CHECK(!plink.npend);
+	for (size_t k = 0; k < NSMP_POSIX_IOV + 2; k++) {
+		memset(data[k], 0xa0 + (int)k, sizeof(data[k]));
+		iov[k].base = data[k];
+		iov[k].len	= sizeof(data[k]);
+	}
+
+	int const n = plink.iface.tx_cb(&plink.iface, iov, NSMP_POSIX_IOV + 2);
+	CHECK(n == NSMP_POSIX_IOV * 3);
+	CHECK(!plink.npend && !plink.done);
+	CHECK(plink.iface.tx_cb(&plink.iface, &iov[NSMP_POSIX_IOV], 2) == 6);
+	CHECK(!plink.npend && (plink.done == 1));
+	plink.done = 0;
+
+	for (int r = 0; (r < 100) && (len < sizeof(data)); r++) {
+		ssize_t const m = read(far, &got[len], sizeof(got) - len);
+		if (m > 0) {
+			len += (size_t)m;
+		}
+	}
+	CHECK(memmem(got, len, data, sizeof(data)));
+
+	nsmp_posix_close(&px);
+	close(far);
+}
+
+/* The slave of a pseudo-terminal, in raw mode */
+static int open_raw(const char* path) {
+	struct termios tio;
+	int const			 fd = open(path, O_RDWR | O_NOCTTY);
+
+	CHECK(fd >= 0);
+	CHECK(tcgetattr(fd, &tio) == 0);
+	cfmakeraw(&tio);
+	CHECK(tcsetattr(fd, TCSANOW, &tio) == 0);
+	return fd;
+}
+
+/* Send back what arrived at the far end, as much as it takes */
+static void echo(void) {
+	ssize_t const n = read(far, &echo_buf[echo_len], sizeof(echo_buf) - echo_len);
+	if (n > 0) {
+		echo_len += (size_t)n;
+	} else {
+		CHECK((n < 0) && (errno == EAGAIN));
+	}
+
+	if (echo_len) {
+		ssize_t const w = write(far, echo_buf, echo_len);
+		if (w > 0) {
+			memmove(echo_buf, &echo_buf[w], echo_len - (size_t)w);
+			echo_len -= (size_t)w;
+		} else {
+			CHECK((w < 0) && (errno == EAGAIN));
+		}
+	}
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	uint32_t n;
+
+	CHECK(msg->len == MTU);
+	memcpy(&n, msg->data, sizeof(n));
+	CHECK(n == rx_count);
+	CHECK(msg->data[MTU - 1] == (uint8_t)n);
+	rx_count++;
+	return NSMP_OK;
+}
@@ -0,0 +1,199 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nsmp_queue.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define STRESS_RECORDS (2000000)
+#define MAX_REC				 (300)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void		test_basic(void);
+static void		test_capacity(void);
+static void		test_walk(void);
+static void		test_stress(void);
+static void*	producer(void* arg);
+static void*	consumer(void* arg);
+static size_t rec_len(uint32_t seq);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t			buf[NSMP_QUEUE_SIZE(16, MAX_REC)] __attribute__((aligned(4)));
+static nsmp_queue_s q;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_basic();
+	test_capacity();
+	test_walk();
+	test_stress();
+	printf("test_queue: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_basic(void) {
+	size_t len;
+
+	CHECK(nsmp_queue_init(&q, buf, 4) != 0);
+	CHECK(nsmp_queue_init(&q, buf, sizeof(buf)) == 0);
+	CHECK(nsmp_queue_peek(&q, &len) == NULL);
+
+	uint8_t* p = nsmp_queue_reserve(&q, 10);
+	CHECK(p != NULL);
+	memcpy(p, "abcdefghij", 10);
+	CHECK(nsmp_queue_peek(&q, &len) == NULL); /* Not visible until committed */
+	nsmp_queue_commit(&q, 5);
+
+	p = nsmp_queue_peek(&q, &len);
+	CHECK(p && (len == 5) && !memcmp(p, "abcde", 5));
+	nsmp_queue_release(&q);
+	CHECK(nsmp_queue_peek(&q, &len) == NULL);
+	CHECK(nsmp_queue_used(&q) == 0);
+
+	/* Oversized records never fit */
+	CHECK(nsmp_queue_reserve(&q, sizeof(buf)) == NULL);
+}
+
+/* A queue sized for 16 large records holds them all, and many more small ones */
+static void test_capacity(void) {
+	size_t	 len;
+	unsigned n;
+
+	for (unsigned round = 0; round < 3; round++) {
+		CHECK(nsmp_queue_init(&q, buf, sizeof(buf)) == 0);
+
+		/* Offset the ring so the large records wrap at different points */
+		for (unsigned i = 0; i < round * 7; i++) {
+			CHECK(nsmp_queue_reserve(&q, 13));
+			nsmp_queue_commit(&q, 13);
+			CHECK(nsmp_queue_peek(&q, &len));
+			nsmp_queue_release(&q);
+		}
+
+		for (n = 0; n < 16; n++) {
+			uint8_t* p = nsmp_queue_reserve(&q, MAX_REC);
+			CHECK(p != NULL);
+			memset(p, (int)n, MAX_REC);
+			nsmp_queue_commit(&q, MAX_REC);
+		}
+		for (n = 0; n < 16; n++) {
+			uint8_t* p = nsmp_queue_peek(&q, &len);
+			CHECK(p && (len == MAX_REC) && (p[0] == n) && (p[MAX_REC - 1] == n));
+			nsmp_queue_release(&q);
+		}
+	}
+
+	CHECK(nsmp_queue_init(&q, buf, sizeof(buf)) == 0);
+	for (n = 0; nsmp_queue_reserve(&q, 8); n++) {
+		nsmp_queue_commit(&q, 8);
+	}
+	CHECK(n > (16 * 20));
+}
+
+/* Records can be read in place and tagged, then released in order later */
+static void test_walk(void) {
+	size_t	 len;
+	uint32_t pos;
+	uint8_t* p;
+
+	CHECK(nsmp_queue_init(&q, buf, sizeof(buf)) == 0);
+	for (unsigned round = 0; round < 40; round++) {
+		for (uint8_t n = 0; n < 5; n++) {
+			p = nsmp_queue_reserve(&q, MAX_REC);
+			CHECK(p != NULL);
+			p[0] = n;
+			nsmp_queue_commit(&q, 1 + (n * 60));
+		}
+
+		/* Tag every other record on the first walk */
+		uint8_t n = 0;
+		pos				= nsmp_queue_head(&q);
+		while ((p = nsmp_queue_at(&q, &pos, &len)) != NULL) {
+			CHECK((p[0] == n) && (len == 1u + (n * 60u)));
+			CHECK(nsmp_queue_tag(p) == 0);
+			nsmp_queue_set_tag(p, (uint8_t)(n & 1));
+			pos = nsmp_queue_next(&q, pos);
+			n++;
+		}
+		CHECK(n == 5);
+
+		/* Tags stay with their records */
+		for (n = 0; (p = nsmp_queue_peek(&q, &len)) != NULL; n++) {
+			CHECK((p[0] == n) && (nsmp_queue_tag(p) == (n & 1)));
+			nsmp_queue_release(&q);
+		}
+		CHECK(n == 5);
+	}
+}
+
+static void test_stress(void) {
+	pthread_t prod, cons;
+
+	CHECK(nsmp_queue_init(&q, buf, sizeof(buf)) == 0);
+	CHECK(pthread_create(&cons, NULL, consumer, NULL) == 0);
+	CHECK(pthread_create(&prod, NULL, producer, NULL) == 0);
+	pthread_join(prod, NULL);
+	pthread_join(cons, NULL);
+	CHECK(nsmp_queue_used(&q) == 0);
+}
+
+static void* producer(void* arg) {
+	(void)arg;
+	for (uint32_t seq = 0; seq < STRESS_RECORDS; seq++) {
+		size_t const len = rec_len(seq);
+		uint8_t*		 p;
+
+		while ((p = nsmp_queue_reserve(&q, len)) == NULL) {
+			sched_yield();
+		}
+		memcpy(p, &seq, sizeof(seq));
+		for (size_t i = sizeof(seq); i < len; i++) {
+			p[i] = (uint8_t)(seq + i);
+		}
+		nsmp_queue_commit(&q, len);
+	}
+	return NULL;
+}
+
+static void* consumer(void* arg) {
+	(void)arg;
+	for (uint32_t seq = 0; seq < STRESS_RECORDS; seq++) {
+		size_t	 len;
+		uint8_t* p;
+		uint32_t got;
+
+		while ((p = nsmp_queue_peek(&q, &len)) == NULL) {
+			sched_yield();
+		}
+		memcpy(&got, p, sizeof(got));
+		CHECK(got == seq);
+		CHECK(len == rec_len(seq));
+		for (size_t i = sizeof(seq); i < len; i++) {
+			CHECK(p[i] == (uint8_t)(seq + i));
+		}
+		nsmp_queue_release(&q);
+	}
+	return NULL;
+}
+
+/* Mostly small records with the occasional maximum-size one */
+static size_t rec_len(uint32_t seq) {
+	uint32_t h = seq * 2654435761u;
+	return ((h >> 28) == 0) ? MAX_REC : (sizeof(uint32_t) + ((h >> 8) % 64));
+}
@@ -0,0 +1,350 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "nsmp_private.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			 (256)
+#define DEPTH		 (8)
+#define IFACES	 (3)
+#define WIRE_LEN (16 * 1024)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void		setup(uint8_t store_forward);
+static void		test_relay(uint8_t store_forward);
+static void		test_split(void);
+static void		test_truncated(void);
+static void		test_blocked(uint8_t store_forward);
+static void		test_sequenced(uint8_t store_forward);
+static void		test_peers(void);
+static size_t build(uint8_t* out, nsmp_msg_type_e type, uint8_t dst,
+										uint8_t src, size_t len, uint8_t seed);
+static size_t build_seq(uint8_t* out, uint8_t src, uint8_t seq, uint8_t retry);
+static size_t encode(uint8_t* out, uint8_t* frame, size_t len);
+static void		feed(int i, const uint8_t* data, size_t len, size_t chunk);
+static int		rx_cb(nsmp_msg_s* msg);
+static int		tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[IFACES][NSMP_QUEUE_LEN(DEPTH, MTU)]
+		__attribute__((aligned(4)));
+static uint8_t rx_q[IFACES][NSMP_QUEUE_LEN(DEPTH, MTU)]
+		__attribute__((aligned(4)));
+static uint8_t tx_buf[IFACES][NSMP_TX_BUF_LEN(MTU)];
+
+static nsmp_iface_s iface[IFACES];
+
+/* Bytes each interface transmitted, and whether its transport takes any */
+static uint8_t wire[IFACES][WIRE_LEN];
+static size_t	 wire_len[IFACES];
+static int		 stalled[IFACES];
+
+/* Messages delivered to the node itself */
+static uint32_t rx_count;
+
+/* The peer that is reached over interface 1 */
+static uint8_t const peer = NSMP_ADDR(0, 1, 3);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_relay(0);
+	test_relay(1);
+	test_split();
+	test_truncated();
+	test_blocked(0);
+	test_blocked(1);
+	test_sequenced(0);
+	test_sequenced(1);
+	test_peers();
+	printf("test_relay: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A node with a peer behind interface 1, whose links do not answer */
+static void setup(uint8_t store_forward) {
+	nsmp_cfg_s const cfg = {.store_forward = store_forward};
+	uint8_t					 enc[NSMP_FRAME_MAX(MTU)];
+
+	CHECK(nsmp_node_init() == NSMP_OK);
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+	for (int i = 0; i < IFACES; i++) {
+		memset(&iface[i], 0, sizeof(iface[i]));
+		iface[i].tx_q				= tx_q[i];
+		iface[i].tx_len			= sizeof(tx_q[i]);
+		iface[i].rx_q				= rx_q[i];
+		iface[i].rx_len			= sizeof(rx_q[i]);
+		iface[i].tx_buf			= tx_buf[i];
+		iface[i].tx_buf_len = sizeof(tx_buf[i]);
+		iface[i].mtu				= MTU;
+		iface[i].rx_cb			= rx_cb;
+		iface[i].tx_cb			= tx_cb;
+		CHECK(nsmp_node_newif(&iface[i]) == NSMP_OK);
+		stalled[i] = 0;
+	}
+
+	feed(1, enc,
+			 build(enc, NSMP_MSG_TYPE_CTL_DISCOVERY, nsmp_addr(), peer, 0, 0), 0);
+	CHECK(nsmp_route(peer) == &iface[1]);
+	memset(wire_len, 0, sizeof(wire_len));
+	rx_count = 0;
+}
+
+/* A frame for the peer leaves on its interface exactly as it arrived, one
+ * for the node is delivered */
+static void test_relay(uint8_t store_forward) {
+	uint8_t enc[NSMP_FRAME_MAX(MTU)];
+
+	setup(store_forward);
+	for (size_t len = 0; len <= MTU; len += 37) {
+		size_t const n = build(enc, NSMP_MSG_TYPE_USER_MESSAGE, peer,
+													 NSMP_ADDR(0, 0, 1), len, (uint8_t)len);
+		feed(0, enc, n, 0);
+		CHECK(wire_len[1] == n);
+		CHECK(!memcmp(wire[1], enc, n));
+		CHECK(wire_len[0] == 0);
+		CHECK(wire_len[2] == 0);
+		CHECK(rx_count == 0);
+		wire_len[1] = 0;
+	}
+	CHECK(nsmp_queue_used(&iface[0].rxq) == 0);
+
+	feed(2, enc,
+			 build(enc, NSMP_MSG_TYPE_USER_MESSAGE, nsmp_addr(), peer, 10, 1), 0);
+	CHECK(rx_count == 1);
+	CHECK(wire_len[0] + wire_len[1] + wire_len[2] == 0);
+}
+
+/* A relayed frame may arrive a byte at a time */
+static void test_split(void) {
+	uint8_t enc[NSMP_FRAME_MAX(MTU)];
+
+	setup(0);
+	size_t const n = build(enc, NSMP_MSG_TYPE_USER_MESSAGE, peer,
+												 NSMP_ADDR(0, 0, 1), 200, 7);
+	feed(2, enc, n, 1);
+	CHECK(wire_len[1] == n);
+	CHECK(!memcmp(wire[1], enc, n));
+}
+
+/* A frame cut short is not relayed, and the next one still is */
+static void test_truncated(void) {
+	uint8_t enc[NSMP_FRAME_MAX(MTU)];
+
+	setup(0);
+	size_t n = build(enc, NSMP_MSG_TYPE_USER_MESSAGE, peer, NSMP_ADDR(0, 0, 1),
+									 100, 3);
+	enc[n / 2] = 0;
+	feed(0, enc, (n / 2) + 1, 0);
+	CHECK(wire_len[1] == 0);
+
+	n = build(enc, NSMP_MSG_TYPE_USER_MESSAGE, peer, NSMP_ADDR(0, 0, 1), 100, 4);
+	feed(0, enc, n, 0);
+	CHECK(wire_len[1] == n);
+	CHECK(!memcmp(wire[1], enc, n));
+}
+
+/* Frames wait in rx_q while the next link is busy, and leave in order */
+static void test_blocked(uint8_t store_forward) {
+	uint8_t all[WIRE_LEN];
+	size_t	all_len = 0;
+
+	setup(store_forward);
+	stalled[1] = 1;
+	for (unsigned i = 0; i < DEPTH; i++) {
+		size_t const len = (i * 61) % MTU;
+		size_t const n =
+				build(&all[all_len], NSMP_MSG_TYPE_USER_MESSAGE, peer,
+							NSMP_ADDR(0, 0, 1), len, (uint8_t)i);
+		feed(0, &all[all_len], n, 0);
+		all_len += n;
+	}
+	for (int r = 0; r < 4; r++) {
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+	CHECK(wire_len[1] == 0);
+
+	stalled[1] = 0;
+	for (int r = 0; (r < 100) && (wire_len[1] < all_len); r++) {
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+	CHECK(wire_len[1] == all_len);
+	CHECK(!memcmp(wire[1], all, all_len));
+	CHECK(nsmp_queue_used(&iface[0].rxq) == 0);
+}
+
+/* Sequenced frames between two other devices are done with once relayed -
+ * only the sender keeps them until they are acknowledged */
+static void test_sequenced(uint8_t store_forward) {
+	uint8_t enc[NSMP_FRAME_MAX(MTU)];
+	size_t	frames = 0;
+
+	setup(store_forward);
+	for (unsigned i = 0; i < 5 * DEPTH; i++) {
+		size_t const n = build(enc, NSMP_MSG_TYPE_CTL_SEQ, peer,
+													 NSMP_ADDR(0, 0, 1), 102, (uint8_t)i);
+		feed(0, enc, n, 0);
+	}
+	for (size_t k = 0; k < wire_len[1]; k++) {
+		frames += (wire[1][k] == 0);
+	}
+	CHECK(frames == 5 * DEPTH);
+	CHECK(nsmp_queue_used(&iface[1].txq) == 0);
+	CHECK(nsmp_queue_used(&iface[0].rxq) == 0);
+}
+
+/* Sequenced messages from more peers than there are slots for are dropped,
+ * to be repeated, until a slot is given up */
+static void test_peers(void) {
+	uint8_t enc[NSMP_FRAME_MAX(MTU)];
+	uint8_t src[NSMP_ARQ_PEERS + 2];
+	size_t	acked;
+
+	setup(0);
+	for (size_t k = 0; k < sizeof(src); k++) {
+		src[k] = NSMP_ADDR(0, 0, k + 1);
+		feed(0, enc,
+				 build(enc, NSMP_MSG_TYPE_CTL_DISCOVERY, nsmp_addr(), src[k], 0, 0),
+				 0);
+	}
+	rx_count = 0;
+	for (size_t k = 0; k < NSMP_ARQ_PEERS; k++) {
+		feed(0, enc, build_seq(enc, src[k], 0, 0), 0);
+	}
+	CHECK(rx_count == NSMP_ARQ_PEERS);
+
+	/* Neither delivered nor acknowledged */
+	wire_len[0] = 0;
+	feed(0, enc, build_seq(enc, src[NSMP_ARQ_PEERS], 0, 0), 0);
+	CHECK(rx_count == NSMP_ARQ_PEERS);
+	CHECK(wire_len[0] == 0);
+
+	/* A peer that unregisters gives its slot up at once */
+	feed(0, enc,
+			 build(enc, NSMP_MSG_TYPE_CTL_UNREGISTER, nsmp_addr(), src[1], 0, 0),
+			 0);
+	rx_count = 0;
+	feed(0, enc, build_seq(enc, src[NSMP_ARQ_PEERS], 0, 1), 0);
+	CHECK(rx_count == 1);
+	CHECK(wire_len[0] != 0);
+	acked = wire_len[0];
+	feed(0, enc, build_seq(enc, src[NSMP_ARQ_PEERS], 0, 1), 0);
+	CHECK(rx_count == 1);
+
+	/* Quiet ones give theirs up after a while, the least recently used first */
+	feed(0, enc, build_seq(enc, src[NSMP_ARQ_PEERS + 1], 0, 0), 0);
+	CHECK(rx_count == 1);
+	for (unsigned i = 0; i < NSMP_ARQ_IDLE_MS; i++) {
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+	feed(0, enc, build_seq(enc, src[NSMP_ARQ_PEERS + 1], 0, 1), 0);
+	CHECK(rx_count == 2);
+	CHECK(wire_len[0] > acked);
+
+	/* src[0] lost its slot, and takes up from wherever it has got to */
+	feed(0, enc, build_seq(enc, src[0], 40, 0), 0);
+	feed(0, enc, build_seq(enc, src[0], 41, 0), 0);
+	CHECK(rx_count == 4);
+	feed(0, enc, build_seq(enc, src[0], 41, 1), 0);
+	CHECK(rx_count == 4);
+}
+
+/* Encode a frame carrying len bytes of a pattern, returns its length */
+static size_t build(uint8_t* out, nsmp_msg_type_e type, uint8_t dst,
+										uint8_t src, size_t len, uint8_t seed) {
+	uint8_t		 frame[NSMP_HDR_LEN + MTU + NSMP_PAYLOAD_CRC_LEN];
+	nsmp_hdr_s hdr = {
+			.ctl = {.data = (len != 0), .type = type},
+			.dst = dst,
+			.src = src,
+	};
+
+	for (size_t i = 0; i < len; i++) {
+		frame[NSMP_HDR_LEN + i] = (uint8_t)(seed + (i * 7));
+	}
+	nsmp_frame_hdr(frame, &hdr, (uint16_t)len);
+	return encode(out, frame, len);
+}
+
+/* Encode a sequenced message for the node, returns its length */
+static size_t build_seq(uint8_t* out, uint8_t src, uint8_t seq, uint8_t retry) {
+	uint8_t						frame[NSMP_HDR_LEN + MTU + NSMP_PAYLOAD_CRC_LEN];
+	nsmp_ctrl_s const ctl = {.data = 1, .type = NSMP_MSG_TYPE_USER_MESSAGE};
+	nsmp_hdr_s const	hdr = {
+			 .ctl = {.data = 1, .retry = retry, .type = NSMP_MSG_TYPE_CTL_SEQ},
+			 .dst = nsmp_addr(),
+			 .src = src,
+	 };
+
+	frame[NSMP_OFS_SEQ] = seq;
+	memcpy(&frame[NSMP_OFS_SEQ_CTL], &ctl, sizeof(ctl));
+	memset(&frame[NSMP_HDR_LEN + NSMP_SEQ_LEN], seq, 4);
+	nsmp_frame_hdr(frame, &hdr, NSMP_SEQ_LEN + 4);
+	return encode(out, frame, NSMP_SEQ_LEN + 4);
+}
+
+/* COBS encode a frame with a payload of len bytes, adding its CRC */
+static size_t encode(uint8_t* out, uint8_t* frame, size_t len) {
+	unsigned n = 0;
+
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+	uint32_t const crc = nsmp_crc_payload(&frame[NSMP_HDR_LEN], len);
+	for (size_t i = 0; i < NSMP_PAYLOAD_CRC_LEN; i++) {
+		frame[NSMP_HDR_LEN + len + i] = (uint8_t)(crc >> (8 * i));
+	}
+#endif
+	CHECK(cobs_encode(frame, (unsigned)(NSMP_HDR_LEN + len + NSMP_PAYLOAD_CRC_LEN),
+										out, NSMP_FRAME_MAX(MTU), &n) == COBS_RET_SUCCESS);
+	if (out[n - 1] != 0) {
+		out[n++] = 0;
+	}
+	return n;
+}
+
+/* Receive bytes on interface i, chunk at a time (0 for all at once) */
+static void feed(int i, const uint8_t* data, size_t len, size_t chunk) {
+	if (!chunk) {
+		chunk = len;
+	}
+	for (size_t pos = 0; pos < len; pos += chunk) {
+		size_t const n = ((len - pos) < chunk) ? (len - pos) : chunk;
+		CHECK(nsmp_parse_if(&iface[i], &data[pos], n) >= 0);
+	}
+
+	/* A frame relayed to an interface served before this one leaves on the
+	 * next update */
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	(void)msg;
+	rx_count++;
+	return NSMP_OK;
+}
+
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	size_t const n = (size_t)(i - iface);
+
+	if (stalled[n]) {
+		return 0;
+	}
+	return wire_put(wire[n], &wire_len[n], WIRE_LEN, iov, iovcnt);
+}
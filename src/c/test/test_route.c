@@ -0,0 +1,255 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "nsmp_private.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU		 (64)
+#define DEPTH	 (8)
+#define IFACES (3)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void setup(void);
+static void test_learn(void);
+static void test_metric(void);
+static void test_unregister(void);
+static void test_full(void);
+static void test_add_twice(void);
+static void inject(int i, nsmp_msg_type_e type, uint8_t reqres, uint8_t src);
+static int	sent_on(uint8_t dst);
+static int	reaches(uint8_t addr);
+static int	tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[IFACES][NSMP_QUEUE_LEN(DEPTH, MTU)]
+		__attribute__((aligned(4)));
+static uint8_t rx_q[IFACES][NSMP_QUEUE_LEN(DEPTH, MTU)]
+		__attribute__((aligned(4)));
+static uint8_t tx_buf[IFACES][NSMP_TX_BUF_LEN(MTU)];
+
+static nsmp_iface_s iface[IFACES];
+
+/* Bytes each interface transmitted */
+static size_t tx_bytes[IFACES];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_learn();
+	test_metric();
+	test_unregister();
+	test_full();
+	test_add_twice();
+	printf("test_route: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A node with one link per interface, and nothing learnt yet */
+static void setup(void) {
+	CHECK(nsmp_node_init() == NSMP_OK);
+	for (int i = 0; i < IFACES; i++) {
+		memset(&iface[i], 0, sizeof(iface[i]));
+		iface[i].tx_q				= tx_q[i];
+		iface[i].tx_len			= sizeof(tx_q[i]);
+		iface[i].rx_q				= rx_q[i];
+		iface[i].rx_len			= sizeof(rx_q[i]);
+		iface[i].tx_buf			= tx_buf[i];
+		iface[i].tx_buf_len = sizeof(tx_buf[i]);
+		iface[i].mtu				= MTU;
+		iface[i].tx_cb			= tx_cb;
+		CHECK(nsmp_node_newif(&iface[i]) == NSMP_OK);
+	}
+
+	/* Capabilities requests go out on every link first */
+	CHECK(nsmp_update() == NSMP_OK);
+	memset(tx_bytes, 0, sizeof(tx_bytes));
+}
+
+/* Discovery and registration traffic adds routes over the link it came from */
+static void test_learn(void) {
+	uint8_t const a = NSMP_ADDR(0, 0, 5);
+	uint8_t const b = NSMP_ADDR(0, 0, 6);
+
+	setup();
+
+	/* Without a route everything goes to the first interface */
+	CHECK(nsmp_route_hops(a) == 0);
+	CHECK(sent_on(a) == 0);
+
+	inject(2, NSMP_MSG_TYPE_CTL_DISCOVERY, NSMP_MSG_RESPONSE, a);
+	inject(1, NSMP_MSG_TYPE_CTL_REGISTER, NSMP_MSG_REQUEST, b);
+	CHECK(nsmp_route_hops(a) == 1);
+	CHECK(nsmp_route_hops(b) == 1);
+	CHECK(sent_on(a) == 2);
+	CHECK(sent_on(b) == 1);
+	CHECK(reaches(a) == (1 << 2));
+	CHECK(reaches(b) == (1 << 1));
+
+	/* Link messages are never routed */
+	inject(1, NSMP_MSG_TYPE_CTL_DISCOVERY, NSMP_MSG_REQUEST, NSMP_ADDR_LINK);
+	CHECK(nsmp_route_hops(NSMP_ADDR_LINK) == 0);
+}
+
+/* A route only moves to another link when that one is shorter, and peers of
+ * other nodes are reached through their broker */
+static void test_metric(void) {
+	uint8_t const a			 = NSMP_ADDR(0, 0, 5);
+	uint8_t const broker = NSMP_ADDR(1, 2, 0);
+	uint8_t const remote = NSMP_ADDR(0, 2, 17);
+
+	setup();
+	inject(2, NSMP_MSG_TYPE_CTL_DISCOVERY, NSMP_MSG_RESPONSE, a);
+	inject(1, NSMP_MSG_TYPE_CTL_DISCOVERY, NSMP_MSG_RESPONSE, a);
+	CHECK(sent_on(a) == 2);
+	CHECK(reaches(a) == (1 << 2));
+
+	inject(1, NSMP_MSG_TYPE_CTL_DISCOVERY, NSMP_MSG_REQUEST, broker);
+	CHECK(nsmp_route_hops(broker) == 1);
+	CHECK(nsmp_route_hops(remote) == 2);
+	CHECK(sent_on(remote) == 1);
+	CHECK(reaches(remote) == 0);
+
+	/* A direct route to the remote peer wins over the one through its broker */
+	inject(2, NSMP_MSG_TYPE_CTL_REGISTER, NSMP_MSG_RESPONSE, remote);
+	CHECK(nsmp_route_hops(remote) == 1);
+	CHECK(sent_on(remote) == 2);
+}
+
+/* A device that leaves is forgotten, but only over the link it was routed */
+static void test_unregister(void) {
+	uint8_t const a = NSMP_ADDR(0, 1, 9);
+
+	setup();
+	inject(2, NSMP_MSG_TYPE_CTL_DISCOVERY, NSMP_MSG_RESPONSE, a);
+	inject(1, NSMP_MSG_TYPE_CTL_UNREGISTER, NSMP_MSG_REQUEST, a);
+	CHECK(nsmp_route_hops(a) == 1);
+	CHECK(reaches(a) == (1 << 2));
+
+	inject(2, NSMP_MSG_TYPE_CTL_UNREGISTER, NSMP_MSG_REQUEST, a);
+	CHECK(nsmp_route_hops(a) == 0);
+	CHECK(reaches(a) == 0);
+	CHECK(sent_on(a) == 0);
+
+	/* And comes back over another link */
+	inject(1, NSMP_MSG_TYPE_CTL_REGISTER, NSMP_MSG_REQUEST, a);
+	CHECK(sent_on(a) == 1);
+	CHECK(reaches(a) == (1 << 1));
+}
+
+/* Every peer of every node has a route of its own */
+static void test_full(void) {
+	setup();
+	for (unsigned n = 0; n < NSMP_MAX_NODES; n++) {
+		for (unsigned p = 0; p < NSMP_MAX_PEERS; p++) {
+			uint8_t const a = NSMP_ADDR(0, n, p);
+			if (a != nsmp_addr()) {
+				inject((int)((n + p) % IFACES), NSMP_MSG_TYPE_CTL_DISCOVERY,
+							 NSMP_MSG_RESPONSE, a);
+			}
+		}
+	}
+	for (unsigned n = 0; n < NSMP_MAX_NODES; n++) {
+		for (unsigned p = 0; p < NSMP_MAX_PEERS; p++) {
+			uint8_t const a = NSMP_ADDR(0, n, p);
+			if (a != nsmp_addr()) {
+				CHECK(nsmp_route_hops(a) == 1);
+				CHECK(nsmp_route(a) == &iface[(n + p) % IFACES]);
+				CHECK(reaches(a) == (1 << ((n + p) % IFACES)));
+			}
+		}
+	}
+}
+
+/* Registering an interface again is refused, and leaves its state alone */
+static void test_add_twice(void) {
+	uint8_t const a = NSMP_ADDR(0, 0, 5);
+
+	setup();
+	inject(2, NSMP_MSG_TYPE_CTL_DISCOVERY, NSMP_MSG_RESPONSE, a);
+	CHECK(reaches(a) == (1 << 2));
+
+	CHECK(nsmp_node_newif(&iface[2]) == NSMP_ERR_BAD_ARG);
+	CHECK(reaches(a) == (1 << 2));
+	CHECK(sent_on(a) == 2);
+}
+
+/* Build a frame without payload from src and receive it on interface i */
+static void inject(int i, nsmp_msg_type_e type, uint8_t reqres, uint8_t src) {
+	uint8_t		 frame[NSMP_HDR_LEN + NSMP_PAYLOAD_CRC_LEN];
+	uint8_t		 enc[COBS_ENCODE_MAX(sizeof(frame)) + 1];
+	unsigned	 len = 0;
+	nsmp_hdr_s hdr = {
+			.ctl = {.reqres = reqres, .type = type},
+			.dst = nsmp_addr(),
+			.src = src,
+	};
+
+	nsmp_frame_hdr(frame, &hdr, 0);
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+	uint32_t const crc = nsmp_crc_payload(NULL, 0);
+	for (size_t n = 0; n < NSMP_PAYLOAD_CRC_LEN; n++) {
+		frame[NSMP_HDR_LEN + n] = (uint8_t)(crc >> (8 * n));
+	}
+#endif
+	CHECK(cobs_encode(frame, sizeof(frame), enc, sizeof(enc), &len) ==
+				COBS_RET_SUCCESS);
+	if (enc[len - 1] != 0) {
+		enc[len++] = 0;
+	}
+	CHECK(nsmp_parse_if(&iface[i], enc, len) == 1);
+	CHECK(nsmp_update() == NSMP_OK);
+}
+
+/* Send a message and return the interface it went out on */
+static int sent_on(uint8_t dst) {
+	uint8_t		 data[4] = {0};
+	nsmp_msg_s msg		 = {.hdr.dst = dst, .hdr.src = nsmp_addr()};
+	int				 found	 = -1;
+
+	memset(tx_bytes, 0, sizeof(tx_bytes));
+	nsmp_add_data(&msg, data, sizeof(data));
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+	for (int i = 0; i < IFACES; i++) {
+		if (tx_bytes[i]) {
+			CHECK(found < 0);
+			found = i;
+		}
+	}
+	CHECK(found >= 0);
+	return found;
+}
+
+/* Interfaces whose reachability bitmap has an address */
+static int reaches(uint8_t addr) {
+	int mask = 0;
+
+	for (int i = 0; i < IFACES; i++) {
+		mask |= nsmp_reach(&iface[i], addr) << i;
+	}
+	return mask;
+}
+
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	size_t const total = iov_len(iov, iovcnt);
+
+	tx_bytes[i - iface] += total;
+	return (int)total;
+}
@@ -0,0 +1,204 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "nsmp_private.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			(64)
+#define DEPTH		(32)
+#define IFACES	(3)
+#define PAYLOAD (32)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void setup(const nsmp_cfg_s* cfg);
+static void test_unlimited(void);
+static void test_latency(void);
+static void test_weight(void);
+static void test_time(void);
+static void inject(int i, unsigned frames);
+static int	drain(void);
+static int	rx_cb(nsmp_msg_s* msg);
+static int	tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[IFACES][NSMP_QUEUE_LEN(DEPTH, MTU)]
+		__attribute__((aligned(4)));
+static uint8_t rx_q[IFACES][NSMP_QUEUE_LEN(DEPTH, MTU)]
+		__attribute__((aligned(4)));
+static uint8_t tx_buf[IFACES][NSMP_TX_BUF_LEN(MTU)];
+
+static nsmp_iface_s iface[IFACES];
+
+/* Messages delivered from each interface, told apart by their source */
+static uint32_t rx_count[IFACES];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_unlimited();
+	test_latency();
+	test_weight();
+	test_time();
+	printf("test_sched: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A node whose links have exchanged nothing yet */
+static void setup(const nsmp_cfg_s* cfg) {
+	CHECK(nsmp_node_init() == NSMP_OK);
+	CHECK(nsmp_config(cfg) == NSMP_OK);
+	for (int i = 0; i < IFACES; i++) {
+		memset(&iface[i], 0, sizeof(iface[i]));
+		iface[i].tx_q				= tx_q[i];
+		iface[i].tx_len			= sizeof(tx_q[i]);
+		iface[i].rx_q				= rx_q[i];
+		iface[i].rx_len			= sizeof(rx_q[i]);
+		iface[i].tx_buf			= tx_buf[i];
+		iface[i].tx_buf_len = sizeof(tx_buf[i]);
+		iface[i].mtu				= MTU;
+		iface[i].rx_cb			= rx_cb;
+		iface[i].tx_cb			= tx_cb;
+		CHECK(nsmp_node_newif(&iface[i]) == NSMP_OK);
+	}
+
+	/* Capabilities requests */
+	CHECK(drain() < 100);
+	memset(rx_count, 0, sizeof(rx_count));
+	now_ms = 0;
+}
+
+/* Without a budget one call does everything */
+static void test_unlimited(void) {
+	nsmp_cfg_s const cfg = {0};
+
+	setup(&cfg);
+	inject(0, DEPTH);
+	inject(2, 5);
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(rx_count[0] == DEPTH);
+	CHECK(rx_count[1] == 0);
+	CHECK(rx_count[2] == 5);
+	CHECK(nsmp_update() == NSMP_OK);
+}
+
+/* A busy interface does not hold up a quiet one, and the call reports that
+ * work is left */
+static void test_latency(void) {
+	nsmp_cfg_s const cfg = {.update_bytes = 4 * (NSMP_HDR_LEN + PAYLOAD)};
+
+	setup(&cfg);
+	inject(0, DEPTH);
+	inject(1, 1);
+	CHECK(nsmp_update() == 1);
+	CHECK(rx_count[1] == 1);
+	CHECK(rx_count[0] < DEPTH);
+
+	/* Then the next calls carry on where it stopped */
+	CHECK(drain() < DEPTH);
+	CHECK(rx_count[0] == DEPTH);
+	CHECK(nsmp_update() == NSMP_OK);
+}
+
+/* Interfaces with work left share the budget in proportion to their weight */
+static void test_weight(void) {
+	nsmp_cfg_s const cfg = {.update_bytes = 8 * (NSMP_HDR_LEN + PAYLOAD)};
+
+	setup(&cfg);
+	iface[0].weight = 3;
+	inject(0, DEPTH);
+	inject(1, DEPTH);
+	for (int r = 0; r < 4; r++) {
+		CHECK(nsmp_update() == 2);
+	}
+	CHECK(rx_count[1] > 0);
+	CHECK(rx_count[0] >= 2 * rx_count[1]);
+	CHECK(rx_count[0] <= 4 * rx_count[1]);
+
+	CHECK(drain() < 2 * DEPTH);
+	CHECK(rx_count[0] == DEPTH);
+	CHECK(rx_count[1] == DEPTH);
+}
+
+/* A time budget stops a call after update_ms */
+static void test_time(void) {
+	nsmp_cfg_s const cfg = {.get_time_ms = clock_ms, .update_ms = 3};
+
+	setup(&cfg);
+	inject(0, DEPTH);
+	CHECK(nsmp_update() == 1);
+	CHECK(rx_count[0] >= 3);
+	CHECK(rx_count[0] < DEPTH / 2);
+	CHECK(drain() < DEPTH);
+	CHECK(rx_count[0] == DEPTH);
+}
+
+/* Receive frames of PAYLOAD bytes for the node on interface i */
+static void inject(int i, unsigned frames) {
+	uint8_t		 frame[NSMP_HDR_LEN + PAYLOAD + NSMP_PAYLOAD_CRC_LEN];
+	uint8_t		 enc[COBS_ENCODE_MAX(sizeof(frame)) + 1];
+	unsigned	 len = 0;
+	nsmp_hdr_s hdr = {
+			.ctl = {.data = 1, .type = NSMP_MSG_TYPE_USER_MESSAGE},
+			.dst = nsmp_addr(),
+			.src = NSMP_ADDR(0, 1, i + 1),
+	};
+
+	memset(&frame[NSMP_HDR_LEN], 0x5A, PAYLOAD);
+	nsmp_frame_hdr(frame, &hdr, PAYLOAD);
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+	uint32_t const crc = nsmp_crc_payload(&frame[NSMP_HDR_LEN], PAYLOAD);
+	for (size_t n = 0; n < NSMP_PAYLOAD_CRC_LEN; n++) {
+		frame[NSMP_HDR_LEN + PAYLOAD + n] = (uint8_t)(crc >> (8 * n));
+	}
+#endif
+	CHECK(cobs_encode(frame, sizeof(frame), enc, sizeof(enc), &len) ==
+				COBS_RET_SUCCESS);
+	if (enc[len - 1] != 0) {
+		enc[len++] = 0;
+	}
+	for (unsigned n = 0; n < frames; n++) {
+		CHECK(nsmp_parse_if(&iface[i], enc, len) == 1);
+	}
+}
+
+/* Update until no work is left, returns the number of calls */
+static int drain(void) {
+	int calls = 1;
+
+	for (int status; (status = nsmp_update()) != NSMP_OK; calls++) {
+		CHECK(status > 0);
+		CHECK(calls < 1000);
+	}
+	return calls;
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	unsigned const i = NSMP_ADDR_PEER(msg->hdr.src) - 1;
+
+	CHECK(i < IFACES);
+	rx_count[i]++;
+	now_ms++;
+	return NSMP_OK;
+}
+
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	(void)i;
+	return (int)iov_len(iov, iovcnt);
+}
@@ -0,0 +1,471 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "nsmp_private.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			 (64)
+#define DEPTH		 (4)
+#define WIRE_LEN (16 * 1024)
+
+#define OWN_ADDR	NSMP_ADDR(0, 1, 1)
+#define NODE_ADDR NSMP_ADDR(1, 1, 0)
+#define HOST_ADDR NSMP_ADDR(0, 2, 3)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void					setup(void);
+static void					test_rx(void);
+static void					test_errors(void);
+static void					test_tx(void);
+static void					test_latency(void);
+static void					test_query(void);
+static void					test_response(void);
+static size_t				frame(uint8_t* dec, nsmp_msg_type_e type, uint8_t reqres,
+													uint8_t src, const uint8_t* data, size_t len);
+static size_t				encode(uint8_t* out, const uint8_t* dec, size_t len);
+static size_t				build(uint8_t* out, nsmp_msg_type_e type, uint8_t reqres,
+													uint8_t src, const uint8_t* data, size_t len);
+static size_t				next_frame(size_t* pos, uint8_t* dec);
+static nsmp_stats_s snap(void);
+static int					rx_cb(nsmp_msg_s* msg);
+static int tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t rx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t tx_buf[NSMP_TX_BUF_LEN(MTU)];
+
+static nsmp_iface_s iface;
+
+/* Bytes transmitted, and whether tx_cb fails */
+static uint8_t wire[WIRE_LEN];
+static size_t	 wire_len;
+static int		 tx_fail;
+
+/* Messages delivered, and the statistics responses read from them */
+static size_t				rx_count;
+static nsmp_stats_s rx_stats;
+static int					rx_read;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_rx();
+	test_errors();
+	test_tx();
+	test_latency();
+	test_query();
+	test_response();
+	printf("test_stats: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A peer with one interface, on a clock of our own */
+static void setup(void) {
+	nsmp_cfg_s const cfg = {
+			.addr				 = OWN_ADDR,
+			.get_time_ms = clock_ms,
+	};
+
+	CHECK(nsmp_init(NSMP_ROLE_PEER) == NSMP_OK);
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+	memset(&iface, 0, sizeof(iface));
+	iface.tx_q			 = tx_q;
+	iface.tx_len		 = sizeof(tx_q);
+	iface.rx_q			 = rx_q;
+	iface.rx_len		 = sizeof(rx_q);
+	iface.tx_buf		 = tx_buf;
+	iface.tx_buf_len = sizeof(tx_buf);
+	iface.mtu				 = MTU;
+	iface.rx_cb			 = rx_cb;
+	iface.tx_cb			 = tx_cb;
+	CHECK(nsmp_peer_newif(&iface) == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+	now_ms = 0;
+	wire_len = 0;
+	tx_fail	 = 0;
+	rx_count = 0;
+	rx_read	 = 0;
+	memset(&rx_stats, 0, sizeof(rx_stats));
+}
+
+/* Frames and bytes received, and the most of rx_q they took */
+static void test_rx(void) {
+	uint8_t const data[] = {1, 2, 3, 4, 5, 6, 7, 8};
+	uint8_t				buf[NSMP_FRAME_MAX(MTU)];
+
+	setup();
+	CHECK(nsmp_stats_get(NULL, &rx_stats) == NSMP_ERR_BAD_ARG);
+	CHECK(nsmp_stats_get(&iface, NULL) == NSMP_ERR_BAD_ARG);
+
+	size_t const n =
+			build(buf, NSMP_MSG_TYPE_USER_MESSAGE, NSMP_MSG_REQUEST, NODE_ADDR, data,
+						sizeof(data));
+	rx_feed(&iface, buf, n);
+	rx_feed(&iface, buf, n);
+
+	nsmp_stats_s const s = snap();
+	CHECK(rx_count == 2);
+	CHECK(s.rx_frames == 2);
+	CHECK(s.rx_bytes == 2 * n);
+	CHECK(s.rx_q_max == NSMP_QUEUE_REC_LEN(NSMP_HDR_LEN + sizeof(data)));
+	CHECK(!s.err_crc && !s.err_cobs && !s.err_len && !s.rx_drops);
+
+	/* Nothing taken from rx_q while it fills up */
+	for (int i = 0; i < 16 * DEPTH; i++) {
+		CHECK(nsmp_parse_if(&iface, buf, n) >= 0);
+	}
+	CHECK(snap().rx_drops > 0);
+	CHECK(snap().rx_frames + snap().rx_drops == 2 + (16 * DEPTH));
+	CHECK(snap().rx_q_max > NSMP_QUEUE_REC_LEN(NSMP_HDR_LEN + sizeof(data)));
+}
+
+/* Each way a frame goes wrong is counted once */
+static void test_errors(void) {
+	uint8_t data[20];
+	uint8_t dec[NSMP_HDR_LEN + MTU + NSMP_PAYLOAD_CRC_LEN + 16];
+	uint8_t buf[NSMP_FRAME_MAX(MTU) + 16];
+
+	setup();
+	memset(data, 0x55, sizeof(data));
+
+	/* Header CRC */
+	size_t n = frame(dec, NSMP_MSG_TYPE_USER_MESSAGE, NSMP_MSG_REQUEST,
+									 NODE_ADDR, data, sizeof(data));
+	dec[NSMP_OFS_CRC] ^= 0x01;
+	rx_feed(&iface, buf, encode(buf, dec, n));
+	CHECK(snap().err_crc == 1);
+
+	/* Longer than the mtu, dropped as soon as the header is in */
+	nsmp_hdr_s const hdr = {
+			.ctl = {.data = 1, .reqres = NSMP_MSG_REQUEST},
+			.dst = OWN_ADDR,
+			.src = NODE_ADDR,
+	};
+	nsmp_frame_hdr(dec, &hdr, MTU + NSMP_SEQ_LEN + 1);
+	rx_feed(&iface, buf, encode(buf, dec, NSMP_HDR_LEN));
+	CHECK(snap().err_len == 1);
+
+	/* Cut short by a delimiter in the middle of the payload */
+	n = build(buf, NSMP_MSG_TYPE_USER_MESSAGE, NSMP_MSG_REQUEST, NODE_ADDR, data,
+						sizeof(data));
+	buf[n / 2] = COBS_FRAME_DELIMITER;
+	rx_feed(&iface, buf, (n / 2) + 1);
+	CHECK(snap().err_cobs == 1);
+
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+	/* Payload CRC */
+	n = frame(dec, NSMP_MSG_TYPE_USER_MESSAGE, NSMP_MSG_REQUEST, NODE_ADDR, data,
+						sizeof(data));
+	dec[NSMP_HDR_LEN] ^= 0x01;
+	rx_feed(&iface, buf, encode(buf, dec, n));
+	CHECK(snap().err_crc == 2);
+#endif
+
+	nsmp_stats_s const s = snap();
+	CHECK(!s.rx_frames && !s.rx_drops && !rx_count);
+	CHECK(s.err_len == 1);
+	CHECK(s.err_cobs == 1);
+
+	/* The parser is back in step */
+	n = build(buf, NSMP_MSG_TYPE_USER_MESSAGE, NSMP_MSG_REQUEST, NODE_ADDR, data,
+						sizeof(data));
+	rx_feed(&iface, buf, n);
+	CHECK(snap().rx_frames == 1);
+	CHECK(rx_count == 1);
+}
+
+/* Frames and bytes sent, and those tx_cb discarded */
+static void test_tx(void) {
+	uint8_t		 data[32];
+	nsmp_msg_s msg = {
+			.hdr =
+					{
+							.ctl = {.reqres = NSMP_MSG_REQUEST},
+							.dst = NODE_ADDR,
+							.src = OWN_ADDR,
+					},
+	};
+
+	setup();
+	memset(data, 0xA5, sizeof(data));
+	nsmp_stats_s const s0 = snap();
+	CHECK(s0.tx_frames && s0.tx_bytes);
+
+	CHECK(nsmp_add_data(&msg, data, sizeof(data)) == NSMP_OK);
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	CHECK(snap().tx_q_max >= 2 * NSMP_QUEUE_REC_LEN(NSMP_HDR_LEN + sizeof(data)));
+	CHECK(nsmp_update() == NSMP_OK);
+
+	nsmp_stats_s const s1 = snap();
+	CHECK(s1.tx_frames == s0.tx_frames + 2);
+	CHECK(s1.tx_bytes == s0.tx_bytes + wire_len);
+	CHECK(!s1.tx_drops && !s1.retransmits);
+
+	tx_fail = 1;
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+	nsmp_stats_s const s2 = snap();
+	CHECK(s2.tx_frames == s1.tx_frames + 1);
+	CHECK(s2.tx_bytes == s1.tx_bytes);
+	CHECK(s2.tx_drops > NSMP_HDR_LEN + sizeof(data));
+}
+
+/* Latency from queueing to transmission and from reception to rx_cb, in the
+ * bucket of its power of two */
+static void test_latency(void) {
+	uint8_t		 data[8] = {0};
+	uint8_t		 buf[NSMP_FRAME_MAX(MTU)];
+	nsmp_msg_s msg		 = {
+					.hdr =
+							{
+									.ctl = {.reqres = NSMP_MSG_REQUEST},
+									.dst = NODE_ADDR,
+									.src = OWN_ADDR,
+							},
+	};
+
+	setup();
+	nsmp_stats_s const s0 = snap();
+
+	/* 5 ms goes in the bucket from 4 up to 8 */
+	CHECK(nsmp_add_data(&msg, data, sizeof(data)) == NSMP_OK);
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	now_ms += 5;
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(snap().tx_delay[3] == s0.tx_delay[3] + 1);
+
+	/* Only one message at a time is timed */
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	now_ms += 1;
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(snap().tx_delay[1] == s0.tx_delay[1] + 1);
+
+	/* 20 ms from 16 up to 32, and no wait in the first bucket */
+	size_t const n = build(buf, NSMP_MSG_TYPE_USER_MESSAGE, NSMP_MSG_REQUEST,
+												 NODE_ADDR, data, sizeof(data));
+	CHECK(nsmp_parse_if(&iface, buf, n) == 1);
+	now_ms += 20;
+	CHECK(nsmp_update() == NSMP_OK);
+	rx_feed(&iface, buf, n);
+	nsmp_stats_s const s1 = snap();
+	CHECK(rx_count == 2);
+	CHECK(s1.rx_delay[5] == 1);
+	CHECK(s1.rx_delay[0] == 1);
+
+	/* Anything longer goes in the last */
+	CHECK(nsmp_parse_if(&iface, buf, n) == 1);
+	now_ms += 60000;
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(snap().rx_delay[NSMP_STATS_BUCKETS - 1] == 1);
+}
+
+/* A request is answered with the counters, in as many frames as the mtu
+ * needs, and a query sends one */
+static void test_query(void) {
+	size_t const	per = (MTU - NSMP_STATS_HDR) / sizeof(uint32_t);
+	uint8_t				buf[NSMP_FRAME_MAX(MTU)];
+	uint8_t				dec[NSMP_FRAME_MAX(MTU)];
+	uint8_t				idx = 0;
+	nsmp_stats_s	got;
+	size_t				frames = 0;
+	int						done	 = 0;
+
+	setup();
+	memset(&got, 0, sizeof(got));
+	size_t n = build(buf, NSMP_MSG_TYPE_CTL_STATS, NSMP_MSG_REQUEST, HOST_ADDR,
+									 &idx, sizeof(idx));
+	rx_feed(&iface, buf, n);
+	nsmp_stats_s const s = snap();
+
+	/* The urgent lane takes a frame at a time */
+	for (int i = 0; i < 4; i++) {
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+	CHECK(!rx_count);
+
+	size_t pos = 0;
+	while ((n = next_frame(&pos, dec)) != 0) {
+		nsmp_msg_s m;
+		memcpy(&m.hdr, dec, sizeof(m.hdr));
+		if (m.hdr.ctl.type != NSMP_MSG_TYPE_CTL_STATS) {
+			continue;
+		}
+		CHECK(!done);
+		CHECK(m.hdr.dst == HOST_ADDR);
+		CHECK(m.hdr.src == OWN_ADDR);
+		m.data = &dec[NSMP_HDR_LEN];
+		m.len	 = (uint16_t)(n - NSMP_HDR_LEN);
+		CHECK(m.data[0] == 0);
+		CHECK(m.data[1] == frames * per);
+		done = nsmp_stats_read(&m, &got);
+		CHECK(done >= 0);
+		frames++;
+	}
+	CHECK(done == 1);
+	CHECK(frames == (NSMP_STATS_WORDS + per - 1) / per);
+	CHECK(got.rx_frames == 1);
+	CHECK(got.rx_bytes == s.rx_bytes);
+	CHECK(got.rx_q_max == s.rx_q_max);
+
+	/* An interface there is not */
+	wire_len = 0;
+	idx			 = 3;
+	n = build(buf, NSMP_MSG_TYPE_CTL_STATS, NSMP_MSG_REQUEST, HOST_ADDR, &idx,
+						sizeof(idx));
+	rx_feed(&iface, buf, n);
+	pos		 = 0;
+	frames = 0;
+	while ((n = next_frame(&pos, dec)) != 0) {
+		if (nsmp_frame_type(dec) == NSMP_MSG_TYPE_CTL_STATS) {
+			nsmp_msg_s m;
+			memcpy(&m.hdr, dec, sizeof(m.hdr));
+			m.data = &dec[NSMP_HDR_LEN];
+			m.len	 = (uint16_t)(n - NSMP_HDR_LEN);
+			CHECK(nsmp_stats_read(&m, &got) == NSMP_ERR_NO_IF);
+			frames++;
+		}
+	}
+	CHECK(frames == 1);
+
+	/* Asking the other end of the link */
+	wire_len = 0;
+	CHECK(nsmp_stats_query(NSMP_ADDR_LINK, 2) == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+	pos = 0;
+	CHECK((n = next_frame(&pos, dec)) == NSMP_HDR_LEN + NSMP_STATS_REQ_LEN);
+	nsmp_ctrl_s ctl;
+	memcpy(&ctl, &dec[NSMP_OFS_CTL], sizeof(ctl));
+	CHECK(ctl.type == NSMP_MSG_TYPE_CTL_STATS);
+	CHECK(ctl.reqres == NSMP_MSG_REQUEST);
+	CHECK(dec[NSMP_OFS_DST] == NSMP_ADDR_LINK);
+	CHECK(dec[NSMP_HDR_LEN] == 2);
+}
+
+/* Responses are delivered, and rejected if they do not fit */
+static void test_response(void) {
+	uint8_t buf[NSMP_FRAME_MAX(MTU)];
+	uint8_t data[NSMP_STATS_HDR + 8] = {0, 0, NSMP_STATS_WORDS};
+
+	setup();
+	data[NSMP_STATS_HDR]		 = 7;
+	data[NSMP_STATS_HDR + 4] = 9;
+	rx_feed(&iface, buf,
+					build(buf, NSMP_MSG_TYPE_CTL_STATS, NSMP_MSG_RESPONSE, HOST_ADDR, data,
+								sizeof(data)));
+	CHECK(rx_count == 1);
+	CHECK(rx_read == 0);
+	CHECK(rx_stats.rx_frames == 7);
+	CHECK(rx_stats.rx_bytes == 9);
+
+	/* The last words */
+	data[1] = NSMP_STATS_WORDS - 2;
+	rx_feed(&iface, buf,
+					build(buf, NSMP_MSG_TYPE_CTL_STATS, NSMP_MSG_RESPONSE, HOST_ADDR, data,
+								sizeof(data)));
+	CHECK(rx_read == 1);
+	CHECK(rx_stats.tx_delay[NSMP_STATS_BUCKETS - 2] == 7);
+	CHECK(rx_stats.tx_delay[NSMP_STATS_BUCKETS - 1] == 9);
+
+	/* Past the end, or from a device with other buckets */
+	data[1] = NSMP_STATS_WORDS - 1;
+	rx_feed(&iface, buf,
+					build(buf, NSMP_MSG_TYPE_CTL_STATS, NSMP_MSG_RESPONSE, HOST_ADDR, data,
+								sizeof(data)));
+	CHECK(rx_read == NSMP_ERR_BAD_LEN);
+	data[1] = 0;
+	data[2] = NSMP_STATS_WORDS + 2;
+	rx_feed(&iface, buf,
+					build(buf, NSMP_MSG_TYPE_CTL_STATS, NSMP_MSG_RESPONSE, HOST_ADDR, data,
+								sizeof(data)));
+	CHECK(rx_read == NSMP_ERR_BAD_LEN);
+	CHECK(rx_count == 4);
+}
+
+/* A decoded frame for this device, with its payload CRC */
+static size_t frame(uint8_t* dec, nsmp_msg_type_e type, uint8_t reqres,
+										uint8_t src, const uint8_t* data, size_t len) {
+	nsmp_hdr_s hdr = {
+			.ctl = {.data = (len != 0), .reqres = reqres, .type = type},
+			.dst = OWN_ADDR,
+			.src = src,
+	};
+
+	if (len) {
+		memcpy(&dec[NSMP_HDR_LEN], data, len);
+	}
+	nsmp_frame_hdr(dec, &hdr, (uint16_t)len);
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+	uint32_t const crc = nsmp_crc_payload(&dec[NSMP_HDR_LEN], len);
+	for (size_t i = 0; i < NSMP_PAYLOAD_CRC_LEN; i++) {
+		dec[NSMP_HDR_LEN + len + i] = (uint8_t)(crc >> (8 * i));
+	}
+#endif
+	return NSMP_HDR_LEN + len + NSMP_PAYLOAD_CRC_LEN;
+}
+
+/* Encode a decoded frame, with its delimiter */
+static size_t encode(uint8_t* out, const uint8_t* dec, size_t len) {
+	unsigned n = 0;
+
+	CHECK(cobs_encode(dec, (unsigned)len, out, NSMP_FRAME_MAX(MTU), &n) ==
+				COBS_RET_SUCCESS);
+	if (out[n - 1] != 0) {
+		out[n++] = 0;
+	}
+	return n;
+}
+
+static size_t build(uint8_t* out, nsmp_msg_type_e type, uint8_t reqres,
+										uint8_t src, const uint8_t* data, size_t len) {
+	uint8_t dec[NSMP_HDR_LEN + MTU + NSMP_PAYLOAD_CRC_LEN];
+
+	return encode(out, dec, frame(dec, type, reqres, src, data, len));
+}
+
+/* Decode the frame at pos on the wire, returns its length without the
+ * payload CRC, or 0 at the end */
+static size_t next_frame(size_t* pos, uint8_t* dec) {
+	size_t const n = wire_frame(wire, wire_len, pos, dec, NSMP_FRAME_MAX(MTU));
+
+	return n ? (n - NSMP_PAYLOAD_CRC_LEN) : 0;
+}
+
+static nsmp_stats_s snap(void) {
+	nsmp_stats_s s;
+
+	CHECK(nsmp_stats_get(&iface, &s) == NSMP_OK);
+	return s;
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	rx_count++;
+	if (msg->hdr.ctl.type == NSMP_MSG_TYPE_CTL_STATS) {
+		rx_read = nsmp_stats_read(msg, &rx_stats);
+	}
+	return NSMP_OK;
+}
+
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	(void)i;
+	return tx_fail ? -1 : wire_put(wire, &wire_len, WIRE_LEN, iov, iovcnt);
+}
@@ -0,0 +1,414 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "nsmp_private.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			 (256)
+#define DEPTH		 (8)
+#define IFACES	 (4)
+#define WIRE_LEN (16 * 1024)
+
+#define TOPIC_A (5)
+#define TOPIC_B (6)
+#define TOPIC_C (7) /* Without subscribers */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void		setup(uint8_t store_forward);
+static void		test_fanout(uint8_t store_forward);
+static void		test_local(void);
+static void		test_leave(void);
+static void		test_blocked(void);
+static void		test_node_publish(void);
+static void		test_peer(void);
+static void		subscribe(int i, uint8_t src, uint8_t topic, uint8_t on);
+static size_t publish(uint8_t* out, uint8_t src, uint8_t topic, size_t len);
+static size_t build(uint8_t* out, nsmp_msg_type_e type, uint8_t dst,
+										uint8_t src, const uint8_t* data, size_t len);
+static void		clear(void);
+static int		rx_cb(nsmp_msg_s* msg);
+static int		tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[IFACES][NSMP_QUEUE_LEN(DEPTH, MTU)]
+		__attribute__((aligned(4)));
+static uint8_t rx_q[IFACES][NSMP_QUEUE_LEN(DEPTH, MTU)]
+		__attribute__((aligned(4)));
+static uint8_t tx_buf[IFACES][NSMP_TX_BUF_LEN(MTU)];
+
+static nsmp_iface_s iface[IFACES];
+
+/* Bytes each interface transmitted, and whether its transport takes any */
+static uint8_t wire[IFACES][WIRE_LEN];
+static size_t	 wire_len[IFACES];
+static int		 stalled[IFACES];
+
+/* Messages delivered to the device itself, and the topic of the last one */
+static uint32_t rx_count;
+static int			rx_topic;
+
+/* The publisher on interface 0, and a subscriber on each of the others */
+static uint8_t const pub		= NSMP_ADDR(0, 0, 1);
+static uint8_t const sub[] = {0, NSMP_ADDR(0, 0, 2), NSMP_ADDR(0, 0, 3),
+															NSMP_ADDR(0, 0, 4)};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_fanout(0);
+	test_fanout(1);
+	test_local();
+	test_leave();
+	test_blocked();
+	test_node_publish();
+	test_peer();
+	printf("test_topic: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A node whose links do not answer, the peers on interfaces 1 and 2
+ * subscribed to TOPIC_A and the one on interface 3 to TOPIC_B */
+static void setup(uint8_t store_forward) {
+	nsmp_cfg_s const cfg = {.store_forward = store_forward};
+
+	CHECK(nsmp_node_init() == NSMP_OK);
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+	for (int i = 0; i < IFACES; i++) {
+		memset(&iface[i], 0, sizeof(iface[i]));
+		iface[i].tx_q				= tx_q[i];
+		iface[i].tx_len			= sizeof(tx_q[i]);
+		iface[i].rx_q				= rx_q[i];
+		iface[i].rx_len			= sizeof(rx_q[i]);
+		iface[i].tx_buf			= tx_buf[i];
+		iface[i].tx_buf_len = sizeof(tx_buf[i]);
+		iface[i].mtu				= MTU;
+		iface[i].rx_cb			= rx_cb;
+		iface[i].tx_cb			= tx_cb;
+		CHECK(nsmp_node_newif(&iface[i]) == NSMP_OK);
+		stalled[i] = 0;
+	}
+
+	subscribe(1, sub[1], TOPIC_A, 1);
+	subscribe(2, sub[2], TOPIC_A, 1);
+	subscribe(3, sub[3], TOPIC_B, 1);
+	CHECK(nsmp_route(sub[2]) == &iface[2]);
+	clear();
+}
+
+/* A published frame leaves on each interface with a subscriber to its topic
+ * exactly as it arrived, and on no other */
+static void test_fanout(uint8_t store_forward) {
+	uint8_t enc[NSMP_FRAME_MAX(MTU)];
+
+	setup(store_forward);
+	for (size_t len = 1; len <= MTU; len += 37) {
+		size_t const n = publish(enc, pub, TOPIC_A, len);
+		rx_feed(&iface[0], enc, n);
+		CHECK((wire_len[1] == n) && !memcmp(wire[1], enc, n));
+		CHECK((wire_len[2] == n) && !memcmp(wire[2], enc, n));
+		CHECK(wire_len[0] + wire_len[3] == 0);
+		clear();
+	}
+
+	/* Not back to the subscriber that published it */
+	size_t n = publish(enc, sub[1], TOPIC_A, 20);
+	rx_feed(&iface[1], enc, n);
+	CHECK((wire_len[2] == n) && !memcmp(wire[2], enc, n));
+	CHECK(wire_len[0] + wire_len[1] + wire_len[3] == 0);
+	clear();
+
+	n = publish(enc, pub, TOPIC_B, 20);
+	rx_feed(&iface[0], enc, n);
+	CHECK((wire_len[3] == n) && !memcmp(wire[3], enc, n));
+	CHECK(wire_len[0] + wire_len[1] + wire_len[2] == 0);
+	clear();
+
+	/* Nobody wants it, it is dropped as it arrives */
+	n = publish(enc, pub, TOPIC_C, 20);
+	CHECK(nsmp_parse_if(&iface[0], enc, n) == 0);
+	CHECK(nsmp_queue_used(&iface[0].rxq) == 0);
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(wire_len[0] + wire_len[1] + wire_len[2] + wire_len[3] == 0);
+	CHECK(rx_count == 0);
+}
+
+/* A node that subscribes itself gets the message as well */
+static void test_local(void) {
+	uint8_t enc[NSMP_FRAME_MAX(MTU)];
+
+	setup(0);
+	CHECK(nsmp_subscribe(NSMP_TOPICS, 1) == NSMP_ERR_BAD_ARG);
+	CHECK(nsmp_subscribe(TOPIC_A, 1) == NSMP_OK);
+	CHECK(nsmp_subscribe(TOPIC_C, 1) == NSMP_OK);
+
+	for (size_t len = 1; len <= MTU; len += 51) {
+		size_t const n = publish(enc, pub, TOPIC_A, len);
+		rx_feed(&iface[0], enc, n);
+		CHECK((rx_count == 1) && (rx_topic == TOPIC_A));
+		CHECK((wire_len[1] == n) && !memcmp(wire[1], enc, n));
+		CHECK((wire_len[2] == n) && !memcmp(wire[2], enc, n));
+		CHECK(wire_len[0] + wire_len[3] == 0);
+		clear();
+	}
+
+	size_t n = publish(enc, pub, TOPIC_C, 10);
+	rx_feed(&iface[0], enc, n);
+	CHECK((rx_count == 1) && (rx_topic == TOPIC_C));
+	CHECK(wire_len[0] + wire_len[1] + wire_len[2] + wire_len[3] == 0);
+	clear();
+
+	/* Topics it does not subscribe to are only sent on */
+	n = publish(enc, pub, TOPIC_B, 10);
+	rx_feed(&iface[0], enc, n);
+	CHECK(rx_count == 0);
+	CHECK(wire_len[3] == n);
+	clear();
+
+	CHECK(nsmp_subscribe(TOPIC_A, 0) == NSMP_OK);
+	n = publish(enc, pub, TOPIC_A, 10);
+	rx_feed(&iface[0], enc, n);
+	CHECK(rx_count == 0);
+	CHECK((wire_len[1] == n) && (wire_len[2] == n));
+}
+
+/* Subscribers stop when they ask to, or when they leave */
+static void test_leave(void) {
+	uint8_t enc[NSMP_FRAME_MAX(MTU)];
+
+	setup(0);
+	subscribe(2, sub[2], TOPIC_A, 0);
+	size_t n = publish(enc, pub, TOPIC_A, 10);
+	rx_feed(&iface[0], enc, n);
+	CHECK((wire_len[1] == n) && (wire_len[2] == 0));
+	clear();
+
+	rx_feed(&iface[1], enc,
+					build(enc, NSMP_MSG_TYPE_CTL_UNREGISTER, nsmp_addr(), sub[1], NULL,
+								0));
+	n = publish(enc, pub, TOPIC_A, 10);
+	CHECK(nsmp_parse_if(&iface[0], enc, n) == 0);
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(wire_len[1] + wire_len[2] == 0);
+
+	/* A subscriber that moves takes its subscriptions along */
+	subscribe(2, sub[3], TOPIC_B, 1);
+	n = publish(enc, pub, TOPIC_B, 10);
+	rx_feed(&iface[0], enc, n);
+	CHECK((wire_len[2] == n) && (wire_len[3] == 0));
+}
+
+/* A subscriber whose link is busy holds up the frames behind the one it has
+ * yet to get, the others get each frame once */
+static void test_blocked(void) {
+	uint8_t all[WIRE_LEN];
+	size_t	all_len = 0;
+
+	setup(0);
+	stalled[2] = 1;
+	for (unsigned i = 0; i < DEPTH; i++) {
+		size_t const n = publish(&all[all_len], pub, TOPIC_A, 1 + (i * 61) % MTU);
+		rx_feed(&iface[0], &all[all_len], n);
+		all_len += n;
+	}
+	for (int r = 0; r < 4; r++) {
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+	CHECK(wire_len[2] == 0);
+	CHECK(wire_len[1] < all_len);
+
+	stalled[2] = 0;
+	for (int r = 0; (r < 100) && (wire_len[2] < all_len); r++) {
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+	CHECK((wire_len[1] == all_len) && !memcmp(wire[1], all, all_len));
+	CHECK((wire_len[2] == all_len) && !memcmp(wire[2], all, all_len));
+	CHECK(nsmp_queue_used(&iface[0].rxq) == 0);
+}
+
+/* A node's own messages go to each interface with a subscriber, or to none */
+static void test_node_publish(void) {
+	uint8_t		 enc[NSMP_FRAME_MAX(MTU)];
+	uint8_t		 payload[MTU + 1];
+	nsmp_msg_s msg = {
+			.hdr = {.ctl = {.reqres = NSMP_MSG_REQUEST},
+							.dst = NSMP_ADDR_TOPIC,
+							.src = pub},
+	};
+
+	setup(0);
+	memset(payload, TOPIC_A, sizeof(payload));
+	CHECK(nsmp_add_data(&msg, payload, 10) == NSMP_OK);
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+	size_t const n = build(enc, NSMP_MSG_TYPE_USER_MESSAGE, NSMP_ADDR_TOPIC, pub,
+												 payload, 10);
+	CHECK((wire_len[1] == n) && !memcmp(wire[1], enc, n));
+	CHECK((wire_len[2] == n) && !memcmp(wire[2], enc, n));
+	CHECK(wire_len[0] + wire_len[3] == 0);
+	clear();
+
+	CHECK(nsmp_add_data(&msg, payload, MTU + 1) == NSMP_OK);
+	CHECK(nsmp_send(&msg) == NSMP_ERR_BAD_LEN);
+	CHECK(nsmp_add_data(&msg, payload, 0) == NSMP_OK);
+	CHECK(nsmp_send(&msg) == NSMP_ERR_BAD_ARG);
+	CHECK(!nsmp_send_reserve(NSMP_ADDR_TOPIC, NSMP_MSG_TYPE_USER_MESSAGE, 10));
+
+	/* Queued nowhere while one of them has no room */
+	stalled[2] = 1;
+	CHECK(nsmp_add_data(&msg, payload, MTU) == NSMP_OK);
+	int sent = 0;
+	for (int i = 0; (i < 4 * DEPTH) && (nsmp_send(&msg) == NSMP_OK); i++) {
+		sent++;
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+	CHECK((sent > 0) && (sent < 4 * DEPTH));
+	stalled[2] = 0;
+	for (int r = 0; r < 4 * DEPTH; r++) {
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+	size_t const m = build(enc, NSMP_MSG_TYPE_USER_MESSAGE, NSMP_ADDR_TOPIC, pub,
+												 payload, MTU);
+	CHECK((wire_len[1] == sent * m) && (wire_len[2] == sent * m));
+}
+
+/* A peer subscribes through its node, and only gets the topics it asked for */
+static void test_peer(void) {
+	uint8_t		 enc[NSMP_FRAME_MAX(MTU)];
+	uint8_t		 dec[NSMP_FRAME_MAX(MTU)];
+	uint8_t		 payload[8];
+	nsmp_msg_s msg = {
+			.hdr = {.ctl = {.reqres = NSMP_MSG_REQUEST}, .dst = NSMP_ADDR_TOPIC},
+	};
+	unsigned	 n;
+
+	CHECK(nsmp_peer_init() == NSMP_OK);
+	memset(&iface[0], 0, sizeof(iface[0]));
+	iface[0].tx_q				= tx_q[0];
+	iface[0].tx_len			= sizeof(tx_q[0]);
+	iface[0].rx_q				= rx_q[0];
+	iface[0].rx_len			= sizeof(rx_q[0]);
+	iface[0].tx_buf			= tx_buf[0];
+	iface[0].tx_buf_len = sizeof(tx_buf[0]);
+	iface[0].mtu				= MTU;
+	iface[0].rx_cb			= rx_cb;
+	iface[0].tx_cb			= tx_cb;
+	iface[0].bundle_len = MTU;
+	iface[0].peer_caps	= NSMP_CAP_BUNDLE;
+	CHECK(nsmp_peer_newif(&iface[0]) == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+	clear();
+
+	CHECK(nsmp_subscribe(TOPIC_A, 1) == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(cobs_decode(wire[0], (unsigned)wire_len[0], dec, sizeof(dec), &n) ==
+				COBS_RET_SUCCESS);
+	CHECK(nsmp_frame_type(dec) == NSMP_MSG_TYPE_CTL_SUBSCRIBE);
+	CHECK(dec[NSMP_OFS_DST] == NSMP_ADDR_LINK);
+	CHECK((nsmp_frame_len(dec) == 2) && (dec[NSMP_HDR_LEN] == TOPIC_A) &&
+				(dec[NSMP_HDR_LEN + 1] == 1));
+	clear();
+
+	/* Published as frames of their own, even with bundling */
+	memset(payload, TOPIC_B, sizeof(payload));
+	CHECK(nsmp_add_data(&msg, payload, sizeof(payload)) == NSMP_OK);
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+	size_t const one = build(enc, NSMP_MSG_TYPE_USER_MESSAGE, NSMP_ADDR_TOPIC,
+													 nsmp_addr(), payload, sizeof(payload));
+	CHECK((wire_len[0] == 2 * one) && !memcmp(wire[0], enc, one));
+	clear();
+
+	rx_feed(&iface[0], enc, publish(enc, pub, TOPIC_B, 10));
+	CHECK(rx_count == 0);
+	rx_feed(&iface[0], enc, publish(enc, pub, TOPIC_A, 10));
+	CHECK((rx_count == 1) && (rx_topic == TOPIC_A));
+}
+
+/* A peer on interface i asks for a topic, or stops */
+static void subscribe(int i, uint8_t src, uint8_t topic, uint8_t on) {
+	uint8_t const d[] = {topic, on};
+	uint8_t				enc[NSMP_FRAME_MAX(MTU)];
+
+	rx_feed(&iface[i], enc,
+					build(enc, NSMP_MSG_TYPE_CTL_SUBSCRIBE, NSMP_ADDR_LINK, src, d,
+								sizeof(d)));
+}
+
+/* Encode a message of len bytes published to a topic */
+static size_t publish(uint8_t* out, uint8_t src, uint8_t topic, size_t len) {
+	uint8_t data[MTU];
+
+	for (size_t i = 0; i < len; i++) {
+		data[i] = (uint8_t)(topic + (i * 7));
+	}
+	return build(out, NSMP_MSG_TYPE_USER_MESSAGE, NSMP_ADDR_TOPIC, src, data,
+							 len);
+}
+
+/* Encode a frame, returns its length */
+static size_t build(uint8_t* out, nsmp_msg_type_e type, uint8_t dst,
+										uint8_t src, const uint8_t* data, size_t len) {
+	uint8_t		 frame[NSMP_HDR_LEN + MTU + NSMP_PAYLOAD_CRC_LEN];
+	unsigned	 n	 = 0;
+	nsmp_hdr_s hdr = {
+			.ctl = {.data = (len != 0), .reqres = NSMP_MSG_REQUEST, .type = type},
+			.dst = dst,
+			.src = src,
+	};
+
+	if (len) {
+		memcpy(&frame[NSMP_HDR_LEN], data, len);
+	}
+	nsmp_frame_hdr(frame, &hdr, (uint16_t)len);
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+	uint32_t const crc = nsmp_crc_payload(&frame[NSMP_HDR_LEN], len);
+	for (size_t i = 0; i < NSMP_PAYLOAD_CRC_LEN; i++) {
+		frame[NSMP_HDR_LEN + len + i] = (uint8_t)(crc >> (8 * i));
+	}
+#endif
+	CHECK(cobs_encode(frame, (unsigned)(NSMP_HDR_LEN + len + NSMP_PAYLOAD_CRC_LEN),
+										out, NSMP_FRAME_MAX(MTU), &n) == COBS_RET_SUCCESS);
+	if (out[n - 1] != 0) {
+		out[n++] = 0;
+	}
+	return n;
+}
+
+static void clear(void) {
+	memset(wire_len, 0, sizeof(wire_len));
+	rx_count = 0;
+	rx_topic = -1;
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	rx_count++;
+	rx_topic = msg->len ? msg->data[0] : -1;
+	return NSMP_OK;
+}
+
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	size_t const n = (size_t)(i - iface);
+
+	if (stalled[n]) {
+		return 0;
+	}
+	return wire_put(wire[n], &wire_len[n], WIRE_LEN, iov, iovcnt);
+}
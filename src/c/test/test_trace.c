@@ -0,0 +1,288 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* The trace ring is only built in with NSMP_TRACE, e.g.
+ *
+ *   cmake -S . -B build -DNSMP_TRACE=64
+ *
+ * otherwise this only checks that nothing is recorded. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "nsmp_private.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			 (64)
+#define DEPTH		 (4)
+#define WIRE_LEN (16 * 1024)
+
+#define OWN_ADDR	NSMP_ADDR(0, 1, 1)
+#define NODE_ADDR NSMP_ADDR(1, 1, 0)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void							setup(void);
+															#if NSMP_TRACE
+static void							test_rx(void);
+static void							test_errors(void);
+static void							test_tx(void);
+static void							test_wrap(void);
+static nsmp_trace_rec_s last(void);
+static size_t						frame(uint8_t* dec, const uint8_t* data, size_t len);
+static size_t						encode(uint8_t* out, const uint8_t* dec, size_t len);
+															 #endif
+static int							rx_cb(nsmp_msg_s* msg);
+static int tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t rx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t tx_buf[NSMP_TX_BUF_LEN(MTU)];
+
+static nsmp_iface_s iface;
+
+/* Bytes transmitted, and whether tx_cb fails */
+static size_t wire_len;
+static int		tx_fail;
+
+#if NSMP_TRACE
+static nsmp_trace_rec_s recs[NSMP_TRACE];
+#endif
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+#if NSMP_TRACE
+	test_rx();
+	test_errors();
+	test_tx();
+	test_wrap();
+#else
+	nsmp_trace_rec_s r;
+
+	setup();
+	CHECK(nsmp_trace_read(&r, 1) == 0);
+#endif
+	printf("test_trace: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A peer with one interface, on a clock of our own */
+static void setup(void) {
+	nsmp_cfg_s const cfg = {
+			.addr				 = OWN_ADDR,
+			.get_time_ms = clock_ms,
+	};
+
+	CHECK(nsmp_init(NSMP_ROLE_PEER) == NSMP_OK);
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+	memset(&iface, 0, sizeof(iface));
+	iface.tx_q			 = tx_q;
+	iface.tx_len		 = sizeof(tx_q);
+	iface.rx_q			 = rx_q;
+	iface.rx_len		 = sizeof(rx_q);
+	iface.tx_buf		 = tx_buf;
+	iface.tx_buf_len = sizeof(tx_buf);
+	iface.mtu				 = MTU;
+	iface.rx_cb			 = rx_cb;
+	iface.tx_cb			 = tx_cb;
+	CHECK(nsmp_peer_newif(&iface) == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+	now_ms = 0;
+	wire_len = 0;
+	tx_fail	 = 0;
+}
+
+#if NSMP_TRACE
+
+/* A frame received whole is recorded with its header, as it arrived */
+static void test_rx(void) {
+	uint8_t const data[] = {1, 2, 3, 4, 5, 6, 7, 8};
+	uint8_t				dec[NSMP_HDR_LEN + MTU + NSMP_PAYLOAD_CRC_LEN];
+	uint8_t				buf[NSMP_FRAME_MAX(MTU)];
+
+	setup();
+	CHECK(nsmp_trace_read(NULL, 1) == 0);
+	now_ms = 1234;
+	size_t const n = frame(dec, data, sizeof(data));
+	CHECK(nsmp_parse_if(&iface, buf, encode(buf, dec, n)) == 1);
+
+	nsmp_trace_rec_s const r = last();
+	CHECK(r.dir == NSMP_TRACE_RX);
+	CHECK(r.result == NSMP_OK);
+	CHECK(r.ms == 1234);
+	CHECK(r.iface == 0);
+	CHECK(r.len == sizeof(data));
+	CHECK(!memcmp(&r.hdr, dec, sizeof(r.hdr)));
+	CHECK(r.hdr.src == NODE_ADDR);
+	CHECK(r.hdr.ctl.type == NSMP_MSG_TYPE_USER_MESSAGE);
+}
+
+/* A dropped frame is recorded with the reason, and its header if it had one */
+static void test_errors(void) {
+	uint8_t data[20];
+	uint8_t dec[NSMP_HDR_LEN + MTU + NSMP_PAYLOAD_CRC_LEN];
+	uint8_t buf[NSMP_FRAME_MAX(MTU)];
+
+	setup();
+	memset(data, 0x55, sizeof(data));
+
+	size_t n = frame(dec, data, sizeof(data));
+	dec[NSMP_OFS_CRC] ^= 0x01;
+	rx_feed(&iface, buf, encode(buf, dec, n));
+	nsmp_trace_rec_s r = last();
+	CHECK((r.dir == NSMP_TRACE_RX) && (r.result == NSMP_ERR_BAD_CRC));
+	CHECK(r.hdr.crc8 == dec[NSMP_OFS_CRC]);
+	CHECK(r.len == sizeof(data));
+
+	/* Longer than the mtu */
+	nsmp_hdr_s const hdr = {
+			.ctl = {.data = 1, .reqres = NSMP_MSG_REQUEST},
+			.dst = OWN_ADDR,
+			.src = NODE_ADDR,
+	};
+	nsmp_frame_hdr(dec, &hdr, MTU + NSMP_SEQ_LEN + 1);
+	rx_feed(&iface, buf, encode(buf, dec, NSMP_HDR_LEN));
+	r = last();
+	CHECK((r.dir == NSMP_TRACE_RX) && (r.result == NSMP_ERR_BAD_LEN));
+	CHECK(r.len == MTU + NSMP_SEQ_LEN + 1);
+
+	/* Cut short inside the header, which is left out */
+	n = frame(dec, data, sizeof(data));
+	n = encode(buf, dec, n);
+	buf[3] = COBS_FRAME_DELIMITER;
+	rx_feed(&iface, buf, 4);
+	r = last();
+	CHECK((r.dir == NSMP_TRACE_RX) && (r.result == NSMP_ERR_BAD_ENC));
+	CHECK(!r.hdr.src && !r.hdr.dst && !r.len);
+}
+
+/* Each frame encoded for tx_cb, and each batch it discarded */
+static void test_tx(void) {
+	uint8_t		 data[32];
+	nsmp_msg_s msg = {
+			.hdr =
+					{
+							.ctl = {.reqres = NSMP_MSG_REQUEST},
+							.dst = NODE_ADDR,
+							.src = OWN_ADDR,
+					},
+	};
+
+	setup();
+	memset(data, 0xA5, sizeof(data));
+	CHECK(nsmp_add_data(&msg, data, sizeof(data)) == NSMP_OK);
+
+	now_ms = 77;
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+	nsmp_trace_rec_s r = last();
+	CHECK((r.dir == NSMP_TRACE_TX) && (r.result == NSMP_OK));
+	CHECK(r.ms == 77);
+	CHECK(r.hdr.dst == NODE_ADDR);
+	CHECK(r.len == sizeof(data));
+
+	tx_fail = 1;
+	CHECK(nsmp_send(&msg) == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+	r = last();
+	CHECK((r.dir == NSMP_TRACE_TX) && (r.result == NSMP_ERR_IO));
+	CHECK(!r.hdr.dst && (r.len > NSMP_HDR_LEN + sizeof(data)));
+}
+
+/* The ring keeps the newest NSMP_TRACE events, read back oldest first */
+static void test_wrap(void) {
+	uint8_t const data[] = {9};
+	uint8_t				dec[NSMP_HDR_LEN + MTU + NSMP_PAYLOAD_CRC_LEN];
+	uint8_t				buf[NSMP_FRAME_MAX(MTU)];
+	nsmp_trace_rec_s tail[3];
+
+	setup();
+	size_t const n = encode(buf, dec, frame(dec, data, sizeof(data)));
+	for (uint32_t i = 0; i < NSMP_TRACE + 5; i++) {
+		now_ms = i;
+		rx_feed(&iface, buf, n);
+	}
+
+	CHECK(nsmp_trace_read(recs, NSMP_TRACE + 8) == NSMP_TRACE);
+	for (size_t i = 1; i < NSMP_TRACE; i++) {
+		CHECK(recs[i].seq == (uint16_t)(recs[i - 1].seq + 1));
+		CHECK(recs[i].ms >= recs[i - 1].ms);
+	}
+	CHECK(recs[NSMP_TRACE - 1].ms == NSMP_TRACE + 4);
+
+	CHECK(nsmp_trace_read(tail, 3) == 3);
+	CHECK(!memcmp(tail, &recs[NSMP_TRACE - 3], sizeof(tail)));
+}
+
+/* Newest record */
+static nsmp_trace_rec_s last(void) {
+	size_t const n = nsmp_trace_read(recs, NSMP_TRACE);
+
+	CHECK(n > 0);
+	return recs[n - 1];
+}
+
+/* A decoded user message for this device, with its payload CRC */
+static size_t frame(uint8_t* dec, const uint8_t* data, size_t len) {
+	nsmp_hdr_s hdr = {
+			.ctl = {.data = 1, .reqres = NSMP_MSG_REQUEST},
+			.dst = OWN_ADDR,
+			.src = NODE_ADDR,
+	};
+
+	memcpy(&dec[NSMP_HDR_LEN], data, len);
+	nsmp_frame_hdr(dec, &hdr, (uint16_t)len);
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+	uint32_t const crc = nsmp_crc_payload(&dec[NSMP_HDR_LEN], len);
+	for (size_t i = 0; i < NSMP_PAYLOAD_CRC_LEN; i++) {
+		dec[NSMP_HDR_LEN + len + i] = (uint8_t)(crc >> (8 * i));
+	}
+#endif
+	return NSMP_HDR_LEN + len + NSMP_PAYLOAD_CRC_LEN;
+}
+
+/* Encode a decoded frame, with its delimiter */
+static size_t encode(uint8_t* out, const uint8_t* dec, size_t len) {
+	unsigned n = 0;
+
+	CHECK(cobs_encode(dec, (unsigned)len, out, NSMP_FRAME_MAX(MTU), &n) ==
+				COBS_RET_SUCCESS);
+	if (out[n - 1] != 0) {
+		out[n++] = 0;
+	}
+	return n;
+}
+
+#endif
+
+static int rx_cb(nsmp_msg_s* msg) {
+	(void)msg;
+	return NSMP_OK;
+}
+
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	size_t const total = iov_len(iov, iovcnt);
+
+	(void)i;
+	if (!tx_fail) {
+		CHECK(wire_len + total <= WIRE_LEN);
+		wire_len += total;
+	}
+	return tx_fail ? -1 : (int)total;
+}
@@ -0,0 +1,112 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+#pragma once
+/* What the tests share: CHECK, clocks for nsmp_cfg_s::get_time_ms, and a
+ * wire that tx_cb appends to and the test parses back. Each test keeps its
+ * own interfaces, queues and wire buffers. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define CHECK(x)                                                               \
+	do {                                                                         \
+		if (!(x)) {                                                                \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x);    \
+			exit(1);                                                                 \
+		}                                                                          \
+	} while (0)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Time given by clock_ms(), moved on by the test */
+static uint32_t now_ms;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static inline uint32_t clock_ms(void) {
+	return now_ms;
+}
+
+/* The system's monotonic clock, for tests that run threads */
+static inline uint32_t mono_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((ts.tv_sec * 1000) + (ts.tv_nsec / 1000000));
+}
+
+/* Bytes handed to tx_cb */
+static inline size_t iov_len(const nsmp_iovec_s* iov, size_t iovcnt) {
+	size_t total = 0;
+
+	for (size_t n = 0; n < iovcnt; n++) {
+		total += iov[n].len;
+	}
+	return total;
+}
+
+/* Append the bytes handed to tx_cb to a wire of cap bytes, returns their
+ * number for tx_cb to return */
+static inline int wire_put(uint8_t* wire, size_t* len, size_t cap,
+													 const nsmp_iovec_s* iov, size_t iovcnt) {
+	size_t const total = iov_len(iov, iovcnt);
+
+	CHECK(*len + total <= cap);
+	for (size_t n = 0; n < iovcnt; n++) {
+		memcpy(&wire[*len], iov[n].base, iov[n].len);
+		*len += iov[n].len;
+	}
+	return (int)total;
+}
+
+/* Decode the frame at pos on a wire into max bytes at dec, moving pos past
+ * it. Returns its decoded length, or 0 if no whole frame is left. */
+static inline size_t wire_frame(const uint8_t* wire, size_t len, size_t* pos,
+																uint8_t* dec, size_t max) {
+	size_t	 end = *pos;
+	unsigned n	 = 0;
+
+	while ((end < len) && wire[end]) {
+		end++;
+	}
+	if (end >= len) {
+		return 0;
+	}
+	CHECK(cobs_decode(&wire[*pos], (unsigned)(end + 1 - *pos), dec,
+										(unsigned)max, &n) == COBS_RET_SUCCESS);
+	*pos = end + 1;
+	return n;
+}
+
+/* Receive bytes on an interface, and send what they lead to */
+static inline void rx_feed(nsmp_iface_s* iface, const uint8_t* data,
+													 size_t len) {
+	CHECK(nsmp_parse_if(iface, data, len) >= 0);
+	CHECK(nsmp_update() == NSMP_OK);
+	CHECK(nsmp_update() == NSMP_OK);
+}
+
+/* An interface looped back to itself: what it sent is received, rounds
+ * times */
+static inline void loopback(nsmp_iface_s* iface, uint8_t* wire, size_t* len,
+														unsigned rounds) {
+	for (unsigned r = 0; r < rounds; r++) {
+		CHECK(nsmp_update() == NSMP_OK);
+		CHECK(nsmp_parse_if(iface, wire, *len) >= 0);
+		*len = 0;
+		CHECK(nsmp_update() == NSMP_OK);
+	}
+}
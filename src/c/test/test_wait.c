@@ -0,0 +1,255 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nsmp.h"
+#include "nsmp_os.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			 (32)
+#define DEPTH		 (8)
+#define PAYLOAD	 (16)
+#define MSGS		 (500)
+#define WIRE_LEN (16 * 1024)
+
+/* Length of a record in rcv_q for a message of PAYLOAD bytes */
+#define REC_LEN (NSMP_QUEUE_REC_LEN(sizeof(nsmp_hdr_s) + PAYLOAD))
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void	 setup(const nsmp_os_s* os, size_t rcv_len);
+static void	 test_rcv(void);
+static void	 test_backpressure(void);
+static void	 test_threads(const char* name, const nsmp_os_s* os);
+static void* updater(void* arg);
+static void* sender(void* arg);
+static int	 queue(uint32_t n);
+static void	 take(uint32_t n);
+static int	 tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[NSMP_QUEUE_LEN(DEPTH, MTU) + NSMP_URGENT_LEN(MTU)]
+		__attribute__((aligned(4)));
+static uint8_t rx_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t rcv_q[NSMP_QUEUE_LEN(DEPTH, MTU)] __attribute__((aligned(4)));
+static uint8_t tx_buf[NSMP_TX_BUF_LEN(MTU)];
+
+/* A link that loops back to itself, with no rx_cb so messages go to rcv_q */
+static nsmp_iface_s iface;
+
+/* Encoded bytes written by tx_cb, parsed after each update */
+static uint8_t wire[WIRE_LEN];
+static size_t	 wire_len;
+
+/* Tells updater() to return */
+static int stop;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	nsmp_os_s					os;
+	nsmp_os_pthread_s p;
+	nsmp_os_futex_s		f;
+	nsmp_os_eventfd_s e;
+
+	test_rcv();
+	test_backpressure();
+
+	CHECK(nsmp_os_pthread(&os, &p) == NSMP_OK);
+	test_threads("pthread", &os);
+	CHECK(nsmp_os_futex(&os, &f) == NSMP_OK);
+	test_threads("futex", &os);
+	CHECK(nsmp_os_eventfd(&os, &e) == NSMP_OK);
+	test_threads("eventfd", &os);
+	nsmp_os_eventfd_close(&e);
+
+	printf("test_wait: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void setup(const nsmp_os_s* os, size_t rcv_len) {
+	nsmp_cfg_s cfg = {
+			.get_time_ms = mono_ms,
+			.rcv_q			 = rcv_q,
+			.rcv_len		 = rcv_len,
+	};
+
+	if (os) {
+		cfg.os = *os;
+	}
+	memset(&iface, 0, sizeof(iface));
+	iface.tx_q			 = tx_q;
+	iface.tx_len		 = sizeof(tx_q);
+	iface.rx_q			 = rx_q;
+	iface.rx_len		 = sizeof(rx_q);
+	iface.tx_buf		 = tx_buf;
+	iface.tx_buf_len = sizeof(tx_buf);
+	iface.mtu				 = MTU;
+	iface.tx_cb			 = tx_cb;
+
+	CHECK(nsmp_peer_init() == NSMP_OK);
+	CHECK(nsmp_peer_newif(&iface) == NSMP_OK);
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+	wire_len = 0;
+
+	/* Capabilities, then the first grant */
+	loopback(&iface, wire, &wire_len, 3);
+	CHECK(iface.peer_caps & NSMP_CAP_CREDIT);
+}
+
+/* Messages are taken in order, a buffer too small for one leaves it queued */
+static void test_rcv(void) {
+	uint8_t		 small[PAYLOAD / 2];
+	nsmp_msg_s msg = {0};
+
+	setup(NULL, sizeof(rcv_q));
+	CHECK(nsmp_rcv(&msg) == NSMP_ERR_AGAIN);
+	CHECK(nsmp_rcv_wait(&msg, 10) == NSMP_ERR_AGAIN);
+
+	for (uint32_t n = 0; n < 4; n++) {
+		CHECK(queue(n) == NSMP_OK);
+	}
+	loopback(&iface, wire, &wire_len, 2);
+
+	nsmp_add_data(&msg, small, sizeof(small));
+	CHECK(nsmp_rcv(&msg) == NSMP_ERR_BAD_LEN);
+	CHECK(msg.len == PAYLOAD);
+	for (uint32_t n = 0; n < 4; n++) {
+		take(n);
+	}
+	CHECK(nsmp_rcv(&msg) == NSMP_ERR_AGAIN);
+
+	/* Too small to hold anything */
+	nsmp_cfg_s const cfg = {.rcv_q = rcv_q, .rcv_len = 4};
+	CHECK(nsmp_config(&cfg) == NSMP_ERR_BAD_ARG);
+}
+
+/* Messages that do not fit in rcv_q wait in rx_q and then on the sender, and
+ * none is lost */
+static void test_backpressure(void) {
+	uint32_t sent = 0;
+	uint32_t got	= 0;
+	int			 held = 0;
+
+	setup(NULL, 3 * REC_LEN);
+	while (got < 4 * DEPTH) {
+		while ((sent < 4 * DEPTH) && (queue(sent) == NSMP_OK)) {
+			sent++;
+		}
+		loopback(&iface, wire, &wire_len, 4);
+		held |= (nsmp_queue_used(&iface.rxq) != 0);
+
+		/* Takes one message at a time, more slowly than they are sent */
+		take(got++);
+	}
+	CHECK(held);
+	CHECK(iface.cr.drops == 0);
+	CHECK(nsmp_queue_used(&iface.rxq) == 0);
+}
+
+/* A sender blocked on a full tx_q and a receiver waiting for messages are
+ * woken by an update thread, which itself only runs when there is work */
+static void test_threads(const char* name, const nsmp_os_s* os) {
+	pthread_t		u;
+	pthread_t		s;
+	nsmp_msg_s	msg = {0};
+	uint8_t			data[PAYLOAD];
+	uint32_t		t0;
+
+	setup(os, 4 * REC_LEN);
+	__atomic_store_n(&stop, 0, __ATOMIC_RELEASE);
+	CHECK(pthread_create(&u, NULL, updater, (void*)os) == 0);
+
+	t0 = mono_ms();
+	nsmp_add_data(&msg, data, sizeof(data));
+	CHECK(nsmp_rcv_wait(&msg, 20) == NSMP_ERR_AGAIN);
+	CHECK(mono_ms() - t0 >= 20);
+
+	CHECK(pthread_create(&s, NULL, sender, NULL) == 0);
+	for (uint32_t n = 0; n < MSGS; n++) {
+		nsmp_add_data(&msg, data, sizeof(data));
+		CHECK(nsmp_rcv_wait(&msg, NSMP_WAIT_FOREVER) == NSMP_OK);
+		CHECK(msg.len == PAYLOAD);
+		CHECK(memcmp(data, &n, sizeof(n)) == 0);
+	}
+	CHECK(pthread_join(s, NULL) == 0);
+
+	__atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+	os->signal(os->ctx, NSMP_EV_READY);
+	CHECK(pthread_join(u, NULL) == 0);
+	CHECK(iface.cr.drops == 0);
+	printf("test_wait: %s ok\n", name);
+}
+
+/* Runs nsmp_update() when signalled, and the timers now and then */
+static void* updater(void* arg) {
+	const nsmp_os_s* const os = arg;
+
+	while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE)) {
+		int status = nsmp_update();
+		CHECK(status >= 0);
+		if (wire_len) {
+			CHECK(nsmp_parse_if(&iface, wire, wire_len) >= 0);
+			wire_len = 0;
+		} else if (status == NSMP_OK) {
+			os->wait(os->ctx, NSMP_EV_READY, 5);
+		}
+	}
+	return NULL;
+}
+
+/* Sends far more than tx_q holds, blocking while it is full */
+static void* sender(void* arg) {
+	(void)arg;
+	for (uint32_t n = 0; n < MSGS; n++) {
+		uint8_t		 payload[PAYLOAD] = {0};
+		nsmp_msg_s msg							= {.hdr.dst = 0};
+
+		memcpy(payload, &n, sizeof(n));
+		nsmp_add_data(&msg, payload, sizeof(payload));
+		CHECK(nsmp_send_wait(&msg, NSMP_WAIT_FOREVER) == NSMP_OK);
+	}
+	return NULL;
+}
+
+/* Queue message n, of PAYLOAD bytes starting with n */
+static int queue(uint32_t n) {
+	uint8_t		 payload[PAYLOAD] = {0};
+	nsmp_msg_s msg							= {.hdr.dst = 0};
+
+	memcpy(payload, &n, sizeof(n));
+	nsmp_add_data(&msg, payload, sizeof(payload));
+	return nsmp_send(&msg);
+}
+
+/* Take message n from rcv_q */
+static void take(uint32_t n) {
+	uint8_t		 payload[MTU];
+	nsmp_msg_s msg = {0};
+
+	nsmp_add_data(&msg, payload, sizeof(payload));
+	CHECK(nsmp_rcv(&msg) == NSMP_OK);
+	CHECK(msg.len == PAYLOAD);
+	CHECK(msg.hdr.ctl.type == NSMP_MSG_TYPE_USER_MESSAGE);
+	CHECK(memcmp(payload, &n, sizeof(n)) == 0);
+}
+
+static int tx_cb(nsmp_iface_s* i, const nsmp_iovec_s* iov, size_t iovcnt) {
+	(void)i;
+	return wire_put(wire, &wire_len, sizeof(wire), iov, iovcnt);
+}
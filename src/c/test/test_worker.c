@@ -0,0 +1,373 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "nsmp_os.h"
+#include "nsmp_private.h"
+#include "test_util.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MTU			(128)
+#define DEPTH		(8)
+#define WORKERS (NSMP_MAX_WORKERS)
+#define IFACES	(2 * WORKERS)
+#define FRAMES	(3000) /* Sent by each peer */
+#define MOVE		(64)	 /* Frames between route changes */
+#define ENC_MAX (NSMP_FRAME_MAX(MTU) + 1)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void		 setup(void);
+static void		 test_args(void);
+static void		 test_threads(void);
+static void*	 worker_main(void* arg);
+static uint8_t peer(int i);
+static int		 flow_dst(int i, uint32_t seq);
+static size_t	 build(uint8_t* out, nsmp_msg_type_e type, uint8_t dst,
+										 uint8_t src, const uint8_t* data, size_t len);
+static void		 feed(int i, const uint8_t* data, size_t len);
+static void		 check_frame(int i, const uint8_t* enc, size_t len);
+static int		 rx_cb(nsmp_msg_s* msg);
+static int tx_cb(nsmp_iface_s* iface, const nsmp_iovec_s* iov, size_t iovcnt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t tx_q[IFACES][NSMP_QUEUE_LEN(DEPTH, MTU) + NSMP_URGENT_LEN(MTU)]
+		__attribute__((aligned(4)));
+static uint8_t rx_q[IFACES][NSMP_QUEUE_LEN(DEPTH, MTU)]
+		__attribute__((aligned(4)));
+static uint8_t tx_buf[IFACES][NSMP_TX_BUF_LEN(MTU)];
+static uint8_t relay_q[WORKERS][NSMP_RELAY_Q_LEN(4, MTU)]
+		__attribute__((aligned(4)));
+
+static nsmp_iface_s			 iface[IFACES];
+static nsmp_worker_s		 worker[WORKERS];
+static nsmp_os_pthread_s os[WORKERS];
+
+/* Each interface's transmitted bytes up to the end of the last frame */
+static uint8_t part[IFACES][ENC_MAX];
+static size_t	 part_len[IFACES];
+
+/* Next sequence number expected from each peer on each interface, and the
+ * frames that arrived */
+static uint32_t next[IFACES][IFACES];
+static uint32_t got[IFACES][IFACES];
+
+/* User messages sent out, and those delivered to the node itself */
+static uint32_t out_count;
+static uint32_t rx_count;
+
+/* Messages each peer sent to the node, delivered without the lock in the
+ * thread of its interface's worker */
+static uint32_t local[IFACES];
+
+/* Address moved between interfaces while frames are relayed */
+static uint8_t const roamer = NSMP_ADDR(0, 2, 1);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(void) {
+	test_args();
+	test_threads();
+	printf("test_worker: ok\n");
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A node with peer i behind interface i, and interfaces 2k and 2k + 1 served
+ * by worker k */
+static void setup(void) {
+	nsmp_cfg_s const cfg = {.get_time_ms = mono_ms};
+	uint8_t					 enc[ENC_MAX];
+
+	CHECK(nsmp_node_init() == NSMP_OK);
+	CHECK(nsmp_config(&cfg) == NSMP_OK);
+	for (int i = 0; i < IFACES; i++) {
+		memset(&iface[i], 0, sizeof(iface[i]));
+		iface[i].tx_q				= tx_q[i];
+		iface[i].tx_len			= sizeof(tx_q[i]);
+		iface[i].rx_q				= rx_q[i];
+		iface[i].rx_len			= sizeof(rx_q[i]);
+		iface[i].tx_buf			= tx_buf[i];
+		iface[i].tx_buf_len = sizeof(tx_buf[i]);
+		iface[i].mtu				= MTU;
+		iface[i].rx_cb			= rx_cb;
+		iface[i].tx_cb			= tx_cb;
+		CHECK(nsmp_node_newif(&iface[i]) == NSMP_OK);
+		feed(i, enc, build(enc, NSMP_MSG_TYPE_CTL_DISCOVERY, nsmp_addr(), peer(i),
+											 NULL, 0));
+	}
+	for (int r = 0; r < 10; r++) {
+		CHECK(nsmp_update() >= 0);
+	}
+	for (int i = 0; i < IFACES; i++) {
+		CHECK(nsmp_route(peer(i)) == &iface[i]);
+	}
+
+	for (int k = 0; k < WORKERS; k++) {
+		memset(&worker[k], 0, sizeof(worker[k]));
+		worker[k].relay_q		= relay_q[k];
+		worker[k].relay_len = sizeof(relay_q[k]);
+		CHECK(nsmp_os_pthread(&worker[k].os, &os[k]) == NSMP_OK);
+		CHECK(nsmp_worker_add(&worker[k]) == NSMP_OK);
+		CHECK(nsmp_worker_iface(&worker[k], &iface[2 * k]) == NSMP_OK);
+		CHECK(nsmp_worker_iface(&worker[k], &iface[(2 * k) + 1]) == NSMP_OK);
+	}
+	memset(part_len, 0, sizeof(part_len));
+	memset(next, 0, sizeof(next));
+	memset(got, 0, sizeof(got));
+	memset(local, 0, sizeof(local));
+	out_count = 0;
+	rx_count	= 0;
+}
+
+static void test_args(void) {
+	nsmp_cfg_s const arq = {.arq_window = 4};
+	nsmp_worker_s		 w	 = {.relay_q = relay_q[0], .relay_len = 64};
+	nsmp_iface_s		 loose;
+
+	/* Peers have one interface, and nothing to spread */
+	CHECK(nsmp_peer_init() == NSMP_OK);
+	w.relay_len = sizeof(relay_q[0]);
+	CHECK(nsmp_worker_add(&w) == NSMP_ERR_BAD_ARG);
+
+	/* Reliable delivery keeps one window per peer, not shared by workers */
+	CHECK(nsmp_node_init() == NSMP_OK);
+	CHECK(nsmp_config(&arq) == NSMP_OK);
+	CHECK(nsmp_worker_add(&w) == NSMP_ERR_BAD_ARG);
+
+	setup();
+	CHECK(nsmp_config(&arq) == NSMP_ERR_BAD_ARG);
+	CHECK(nsmp_worker_add(&worker[0]) == NSMP_ERR_BAD_ARG);
+	CHECK(nsmp_worker_update(&w) == NSMP_ERR_BAD_ARG);
+	CHECK(nsmp_worker_update(NULL) == NSMP_ERR_BAD_ARG);
+
+	memset(&loose, 0, sizeof(loose));
+	CHECK(nsmp_worker_iface(&worker[0], &loose) == NSMP_ERR_BAD_ARG);
+	CHECK(nsmp_worker_iface(&w, &iface[0]) == NSMP_ERR_BAD_ARG);
+
+#if (NSMP_MAX_WORKERS == WORKERS)
+	CHECK(nsmp_worker_add(&w) == NSMP_ERR_BAD_ARG);
+#endif
+
+	/* Too small for a frame from each of the interfaces already served */
+	CHECK(nsmp_node_init() == NSMP_OK);
+	CHECK(nsmp_config(&(nsmp_cfg_s){0}) == NSMP_OK);
+	memset(&iface[0], 0, sizeof(iface[0]));
+	iface[0].rx_q		= rx_q[0];
+	iface[0].rx_len = sizeof(rx_q[0]);
+	iface[0].mtu		= MTU;
+	CHECK(nsmp_node_newif(&iface[0]) == NSMP_OK);
+	w.relay_len = NSMP_RELAY_Q_LEN(1, MTU / 2);
+	CHECK(nsmp_worker_add(&w) == NSMP_OK);
+	CHECK(nsmp_worker_iface(&w, &iface[0]) == NSMP_ERR_BAD_ARG);
+	worker[0].relay_q		= relay_q[1];
+	worker[0].relay_len = NSMP_RELAY_Q_LEN(1, MTU);
+	CHECK(nsmp_worker_add(&worker[0]) == NSMP_OK);
+	CHECK(nsmp_worker_iface(&worker[0], &iface[0]) == NSMP_ERR_BAD_ARG);
+
+	CHECK(nsmp_node_init() == NSMP_OK);
+	CHECK(nsmp_config(&(nsmp_cfg_s){0}) == NSMP_OK);
+	CHECK(nsmp_node_newif(&iface[0]) == NSMP_OK);
+	CHECK(nsmp_worker_add(&worker[0]) == NSMP_OK);
+	CHECK(nsmp_worker_iface(&worker[0], &iface[0]) == NSMP_OK);
+	CHECK(nsmp_worker_add(&w) == NSMP_ERR_BAD_ARG);
+}
+
+/* Every peer streams to the others through the workers' threads, most of it
+ * to interfaces of another worker. Nothing is dropped, each flow arrives in
+ * order, and routes moving meanwhile do not disturb it. */
+static void test_threads(void) {
+	pthread_t t[WORKERS];
+
+	setup();
+	for (int k = 0; k < WORKERS; k++) {
+		CHECK(pthread_create(&t[k], NULL, worker_main, &worker[k]) == 0);
+	}
+	for (int k = 0; k < WORKERS; k++) {
+		CHECK(pthread_join(t[k], NULL) == 0);
+	}
+
+	CHECK(out_count == IFACES * FRAMES);
+	for (int i = 0; i < IFACES; i++) {
+		uint32_t sum = 0;
+		for (int j = 0; j < IFACES; j++) {
+			sum += got[i][j];
+		}
+		CHECK(sum == FRAMES);
+		CHECK(iface[i].cr.drops == 0);
+		CHECK(part_len[i] == 0);
+		CHECK(local[i] == FRAMES / MOVE);
+	}
+	CHECK(rx_count == IFACES * (FRAMES / MOVE));
+}
+
+/* Feeds the peers of a worker's interfaces whenever their rx_q has room, and
+ * serves them until every frame has gone out */
+static void* worker_main(void* arg) {
+	nsmp_worker_s* const w = arg;
+	uint32_t						 seq[2] = {0};
+	uint8_t							 enc[ENC_MAX];
+	uint8_t							 data[MTU];
+
+	while (__atomic_load_n(&out_count, __ATOMIC_ACQUIRE) < IFACES * FRAMES) {
+		int fed = 0;
+
+		for (int n = 0; n < 2; n++) {
+			int const i = (2 * w->idx) + n;
+			if ((seq[n] == FRAMES) ||
+					(nsmp_queue_used(&iface[i].rxq) > iface[i].rx_len / 2)) {
+				continue;
+			}
+			if (seq[n] && !(seq[n] % MOVE)) {
+				feed(i, enc,
+						 build(enc, NSMP_MSG_TYPE_CTL_DISCOVERY, nsmp_addr(), roamer, NULL,
+									 0));
+				data[0] = (uint8_t)i;
+				data[1] = (uint8_t)(seq[n] / MOVE);
+				feed(i, enc,
+						 build(enc, NSMP_MSG_TYPE_USER_MESSAGE, nsmp_addr(), peer(i), data,
+									 2));
+			}
+
+			size_t const len = 4 + ((seq[n] * 13) % (MTU - 4));
+			data[0]					 = (uint8_t)i;
+			data[1]					 = (uint8_t)seq[n];
+			data[2]					 = (uint8_t)(seq[n] >> 8);
+			data[3]					 = (uint8_t)(seq[n] >> 16);
+			memset(&data[4], (int)seq[n], len - 4);
+			feed(i, enc,
+					 build(enc, NSMP_MSG_TYPE_USER_MESSAGE, peer(flow_dst(i, seq[n])),
+								 peer(i), data, len));
+			seq[n]++;
+			fed = 1;
+		}
+
+		int const rc = nsmp_worker_update(w);
+		CHECK(rc >= 0);
+		if (!rc && !fed) {
+			w->os.wait(w->os.ctx, NSMP_EV_READY, 1);
+		}
+	}
+	return NULL;
+}
+
+static uint8_t peer(int i) {
+	return NSMP_ADDR(0, 1, i + 1);
+}
+
+/* Peer i sends to the peer three interfaces on, on another worker, and every
+ * fifth frame to the other interface of its own worker */
+static int flow_dst(int i, uint32_t seq) {
+	return (seq % 5) ? ((i + 3) % IFACES) : (i ^ 1);
+}
+
+/* Encode a frame, returns its length */
+static size_t build(uint8_t* out, nsmp_msg_type_e type, uint8_t dst,
+										uint8_t src, const uint8_t* data, size_t len) {
+	uint8_t		 frame[NSMP_HDR_LEN + MTU + NSMP_PAYLOAD_CRC_LEN];
+	unsigned	 n	 = 0;
+	nsmp_hdr_s hdr = {
+			.ctl = {.data = (len != 0), .type = type},
+			.dst = dst,
+			.src = src,
+	};
+
+	if (len) {
+		memcpy(&frame[NSMP_HDR_LEN], data, len);
+	}
+	nsmp_frame_hdr(frame, &hdr, (uint16_t)len);
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+	uint32_t const crc = nsmp_crc_payload(&frame[NSMP_HDR_LEN], len);
+	for (size_t i = 0; i < NSMP_PAYLOAD_CRC_LEN; i++) {
+		frame[NSMP_HDR_LEN + len + i] = (uint8_t)(crc >> (8 * i));
+	}
+#endif
+	CHECK(cobs_encode(frame, (unsigned)(NSMP_HDR_LEN + len + NSMP_PAYLOAD_CRC_LEN),
+										out, ENC_MAX, &n) == COBS_RET_SUCCESS);
+	if (out[n - 1] != 0) {
+		out[n++] = 0;
+	}
+	return n;
+}
+
+static void feed(int i, const uint8_t* data, size_t len) {
+	CHECK(nsmp_parse_if(&iface[i], data, len) == 1);
+}
+
+/* A user message sent on interface i came from the peer it names, and is the
+ * next of its flow */
+static void check_frame(int i, const uint8_t* enc, size_t len) {
+	uint8_t	 dec[NSMP_HDR_LEN + MTU + NSMP_PAYLOAD_CRC_LEN];
+	unsigned n = 0;
+
+	CHECK(cobs_decode(enc, (unsigned)len, dec, sizeof(dec), &n) ==
+				COBS_RET_SUCCESS);
+	CHECK(n >= NSMP_HDR_LEN);
+	if (nsmp_frame_type(dec) != NSMP_MSG_TYPE_USER_MESSAGE) {
+		return;
+	}
+
+	int const			 src = dec[NSMP_HDR_LEN];
+	uint32_t const seq = dec[NSMP_HDR_LEN + 1] |
+											 ((uint32_t)dec[NSMP_HDR_LEN + 2] << 8) |
+											 ((uint32_t)dec[NSMP_HDR_LEN + 3] << 16);
+	CHECK(src < IFACES);
+	CHECK(dec[NSMP_OFS_SRC] == peer(src));
+	CHECK(dec[NSMP_OFS_DST] == peer(i));
+
+	/* Frames of the peer in between went to other interfaces */
+	while (flow_dst(src, next[src][i]) != i) {
+		next[src][i]++;
+	}
+	CHECK(seq == next[src][i]);
+	next[src][i]++;
+	got[src][i]++;
+	__atomic_fetch_add(&out_count, 1, __ATOMIC_RELEASE);
+}
+
+static int rx_cb(nsmp_msg_s* msg) {
+	if (msg->hdr.src == roamer) {
+		__atomic_fetch_add(&rx_count, 1, __ATOMIC_RELAXED);
+	} else if (msg->hdr.ctl.type == NSMP_MSG_TYPE_USER_MESSAGE) {
+		int const i = msg->data[0];
+		CHECK((i < IFACES) && (msg->hdr.src == peer(i)));
+		CHECK(msg->data[1] == (uint8_t)(local[i] + 1));
+		local[i]++;
+	}
+	return NSMP_OK;
+}
+
+/* Runs in the thread of the interface's worker */
+static int tx_cb(nsmp_iface_s* ifp, const nsmp_iovec_s* iov, size_t iovcnt) {
+	int const i			= (int)(ifp - iface);
+	size_t		total = 0;
+
+	for (size_t k = 0; k < iovcnt; k++) {
+		for (size_t pos = 0; pos < iov[k].len; pos++) {
+			CHECK(part_len[i] < ENC_MAX);
+			part[i][part_len[i]++] = iov[k].base[pos];
+			if (!iov[k].base[pos]) {
+				check_frame(i, part[i], part_len[i]);
+				part_len[i] = 0;
+			}
+		}
+		total += iov[k].len;
+	}
+	return (int)total;
+}
+
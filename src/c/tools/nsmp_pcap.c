@@ -0,0 +1,339 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2023 - 2026) Nicolaus Starke               */
+/*                      https://github.com/nic-starke/nsmp                    */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Turns NSMP traffic into a pcap capture, for Wireshark, tshark, tcpdump and
+ * the like:
+ *
+ *   nsmp_pcap trace.bin out.pcap
+ *   nsmp_pcap -l /dev/ttyUSB0 -i 1 out.pcap
+ *   nsmp_pcap -l /dev/pts/3 - | wireshark -k -i -
+ *
+ * The first reads trace records (nsmp_trace_rec_s), as nsmp_trace_read()
+ * copies them or as the ring is dumped from the memory of a device built with
+ * NSMP_TRACE - they are put back in order by their seq. Records are in the
+ * byte order of the device, which must be that of the host. The second
+ * captures the frames arriving on a serial port or pseudo-terminal (- for
+ * stdin), taking the place of the device at the other end of the link, until
+ * the input ends or the tool is interrupted; the output is flushed after
+ * every frame so it can be read while it grows.
+ *
+ * Each packet has link type LINKTYPE_USER0 and starts with a 4-byte
+ * pseudo-header: direction (NSMP_TRACE_RX or NSMP_TRACE_TX), interface
+ * index, result (NSMP_OK or the NSMP_ERR_* the frame was dropped with, as a
+ * signed byte) and a reserved zero. The decoded frame follows - its header
+ * alone for a trace record, with the original length still counting the
+ * payload. In Wireshark, "frame[2] != 0" finds the dropped frames and the
+ * frame times show where the link stalled; a dissector can be attached to
+ * the link type under DLT_USER. Trace records are timestamped with the
+ * device's nsmp_now(), captured frames with the host's clock. */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cobs.h"
+#include "nsmp.h"
+#include "nsmp_private.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define LINKTYPE_USER0 (147)
+
+/* Pseudo-header ahead of each frame */
+#define PSEUDO_LEN (4)
+
+/* Largest decoded frame, and its encoding */
+#define FRAME_MAX (NSMP_HDR_LEN + UINT16_MAX + NSMP_PAYLOAD_CRC_LEN)
+#define ENC_MAX		(COBS_ENCODE_MAX(FRAME_MAX) + 1)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* A trace record and its place in the ring */
+typedef struct {
+	int32_t					 order;
+	nsmp_trace_rec_s rec;
+} entry_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int	from_records(const char* in, FILE* out);
+static int	from_link(const char* dev, uint8_t iface, FILE* out);
+static int	check_frame(const uint8_t* enc, size_t len, uint8_t* dec,
+												size_t* dec_len);
+static int	by_order(const void* a, const void* b);
+static void write_header(FILE* out);
+static void write_packet(FILE* out, uint32_t sec, uint32_t usec,
+												 const uint8_t* pseudo, const uint8_t* data,
+												 size_t len, size_t orig);
+static void on_signal(int sig);
+static int	usage(const char* argv0);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static volatile sig_atomic_t stop;
+
+static uint8_t enc[ENC_MAX];
+static uint8_t dec[FRAME_MAX];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int main(int argc, char** argv) {
+	const char* dev		= NULL;
+	int					iface = 0;
+	int					opt;
+
+	while ((opt = getopt(argc, argv, "l:i:h")) != -1) {
+		switch (opt) {
+			case 'l':
+				dev = optarg;
+				break;
+			case 'i':
+				iface = atoi(optarg);
+				break;
+			default:
+				return usage(argv[0]);
+		}
+	}
+	if (argc - optind != (dev ? 1 : 2)) {
+		return usage(argv[0]);
+	}
+
+	const char* const path = argv[argc - 1];
+	FILE* const out = strcmp(path, "-") ? fopen(path, "wb") : stdout;
+	if (!out) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	write_header(out);
+	int const rc = dev ? from_link(dev, (uint8_t)iface, out)
+										 : from_records(argv[optind], out);
+	if ((out != stdout) && fclose(out)) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	return rc;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int from_records(const char* in, FILE* out) {
+	FILE* const f = fopen(in, "rb");
+	if (!f) {
+		fprintf(stderr, "%s: %s\n", in, strerror(errno));
+		return 1;
+	}
+
+	entry_s* e	 = NULL;
+	size_t	 n	 = 0;
+	size_t	 cap = 0;
+	nsmp_trace_rec_s r;
+
+	while (fread(&r, sizeof(r), 1, f) == 1) {
+		if (!r.dir) {
+			continue; /* Never written */
+		}
+		if (n == cap) {
+			cap							= cap ? 2 * cap : 256;
+			entry_s* const m = realloc(e, cap * sizeof(*e));
+			if (!m) {
+				fprintf(stderr, "out of memory\n");
+				free(e);
+				fclose(f);
+				return 1;
+			}
+			e = m;
+		}
+		/* A ring holds at most 32768 records, so each is less than that far
+		 * from the first one read, either way */
+		e[n].order = n ? (int16_t)(r.seq - e[0].rec.seq) : 0;
+		e[n].rec	 = r;
+		n++;
+	}
+	fclose(f);
+
+	qsort(e, n, sizeof(*e), by_order);
+	for (size_t i = 0; i < n; i++) {
+		const nsmp_trace_rec_s* const t = &e[i].rec;
+		uint8_t const pseudo[PSEUDO_LEN] = {t->dir, t->iface, (uint8_t)t->result,
+																				0};
+		uint8_t hdr[NSMP_HDR_LEN];
+
+		memcpy(hdr, &t->hdr, sizeof(t->hdr));
+		hdr[NSMP_OFS_LEN]			= (uint8_t)t->len;
+		hdr[NSMP_OFS_LEN + 1] = (uint8_t)(t->len >> 8);
+		write_packet(out, t->ms / 1000, (t->ms % 1000) * 1000, pseudo, hdr,
+								 sizeof(hdr), sizeof(hdr) + t->len);
+	}
+	free(e);
+	fprintf(stderr, "%zu records\n", n);
+	return 0;
+}
+
+static int from_link(const char* dev, uint8_t iface, FILE* out) {
+	int const fd = strcmp(dev, "-") ? open(dev, O_RDONLY | O_NOCTTY) : 0;
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", dev, strerror(errno));
+		return 1;
+	}
+
+	struct termios tio;
+	if (!tcgetattr(fd, &tio)) {
+		cfmakeraw(&tio);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+
+	/* Without SA_RESTART, so read() returns when interrupted */
+	struct sigaction sa = {.sa_handler = on_signal};
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	uint8_t buf[4096];
+	size_t	len		 = 0;
+	size_t	frames = 0;
+	int			over	 = 0;
+
+	while (!stop) {
+		ssize_t const got = read(fd, buf, sizeof(buf));
+		if (got <= 0) {
+			if ((got < 0) && (errno != EINTR) && (errno != EIO)) {
+				fprintf(stderr, "%s: %s\n", dev, strerror(errno));
+			}
+			break;
+		}
+		for (ssize_t i = 0; i < got; i++) {
+			if (buf[i] != COBS_FRAME_DELIMITER) {
+				if (len < ENC_MAX - 1) {
+					enc[len++] = buf[i];
+				} else {
+					over = 1;
+				}
+				continue;
+			}
+			if (!len) {
+				continue; /* Back-to-back delimiters */
+			}
+
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+
+			enc[len++]				 = COBS_FRAME_DELIMITER;
+			size_t		dec_len	 = 0;
+			int const result	 = over ? NSMP_ERR_BAD_LEN
+																: check_frame(enc, len, dec, &dec_len);
+			uint8_t const pseudo[PSEUDO_LEN] = {NSMP_TRACE_RX, iface,
+																					(uint8_t)result, 0};
+			/* Kept as it arrived when it does not decode */
+			const uint8_t* const data = dec_len ? dec : enc;
+			size_t const				 n		= dec_len ? dec_len : len - 1;
+
+			write_packet(out, (uint32_t)ts.tv_sec, (uint32_t)(ts.tv_nsec / 1000),
+									 pseudo, data, n, n);
+			fflush(out);
+			frames++;
+			len	 = 0;
+			over = 0;
+		}
+	}
+	if (fd) {
+		close(fd);
+	}
+	fprintf(stderr, "%zu frames\n", frames);
+	return 0;
+}
+
+/* Decode a frame ending with its delimiter, checking it as nsmp_parse_if()
+ * would. dec_len is left 0 if it does not decode. */
+static int check_frame(const uint8_t* e, size_t len, uint8_t* d,
+											 size_t* dec_len) {
+	unsigned n;
+
+	if (cobs_decode(e, (unsigned)len, d, FRAME_MAX, &n) != COBS_RET_SUCCESS) {
+		return NSMP_ERR_BAD_ENC;
+	}
+	*dec_len = n;
+	if (n < NSMP_HDR_LEN) {
+		return NSMP_ERR_BAD_ENC;
+	}
+	if (nsmp_hdr_crc(d) != d[NSMP_OFS_CRC]) {
+		return NSMP_ERR_BAD_CRC;
+	}
+	if (n != NSMP_HDR_LEN + nsmp_frame_len(d) + NSMP_PAYLOAD_CRC_LEN) {
+		return NSMP_ERR_BAD_LEN;
+	}
+#if (NSMP_PAYLOAD_CRC_LEN > 0)
+	size_t const plen = n - NSMP_HDR_LEN - NSMP_PAYLOAD_CRC_LEN;
+	uint32_t		 crc	= 0;
+	for (size_t i = 0; i < NSMP_PAYLOAD_CRC_LEN; i++) {
+		crc |= (uint32_t)d[NSMP_HDR_LEN + plen + i] << (8 * i);
+	}
+	if (crc != nsmp_crc_payload(&d[NSMP_HDR_LEN], plen)) {
+		return NSMP_ERR_BAD_CRC;
+	}
+#endif
+	return NSMP_OK;
+}
+
+static int by_order(const void* a, const void* b) {
+	int32_t const x = ((const entry_s*)a)->order;
+	int32_t const y = ((const entry_s*)b)->order;
+
+	return (x > y) - (x < y);
+}
+
+/* pcap file header, in the byte order of the host */
+static void write_header(FILE* out) {
+	struct {
+		uint32_t magic;
+		uint16_t major;
+		uint16_t minor;
+		int32_t	 zone;
+		uint32_t sigfigs;
+		uint32_t snaplen;
+		uint32_t linktype;
+	} const h = {0xA1B2C3D4, 2, 4, 0, 0, PSEUDO_LEN + FRAME_MAX, LINKTYPE_USER0};
+
+	fwrite(&h, sizeof(h), 1, out);
+}
+
+static void write_packet(FILE* out, uint32_t sec, uint32_t usec,
+												 const uint8_t* pseudo, const uint8_t* data,
+												 size_t len, size_t orig) {
+	uint32_t const h[4] = {sec, usec, (uint32_t)(PSEUDO_LEN + len),
+												 (uint32_t)(PSEUDO_LEN + orig)};
+
+	fwrite(h, sizeof(h), 1, out);
+	fwrite(pseudo, PSEUDO_LEN, 1, out);
+	fwrite(data, len, 1, out);
+}
+
+static void on_signal(int sig) {
+	(void)sig;
+	stop = 1;
+}
+
+static int usage(const char* argv0) {
+	fprintf(stderr,
+					"usage: %s RECORDS OUT.pcap\n"
+					"       %s -l DEVICE [-i IFACE] OUT.pcap\n"
+					"  RECORDS  trace records, from nsmp_trace_read() or a dump of the ring\n"
+					"  DEVICE   serial port or pseudo-terminal to capture, - for stdin\n"
+					"  IFACE    interface index put in the captured packets\n"
+					"  OUT      - for stdout\n",
+					argv0, argv0);
+	return 2;
+}